@@ -0,0 +1,231 @@
+#include "../src/world/mesher.h"
+#include "../src/util/range_alloc.h"
+#include "bench.h"
+#include "terrain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The GL side of the vertex arena needs a context, this measures the range
+// allocator underneath it with chunk mesh sizes taken from real terrain
+#define SPACE_QUADS     (1 << 19)   // one 16 MiB page of packed quads
+#define SAMPLE_REGION   3
+#define CHECK_ROUNDS    200000
+#define LIVE_CHUNKS     600
+#define FRAMES          2000
+#define SWAPS_PER_FRAME 8
+#define COMPACT_BUDGET  ((1 << 20) / (4 * sizeof(PackedVertex)))    // 1 MiB in quads
+
+
+// Random allocations and releases checked against a bitmap of used units
+static int check_allocator(void)
+{
+    enum { SPACE = 4096, SLOTS = 256 };
+    static uint8_t used[SPACE];
+    uint32_t offsets[SLOTS];
+    uint32_t sizes[SLOTS] = {0};
+    RangeAllocator alloc;
+    uint64_t seed = 0xa11c;
+
+    init_range_allocator(&alloc, SPACE);
+    memset(used, 0, sizeof(used));
+    for (int round = 0; round < CHECK_ROUNDS; round++) {
+        int s = (int)(bench_rand(&seed) % SLOTS);
+        if (sizes[s]) {
+            release_range(&alloc, offsets[s], sizes[s]);
+            memset(&used[offsets[s]], 0, sizes[s]);
+            sizes[s] = 0;
+        } else {
+            uint32_t size = 1 + (uint32_t)(bench_rand(&seed) % 64);
+            if (alloc_range(&alloc, size, &offsets[s])) {
+                for (uint32_t i = offsets[s]; i < offsets[s] + size; i++) {
+                    if (used[i]) {
+                        fprintf(stderr, "round %d: range %u+%u overlaps a live one\n", round, offsets[s], size);
+                        return 1;
+                    }
+                    used[i] = 1;
+                }
+                sizes[s] = size;
+            }
+        }
+    }
+
+    // The free list has to be exactly the maximal runs of unused units
+    uint32_t r = 0;
+    uint32_t free_units = 0;
+    for (uint32_t i = 0; i < SPACE;) {
+        if (used[i]) {
+            i++;
+            continue;
+        }
+        uint32_t start = i;
+        while (i < SPACE && !used[i]) i++;
+        if (r >= alloc.count || alloc.ranges[r].offset != start || alloc.ranges[r].size != i - start) {
+            fprintf(stderr, "free range %u does not match the used units\n", r);
+            return 1;
+        }
+        free_units += i - start;
+        r++;
+    }
+    if (r != alloc.count || free_units != alloc.free) {
+        fprintf(stderr, "free list has %u ranges and %u units, expected %u and %u\n",
+                alloc.count, alloc.free, r, free_units);
+        return 1;
+    }
+    printf("  %d random operations verified, %u free ranges\n", CHECK_ROUNDS, alloc.count);
+    free_range_allocator(&alloc);
+    return 0;
+}
+
+// Quads of the packed meshes of some terrain, used as the size distribution
+static uint32_t *sample_mesh_sizes(int *count)
+{
+    ChunkMap *map = create_chunk_map(256);
+    Chunk *chunks[(2 * SAMPLE_REGION + 1) * (2 * SAMPLE_REGION + 1) * 4];
+    int n = 0;
+    for (int cz = -SAMPLE_REGION; cz <= SAMPLE_REGION; cz++) {
+        for (int cx = -SAMPLE_REGION; cx <= SAMPLE_REGION; cx++) {
+            for (int cy = 0; cy < 4; cy++) {
+                chunks[n] = create_chunk((ChunkCoord){cx, cy, cz});
+                generate_bench_terrain(chunks[n]->blocks, chunks[n]->coord);
+                update_chunk_heights(chunks[n]);
+                insert_chunk(map, chunks[n]);
+                n++;
+            }
+        }
+    }
+
+    uint32_t *sizes = (uint32_t *) malloc(n * sizeof(uint32_t));
+    ChunkMesh mesh;
+    init_chunk_mesh(&mesh);
+    mesh.format = VERTEX_FORMAT_PACKED;
+    *count = 0;
+    for (int i = 0; i < n; i++) {
+        Chunk *neighbors[MAX_NEIGHBOR];
+        find_chunk_neighbors(map, chunks[i]->coord, neighbors);
+        build_chunk_mesh(&mesh, chunks[i], neighbors, MESHER_BINARY);
+        // Empty chunks never reach the arena
+        if (mesh.vertex_count > 0) {
+            sizes[(*count)++] = mesh.vertex_count / 4;
+        }
+    }
+    free_chunk_mesh(&mesh);
+    destroy_chunk_map(map);
+    for (int i = 0; i < n; i++) {
+        destroy_chunk(chunks[i]);
+    }
+    return sizes;
+}
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} Placed;
+
+// Same policy as compact_vertex_arena: move the highest mesh into the lowest
+// hole it fits in until the budget is spent
+static uint64_t compact(RangeAllocator *alloc, Placed *live, int count, uint64_t budget)
+{
+    uint64_t moved = 0;
+    while (moved < budget && alloc->count > 1) {
+        Placed *top = &live[0];
+        for (int i = 1; i < count; i++) {
+            if (live[i].offset > top->offset) {
+                top = &live[i];
+            }
+        }
+        uint32_t offset;
+        if (!alloc_range(alloc, top->size, &offset)) {
+            break;
+        }
+        if (offset > top->offset) {
+            release_range(alloc, offset, top->size);
+            break;
+        }
+        release_range(alloc, top->offset, top->size);
+        top->offset = offset;
+        moved += top->size;
+    }
+    return moved;
+}
+
+// Stream chunks in and out for a number of frames, optionally compacting
+static int simulate(const uint32_t *sizes, int size_count, bool compacting)
+{
+    RangeAllocator alloc;
+    Placed live[LIVE_CHUNKS];
+    uint64_t seed = 0x57e4;
+    uint64_t moved = 0;
+    uint64_t operations = 0;
+    int failures = 0;
+
+    init_range_allocator(&alloc, SPACE_QUADS);
+    for (int i = 0; i < LIVE_CHUNKS; i++) {
+        live[i].size = sizes[bench_rand(&seed) % size_count];
+        alloc_range(&alloc, live[i].size, &live[i].offset);
+    }
+
+    double alloc_time = 0.0;
+    double compact_time = 0.0;
+    for (int frame = 0; frame < FRAMES; frame++) {
+        double start = bench_now();
+        for (int s = 0; s < SWAPS_PER_FRAME; s++) {
+            // A chunk unloads or is remeshed to a new size
+            Placed *p = &live[bench_rand(&seed) % LIVE_CHUNKS];
+            release_range(&alloc, p->offset, p->size);
+            p->size = sizes[bench_rand(&seed) % size_count];
+            if (!alloc_range(&alloc, p->size, &p->offset)) {
+                failures++;
+                p->size = 0;
+                p->offset = 0;
+            }
+            operations += 2;
+        }
+        alloc_time += bench_now() - start;
+        if (compacting) {
+            start = bench_now();
+            moved += compact(&alloc, live, LIVE_CHUNKS, COMPACT_BUDGET);
+            compact_time += bench_now() - start;
+        }
+    }
+
+    uint32_t used = alloc.size - alloc.free;
+    uint32_t high = 0;
+    for (int i = 0; i < LIVE_CHUNKS; i++) {
+        if (live[i].size && live[i].offset + live[i].size > high) {
+            high = live[i].offset + live[i].size;
+        }
+    }
+    printf("  %-13s %5.0f ns/op, occupancy %4.1f%%, high water %4.1f%%, %4u holes, fragmentation %.2f, "
+           "moved %5.1f KiB/frame (%.1f us), %d failed\n",
+           compacting ? "compacting" : "no compaction",
+           alloc_time / operations * 1e9, 100.0 * used / alloc.size, 100.0 * high / alloc.size,
+           alloc.count, range_fragmentation(&alloc),
+           (double)moved * 4 * sizeof(PackedVertex) / FRAMES / 1024.0, compact_time / FRAMES * 1e6, failures);
+    free_range_allocator(&alloc);
+    return 0;
+}
+
+int main(void)
+{
+    printf("vertex arena allocator\n");
+    if (check_allocator() != 0) {
+        return 1;
+    }
+
+    int size_count;
+    uint32_t *sizes = sample_mesh_sizes(&size_count);
+    uint64_t total = 0;
+    for (int i = 0; i < size_count; i++) {
+        total += sizes[i];
+    }
+    printf("  %d sampled meshes, %.0f quads (%.1f KiB) on average, %d live chunks, %d swaps per frame\n",
+           size_count, (double)total / size_count, (double)total / size_count * 4 * sizeof(PackedVertex) / 1024.0,
+           LIVE_CHUNKS, SWAPS_PER_FRAME);
+
+    simulate(sizes, size_count, false);
+    simulate(sizes, size_count, true);
+    free(sizes);
+    return 0;
+}
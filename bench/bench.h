@@ -0,0 +1,63 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include "../src/gfx/gfx.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Small helpers shared by the benchmark programs in bench/
+
+static inline double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// xorshift64*, deterministic so runs are comparable
+static inline uint64_t bench_rand(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Keep the optimizer from discarding a computed value
+static inline void bench_consume(uint64_t value)
+{
+    static volatile uint64_t sink;
+    sink += value;
+}
+
+// Hidden window with a current core profile context of GL major.minor and
+// the GL functions loaded. NULL when the driver does not offer that version.
+static inline GLFWwindow *bench_gl_context(int major, int minor, const char *title)
+{
+    if (!glfwInit()) {
+        fprintf(stderr, "glfw init failed\n");
+        return NULL;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, title, NULL, NULL);
+    if (window == NULL) {
+        return NULL;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        fprintf(stderr, "glad failed\n");
+        glfwDestroyWindow(window);
+        return NULL;
+    }
+    return window;
+}
+
+#endif // _BENCH_H_
@@ -0,0 +1,160 @@
+#include "../src/loki.h"
+#include "../src/world/worldgen.h"
+#include "bench.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEA_LEVEL       64
+#define WORLD_RADIUS    3               // chunk columns in x and z around the origin
+#define WORLD_HEIGHT    3               // chunks in y
+#define WORLD_CHUNKS    ((2 * WORLD_RADIUS) * (2 * WORLD_RADIUS) * WORLD_HEIGHT)
+#define THRESHOLD       0.45f
+#define ROUNDS          3
+#define MIN_REDUCTION   10.0            // fewer noise samples at a step of 4 than every block
+#define MAX_VOLUME_DIFF 3.0             // percent of cave volume lost or gained, steps up to 8
+
+static ChunkCoord coords[WORLD_CHUNKS];
+static float full[WORLD_CHUNKS][CHUNK_VOLUME];
+static float coarse[CHUNK_VOLUME];
+static double full_spread;
+
+static bool init_gen(WorldGen *gen, int step)
+{
+    WorldGenDesc desc = {
+        .seed = 0x10C1,
+        .sea_level = SEA_LEVEL,
+        .land_height = SEA_LEVEL + 4.0f,
+        .land_range = 24.0f,
+        .mountain_height = 40.0f,
+        .soil_depth = 3,
+        .cave_threshold = THRESHOLD,
+        .cave_roof = 6,
+        .cave_step = step,
+    };
+    return init_world_gen(gen, &desc);
+}
+
+// Whole chunks, seconds per chunk and the samples taken per chunk
+static double time_density(const WorldGen *gen, float *out, size_t stride, double *samples)
+{
+    uint64_t total = 0;
+    double start = bench_now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < WORLD_CHUNKS; i++) {
+            total += (uint64_t)sample_cave_density(gen, coords[i], CHUNK_SIZE, out + stride * i);
+        }
+    }
+    *samples = (double)total / (ROUNDS * WORLD_CHUNKS);
+    return (bench_now() - start) / (ROUNDS * WORLD_CHUNKS);
+}
+
+// Root mean square of the density, its spread around 0
+static double spread(const float *density, size_t count)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        sum += (double)density[i] * density[i];
+    }
+    return sqrt(sum / count);
+}
+
+// Lattice points must match the full resolution density bit for bit,
+// everything between is compared against it. Caves at the step's scaled
+// threshold must keep the volume of the full resolution ones.
+static int compare_step(int step, double full_time)
+{
+    WorldGen gen;
+    if (!init_gen(&gen, step)) {
+        fprintf(stderr, "step %d refused\n", step);
+        return 1;
+    }
+    double samples;
+    double time = time_density(&gen, coarse, 0, &samples);
+
+    double error = 0.0;
+    float max_error = 0.0f;
+    uint64_t flipped = 0;
+    uint64_t full_caves = 0;
+    uint64_t coarse_caves = 0;
+    double coarse_spread = 0.0;
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        sample_cave_density(&gen, coords[i], CHUNK_SIZE, coarse);
+        double s = spread(coarse, CHUNK_VOLUME);
+        coarse_spread += s * s;
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                for (int x = 0; x < CHUNK_SIZE; x++) {
+                    int v = CHUNK_INDEX(x, y, z);
+                    float d = fabsf(coarse[v] - full[i][v]);
+                    if (x % step == 0 && y % step == 0 && z % step == 0 && d != 0.0f) {
+                        fprintf(stderr, "step %d: lattice point (%d, %d, %d) of chunk %d is off by %g\n", step, x, y,
+                                z, i, d);
+                        return 1;
+                    }
+                    error += d;
+                    max_error = d > max_error ? d : max_error;
+                    bool full_cave = full[i][v] > THRESHOLD;
+                    bool coarse_cave = coarse[v] > gen.cave_threshold;
+                    full_caves += full_cave;
+                    coarse_caves += coarse_cave;
+                    flipped += full_cave != coarse_cave;
+                }
+            }
+        }
+    }
+    double voxels = (double)WORLD_CHUNKS * CHUNK_VOLUME;
+    double reduction = CHUNK_VOLUME / samples;
+    double volume = full_caves > 0 ? 100.0 * ((double)coarse_caves - (double)full_caves) / (double)full_caves : 0.0;
+    // The spread ratio is what worldgen.c scales the threshold by
+    printf("  step %2d %7.0f samples/chunk (%5.1fx fewer) %7.3f ms/chunk (%5.1fx faster), error mean %.4f max %.4f, "
+           "spread %.3f, threshold %.3f, %5.2f%% blocks flipped, cave volume %+.1f%%\n",
+           step, samples, reduction, time * 1e3, full_time / time, error / voxels, max_error,
+           sqrt(coarse_spread / WORLD_CHUNKS) / full_spread, gen.cave_threshold, 100.0 * flipped / voxels, volume);
+    if (step == 4 && reduction < MIN_REDUCTION) {
+        fprintf(stderr, "step 4 takes only %.1fx fewer samples\n", reduction);
+        return 1;
+    }
+    if (step <= 8 && fabs(volume) > MAX_VOLUME_DIFF) {
+        fprintf(stderr, "step %d changes the cave volume by %+.1f%%\n", step, volume);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int count = 0;
+    for (int z = -WORLD_RADIUS; z < WORLD_RADIUS; z++) {
+        for (int x = -WORLD_RADIUS; x < WORLD_RADIUS; x++) {
+            for (int y = 0; y < WORLD_HEIGHT; y++) {
+                coords[count++] = (ChunkCoord){x, y, z};
+            }
+        }
+    }
+
+    WorldGen gen;
+    if (!init_gen(&gen, 1)) {
+        fprintf(stderr, "bad world generator\n");
+        return 1;
+    }
+    WorldGen refused;
+    if (init_gen(&refused, 3) || init_gen(&refused, 2 * CHUNK_SIZE)) {
+        fprintf(stderr, "cave steps that do not divide chunks were accepted\n");
+        return 1;
+    }
+    printf("cave density, %d chunks, noise backend %s\n", WORLD_CHUNKS, get_noise_backend_name(get_noise_backend()));
+    double samples;
+    double full_time = time_density(&gen, full[0], CHUNK_VOLUME, &samples);
+    full_spread = spread(full[0], (size_t)WORLD_CHUNKS * CHUNK_VOLUME);
+    printf("  every block %5.0f samples/chunk %7.3f ms/chunk\n", samples, full_time * 1e3);
+
+    for (int step = 2; step <= CHUNK_SIZE; step *= 2) {
+        if (compare_step(step, full_time) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
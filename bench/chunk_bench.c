@@ -0,0 +1,100 @@
+#include "../src/world/chunk.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Layout used before chunks existed: one full struct per voxel
+typedef struct {
+    vec3 position;
+    VoxelType type;
+} LegacyVoxel;
+
+#define BENCH_CHUNKS    64
+#define BENCH_LOOKUPS   (1 << 24)
+
+
+int main(void)
+{
+    uint64_t seed = 0x10c1;
+    size_t voxel_count = (size_t)BENCH_CHUNKS * CHUNK_VOLUME;
+
+    // Build the same world in both layouts
+    LegacyVoxel *legacy = (LegacyVoxel *) malloc(voxel_count * sizeof(LegacyVoxel));
+    Chunk *chunks[BENCH_CHUNKS];
+    if (legacy == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int c = 0; c < BENCH_CHUNKS; c++) {
+        chunks[c] = create_chunk((ChunkCoord){c, 0, 0});
+        if (chunks[c] == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                for (int x = 0; x < CHUNK_SIZE; x++) {
+                    VoxelType type = (VoxelType)(bench_rand(&seed) % MAX_VOXEL);
+                    LegacyVoxel *v = &legacy[(size_t)c * CHUNK_VOLUME + CHUNK_INDEX(x, y, z)];
+                    v->position[0] = (float)(c * CHUNK_SIZE + x);
+                    v->position[1] = (float)y;
+                    v->position[2] = (float)z;
+                    v->type = type;
+                    set_chunk_block(chunks[c], x, y, z, (BlockId)type);
+                }
+            }
+        }
+    }
+
+    // Random coordinates, shared by both runs
+    uint32_t *lookups = (uint32_t *) malloc(BENCH_LOOKUPS * sizeof(uint32_t));
+    if (lookups == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        lookups[i] = (uint32_t)(bench_rand(&seed) % voxel_count);
+    }
+
+    double start = bench_now();
+    uint64_t sum_legacy = 0;
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        sum_legacy += legacy[lookups[i]].type;
+    }
+    double legacy_time = bench_now() - start;
+
+    start = bench_now();
+    uint64_t sum_chunk = 0;
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        uint32_t l = lookups[i];
+        const Chunk *chunk = chunks[l / CHUNK_VOLUME];
+        uint32_t idx = l % CHUNK_VOLUME;
+        sum_chunk += get_chunk_block(chunk, idx & CHUNK_MASK, idx >> (2 * CHUNK_SHIFT),
+                                     (idx >> CHUNK_SHIFT) & CHUNK_MASK);
+    }
+    double chunk_time = bench_now() - start;
+    bench_consume(sum_legacy + sum_chunk);
+
+    if (sum_legacy != sum_chunk) {
+        fprintf(stderr, "layouts disagree: %llu != %llu\n",
+                (unsigned long long)sum_legacy, (unsigned long long)sum_chunk);
+        return 1;
+    }
+
+    printf("chunk storage, %d chunks of %d^3 blocks\n", BENCH_CHUNKS, CHUNK_SIZE);
+    printf("  %-10s %6.2f bytes/voxel %8.2f MiB %8.1f M lookups/s\n", "Voxel",
+           (double)sizeof(LegacyVoxel), voxel_count * sizeof(LegacyVoxel) / 1048576.0,
+           BENCH_LOOKUPS / legacy_time * 1e-6);
+    // Blocks, light and heights
+    printf("  %-10s %6.2f bytes/voxel %8.2f MiB %8.1f M lookups/s\n", "Chunk",
+           sizeof(Chunk) / (double)CHUNK_VOLUME, BENCH_CHUNKS * sizeof(Chunk) / 1048576.0,
+           BENCH_LOOKUPS / chunk_time * 1e-6);
+
+    for (int c = 0; c < BENCH_CHUNKS; c++) {
+        destroy_chunk(chunks[c]);
+    }
+    free(lookups);
+    free(legacy);
+    return 0;
+}
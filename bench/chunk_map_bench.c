@@ -0,0 +1,226 @@
+#include "../src/world/chunk_map.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RENDER_DISTANCE     32
+#define COLUMN_CHUNKS       8
+#define LOOKUP_ROUNDS       (1 << 22)
+#define STRESS_ROUNDS       200000
+
+
+// Naive chained map used as the baseline: one malloc'd node per chunk
+typedef struct ChainNode {
+    ChunkCoord coord;
+    Chunk *chunk;
+    struct ChainNode *next;
+} ChainNode;
+
+typedef struct {
+    ChainNode **buckets;
+    uint32_t bucket_count;
+} ChainMap;
+
+static uint32_t chain_hash(ChunkCoord c)
+{
+    return (uint32_t)(c.x * 73856093) ^ (uint32_t)(c.y * 19349663) ^ (uint32_t)(c.z * 83492791);
+}
+
+static void chain_insert(ChainMap *map, ChunkCoord coord, Chunk *chunk)
+{
+    ChainNode *node = (ChainNode *) malloc(sizeof(ChainNode));
+    uint32_t b = chain_hash(coord) % map->bucket_count;
+    node->coord = coord;
+    node->chunk = chunk;
+    node->next = map->buckets[b];
+    map->buckets[b] = node;
+}
+
+static Chunk *chain_find(ChainMap *map, ChunkCoord coord)
+{
+    for (ChainNode *n = map->buckets[chain_hash(coord) % map->bucket_count]; n; n = n->next) {
+        if (n->coord.x == coord.x && n->coord.y == coord.y && n->coord.z == coord.z) {
+            return n->chunk;
+        }
+    }
+    return NULL;
+}
+
+static void chain_free(ChainMap *map)
+{
+    for (uint32_t b = 0; b < map->bucket_count; b++) {
+        ChainNode *n = map->buckets[b];
+        while (n) {
+            ChainNode *next = n->next;
+            free(n);
+            n = next;
+        }
+    }
+    free(map->buckets);
+}
+
+
+// Only the coordinate of each chunk is used, so the benchmark stores small
+// stand-ins instead of full chunks
+typedef struct {
+    ChunkCoord coord;
+} FakeChunk;
+
+typedef struct {
+    ChunkMap *map;
+    FakeChunk *chunks;
+    int count;
+    atomic_bool done;
+    long errors;
+    long hits;
+} StressState;
+
+// Reader thread: every hit has to return the chunk stored for that key
+static void *stress_reader(void *arg)
+{
+    StressState *s = (StressState *) arg;
+    uint64_t seed = 0xbeef;
+    while (!atomic_load(&s->done)) {
+        FakeChunk *expected = &s->chunks[bench_rand(&seed) % s->count];
+        Chunk *found = find_chunk(s->map, expected->coord);
+        if (found != NULL) {
+            s->hits++;
+            if (found != (Chunk *)expected) {
+                s->errors++;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int stress_concurrent(FakeChunk *chunks, int count)
+{
+    StressState s = { create_chunk_map(16), chunks, count, false, 0, 0 };
+    pthread_t reader;
+    uint64_t seed = 0xcafe;
+
+    pthread_create(&reader, NULL, stress_reader, &s);
+    for (int r = 0; r < STRESS_ROUNDS; r++) {
+        FakeChunk *c = &chunks[bench_rand(&seed) % count];
+        if (bench_rand(&seed) & 1) {
+            insert_chunk(s.map, (Chunk *)c);
+        } else {
+            remove_chunk(s.map, c->coord);
+        }
+    }
+    atomic_store(&s.done, true);
+    pthread_join(reader, NULL);
+    // Retired tables are only freed after the reader left
+    destroy_chunk_map(s.map);
+
+    printf("  concurrent reader: %ld hits, %ld wrong values\n", s.hits, s.errors);
+    return s.errors != 0;
+}
+
+int main(void)
+{
+    int side = 2 * RENDER_DISTANCE + 1;
+    int count = side * side * COLUMN_CHUNKS;
+    FakeChunk *chunks = (FakeChunk *) malloc(count * sizeof(FakeChunk));
+    ChunkCoord *queries = (ChunkCoord *) malloc(LOOKUP_ROUNDS * sizeof(ChunkCoord));
+    uint64_t seed = 0x3a9;
+    int n = 0;
+
+    for (int z = -RENDER_DISTANCE; z <= RENDER_DISTANCE; z++) {
+        for (int x = -RENDER_DISTANCE; x <= RENDER_DISTANCE; x++) {
+            for (int y = 0; y < COLUMN_CHUNKS; y++) {
+                chunks[n++].coord = (ChunkCoord){x, y, z};
+            }
+        }
+    }
+    for (int i = 0; i < LOOKUP_ROUNDS; i++) {
+        queries[i] = chunks[bench_rand(&seed) % count].coord;
+    }
+
+    // Round trip of the key packing, negative coordinates included
+    for (int i = 0; i < 1000; i++) {
+        ChunkCoord c = {
+            (int32_t)(bench_rand(&seed) % (1 << 21)) - (1 << 20),
+            (int32_t)(bench_rand(&seed) % (1 << 21)) - (1 << 20),
+            (int32_t)(bench_rand(&seed) % (1 << 21)) - (1 << 20),
+        };
+        ChunkCoord u = unpack_chunk_coord(pack_chunk_coord(c));
+        if (u.x != c.x || u.y != c.y || u.z != c.z) {
+            fprintf(stderr, "key packing mismatch\n");
+            return 1;
+        }
+    }
+
+    printf("chunk map, %d chunks\n", count);
+
+    // Insert
+    double start = bench_now();
+    ChunkMap *map = create_chunk_map(16);
+    for (int i = 0; i < count; i++) {
+        insert_chunk(map, (Chunk *)&chunks[i]);
+    }
+    double open_insert = bench_now() - start;
+
+    start = bench_now();
+    ChainMap chain = { calloc(count, sizeof(ChainNode *)), (uint32_t)count };
+    for (int i = 0; i < count; i++) {
+        chain_insert(&chain, chunks[i].coord, (Chunk *)&chunks[i]);
+    }
+    double chain_insert_time = bench_now() - start;
+
+    // Random lookups
+    uint64_t hits = 0;
+    start = bench_now();
+    for (int i = 0; i < LOOKUP_ROUNDS; i++) {
+        hits += find_chunk(map, queries[i]) != NULL;
+    }
+    double open_lookup = bench_now() - start;
+
+    start = bench_now();
+    for (int i = 0; i < LOOKUP_ROUNDS; i++) {
+        hits += chain_find(&chain, queries[i]) != NULL;
+    }
+    double chain_lookup = bench_now() - start;
+    if (hits != 2ULL * LOOKUP_ROUNDS) {
+        fprintf(stderr, "lookups missed: %llu\n", (unsigned long long)hits);
+        return 1;
+    }
+
+    // Neighbor gather for every chunk, the pattern used by the mesher
+    Chunk *neighbors[MAX_NEIGHBOR];
+    start = bench_now();
+    for (int i = 0; i < count; i++) {
+        find_chunk_neighbors(map, chunks[i].coord, neighbors);
+        bench_consume((uintptr_t)neighbors[NEIGHBOR_POS_Y]);
+    }
+    double open_gather = bench_now() - start;
+
+    start = bench_now();
+    for (int i = 0; i < count; i++) {
+        ChunkCoord c = chunks[i].coord;
+        neighbors[0] = chain_find(&chain, (ChunkCoord){c.x - 1, c.y, c.z});
+        neighbors[1] = chain_find(&chain, (ChunkCoord){c.x + 1, c.y, c.z});
+        neighbors[2] = chain_find(&chain, (ChunkCoord){c.x, c.y - 1, c.z});
+        neighbors[3] = chain_find(&chain, (ChunkCoord){c.x, c.y + 1, c.z});
+        neighbors[4] = chain_find(&chain, (ChunkCoord){c.x, c.y, c.z - 1});
+        neighbors[5] = chain_find(&chain, (ChunkCoord){c.x, c.y, c.z + 1});
+        bench_consume((uintptr_t)neighbors[NEIGHBOR_POS_Y]);
+    }
+    double chain_gather = bench_now() - start;
+
+    printf("  %-14s %9s %12s %12s\n", "", "insert", "lookup", "gather x6");
+    printf("  %-14s %6.1f ns %9.1f ns %9.1f ns\n", "open address",
+           open_insert / count * 1e9, open_lookup / LOOKUP_ROUNDS * 1e9, open_gather / count * 1e9);
+    printf("  %-14s %6.1f ns %9.1f ns %9.1f ns\n", "chained",
+           chain_insert_time / count * 1e9, chain_lookup / LOOKUP_ROUNDS * 1e9, chain_gather / count * 1e9);
+
+    destroy_chunk_map(map);
+    chain_free(&chain);
+
+    int failed = stress_concurrent(chunks, 4096);
+    free(queries);
+    free(chunks);
+    return failed;
+}
@@ -0,0 +1,133 @@
+#include "../src/gfx/arena.h"
+#include "../src/gfx/gfx.h"
+#include "../src/gfx/renderer.h"
+#include "../src/gfx/shaders.h"
+#include "../src/world/mesher.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// CPU cost of submitting chunk draws. Needs a GL context, e.g. Mesa llvmpipe:
+//   LIBGL_ALWAYS_SOFTWARE=1 ./bin/draw_bench
+// Rasterization is discarded so the numbers are driver and API overhead.
+#define CHUNKS          4096
+#define QUADS_PER_CHUNK 16
+#define FRAMES          100
+
+static const char *vertex_src = "#version 330 core\n"
+    "layout (location = 0) in uvec2 aPacked;\n"
+    "layout (location = 3) in vec3 aOrigin;\n"
+    "uniform mat4 model;\n"
+    "uniform mat4 view_projection;\n"
+    "void main()\n"
+    "{\n"
+    "   uint a = aPacked.x;\n"
+    "   vec3 pos = vec3(a & 63u, (a >> 6) & 63u, (a >> 12) & 63u);\n"
+    "   gl_Position = view_projection * model * vec4(pos + aOrigin, 1.0);\n"
+    "}\0";
+
+static const char *fragment_src = "#version 330 core\n"
+    "out vec4 FragColor;\n"
+    "void main()\n"
+    "{\n"
+    "   FragColor = vec4(1.0);\n"
+    "}\0";
+
+typedef enum {
+    PATH_MODEL_UNIFORM = 0,     // the original loop: a model matrix and a draw per chunk
+    PATH_SINGLE,                // DRAW_PATH_SINGLE
+    PATH_MULTI_INDIRECT,        // DRAW_PATH_MULTI_INDIRECT
+    MAX_PATH,
+} BenchPath;
+
+static const char *path_names[MAX_PATH] = {"model uniform", "single draws", "multi indirect"};
+
+int main(void)
+{
+    GLFWwindow *window = bench_gl_context(4, 3, "draw bench");
+    if (window == NULL) {
+        window = bench_gl_context(3, 3, "draw bench");
+    }
+    if (window == NULL) {
+        fprintf(stderr, "no GL 3.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    bool multi_draw = load_multi_draw_indirect();
+    printf("draw submission, %d chunks of %d quads, %s\n", CHUNKS, QUADS_PER_CHUNK, (const char *)glGetString(GL_RENDERER));
+
+    unsigned int program = create_shader_program(vertex_src, fragment_src);
+    if (program == 0) {
+        fprintf(stderr, "shader: %s\n", get_shader_error());
+        return 1;
+    }
+    use_program(program);
+    int model_loc = glGetUniformLocation(program, "model");
+    mat4 identity;
+    glm_mat4_identity(identity);
+    glUniformMatrix4fv(glGetUniformLocation(program, "view_projection"), 1, GL_FALSE, identity[0]);
+
+    unsigned int quad_ebo = create_quad_index_buffer(MAX_CHUNK_QUADS);
+    VertexArena *arena = create_vertex_arena(VERTEX_FORMAT_PACKED, quad_ebo);
+    static ArenaAlloc allocs[CHUNKS];
+    static float origins[CHUNKS][3];
+    PackedVertex vertices[QUADS_PER_CHUNK * 4];
+    uint64_t seed = 0xd4a;
+    for (int i = 0; i < QUADS_PER_CHUNK * 4; i++) {
+        vertices[i].position_face = PACK_POSITION_FACE(i & 31, (i >> 2) & 31, i & 7, 3);
+        vertices[i].uv_layer = PACK_UV_LAYER(i & 1, (i >> 1) & 1, 1, 0);
+    }
+    for (int c = 0; c < CHUNKS; c++) {
+        init_arena_alloc(&allocs[c]);
+        upload_arena_mesh(arena, &allocs[c], vertices, QUADS_PER_CHUNK);
+        for (int a = 0; a < 3; a++) {
+            origins[c][a] = (float)(bench_rand(&seed) % 64) * CHUNK_SIZE;
+        }
+    }
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    for (int path = 0; path < MAX_PATH; path++) {
+        if (path == PATH_MULTI_INDIRECT && !multi_draw) {
+            printf("  %-15s unavailable, needs GL 4.3\n", path_names[path]);
+            continue;
+        }
+        double submit = 0.0;
+        double start = bench_now();
+        for (int frame = 0; frame < FRAMES; frame++) {
+            double frame_start = bench_now();
+            begin_arena_frame(arena);
+            if (path == PATH_MODEL_UNIFORM) {
+                glDisableVertexAttribArray(CHUNK_ORIGIN_ATTRIB);
+                glVertexAttrib3f(CHUNK_ORIGIN_ATTRIB, 0.0f, 0.0f, 0.0f);
+                for (int c = 0; c < CHUNKS; c++) {
+                    mat4 model;
+                    glm_mat4_identity(model);
+                    glm_translate(model, origins[c]);
+                    glUniformMatrix4fv(model_loc, 1, GL_FALSE, model[0]);
+                    bind_vertex_array(arena->pages[allocs[c].page].vao);
+                    glDrawElementsBaseVertex(GL_TRIANGLES, allocs[c].quads * 6, GL_UNSIGNED_INT, (void*)0,
+                                             allocs[c].offset * 4);
+                }
+            } else {
+                glUniformMatrix4fv(model_loc, 1, GL_FALSE, identity[0]);
+                for (int c = 0; c < CHUNKS; c++) {
+                    add_arena_draw(arena, &allocs[c], origins[c]);
+                }
+                draw_arena_batch(arena, path == PATH_SINGLE ? DRAW_PATH_SINGLE : DRAW_PATH_MULTI_INDIRECT);
+            }
+            submit += bench_now() - frame_start;
+            glFinish();
+        }
+        double elapsed = bench_now() - start;
+        printf("  %-15s submit %7.3f ms/frame, with GPU %7.3f ms/frame, %8.0f draws/s submitted\n",
+               path_names[path], submit / FRAMES * 1e3, elapsed / FRAMES * 1e3, CHUNKS * FRAMES / submit);
+    }
+
+    destroy_vertex_arena(arena);
+    destroy_quad_index_buffer(quad_ebo);
+    glDeleteProgram(program);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "../src/loki.h"
+#include "../src/gfx/frustum.h"
+#include "bench.h"
+#include "view.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRID_X      50
+#define GRID_Y      40
+#define GRID_Z      50
+#define CHUNK_EXTENT 32.0f
+#define VIEWS       16
+#define ROUNDS      20
+
+
+int main(void)
+{
+    static const char *names[MAX_CULL_KERNEL] = {"scalar", "sse x4", "avx x8"};
+    AabbList list;
+    int count = GRID_X * GRID_Y * GRID_Z;
+
+    init_aabb_list(&list, 16);
+    for (int y = 0; y < GRID_Y; y++) {
+        for (int z = 0; z < GRID_Z; z++) {
+            for (int x = 0; x < GRID_X; x++) {
+                float min[3] = {x * CHUNK_EXTENT, y * CHUNK_EXTENT, z * CHUNK_EXTENT};
+                float max[3] = {min[0] + CHUNK_EXTENT, min[1] + CHUNK_EXTENT, min[2] + CHUNK_EXTENT};
+                if (push_aabb(&list, min, max) < 0) {
+                    fprintf(stderr, "out of memory\n");
+                    return 1;
+                }
+            }
+        }
+    }
+
+    Frustum frustums[VIEWS];
+    float eye[3] = {GRID_X * CHUNK_EXTENT / 2, GRID_Y * CHUNK_EXTENT / 2 + 5.0f, GRID_Z * CHUNK_EXTENT / 2};
+    for (int v = 0; v < VIEWS; v++) {
+        float m[4][4];
+        bench_view_projection(m, eye, v * 2.0f * 3.14159265f / VIEWS, -0.2f, 512.0f);
+        extract_frustum(&frustums[v], m);
+    }
+
+    uint32_t *reference = (uint32_t *) malloc(count * sizeof(uint32_t));
+    uint32_t *visible = (uint32_t *) malloc(count * sizeof(uint32_t));
+    printf("frustum culling, %d chunk boxes, best kernel %s\n", count, names[best_cull_kernel()]);
+
+    for (int kernel = 0; kernel < MAX_CULL_KERNEL; kernel++) {
+        if (!has_cull_kernel((CullKernel)kernel)) {
+            printf("  %-8s not supported\n", names[kernel]);
+            continue;
+        }
+
+        // Every kernel has to agree with the scalar one, box for box
+        uint64_t total_visible = 0;
+        for (int v = 0; v < VIEWS; v++) {
+            uint32_t expected = cull_aabbs_with(CULL_SCALAR, &frustums[v], &list, reference);
+            uint32_t got = cull_aabbs_with((CullKernel)kernel, &frustums[v], &list, visible);
+            if (got != expected || memcmp(reference, visible, got * sizeof(uint32_t)) != 0) {
+                fprintf(stderr, "%s: view %d gives %u visible boxes, scalar %u\n", names[kernel], v, got, expected);
+                return 1;
+            }
+            total_visible += got;
+        }
+
+        double start = bench_now();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (int v = 0; v < VIEWS; v++) {
+                bench_consume(cull_aabbs_with((CullKernel)kernel, &frustums[v], &list, visible));
+            }
+        }
+        double elapsed = bench_now() - start;
+        printf("  %-8s %6.2f ns/chunk, %6.1f us per 100k chunks, %4.1f%% visible\n", names[kernel],
+               elapsed / ((double)ROUNDS * VIEWS * count) * 1e9,
+               elapsed / ((double)ROUNDS * VIEWS) * 1e6 * 100000.0 / count,
+               100.0 * total_visible / ((double)VIEWS * count));
+    }
+
+    free(reference);
+    free(visible);
+    free_aabb_list(&list);
+    return 0;
+}
@@ -0,0 +1,287 @@
+#include "../src/loki.h"
+#include "../src/world/gen_pool.h"
+#include "bench.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SEA_LEVEL       64
+#define MIN_Y           0
+#define MAX_Y           3               // chunks in [MIN_Y, MAX_Y] on y
+#define CHECK_RADIUS    3               // chunk columns checked around the origin
+#define VIEW_RADIUS     4               // chunk columns kept around the camera in flight
+#define FLIGHT_SECONDS  1.5
+#define MIN_FLIGHT_SPEED 128.0f         // blocks per second, doubled until chunks fall behind
+#define MAX_FLIGHT_SPEED 8192.0f
+#define FRAME_MICROSECONDS 4000
+#define MAX_FLIGHT_COLUMNS 512          // chunk columns along x, enough for the fastest flight
+#define MAX_COLLECT     512
+
+
+static const char *stage_names[MAX_GEN_STAGE] = {
+    [GEN_CLIMATE] = "climate",
+    [GEN_HEIGHTMAP] = "heightmap",
+    [GEN_SURFACE] = "surface",
+    [GEN_CAVES] = "caves",
+    [GEN_DECORATED] = "decorated",
+};
+
+static bool same_chunk(const Chunk *a, const Chunk *b)
+{
+    return memcmp(a->blocks, b->blocks, sizeof(a->blocks)) == 0 &&
+           memcmp(a->heights, b->heights, sizeof(a->heights)) == 0;
+}
+
+// Chunks from the pool must equal generate_chunk_terrain on one thread
+static int check_pool(const WorldGen *gen, int threads)
+{
+    GenPool *pool = create_gen_pool(gen, MIN_Y, MAX_Y, threads);
+    if (pool == NULL) {
+        fprintf(stderr, "failed to start %d workers\n", threads);
+        return 1;
+    }
+    int side = 2 * CHECK_RADIUS + 1;
+    int expected = side * side * (MAX_Y - MIN_Y + 1);
+    double start = bench_now();
+    if (!request_gen_area(pool, (ChunkCoord){0, 0, 0}, CHECK_RADIUS)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    wait_gen_pool(pool);
+    double elapsed = bench_now() - start;
+
+    static Chunk *chunks[MAX_COLLECT];
+    int count = collect_gen_chunks(pool, chunks, MAX_COLLECT);
+    if (count != expected || pool->failed > 0) {
+        fprintf(stderr, "%d workers: %d chunks collected out of %d\n", threads, count, expected);
+        return 1;
+    }
+
+    Chunk *reference = create_chunk((ChunkCoord){0, 0, 0});
+    int trees = 0;
+    for (int i = 0; i < count; i++) {
+        ChunkCoord coord = chunks[i]->coord;
+        if (abs(coord.x) > CHECK_RADIUS || abs(coord.z) > CHECK_RADIUS || coord.y < MIN_Y || coord.y > MAX_Y) {
+            fprintf(stderr, "chunk (%d, %d, %d) was not requested\n", coord.x, coord.y, coord.z);
+            return 1;
+        }
+        reference->coord = coord;
+        generate_chunk_terrain(gen, reference);
+        if (!same_chunk(chunks[i], reference)) {
+            fprintf(stderr, "%d workers: chunk (%d, %d, %d) differs from the direct one\n", threads, coord.x, coord.y,
+                    coord.z);
+            return 1;
+        }
+    }
+
+    // Trees reaching the chunks, counted once per chunk they reach into
+    for (int i = 0; i < count; i++) {
+        static TerrainColumn neighborhood[COLUMN_NEIGHBORHOOD];
+        const TerrainColumn *columns[COLUMN_NEIGHBORHOOD];
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                TerrainColumn *column = &neighborhood[COLUMN_NEIGHBOR(dx, dz)];
+                generate_terrain_column(gen, chunks[i]->coord.x + dx, chunks[i]->coord.z + dz, column);
+                columns[COLUMN_NEIGHBOR(dx, dz)] = column;
+            }
+        }
+        reference->coord = chunks[i]->coord;
+        memset(reference->blocks, AIR, sizeof(reference->blocks));
+        trees += decorate_terrain_chunk(gen, reference, columns);
+    }
+    destroy_chunk(reference);
+
+    printf("  %2d %-7s %6d chunks, %6.0f chunks/s, %d tree reaches, identical to the direct chunks\n", threads,
+           threads == 1 ? "worker" : "workers", count, count / elapsed, trees);
+    for (int i = 0; i < count; i++) {
+        destroy_chunk(chunks[i]);
+    }
+    destroy_gen_pool(pool);
+    return 0;
+}
+
+// Per worker count, the flight speeds up until the pool falls behind
+typedef struct {
+    double chunks_per_second;
+    double utilization;             // busy time over threads times wall time
+    double ahead;                   // share of chunks collected ahead of the camera
+    double lead;                    // mean complete columns from the camera's on
+    double backlog;                 // mean requested chunks not generated yet
+    uint32_t max_backlog;
+    double stage_ms[MAX_GEN_STAGE]; // per job
+} Flight;
+
+// Chunks collected in each column of the band the camera flies along
+static int column_chunks[MAX_FLIGHT_COLUMNS];
+
+static void count_collected(Chunk **chunks, int count, float x, int *ahead)
+{
+    for (int i = 0; i < count; i++) {
+        int column = chunks[i]->coord.x + VIEW_RADIUS;
+        if (column >= 0 && column < MAX_FLIGHT_COLUMNS) {
+            column_chunks[column]++;
+        }
+        if ((chunks[i]->coord.x + 0.5f) * CHUNK_SIZE >= x) {
+            (*ahead)++;
+        }
+        bench_consume(chunks[i]->heights[0]);
+        destroy_chunk(chunks[i]);
+    }
+}
+
+// Columns ready in a row from the camera's column forward, at most the
+// ones requested ahead
+static int ready_lead(int32_t center)
+{
+    int full = (2 * VIEW_RADIUS + 1) * (MAX_Y - MIN_Y + 1);
+    int lead = 0;
+    while (lead <= VIEW_RADIUS && center + lead + VIEW_RADIUS < MAX_FLIGHT_COLUMNS &&
+           column_chunks[center + lead + VIEW_RADIUS] >= full) {
+        lead++;
+    }
+    return lead;
+}
+
+// The camera flies along x looking ahead and the pool streams the chunks
+// around it, starting from a generated area
+static int fly(const WorldGen *gen, int threads, float speed, Flight *flight)
+{
+    GenPool *pool = create_gen_pool(gen, MIN_Y, MAX_Y, threads);
+    if (pool == NULL) {
+        fprintf(stderr, "failed to start %d workers\n", threads);
+        return 1;
+    }
+    memset(column_chunks, 0, sizeof(column_chunks));
+    float front[3] = {1.0f, 0.0f, 0.0f};
+    static Chunk *chunks[MAX_COLLECT];
+    int collected = 0;
+    int ahead = 0;
+    if (!request_gen_area(pool, (ChunkCoord){0, 0, 0}, VIEW_RADIUS)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    wait_gen_pool(pool);
+    int count;
+    while ((count = collect_gen_chunks(pool, chunks, MAX_COLLECT)) > 0) {
+        count_collected(chunks, count, 0.0f, &ahead);
+    }
+    ahead = 0;
+    pthread_mutex_lock(&pool->lock);
+    double busy_start = pool->busy_seconds;
+    pthread_mutex_unlock(&pool->lock);
+
+    int frames = 0;
+    double lead = 0.0;
+    double backlog = 0.0;
+    uint32_t max_backlog = 0;
+    double start = bench_now();
+    double elapsed = 0.0;
+    while (elapsed < FLIGHT_SECONDS) {
+        float position[3] = {speed * (float)elapsed, SEA_LEVEL + 16.0f, 0.0f};
+        ChunkCoord center = {(int32_t)floorf(position[0] / CHUNK_SIZE), 0, 0};
+        set_gen_pool_focus(pool, position, front);
+        if (!request_gen_area(pool, center, VIEW_RADIUS)) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        count = collect_gen_chunks(pool, chunks, MAX_COLLECT);
+        count_collected(chunks, count, position[0], &ahead);
+        collected += count;
+        prune_gen_pool(pool, center, VIEW_RADIUS + 2);
+
+        pthread_mutex_lock(&pool->lock);
+        uint32_t pending = pool->pending;
+        pthread_mutex_unlock(&pool->lock);
+        backlog += pending;
+        max_backlog = pending > max_backlog ? pending : max_backlog;
+        lead += ready_lead(center.x);
+        frames++;
+
+        usleep(FRAME_MICROSECONDS);
+        elapsed = bench_now() - start;
+    }
+    pthread_mutex_lock(&pool->lock);
+    double busy = pool->busy_seconds - busy_start;
+    uint32_t failed = pool->failed;
+    pthread_mutex_unlock(&pool->lock);
+
+    flight->chunks_per_second = collected / elapsed;
+    flight->utilization = busy / (pool->thread_count * elapsed);
+    flight->ahead = collected > 0 ? (double)ahead / collected : 0.0;
+    flight->lead = lead / frames;
+    flight->backlog = backlog / frames;
+    flight->max_backlog = max_backlog;
+    for (GenStage stage = GEN_CLIMATE; stage < MAX_GEN_STAGE; stage++) {
+        flight->stage_ms[stage] =
+            pool->stage_jobs[stage] > 0 ? pool->stage_seconds[stage] * 1e3 / pool->stage_jobs[stage] : 0.0;
+    }
+    destroy_gen_pool(pool);
+    if (failed > 0) {
+        fprintf(stderr, "%d workers: %u chunks failed\n", threads, failed);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    WorldGen gen;
+    WorldGenDesc desc = {
+        .seed = 0x10C1,
+        .sea_level = SEA_LEVEL,
+        .land_height = SEA_LEVEL + 4.0f,
+        .land_range = 24.0f,
+        .mountain_height = 40.0f,
+        .soil_depth = 3,
+        .cave_threshold = 0.45f,
+        .cave_roof = 6,
+        .cave_step = 4,
+    };
+    if (!init_world_gen(&gen, &desc)) {
+        fprintf(stderr, "bad world generator\n");
+        return 1;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = cores > 4 ? (int)cores : 4;
+    printf("generation pool, %d chunks in y, noise backend %s, %ld cores\n", MAX_Y - MIN_Y + 1,
+           get_noise_backend_name(get_noise_backend()), cores);
+
+    printf("area of %d x %d columns, against single thread generation\n", 2 * CHECK_RADIUS + 1,
+           2 * CHECK_RADIUS + 1);
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        if (check_pool(&gen, threads) != 0) {
+            return 1;
+        }
+    }
+
+    // Behind: the camera's own column is not ready on average
+    printf("flight, %d x %d columns requested around the camera, speed doubled until chunks fall behind\n",
+           2 * VIEW_RADIUS + 1, 2 * VIEW_RADIUS + 1);
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        Flight flight;
+        for (float speed = MIN_FLIGHT_SPEED; speed <= MAX_FLIGHT_SPEED; speed *= 2.0f) {
+            if (fly(&gen, threads, speed, &flight) != 0) {
+                return 1;
+            }
+            printf("  %2d %-7s %5.0f blocks/s %6.0f chunks/s, %3.0f%% utilization, %3.0f%% ahead of the camera, "
+                   "%.1f columns ready ahead, backlog %5.1f chunks (max %u)\n",
+                   threads, threads == 1 ? "worker" : "workers", speed, flight.chunks_per_second,
+                   100.0 * flight.utilization, 100.0 * flight.ahead, flight.lead, flight.backlog,
+                   flight.max_backlog);
+            if (flight.lead < 1.0) {
+                break;
+            }
+        }
+        printf("     ");
+        for (GenStage stage = GEN_CLIMATE; stage < MAX_GEN_STAGE; stage++) {
+            printf(" %s %.3f ms", stage_names[stage], flight.stage_ms[stage]);
+        }
+        printf(" per job at the fastest\n");
+    }
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include "../src/gfx/arena.h"
+#include "../src/gfx/frustum.h"
+#include "../src/gfx/gfx.h"
+#include "../src/gfx/gpu_cull.h"
+#include "../src/gfx/renderer.h"
+#include "../src/gfx/shaders.h"
+#include "../src/world/mesher.h"
+#include "bench.h"
+#include "view.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// CPU cost of culling and submitting a grid of chunks: frustum culling on
+// the CPU and one multi draw indirect per page, against the compute shader
+// path. Needs a GL 4.3 context, e.g. Mesa llvmpipe:
+//   LIBGL_ALWAYS_SOFTWARE=1 ./bin/gpu_cull_bench
+// Rasterization is discarded. llvmpipe runs compute shaders on the CPU within
+// the dispatch, so there the compute column grows with the chunk count too;
+// on a GPU its CPU side is the dispatch and one draw per page.
+#define GRID_HEIGHT     4
+#define QUADS_PER_CHUNK 16
+#define VIEWS           8
+#define FRAMES          20
+#define VIEW_DISTANCE   1024.0f
+#define DEPTH_WIDTH     256
+#define DEPTH_HEIGHT    128
+
+static const char *vertex_src = "#version 330 core\n"
+    "layout (location = 0) in uvec2 aPacked;\n"
+    "layout (location = 3) in vec3 aOrigin;\n"
+    "uniform mat4 view_projection;\n"
+    "void main()\n"
+    "{\n"
+    "   uint a = aPacked.x;\n"
+    "   vec3 pos = vec3(a & 63u, (a >> 6) & 63u, (a >> 12) & 63u);\n"
+    "   gl_Position = view_projection * vec4(pos + aOrigin, 1.0);\n"
+    "}\0";
+
+static const char *fragment_src = "#version 330 core\n"
+    "out vec4 FragColor;\n"
+    "void main()\n"
+    "{\n"
+    "   FragColor = vec4(1.0);\n"
+    "}\0";
+
+// A screen wide wall at NDC depth `depth`, below NDC y `top`
+static const char *wall_vertex_src = "#version 330 core\n"
+    "uniform float depth;\n"
+    "uniform float top;\n"
+    "void main()\n"
+    "{\n"
+    "   vec2 corner = vec2((gl_VertexID & 1) != 0 ? 1.0 : -1.0, (gl_VertexID & 2) != 0 ? top : -1.0);\n"
+    "   gl_Position = vec4(corner, depth, 1.0);\n"
+    "}\0";
+
+typedef struct {
+    VertexArena *arena;
+    GpuCuller *culler;
+    ArenaAlloc *allocs;
+    AabbList bounds;
+    int count;
+} Grid;
+
+static bool build_grid(Grid *grid, unsigned int quad_ebo, int side)
+{
+    grid->count = side * side * GRID_HEIGHT;
+    grid->arena = create_vertex_arena(VERTEX_FORMAT_PACKED, quad_ebo);
+    grid->culler = create_gpu_culler();
+    grid->allocs = (ArenaAlloc *) malloc(grid->count * sizeof(ArenaAlloc));
+    if (grid->arena == NULL || grid->culler == NULL || grid->allocs == NULL
+        || !init_aabb_list(&grid->bounds, grid->count)) {
+        return false;
+    }
+    PackedVertex vertices[QUADS_PER_CHUNK * 4];
+    for (int i = 0; i < QUADS_PER_CHUNK * 4; i++) {
+        vertices[i].position_face = PACK_POSITION_FACE(i & 31, (i >> 2) & 31, i & 7, 3);
+        vertices[i].uv_layer = PACK_UV_LAYER(i & 1, (i >> 1) & 1, 1, 0);
+    }
+    begin_gpu_cull_records(grid->culler);
+    int c = 0;
+    for (int y = 0; y < GRID_HEIGHT; y++) {
+        for (int z = -side / 2; z < side / 2; z++) {
+            for (int x = -side / 2; x < side / 2; x++) {
+                float min[3] = {(float)(x * CHUNK_SIZE), (float)(y * CHUNK_SIZE), (float)(z * CHUNK_SIZE)};
+                float max[3] = {min[0] + CHUNK_SIZE, min[1] + CHUNK_SIZE, min[2] + CHUNK_SIZE};
+                init_arena_alloc(&grid->allocs[c]);
+                upload_arena_mesh(grid->arena, &grid->allocs[c], vertices, QUADS_PER_CHUNK);
+                push_aabb(&grid->bounds, min, max);
+                add_gpu_cull_record(grid->culler, &grid->allocs[c], min, min, max);
+                c++;
+            }
+        }
+    }
+    return end_gpu_cull_records(grid->culler, grid->arena);
+}
+
+static void free_grid(Grid *grid)
+{
+    destroy_gpu_culler(grid->culler);
+    destroy_vertex_arena(grid->arena);
+    free(grid->allocs);
+    free_aabb_list(&grid->bounds);
+}
+
+static void grid_view(float m[4][4], int view)
+{
+    float eye[3] = {0.5f, GRID_HEIGHT * CHUNK_SIZE / 2.0f, 0.5f};
+    bench_view_projection(m, eye, view * 2.0f * 3.14159265f / VIEWS, -0.1f, VIEW_DISTANCE);
+}
+
+// Window depth of the nearest corner, or -1 when a corner is behind the eye
+static float nearest_depth(float m[4][4], const float min[3], const float max[3])
+{
+    float nearest = 1.0f;
+    for (int i = 0; i < 8; i++) {
+        float p[3] = {(i & 1) ? max[0] : min[0], (i & 2) ? max[1] : min[1], (i & 4) ? max[2] : min[2]};
+        float z = m[0][2] * p[0] + m[1][2] * p[1] + m[2][2] * p[2] + m[3][2];
+        float w = m[0][3] * p[0] + m[1][3] * p[1] + m[2][3] * p[2] + m[3][3];
+        if (w <= 0.0f) {
+            return -1.0f;
+        }
+        float depth = z / w * 0.5f + 0.5f;
+        nearest = depth < nearest ? depth : nearest;
+    }
+    return nearest;
+}
+
+// The compute shader keeps what cull_aabbs keeps, and behind a full screen
+// wall only what reaches in front of it
+static bool check_gpu_cull(Grid *grid, unsigned int wall_program)
+{
+    uint32_t *visible = (uint32_t *) malloc(grid->count * sizeof(uint32_t));
+    DepthPyramid *pyramid = create_depth_pyramid();
+    unsigned int fbo, depth_rb, vao;
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &depth_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, DEPTH_WIDTH, DEPTH_HEIGHT);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rb);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glGenVertexArrays(1, &vao);
+
+    bool ok = pyramid != NULL && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    uint64_t in_frustum = 0, behind_full = 0, behind_half = 0;
+    for (int v = 0; v < VIEWS && ok; v++) {
+        float m[4][4];
+        Frustum frustum;
+        grid_view(m, v);
+        extract_frustum(&frustum, m);
+        uint32_t expected = cull_aabbs(&frustum, &grid->bounds, visible);
+        dispatch_gpu_cull(grid->culler, grid->arena, m, NULL);
+        uint32_t got = read_gpu_cull_count(grid->culler);
+        if (got != expected) {
+            fprintf(stderr, "view %d: the GPU kept %u chunks, the CPU %u\n", v, got, expected);
+            ok = false;
+        }
+        in_frustum += expected;
+
+        // A wall 100 blocks away across the whole screen, then the lower
+        // half, at the NDC depth bench_view_projection gives that distance
+        float near = 0.1f, far = VIEW_DISTANCE, distance = 100.0f;
+        float wall = ((far + near) / (far - near) * distance - 2.0f * far * near / (far - near)) / distance;
+        for (int half = 0; half < 2 && ok; half++) {
+            glViewport(0, 0, DEPTH_WIDTH, DEPTH_HEIGHT);
+            glDisable(GL_RASTERIZER_DISCARD);
+            glEnable(GL_DEPTH_TEST);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            use_program(wall_program);
+            glUniform1f(glGetUniformLocation(wall_program, "depth"), wall);
+            glUniform1f(glGetUniformLocation(wall_program, "top"), half ? 0.0f : 1.0f);
+            bind_vertex_array(vao);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            update_depth_pyramid(pyramid, DEPTH_WIDTH, DEPTH_HEIGHT);
+            glEnable(GL_RASTERIZER_DISCARD);
+
+            dispatch_gpu_cull(grid->culler, grid->arena, m, pyramid);
+            got = read_gpu_cull_count(grid->culler);
+            if (half) {
+                behind_half += expected - got;
+                continue;
+            }
+            uint32_t reaching = 0;
+            for (uint32_t i = 0; i < expected; i++) {
+                float min[3] = {grid->bounds.min_x[visible[i]], grid->bounds.min_y[visible[i]], grid->bounds.min_z[visible[i]]};
+                float max[3] = {grid->bounds.max_x[visible[i]], grid->bounds.max_y[visible[i]], grid->bounds.max_z[visible[i]]};
+                reaching += nearest_depth(m, min, max) <= wall * 0.5f + 0.5f;
+            }
+            if (got != reaching) {
+                fprintf(stderr, "view %d: %u chunks kept behind the wall, %u reach in front of it\n", v, got, reaching);
+                ok = false;
+            }
+            behind_full += expected - got;
+        }
+    }
+    if (ok) {
+        printf("  %d chunks, %.1f in the frustum, %.1f culled by a full wall, %.1f by a half wall\n", grid->count,
+               (double)in_frustum / VIEWS, (double)behind_full / VIEWS, (double)behind_half / VIEWS);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &depth_rb);
+    glDeleteVertexArrays(1, &vao);
+    reset_gl_state_cache();
+    destroy_depth_pyramid(pyramid);
+    free(visible);
+    return ok;
+}
+
+int main(void)
+{
+    GLFWwindow *window = bench_gl_context(4, 5, "gpu cull bench");
+    if (window == NULL) {
+        window = bench_gl_context(4, 3, "gpu cull bench");
+    }
+    if (window == NULL) {
+        fprintf(stderr, "no GL 4.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    if (!load_multi_draw_indirect() || !load_gpu_culling()) {
+        fprintf(stderr, "GPU culling needs GL 4.3\n");
+        return 1;
+    }
+    printf("chunk culling, CPU frustum against compute, %s, indirect count %s\n",
+           (const char *)glGetString(GL_RENDERER), has_indirect_count() ? "yes" : "no");
+
+    unsigned int program = create_shader_program(vertex_src, fragment_src);
+    unsigned int wall_program = create_shader_program(wall_vertex_src, fragment_src);
+    if (program == 0 || wall_program == 0) {
+        fprintf(stderr, "shader: %s\n", get_shader_error());
+        return 1;
+    }
+    int view_projection_loc = glGetUniformLocation(program, "view_projection");
+    unsigned int quad_ebo = create_quad_index_buffer(MAX_CHUNK_QUADS);
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    bool ok = true;
+    static const int sides[] = {16, 32, 64};
+    for (size_t s = 0; s < sizeof(sides) / sizeof(sides[0]) && ok; s++) {
+        Grid grid;
+        if (!build_grid(&grid, quad_ebo, sides[s])) {
+            fprintf(stderr, "failed to build the grid\n");
+            return 1;
+        }
+        ok = check_gpu_cull(&grid, wall_program);
+
+        uint32_t *visible = (uint32_t *) malloc(grid.count * sizeof(uint32_t));
+        double cpu_submit = 0.0, cpu_total = 0.0, gpu_submit = 0.0, gpu_total = 0.0;
+        for (int v = 0; v < VIEWS && ok; v++) {
+            float m[4][4];
+            grid_view(m, v);
+            use_program(program);
+            glUniformMatrix4fv(view_projection_loc, 1, GL_FALSE, m[0]);
+            glFinish();
+
+            double start = bench_now();
+            for (int frame = 0; frame < FRAMES; frame++) {
+                double frame_start = bench_now();
+                begin_arena_frame(grid.arena);
+                Frustum frustum;
+                extract_frustum(&frustum, m);
+                uint32_t n = cull_aabbs(&frustum, &grid.bounds, visible);
+                for (uint32_t i = 0; i < n; i++) {
+                    float origin[3] = {grid.bounds.min_x[visible[i]], grid.bounds.min_y[visible[i]],
+                                       grid.bounds.min_z[visible[i]]};
+                    add_arena_draw(grid.arena, &grid.allocs[visible[i]], origin);
+                }
+                draw_arena_batch(grid.arena, DRAW_PATH_MULTI_INDIRECT);
+                cpu_submit += bench_now() - frame_start;
+                glFinish();
+            }
+            cpu_total += bench_now() - start;
+
+            start = bench_now();
+            for (int frame = 0; frame < FRAMES; frame++) {
+                double frame_start = bench_now();
+                begin_arena_frame(grid.arena);
+                dispatch_gpu_cull(grid.culler, grid.arena, m, NULL);
+                use_program(program);
+                draw_gpu_culled(grid.culler, grid.arena);
+                gpu_submit += bench_now() - frame_start;
+                glFinish();
+            }
+            gpu_total += bench_now() - start;
+        }
+        double frames = (double)VIEWS * FRAMES;
+        if (ok) {
+            printf("    CPU cull + submit %7.3f ms/frame (with GPU %7.3f), compute cull + submit %7.3f ms/frame "
+                   "(with GPU %7.3f)\n", cpu_submit / frames * 1e3, cpu_total / frames * 1e3,
+                   gpu_submit / frames * 1e3, gpu_total / frames * 1e3);
+        }
+        free(visible);
+        free_grid(&grid);
+    }
+
+    destroy_quad_index_buffer(quad_ebo);
+    glDeleteProgram(program);
+    glDeleteProgram(wall_program);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+#include "../src/loki.h"
+#include "../src/world/heightmap.h"
+#include "bench.h"
+#include "terrain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Column heights on rolling hills with tunnels: the cost of keeping them on
+// block edits, of rebuilding them for a chunk and of surface queries, and
+// the packed size of chunk column summaries. Every result is checked
+// against scanning the blocks.
+#define WORLD_RADIUS    4           // chunks in x and z around the origin
+#define WORLD_HEIGHT    4           // chunks in y
+#define WORLD_CHUNKS    ((2 * WORLD_RADIUS) * (2 * WORLD_RADIUS) * WORLD_HEIGHT)
+#define WORLD_BLOCKS    (2 * WORLD_RADIUS * CHUNK_SIZE)
+#define WORLD_TOP       (WORLD_HEIGHT * CHUNK_SIZE - 1)
+#define EDITS           2000000
+#define QUERIES         1000000
+#define ROUNDS          20
+
+static Chunk *chunks[WORLD_CHUNKS];
+
+// Reference: scan the blocks of the world column from `top` down
+static int32_t scan_surface(ChunkMap *map, int x, int z, int top)
+{
+    for (int y = top; y >= 0; y--) {
+        Chunk *chunk = find_chunk(map, world_to_chunk_coord(x, y, z));
+        if (get_chunk_block(chunk, x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK) != AIR) {
+            return y;
+        }
+    }
+    return HEIGHT_NONE;
+}
+
+// Index of the first chunk whose heights differ from a rebuild, -1 if none
+static int check_heights(void)
+{
+    static uint8_t kept[CHUNK_AREA];
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        memcpy(kept, chunks[i]->heights, CHUNK_AREA);
+        update_chunk_heights(chunks[i]);
+        for (int c = 0; c < CHUNK_AREA; c++) {
+            int x = c & CHUNK_MASK;
+            int z = c >> CHUNK_SHIFT;
+            if (kept[c] != chunks[i]->heights[c] || kept[c] != scan_chunk_height(chunks[i], x, CHUNK_MASK, z)) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+int main(void)
+{
+    ChunkMap *map = create_chunk_map(WORLD_CHUNKS);
+    int count = 0;
+    for (int y = 0; y < WORLD_HEIGHT; y++) {
+        for (int z = -WORLD_RADIUS; z < WORLD_RADIUS; z++) {
+            for (int x = -WORLD_RADIUS; x < WORLD_RADIUS; x++) {
+                Chunk *chunk = create_chunk((ChunkCoord){x, y, z});
+                generate_bench_terrain(chunk->blocks, chunk->coord);
+                carve_bench_caves(chunk->blocks, chunk->coord);
+                update_chunk_heights(chunk);
+                insert_chunk(map, chunk);
+                chunks[count++] = chunk;
+            }
+        }
+    }
+    printf("heightmap, %d chunks\n", WORLD_CHUNKS);
+    if (check_heights() >= 0) {
+        fprintf(stderr, "chunk %d: rebuilt heights differ from the block scan\n", check_heights());
+        return 1;
+    }
+
+    // Whole chunk rebuild against scanning every column down on its own
+    double start = bench_now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < WORLD_CHUNKS; i++) {
+            update_chunk_heights(chunks[i]);
+        }
+    }
+    double rebuild = (bench_now() - start) / (ROUNDS * WORLD_CHUNKS);
+    uint64_t sum = 0;
+    start = bench_now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < WORLD_CHUNKS; i++) {
+            for (int c = 0; c < CHUNK_AREA; c++) {
+                sum += scan_chunk_height(chunks[i], c & CHUNK_MASK, CHUNK_MASK, c >> CHUNK_SHIFT);
+            }
+        }
+    }
+    double scanned = (bench_now() - start) / (ROUNDS * WORLD_CHUNKS);
+    bench_consume(sum);
+    printf("  chunk rebuild   %6.2f us/chunk (column by column scan %.2f us)\n", rebuild * 1e6, scanned * 1e6);
+
+    // Edits near the surface: mostly O(1), a short scan when a top block goes
+    uint64_t seed = 0x4e16;
+    int top_breaks = 0;
+    start = bench_now();
+    for (int e = 0; e < EDITS; e++) {
+        uint64_t r = bench_rand(&seed);
+        Chunk *chunk = chunks[r % WORLD_CHUNKS];
+        int x = (int)(r >> 16) & CHUNK_MASK;
+        int y = (int)(r >> 24) & CHUNK_MASK;
+        int z = (int)(r >> 32) & CHUNK_MASK;
+        // Place or break at random, break the top block now and then
+        BlockId block = ((r >> 44) & 1) ? STONE : AIR;
+        if (((r >> 40) & 7) == 0 && get_chunk_height(chunk, x, z) > 0) {
+            y = get_chunk_height(chunk, x, z) - 1;
+            block = AIR;
+            top_breaks++;
+        }
+        set_chunk_block(chunk, x, y, z, block);
+    }
+    double edit = (bench_now() - start) / EDITS;
+    int differs = check_heights();
+    if (differs >= 0) {
+        fprintf(stderr, "chunk %d: heights kept on edits differ from a rebuild\n", differs);
+        return 1;
+    }
+    printf("  block edits     %6.1f ns/edit, %d of %d aimed at a top block\n", edit * 1e9, top_breaks, EDITS);
+
+    // Boxes of blocks and of air
+    for (int i = 0; i < WORLD_CHUNKS; i += 7) {
+        fill_chunk_region(chunks[i], 4, 10, 4, 20, 30, 12, DIRT);
+        fill_chunk_region(chunks[i], 0, 5, 0, 16, CHUNK_SIZE, 16, AIR);
+    }
+    fill_chunk(chunks[1], AIR);
+    fill_chunk(chunks[2], WATER);
+    if ((differs = check_heights()) >= 0) {
+        fprintf(stderr, "chunk %d: heights kept on fills differ from a rebuild\n", differs);
+        return 1;
+    }
+
+    // Surface queries from the top of the world, against scanning blocks
+    start = bench_now();
+    for (int q = 0; q < QUERIES; q++) {
+        uint64_t r = bench_rand(&seed);
+        int x = (int)(r % WORLD_BLOCKS) - WORLD_BLOCKS / 2;
+        int z = (int)((r >> 16) % WORLD_BLOCKS) - WORLD_BLOCKS / 2;
+        sum += (uint64_t)find_surface_height(map, x, z, WORLD_TOP);
+    }
+    double query = (bench_now() - start) / QUERIES;
+    start = bench_now();
+    for (int q = 0; q < QUERIES / 100; q++) {
+        uint64_t r = bench_rand(&seed);
+        int x = (int)(r % WORLD_BLOCKS) - WORLD_BLOCKS / 2;
+        int z = (int)((r >> 16) % WORLD_BLOCKS) - WORLD_BLOCKS / 2;
+        sum += (uint64_t)scan_surface(map, x, z, WORLD_TOP);
+    }
+    double scan_query = (bench_now() - start) / (QUERIES / 100);
+    bench_consume(sum);
+    for (int q = 0; q < 10000; q++) {
+        uint64_t r = bench_rand(&seed);
+        int x = (int)(r % WORLD_BLOCKS) - WORLD_BLOCKS / 2;
+        int z = (int)((r >> 16) % WORLD_BLOCKS) - WORLD_BLOCKS / 2;
+        int top = (int)((r >> 32) % (WORLD_TOP + 1));
+        if (find_surface_height(map, x, z, top) != scan_surface(map, x, z, top)) {
+            fprintf(stderr, "surface of (%d, %d) below %d is wrong\n", x, z, top);
+            return 1;
+        }
+    }
+    printf("  surface query   %6.1f ns (block scan %.1f ns)\n", query * 1e9, scan_query * 1e9);
+
+    // Chunk column summaries and their packed size
+    static ColumnHeightmap heightmap;
+    static ColumnHeightmap unpacked;
+    static uint8_t packed[COLUMN_HEIGHTMAP_MAX_BYTES];
+    size_t packed_bytes = 0;
+    int columns = (2 * WORLD_RADIUS) * (2 * WORLD_RADIUS);
+    start = bench_now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int z = -WORLD_RADIUS; z < WORLD_RADIUS; z++) {
+            for (int x = -WORLD_RADIUS; x < WORLD_RADIUS; x++) {
+                build_column_heightmap(map, x, z, 0, WORLD_HEIGHT - 1, &heightmap);
+                sum += pack_column_heightmap(&heightmap, packed);
+            }
+        }
+    }
+    double summary = (bench_now() - start) / (ROUNDS * columns);
+    bench_consume(sum);
+    for (int z = -WORLD_RADIUS; z < WORLD_RADIUS; z++) {
+        for (int x = -WORLD_RADIUS; x < WORLD_RADIUS; x++) {
+            build_column_heightmap(map, x, z, 0, WORLD_HEIGHT - 1, &heightmap);
+            size_t size = pack_column_heightmap(&heightmap, packed);
+            packed_bytes += size;
+            if (unpack_column_heightmap(&unpacked, packed, size) != size ||
+                memcmp(&unpacked, &heightmap, sizeof(ColumnHeightmap)) != 0 ||
+                unpack_column_heightmap(&unpacked, packed, size - 1) != 0) {
+                fprintf(stderr, "column (%d, %d) does not survive packing\n", x, z);
+                return 1;
+            }
+            for (int c = 0; c < CHUNK_AREA; c++) {
+                int wx = x * CHUNK_SIZE + (c & CHUNK_MASK);
+                int wz = z * CHUNK_SIZE + (c >> CHUNK_SHIFT);
+                if (heightmap.heights[c] != scan_surface(map, wx, wz, WORLD_TOP)) {
+                    fprintf(stderr, "column (%d, %d) summary is wrong\n", x, z);
+                    return 1;
+                }
+            }
+        }
+    }
+    printf("  column summary  %6.1f us/chunk column built and packed, %.2f bytes/block column "
+           "(%zu raw), round trip verified\n", summary * 1e6, (double)packed_bytes / (columns * CHUNK_AREA),
+           sizeof(int32_t) + sizeof(BlockId));
+
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        destroy_chunk(chunks[i]);
+    }
+    destroy_chunk_map(map);
+    return 0;
+}
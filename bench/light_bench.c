@@ -0,0 +1,241 @@
+#include "../src/loki.h"
+#include "../src/world/light.h"
+#include "bench.h"
+#include "terrain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Flood fill light on rolling hills with lava lit tunnels: how fast whole
+// chunks light up and how long a single block edit takes to relight.
+// Incremental results are checked against lighting the world from scratch.
+#define WORLD_RADIUS    4           // chunks in x and z around the origin
+#define WORLD_HEIGHT    4           // chunks in y
+#define WORLD_CHUNKS    ((2 * WORLD_RADIUS) * (2 * WORLD_RADIUS) * WORLD_HEIGHT)
+#define EDITS           4000
+#define EDIT_MIN_Y      (BENCH_SEA_LEVEL - 30)
+#define EDIT_MAX_Y      (BENCH_SEA_LEVEL + 30)
+
+typedef enum {
+    ORDER_TOP_DOWN = 0,
+    ORDER_BOTTOM_UP,
+    MAX_ORDER,
+} LightOrder;
+
+static const char *order_names[MAX_ORDER] = {"top down", "bottom up"};
+
+static Chunk *chunks[WORLD_CHUNKS];
+
+static Chunk *generate_chunk(ChunkCoord coord)
+{
+    Chunk *chunk = create_chunk(coord);
+    generate_bench_terrain(chunk->blocks, coord);
+    carve_bench_caves(chunk->blocks, coord);
+    // Lava here and there on the tunnel floors
+    for (int i = CHUNK_AREA; i < CHUNK_VOLUME; i++) {
+        if (chunk->blocks[i] == AIR && chunk->blocks[i - CHUNK_AREA] == STONE && i % 61 == 0 &&
+            coord.y * CHUNK_SIZE + (i >> (2 * CHUNK_SHIFT)) < BENCH_SEA_LEVEL - 12) {
+            chunk->blocks[i] = LAVA;
+        }
+    }
+    update_chunk_heights(chunk);
+    return chunk;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+// Light every chunk from zero. Chunks are stored in y major order.
+static bool light_world(LightEngine *engine, LightOrder order)
+{
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        memset(chunks[i]->light, 0, sizeof(chunks[i]->light));
+    }
+    clear_light_changes(engine);
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        Chunk *chunk = chunks[order == ORDER_TOP_DOWN ? WORLD_CHUNKS - 1 - i : i];
+        if (!light_chunk(engine, chunk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void save_light(uint8_t *light)
+{
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        memcpy(&light[(size_t)i * CHUNK_VOLUME], chunks[i]->light, CHUNK_VOLUME);
+    }
+}
+
+// Index of the first chunk whose light differs from `light`, -1 if none
+static int compare_light(const uint8_t *light)
+{
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        if (memcmp(&light[(size_t)i * CHUNK_VOLUME], chunks[i]->light, CHUNK_VOLUME) != 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint8_t get_world_light(ChunkMap *map, int x, int y, int z)
+{
+    Chunk *chunk = find_chunk(map, world_to_chunk_coord(x, y, z));
+    return chunk->light[CHUNK_INDEX(x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK)];
+}
+
+// A lava block sealed in stone lights its pocket by distance, a shaft
+// opened above it lets the sky in and closing it takes the sky out again
+static bool check_known_light(LightEngine *engine, ChunkMap *map)
+{
+    int x = 3;
+    int y = BENCH_SEA_LEVEL - 20;
+    int z = 5;
+    bool ok = true;
+    for (int dy = -1; dy <= 8 && ok; dy++) {
+        for (int dz = -1; dz <= 1 && ok; dz++) {
+            for (int dx = -1; dx <= 5 && ok; dx++) {
+                bool inside = dy >= 0 && dy <= 7 && dz == 0 && dx >= 0 && dx <= 4;
+                ok = set_light_block(engine, x + dx, y + dy, z + dz, inside ? AIR : STONE);
+            }
+        }
+    }
+    ok &= set_light_block(engine, x, y, z, LAVA);
+    for (int d = 0; d <= 4 && ok; d++) {
+        ok = BLOCK_LIGHT(get_world_light(map, x + d, y, z)) == LIGHT_MAX - d;
+    }
+    ok &= BLOCK_LIGHT(get_world_light(map, x + 4, y + 7, z)) == LIGHT_MAX - 11;
+    if (!ok) {
+        fprintf(stderr, "lava pocket lit wrong\n");
+        return false;
+    }
+
+    // Open a shaft from the pocket's top to the sky: full sky light falls in
+    int top = WORLD_HEIGHT * CHUNK_SIZE - 1;
+    for (int sy = y + 8; sy <= top; sy++) {
+        ok &= set_light_block(engine, x + 4, sy, z, AIR);
+    }
+    ok &= SKY_LIGHT(get_world_light(map, x + 4, y + 7, z)) == LIGHT_MAX;
+    ok &= SKY_LIGHT(get_world_light(map, x + 4, y, z)) == LIGHT_MAX;
+    ok &= SKY_LIGHT(get_world_light(map, x, y + 7, z)) == LIGHT_MAX - 4;
+    ok &= set_light_block(engine, x + 4, top - 1, z, STONE);
+    ok &= SKY_LIGHT(get_world_light(map, x + 4, y, z)) == 0;
+    ok &= SKY_LIGHT(get_world_light(map, x + 4, top, z)) == LIGHT_MAX;
+    if (!ok) {
+        fprintf(stderr, "sky shaft lit wrong\n");
+        return false;
+    }
+    printf("  known light: lava pocket and sky shaft levels match\n");
+    return true;
+}
+
+int main(void)
+{
+    ChunkMap *map = create_chunk_map(WORLD_CHUNKS);
+    int count = 0;
+    for (int y = 0; y < WORLD_HEIGHT; y++) {
+        for (int z = -WORLD_RADIUS; z < WORLD_RADIUS; z++) {
+            for (int x = -WORLD_RADIUS; x < WORLD_RADIUS; x++) {
+                chunks[count] = generate_chunk((ChunkCoord){x, y, z});
+                insert_chunk(map, chunks[count++]);
+            }
+        }
+    }
+    printf("light, %d chunks (%.1fM voxels)\n", WORLD_CHUNKS, WORLD_CHUNKS * (double)CHUNK_VOLUME / 1e6);
+
+    LightEngine engine;
+    init_light_engine(&engine, map);
+    uint8_t *reference = (uint8_t *) malloc((size_t)WORLD_CHUNKS * CHUNK_VOLUME);
+
+    // Whole world lighting, the order chunks are lit in must not matter.
+    // Bottom up lights every chunk as open sky first and shades it later.
+    for (int order = 0; order < MAX_ORDER; order++) {
+        engine.visited = 0;
+        double start = bench_now();
+        if (!light_world(&engine, order)) {
+            fprintf(stderr, "lighting failed\n");
+            return 1;
+        }
+        double elapsed = bench_now() - start;
+        printf("  %-9s %7.2f ms, %5.1f M voxels/s world, %5.1f M queue visits/s, %u chunks changed\n",
+               order_names[order], elapsed * 1e3, WORLD_CHUNKS * (double)CHUNK_VOLUME / elapsed / 1e6,
+               engine.visited / elapsed / 1e6, engine.changed_count);
+        if (order == ORDER_TOP_DOWN) {
+            save_light(reference);
+        } else if (compare_light(reference) >= 0) {
+            fprintf(stderr, "chunk %d lit differently %s\n", compare_light(reference), order_names[order]);
+            return 1;
+        }
+    }
+
+    // Random breaks and placements around the surface and the tunnels
+    static int latencies[EDITS];
+    uint64_t seed = 0x11647;
+    uint64_t visited = 0;
+    int placed = 0;
+    clear_light_changes(&engine);
+    for (int e = 0; e < EDITS; e++) {
+        uint64_t r = bench_rand(&seed);
+        int x = (int)(r % (2 * WORLD_RADIUS * CHUNK_SIZE)) - WORLD_RADIUS * CHUNK_SIZE;
+        int z = (int)((r >> 16) % (2 * WORLD_RADIUS * CHUNK_SIZE)) - WORLD_RADIUS * CHUNK_SIZE;
+        int y = EDIT_MIN_Y + (int)((r >> 32) % (EDIT_MAX_Y - EDIT_MIN_Y));
+        Chunk *chunk = find_chunk(map, world_to_chunk_coord(x, y, z));
+        BlockId old = chunk->blocks[CHUNK_INDEX(x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK)];
+        BlockId block = is_block_opaque(old) ? AIR : ((r >> 48) & 3) == 0 ? LAVA : STONE;
+        placed += block != AIR;
+
+        engine.visited = 0;
+        double start = bench_now();
+        bool ok = set_light_block(&engine, x, y, z, block);
+        latencies[e] = (int)((bench_now() - start) * 1e9);
+        visited += engine.visited;
+        if (!ok) {
+            fprintf(stderr, "edit %d failed\n", e);
+            return 1;
+        }
+    }
+    uint32_t changed = engine.changed_count;
+    clear_light_changes(&engine);
+    qsort(latencies, EDITS, sizeof(int), compare_ints);
+    double mean = 0.0;
+    for (int e = 0; e < EDITS; e++) {
+        mean += latencies[e];
+    }
+    mean /= EDITS;
+    printf("  %d edits (%d placed, %d broken): mean %.1f us, median %.1f us, p99 %.1f us, max %.1f us, "
+           "%.0f voxels visited/edit, %u chunks to remesh\n", EDITS, placed, EDITS - placed, mean / 1e3,
+           latencies[EDITS / 2] / 1e3, latencies[EDITS * 99 / 100] / 1e3, latencies[EDITS - 1] / 1e3,
+           (double)visited / EDITS, changed);
+
+    // The incremental result has to be the light of the edited world
+    save_light(reference);
+    light_world(&engine, ORDER_TOP_DOWN);
+    int differs = compare_light(reference);
+    if (differs >= 0) {
+        fprintf(stderr, "chunk %d: incremental light differs from a full relight\n", differs);
+        return 1;
+    }
+    printf("  incremental light matches a full relight\n");
+
+    bool ok = check_known_light(&engine, map);
+    if (ok) {
+        save_light(reference);
+        light_world(&engine, ORDER_TOP_DOWN);
+        ok = compare_light(reference) < 0;
+        if (!ok) {
+            fprintf(stderr, "known light edits differ from a full relight\n");
+        }
+    }
+
+    free(reference);
+    free_light_engine(&engine);
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        destroy_chunk(chunks[i]);
+    }
+    destroy_chunk_map(map);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#include "../src/world/mesh_pool.h"
+#include "bench.h"
+#include "terrain.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REGION          6       // chunks meshed in [-REGION, REGION] on x and z
+#define COLUMN_CHUNKS   4
+#define ROUNDS          3
+
+
+// Collect until every submitted job was delivered or dropped
+static int wait_for_jobs(MeshPool *pool, Chunk **chunks, int count)
+{
+    int delivered = 0;
+    while (mesh_pool_pending(pool) > 0) {
+        MeshJob *job = collect_mesh_jobs(pool);
+        if (job == NULL) {
+            sched_yield();
+            continue;
+        }
+        while (job) {
+            MeshJob *next = job->next;
+            int i = (int)(intptr_t)job->user;
+            if (i < 0 || i >= count || job->chunk != chunks[i] || !job->built) {
+                fprintf(stderr, "job for chunk %d came back wrong\n", i);
+                return -1;
+            }
+            bench_consume(job->mesh.vertex_count);
+            release_mesh_job(pool, job);
+            delivered++;
+            job = next;
+        }
+    }
+    return delivered;
+}
+
+// Remeshing a chunk twice must deliver only the second mesh
+static int check_cancellation(ChunkMap *map, Chunk **chunks, int count)
+{
+    MeshPool *pool = create_mesh_pool(map, 2);
+    for (int i = 0; i < count; i++) {
+        submit_mesh_job(pool, chunks[i], MESHER_BINARY, VERTEX_FORMAT_PACKED, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < count; i += 2) {
+        submit_mesh_job(pool, chunks[i], MESHER_BINARY, VERTEX_FORMAT_PACKED, (void *)(intptr_t)i);
+    }
+    int delivered = wait_for_jobs(pool, chunks, count);
+    unsigned int cancelled = atomic_load(&pool->cancelled);
+    destroy_mesh_pool(pool);
+
+    // Each of the count + count / 2 jobs is either delivered or cancelled, and
+    // a chunk is delivered at least once
+    int submitted = count + (count + 1) / 2;
+    if (delivered < count || delivered + (int)cancelled != submitted) {
+        fprintf(stderr, "cancellation: %d delivered, %u cancelled out of %d\n", delivered, cancelled, submitted);
+        return 1;
+    }
+    printf("  resubmitting half the chunks: %d delivered, %u stale jobs dropped\n", delivered, cancelled);
+    return 0;
+}
+
+int main(void)
+{
+    ChunkMap *map = create_chunk_map(1024);
+    int side = 2 * REGION + 1;
+    Chunk **chunks = (Chunk **) malloc(side * side * COLUMN_CHUNKS * sizeof(Chunk *));
+    int count = 0;
+
+    for (int cz = -REGION; cz <= REGION; cz++) {
+        for (int cx = -REGION; cx <= REGION; cx++) {
+            for (int cy = 0; cy < COLUMN_CHUNKS; cy++) {
+                Chunk *chunk = create_chunk((ChunkCoord){cx, cy, cz});
+                generate_bench_terrain(chunk->blocks, chunk->coord);
+                update_chunk_heights(chunk);
+                insert_chunk(map, chunk);
+                chunks[count++] = chunk;
+            }
+        }
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = cores > 4 ? (int)cores : 4;
+    printf("mesh pool, %d chunks of terrain, binary mesher, %ld cores\n", count, cores);
+
+    // Baseline: everything on the calling thread
+    ChunkMesh mesh;
+    init_chunk_mesh(&mesh);
+    mesh.format = VERTEX_FORMAT_PACKED;
+    double start = bench_now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < count; i++) {
+            Chunk *neighbors[MAX_NEIGHBOR];
+            find_chunk_neighbors(map, chunks[i]->coord, neighbors);
+            build_chunk_mesh(&mesh, chunks[i], neighbors, MESHER_BINARY);
+            bench_consume(mesh.vertex_count);
+        }
+    }
+    double serial = bench_now() - start;
+    free_chunk_mesh(&mesh);
+    printf("  %-10s %8.0f chunks/s\n", "serial", count * ROUNDS / serial);
+
+    float focus[3] = {0.0f, BENCH_SEA_LEVEL, 0.0f};
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        MeshPool *pool = create_mesh_pool(map, threads);
+        if (pool == NULL) {
+            fprintf(stderr, "failed to start %d workers\n", threads);
+            return 1;
+        }
+        set_mesh_pool_focus(pool, focus);
+
+        start = bench_now();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (int i = 0; i < count; i++) {
+                submit_mesh_job(pool, chunks[i], MESHER_BINARY, VERTEX_FORMAT_PACKED, (void *)(intptr_t)i);
+            }
+            if (wait_for_jobs(pool, chunks, count) != count) {
+                fprintf(stderr, "%d workers: jobs lost\n", threads);
+                return 1;
+            }
+        }
+        double elapsed = bench_now() - start;
+        destroy_mesh_pool(pool);
+
+        printf("  %2d %-7s %8.0f chunks/s (%.2fx serial)\n", threads, threads == 1 ? "worker" : "workers",
+               count * ROUNDS / elapsed, serial / elapsed);
+    }
+
+    if (check_cancellation(map, chunks, count) != 0) {
+        return 1;
+    }
+
+    destroy_chunk_map(map);
+    for (int i = 0; i < count; i++) {
+        destroy_chunk(chunks[i]);
+    }
+    free(chunks);
+    return 0;
+}
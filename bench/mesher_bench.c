@@ -0,0 +1,249 @@
+#include "../src/world/mesher.h"
+#include "bench.h"
+#include "terrain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REGION          3       // chunks meshed in [-REGION, REGION] on x and z
+#define COLUMN_CHUNKS   4
+#define ROUNDS          5
+#define EQUIVALENCE_RUNS 200
+
+
+// Old approach: all 6 quads of a cube for every block
+static uint64_t mesh_naive(ChunkMesh *mesh, const Chunk *chunk)
+{
+    uint64_t triangles = 0;
+    clear_chunk_mesh(mesh);
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                if (get_chunk_block(chunk, x, y, z) == AIR) {
+                    continue;
+                }
+                if (mesh->vertex_count + 24 > mesh->vertex_capacity) {
+                    mesh->vertex_capacity = mesh->vertex_capacity ? mesh->vertex_capacity * 2 : 1024;
+                    mesh->vertices = realloc(mesh->vertices, mesh->vertex_capacity * sizeof(Vertex));
+                }
+                for (int v = 0; v < 24; v++) {
+                    Vertex *out = &mesh->vertices[mesh->vertex_count + v];
+                    out->position[0] = (float)(x + ((v >> 0) & 1));
+                    out->position[1] = (float)(y + ((v >> 1) & 1));
+                    out->position[2] = (float)(z + ((v >> 2) & 1));
+                    out->texCoords[0] = (float)(v & 1);
+                    out->texCoords[1] = (float)((v >> 1) & 1);
+                    out->texCoords[2] = 0.0f;
+                    out->normal[0] = out->normal[1] = out->normal[2] = 0.0f;
+                }
+                mesh->vertex_count += 24;
+                triangles += 12;
+            }
+        }
+    }
+    return triangles;
+}
+
+static int compare_quads(const void *a, const void *b)
+{
+    return memcmp(a, b, 4 * sizeof(Vertex));
+}
+
+// Sort the quads of a mesh so meshes can be compared regardless of order
+static void sort_quads(ChunkMesh *mesh)
+{
+    qsort(mesh->vertices, mesh->vertex_count / 4, 4 * sizeof(Vertex), compare_quads);
+}
+
+// Random chunks, light and neighbors must give the same quads with the
+// greedy and the binary mesher
+static int check_equivalence(void)
+{
+    ChunkMesh greedy;
+    ChunkMesh binary;
+    Chunk *chunk = create_chunk((ChunkCoord){0, 0, 0});
+    Chunk *storage[MAX_NEIGHBOR];
+    Chunk *neighbors[MAX_NEIGHBOR];
+    uint64_t seed = 0xb17;
+
+    init_chunk_mesh(&greedy);
+    init_chunk_mesh(&binary);
+    for (int n = 0; n < MAX_NEIGHBOR; n++) {
+        storage[n] = create_chunk((ChunkCoord){0, 0, 0});
+    }
+
+    for (int run = 0; run < EQUIVALENCE_RUNS; run++) {
+        // Vary the density and the number of types, including more types
+        // than the binary mesher handles natively
+        int air_odds = 1 + (int)(bench_rand(&seed) % 8);
+        int types = 1 + (int)(bench_rand(&seed) % (run % 10 == 9 ? 40 : MAX_VOXEL - 1));
+        // From uniform light to a few levels that cut runs now and then
+        int light_levels = 1 + run % 3;
+        for (int i = 0; i < CHUNK_VOLUME; i++) {
+            bool air = bench_rand(&seed) % air_odds == 0;
+            chunk->blocks[i] = air ? AIR : (BlockId)(1 + bench_rand(&seed) % types);
+            chunk->light[i] = (uint8_t)(0xF0 - (bench_rand(&seed) % light_levels) * 0x11);
+        }
+        update_chunk_heights(chunk);
+        for (int n = 0; n < MAX_NEIGHBOR; n++) {
+            neighbors[n] = (bench_rand(&seed) & 3) ? storage[n] : NULL;
+            for (int i = 0; i < CHUNK_VOLUME; i++) {
+                storage[n]->blocks[i] = (BlockId)(bench_rand(&seed) % MAX_VOXEL);
+                storage[n]->light[i] = (uint8_t)(0xF0 - (bench_rand(&seed) % light_levels) * 0x11);
+            }
+            update_chunk_heights(storage[n]);
+        }
+
+        build_chunk_mesh(&greedy, chunk, neighbors, MESHER_GREEDY);
+        build_chunk_mesh(&binary, chunk, neighbors, MESHER_BINARY);
+        sort_quads(&greedy);
+        sort_quads(&binary);
+        if (greedy.vertex_count != binary.vertex_count ||
+            memcmp(greedy.vertices, binary.vertices, greedy.vertex_count * sizeof(Vertex)) != 0) {
+            fprintf(stderr, "run %d: greedy (%u vertices) and binary (%u vertices) meshes differ\n",
+                    run, greedy.vertex_count, binary.vertex_count);
+            return 1;
+        }
+    }
+    printf("  binary mesher matches greedy on %d random chunks\n", EQUIVALENCE_RUNS);
+
+    for (int n = 0; n < MAX_NEIGHBOR; n++) {
+        destroy_chunk(storage[n]);
+    }
+    destroy_chunk(chunk);
+    free_chunk_mesh(&greedy);
+    free_chunk_mesh(&binary);
+    return 0;
+}
+
+// A packed mesh has to decode to exactly the float mesh of the same chunk
+static int check_packed(Chunk **chunks, int count, ChunkMap *map)
+{
+    static const float normals[6][3] = {
+        {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1},
+    };
+    ChunkMesh full;
+    ChunkMesh packed;
+    uint64_t float_bytes = 0;
+    uint64_t packed_bytes = 0;
+
+    init_chunk_mesh(&full);
+    init_chunk_mesh(&packed);
+    packed.format = VERTEX_FORMAT_PACKED;
+    for (int i = 0; i < count; i++) {
+        Chunk *neighbors[MAX_NEIGHBOR];
+        find_chunk_neighbors(map, chunks[i]->coord, neighbors);
+        build_chunk_mesh(&full, chunks[i], neighbors, MESHER_BINARY);
+        build_chunk_mesh(&packed, chunks[i], neighbors, MESHER_BINARY);
+        if (full.vertex_count != packed.vertex_count) {
+            fprintf(stderr, "chunk %d: packed mesh has %u vertices, float mesh %u\n",
+                    i, packed.vertex_count, full.vertex_count);
+            return 1;
+        }
+        for (uint32_t v = 0; v < full.vertex_count; v++) {
+            const Vertex *f = &full.vertices[v];
+            uint32_t a = packed.packed_vertices[v].position_face;
+            uint32_t b = packed.packed_vertices[v].uv_layer;
+            const float *normal = normals[(a >> 18) & 7];
+            if (f->position[0] != (float)(a & 63) || f->position[1] != (float)((a >> 6) & 63) ||
+                f->position[2] != (float)((a >> 12) & 63) ||
+                f->texCoords[0] != (float)(b & 63) || f->texCoords[1] != (float)((b >> 6) & 63) ||
+                f->texCoords[2] != (float)((b >> 12) & 255) ||
+                f->light[0] != (float)((b >> 24) & 15) || f->light[1] != (float)((b >> 20) & 15) ||
+                f->normal[0] != normal[0] || f->normal[1] != normal[1] || f->normal[2] != normal[2]) {
+                fprintf(stderr, "chunk %d: packed vertex %u does not decode to the float vertex\n", i, v);
+                return 1;
+            }
+        }
+        float_bytes += full.vertex_count * sizeof(Vertex);
+        packed_bytes += packed.vertex_count * sizeof(PackedVertex);
+    }
+    printf("  vertex buffers: float %.1f KiB/chunk, packed %.1f KiB/chunk (%.1fx smaller), decode verified\n",
+           (double)float_bytes / count / 1024.0, (double)packed_bytes / count / 1024.0,
+           (double)float_bytes / packed_bytes);
+
+    // Per chunk indices would add 6 per quad, the shared quad buffer none
+    double index_bytes = (double)packed_bytes / sizeof(PackedVertex) / 4 * 6 * sizeof(unsigned int);
+    printf("  packed upload: %.1f KiB/chunk with own indices, %.1f KiB/chunk with the shared quad indices\n",
+           (packed_bytes + index_bytes) / count / 1024.0, (double)packed_bytes / count / 1024.0);
+
+    free_chunk_mesh(&full);
+    free_chunk_mesh(&packed);
+    return 0;
+}
+
+int main(void)
+{
+    ChunkMap *map = create_chunk_map(1024);
+    Chunk *loaded[(2 * REGION + 3) * (2 * REGION + 3) * COLUMN_CHUNKS];
+    Chunk *meshed[(2 * REGION + 1) * (2 * REGION + 1) * COLUMN_CHUNKS];
+    int loaded_count = 0;
+    int count = 0;
+
+    // Load one ring of chunks more than is meshed so borders see neighbors
+    for (int cz = -REGION - 1; cz <= REGION + 1; cz++) {
+        for (int cx = -REGION - 1; cx <= REGION + 1; cx++) {
+            for (int cy = 0; cy < COLUMN_CHUNKS; cy++) {
+                Chunk *chunk = create_chunk((ChunkCoord){cx, cy, cz});
+                generate_bench_terrain(chunk->blocks, chunk->coord);
+                update_chunk_heights(chunk);
+                insert_chunk(map, chunk);
+                loaded[loaded_count++] = chunk;
+                if (abs(cx) <= REGION && abs(cz) <= REGION) {
+                    meshed[count++] = chunk;
+                }
+            }
+        }
+    }
+
+    ChunkMesh mesh;
+    init_chunk_mesh(&mesh);
+    uint64_t naive_triangles = 0;
+    int meshes = count * ROUNDS;
+
+    double start = bench_now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < count; i++) {
+            naive_triangles += mesh_naive(&mesh, meshed[i]);
+        }
+    }
+    double naive_time = bench_now() - start;
+
+    printf("chunk mesher, %d chunks of terrain\n", count);
+    printf("  %-12s %10.0f triangles/chunk %8.1f us/chunk\n", "naive cubes",
+           (double)naive_triangles / meshes, naive_time / meshes * 1e6);
+
+    static const char *names[MAX_MESHER] = {"face culled", "greedy", "binary"};
+    for (int mode = 0; mode < MAX_MESHER; mode++) {
+        uint64_t triangles = 0;
+        uint64_t vertices = 0;
+        start = bench_now();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (int i = 0; i < count; i++) {
+                Chunk *neighbors[MAX_NEIGHBOR];
+                find_chunk_neighbors(map, meshed[i]->coord, neighbors);
+                if (!build_chunk_mesh(&mesh, meshed[i], neighbors, (MesherMode)mode)) {
+                    fprintf(stderr, "out of memory\n");
+                    return 1;
+                }
+                triangles += chunk_mesh_index_count(&mesh) / 3;
+                vertices += mesh.vertex_count;
+            }
+        }
+        double elapsed = bench_now() - start;
+        printf("  %-12s %10.0f triangles/chunk %8.1f us/chunk (%.0f vertices, %.1f KiB)\n", names[mode],
+               (double)triangles / meshes, elapsed / meshes * 1e6,
+               (double)vertices / meshes, (double)vertices / meshes * sizeof(Vertex) / 1024.0);
+    }
+
+    free_chunk_mesh(&mesh);
+    if (check_packed(meshed, count, map) != 0 || check_equivalence() != 0) {
+        return 1;
+    }
+    destroy_chunk_map(map);
+    for (int i = 0; i < loaded_count; i++) {
+        destroy_chunk(loaded[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,266 @@
+#include "../src/loki.h"
+#include "../src/util/noise.h"
+#include "../src/world/worldgen.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Noise kernels on one core: samples per second of every noise type,
+// fractal and dimension for each backend the CPU has, the vector backends
+// checked bit for bit against the scalar reference. Then the world
+// generator, whose chunks must not depend on the backend either.
+#define POINTS          (1 << 16)       // random sample positions, reused
+#define TIMED_SAMPLES   (1 << 21)
+#define CHECKED_SAMPLES (1 << 20)
+#define OCTAVES         4
+#define WORLD_RADIUS    4               // chunk columns in x and z around the origin
+#define WORLD_HEIGHT    4               // chunks in y
+#define WORLD_CHUNKS    ((2 * WORLD_RADIUS) * (2 * WORLD_RADIUS) * WORLD_HEIGHT)
+#define SEA_LEVEL       64
+
+static const char *type_names[MAX_NOISE_TYPE] = {"simplex", "value"};
+static const char *fractal_names[MAX_NOISE_FRACTAL] = {"fbm", "ridged"};
+
+static float xs[POINTS];
+static float ys[POINTS];
+static float zs[POINTS];
+
+static void sample(const Noise *noise, int dims, int i, float *out)
+{
+    if (dims == 2) {
+        sample_noise2(noise, &xs[i], &ys[i], out);
+    } else {
+        sample_noise3(noise, &xs[i], &ys[i], &zs[i], out);
+    }
+}
+
+static double time_samples(const Noise *noise, int dims)
+{
+    float out[NOISE_LANES];
+    uint64_t sum = 0;
+    double start = bench_now();
+    for (int s = 0; s < TIMED_SAMPLES; s += NOISE_LANES) {
+        sample(noise, dims, s & (POINTS - 1), out);
+        sum += (uint64_t)(int64_t)(out[0] * 1000.0f);
+    }
+    double elapsed = bench_now() - start;
+    bench_consume(sum);
+    return TIMED_SAMPLES / elapsed;
+}
+
+// Number of samples whose bits differ from the scalar reference
+static int check_backend(const Noise *noise, int dims, NoiseBackend backend)
+{
+    float reference[NOISE_LANES];
+    float out[NOISE_LANES];
+    int differs = 0;
+    for (int s = 0; s < CHECKED_SAMPLES; s += NOISE_LANES) {
+        int i = s & (POINTS - 1);
+        set_noise_backend(NOISE_BACKEND_SCALAR);
+        sample(noise, dims, i, reference);
+        set_noise_backend(backend);
+        sample(noise, dims, i, out);
+        for (int l = 0; l < NOISE_LANES; l++) {
+            differs += memcmp(&reference[l], &out[l], sizeof(float)) != 0;
+        }
+    }
+    return differs;
+}
+
+// Grids must match the same points sampled one batch at a time, odd sizes included
+static bool check_grids(const Noise *noise)
+{
+    static float grid[7 * 5 * 9];
+    float origin[3] = {-13.5f, 40.25f, 7.0f};
+    int size[3] = {7, 5, 9};
+    fill_noise3_grid(noise, origin, 0.75f, size, grid);
+    for (int i = 0; i < 7 * 5 * 9; i++) {
+        float x[NOISE_LANES], y[NOISE_LANES], z[NOISE_LANES], out[NOISE_LANES];
+        for (int l = 0; l < NOISE_LANES; l++) {
+            x[l] = origin[0] + (float)(i % 7) * 0.75f;
+            z[l] = origin[2] + (float)(i % 63 / 7) * 0.75f;
+            y[l] = origin[1] + (float)(i / 63) * 0.75f;
+        }
+        sample_noise3(noise, x, y, z, out);
+        if (memcmp(&out[0], &grid[i], sizeof(float)) != 0) {
+            return false;
+        }
+    }
+    fill_noise2_grid(noise, origin, 0.75f, size, grid);
+    for (int i = 0; i < 7 * 5; i++) {
+        float x[NOISE_LANES], y[NOISE_LANES], out[NOISE_LANES];
+        for (int l = 0; l < NOISE_LANES; l++) {
+            x[l] = origin[0] + (float)(i % 7) * 0.75f;
+            y[l] = origin[1] + (float)(i / 7) * 0.75f;
+        }
+        sample_noise2(noise, x, y, out);
+        if (memcmp(&out[0], &grid[i], sizeof(float)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Generate the world, returns seconds per chunk and the time in each pass
+static double generate_world(const WorldGen *gen, Chunk **chunks, double pass_times[3], uint64_t *cave_samples)
+{
+    TerrainColumn column;
+    double start = bench_now();
+    int i = 0;
+    for (int z = -WORLD_RADIUS; z < WORLD_RADIUS; z++) {
+        for (int x = -WORLD_RADIUS; x < WORLD_RADIUS; x++) {
+            double t0 = bench_now();
+            generate_terrain_column(gen, x, z, &column);
+            double t1 = bench_now();
+            pass_times[0] += t1 - t0;
+            for (int y = 0; y < WORLD_HEIGHT; y++) {
+                Chunk *chunk = chunks[i++];
+                t0 = bench_now();
+                fill_terrain_layers(gen, chunk, &column);
+                t1 = bench_now();
+                *cave_samples += (uint64_t)carve_terrain_caves(gen, chunk, &column);
+                update_chunk_heights(chunk);
+                pass_times[1] += t1 - t0;
+                pass_times[2] += bench_now() - t1;
+            }
+        }
+    }
+    return (bench_now() - start) / WORLD_CHUNKS;
+}
+
+int main(void)
+{
+    uint64_t seed = 0x5eed;
+    for (int i = 0; i < POINTS; i++) {
+        // Both signs, lattice points and far away coordinates
+        xs[i] = (float)((int64_t)(bench_rand(&seed) % 2000000) - 1000000) / 64.0f;
+        ys[i] = (float)((int64_t)(bench_rand(&seed) % 20000) - 10000) / 16.0f;
+        zs[i] = (float)((int64_t)(bench_rand(&seed) % 2000000) - 1000000) / 64.0f;
+    }
+    NoiseBackend best = get_noise_backend();
+    printf("noise, %d octaves, one core, best backend %s\n", OCTAVES, get_noise_backend_name(best));
+
+    for (int dims = 2; dims <= 3; dims++) {
+        for (int type = 0; type < MAX_NOISE_TYPE; type++) {
+            for (int fractal = 0; fractal < MAX_NOISE_FRACTAL; fractal++) {
+                NoiseDesc desc = {type, fractal, OCTAVES, 1.0f / 32.0f, 2.0f, 0.5f};
+                Noise noise;
+                init_noise(&noise, &desc, 0x0123456789ABCDEFull);
+                printf("  %dD %-7s %-6s", dims, type_names[type], fractal_names[fractal]);
+                double scalar = 0.0;
+                for (int b = 0; b < MAX_NOISE_BACKEND; b++) {
+                    if (!has_noise_backend(b)) {
+                        continue;
+                    }
+                    int differs = b == NOISE_BACKEND_SCALAR ? 0 : check_backend(&noise, dims, b);
+                    if (differs > 0) {
+                        fprintf(stderr, "\n%s: %d of %d samples differ from scalar\n", get_noise_backend_name(b),
+                                differs, CHECKED_SAMPLES);
+                        return 1;
+                    }
+                    set_noise_backend(b);
+                    double rate = time_samples(&noise, dims);
+                    if (b == NOISE_BACKEND_SCALAR) {
+                        scalar = rate;
+                        printf("  %s %6.1f M/s", get_noise_backend_name(b), rate / 1e6);
+                    } else {
+                        printf("  %s %6.1f M/s (%.1fx)", get_noise_backend_name(b), rate / 1e6, rate / scalar);
+                    }
+                }
+                printf("\n");
+            }
+        }
+    }
+    printf("  vector backends match scalar bit for bit on %d samples per row\n", CHECKED_SAMPLES);
+
+    // Seeds: the same seed repeats, another one does not
+    NoiseDesc desc = {NOISE_SIMPLEX, NOISE_FBM, OCTAVES, 1.0f / 32.0f, 2.0f, 0.5f};
+    Noise a, b, c;
+    init_noise(&a, &desc, 42);
+    init_noise(&b, &desc, 42);
+    init_noise(&c, &desc, 42ull << 32);
+    float out_a[NOISE_LANES], out_b[NOISE_LANES], out_c[NOISE_LANES];
+    set_noise_backend(best);
+    sample_noise3(&a, xs, ys, zs, out_a);
+    sample_noise3(&b, xs, ys, zs, out_b);
+    sample_noise3(&c, xs, ys, zs, out_c);
+    if (memcmp(out_a, out_b, sizeof(out_a)) != 0 || memcmp(out_a, out_c, sizeof(out_a)) == 0) {
+        fprintf(stderr, "seeding is not deterministic\n");
+        return 1;
+    }
+    if (!check_grids(&a)) {
+        fprintf(stderr, "grid samples differ from single batches\n");
+        return 1;
+    }
+
+    // The world generator, on the best backend and on the scalar reference
+    WorldGen gen;
+    WorldGenDesc gen_desc = {
+        .seed = 0x10C1,
+        .sea_level = SEA_LEVEL,
+        .land_height = SEA_LEVEL + 4.0f,
+        .land_range = 24.0f,
+        .mountain_height = 40.0f,
+        .soil_depth = 3,
+        .cave_threshold = 0.45f,
+        .cave_roof = 6,
+        .cave_step = 4,
+    };
+    if (!init_world_gen(&gen, &gen_desc)) {
+        fprintf(stderr, "bad world generator\n");
+        return 1;
+    }
+    static Chunk *chunks[WORLD_CHUNKS];
+    static Chunk *reference[WORLD_CHUNKS];
+    int count = 0;
+    for (int z = -WORLD_RADIUS; z < WORLD_RADIUS; z++) {
+        for (int x = -WORLD_RADIUS; x < WORLD_RADIUS; x++) {
+            for (int y = 0; y < WORLD_HEIGHT; y++) {
+                chunks[count] = create_chunk((ChunkCoord){x, y, z});
+                reference[count++] = create_chunk((ChunkCoord){x, y, z});
+            }
+        }
+    }
+    double passes[3] = {0.0, 0.0, 0.0};
+    double scalar_passes[3] = {0.0, 0.0, 0.0};
+    uint64_t cave_samples = 0;
+    set_noise_backend(NOISE_BACKEND_SCALAR);
+    double scalar_chunk = generate_world(&gen, reference, scalar_passes, &cave_samples);
+    set_noise_backend(best);
+    cave_samples = 0;
+    double chunk_time = generate_world(&gen, chunks, passes, &cave_samples);
+
+    uint64_t layers[MAX_VOXEL] = {0};
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        if (memcmp(chunks[i]->blocks, reference[i]->blocks, sizeof(chunks[i]->blocks)) != 0) {
+            fprintf(stderr, "chunk %d differs between backends\n", i);
+            return 1;
+        }
+        for (int b = 0; b < CHUNK_VOLUME; b++) {
+            BlockId block = chunks[i]->blocks[b];
+            layers[block]++;
+            int wy = chunks[i]->coord.y * CHUNK_SIZE + (b >> (2 * CHUNK_SHIFT));
+            if ((block == WATER && wy > SEA_LEVEL) || (block == GRASS && wy <= SEA_LEVEL)) {
+                fprintf(stderr, "chunk %d has %s at y %d\n", i, block == WATER ? "water" : "grass", wy);
+                return 1;
+            }
+        }
+    }
+    printf("terrain, %d chunks: %.2f ms/chunk (scalar %.2f ms), columns %.1f%%, layers %.1f%%, caves %.1f%% "
+           "with %.0f density samples/chunk\n", WORLD_CHUNKS, chunk_time * 1e3, scalar_chunk * 1e3,
+           100.0 * passes[0] / (chunk_time * WORLD_CHUNKS), 100.0 * passes[1] / (chunk_time * WORLD_CHUNKS),
+           100.0 * passes[2] / (chunk_time * WORLD_CHUNKS), (double)cave_samples / WORLD_CHUNKS);
+    double total = (double)WORLD_CHUNKS * CHUNK_VOLUME;
+    printf("  stone %.1f%%, dirt %.1f%%, grass %.2f%%, sand %.2f%%, water %.1f%%, air %.1f%%, "
+           "same blocks on every backend\n", 100.0 * layers[STONE] / total, 100.0 * layers[DIRT] / total,
+           100.0 * layers[GRASS] / total, 100.0 * layers[SAND] / total, 100.0 * layers[WATER] / total,
+           100.0 * layers[AIR] / total);
+
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        destroy_chunk(chunks[i]);
+        destroy_chunk(reference[i]);
+    }
+    return 0;
+}
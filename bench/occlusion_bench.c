@@ -0,0 +1,239 @@
+#include "../src/world/visibility.h"
+#include "../src/gfx/occlusion.h"
+#include "bench.h"
+#include "terrain.h"
+#include "view.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Software occlusion culling over hills: chunks inside the frustum that the
+// solid octants of nearer chunks hide, and what the occlusion pass costs
+#define WORLD_RADIUS    12
+#define WORLD_HEIGHT    4
+#define WORLD_CHUNKS    ((2 * WORLD_RADIUS) * (2 * WORLD_RADIUS) * WORLD_HEIGHT)
+#define BUFFER_WIDTH    256
+#define BUFFER_HEIGHT   128
+#define VIEWS           16
+#define ROUNDS          10
+#define MAX_THREADS     4
+#define VIEW_DISTANCE   512.0f
+
+
+typedef struct {
+    OcclusionBuffer *buffer;
+    int tiles;
+    atomic_int next;
+} TileJob;
+
+static void *tile_worker(void *arg)
+{
+    TileJob *job = (TileJob *) arg;
+    for (int t = atomic_fetch_add(&job->next, 1); t < job->tiles; t = atomic_fetch_add(&job->next, 1)) {
+        rasterize_occlusion_tile(job->buffer, t);
+    }
+    return NULL;
+}
+
+// Tiles spread over `threads` threads, the caller is one of them
+static void rasterize_threaded(OcclusionBuffer *buffer, int threads)
+{
+    TileJob job = {buffer, bin_occlusion_quads(buffer), 0};
+    pthread_t ids[MAX_THREADS];
+    for (int i = 1; i < threads; i++) {
+        pthread_create(&ids[i], NULL, tile_worker, &job);
+    }
+    tile_worker(&job);
+    for (int i = 1; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+    }
+}
+
+static void chunk_bounds(ChunkCoord c, float min[3], float max[3])
+{
+    for (int a = 0; a < 3; a++) {
+        min[a] = (float)((a == 0 ? c.x : a == 1 ? c.y : c.z) * CHUNK_SIZE);
+        max[a] = min[a] + CHUNK_SIZE;
+    }
+}
+
+// A wall 10 blocks ahead of a camera at the origin looking down -z
+static bool check_occlusion(void)
+{
+    OcclusionBuffer *buffer = create_occlusion_buffer(BUFFER_WIDTH, BUFFER_HEIGHT);
+    float m[4][4];
+    float eye[3] = {0.0f, 0.0f, 0.0f};
+    bench_view_projection(m, eye, -3.14159265f / 2.0f, 0.0f, VIEW_DISTANCE);
+    begin_occlusion_frame(buffer, m);
+    add_occluder_box(buffer, (float[3]){-6.0f, -3.0f, -12.0f}, (float[3]){6.0f, 3.0f, -10.0f});
+    rasterize_occlusion_buffer(buffer);
+
+    static const struct {
+        const char *what;
+        float min[3];
+        float max[3];
+        bool occluded;
+    } cases[] = {
+        {"behind",          {-2.0f, -2.0f, -30.0f}, {2.0f, 2.0f, -26.0f},   true},
+        {"in front",        {-2.0f, -2.0f, -8.0f},  {2.0f, 2.0f, -6.0f},    false},
+        {"inside the wall", {-2.0f, -2.0f, -11.5f}, {2.0f, 2.0f, -10.5f},   false},
+        {"peeking above",   {-2.0f, 2.0f, -60.0f},  {2.0f, 30.0f, -56.0f},  false},
+        {"beside",          {20.0f, -2.0f, -30.0f}, {24.0f, 2.0f, -26.0f},  false},
+        {"around the eye",  {-1.0f, -1.0f, -1.0f},  {1.0f, 1.0f, 1.0f},     false},
+    };
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (is_aabb_occluded(buffer, cases[i].min, cases[i].max) != cases[i].occluded) {
+            fprintf(stderr, "box %s: occluded should be %d\n", cases[i].what, cases[i].occluded);
+            ok = false;
+        }
+    }
+    destroy_occlusion_buffer(buffer);
+
+    Chunk *chunk = create_chunk((ChunkCoord){0, 0, 0});
+    bool octants = compute_chunk_occluders(chunk) == 0;
+    fill_chunk_region(chunk, 0, 0, 0, CHUNK_SIZE, CHUNK_SIZE / 2, CHUNK_SIZE, STONE);
+    octants &= compute_chunk_occluders(chunk) == 0x0F;
+    set_chunk_block(chunk, CHUNK_SIZE - 1, 0, 0, WATER);
+    octants &= compute_chunk_occluders(chunk) == 0x0D;
+    fill_chunk(chunk, DIRT);
+    octants &= compute_chunk_occluders(chunk) == 0xFF;
+    destroy_chunk(chunk);
+    if (!octants) {
+        fprintf(stderr, "occluder octants are wrong\n");
+    }
+    return ok && octants;
+}
+
+int main(void)
+{
+    if (!check_occlusion()) {
+        return 1;
+    }
+
+    Chunk **chunks = (Chunk **) malloc(WORLD_CHUNKS * sizeof(Chunk *));
+    int count = 0;
+    int ground = 0;
+    for (int y = 0; y < WORLD_HEIGHT; y++) {
+        for (int z = -WORLD_RADIUS; z < WORLD_RADIUS; z++) {
+            for (int x = -WORLD_RADIUS; x < WORLD_RADIUS; x++) {
+                Chunk *chunk = create_chunk((ChunkCoord){x, y, z});
+                generate_bench_terrain(chunk->blocks, chunk->coord);
+                carve_bench_caves(chunk->blocks, chunk->coord);
+                update_chunk_heights(chunk);
+                chunk->occluders = compute_chunk_occluders(chunk);
+                // Surface height at the world origin, where the camera stands
+                if (x == 0 && z == 0) {
+                    for (int by = 0; by < CHUNK_SIZE; by++) {
+                        if (is_block_opaque(get_chunk_block(chunk, 0, by, 0))) {
+                            ground = y * CHUNK_SIZE + by + 1;
+                        }
+                    }
+                }
+                chunks[count++] = chunk;
+            }
+        }
+    }
+    int solid = 0;
+    for (int i = 0; i < count; i++) {
+        solid += chunks[i]->occluders == 0xFF;
+    }
+
+    OcclusionBuffer *buffer = create_occlusion_buffer(BUFFER_WIDTH, BUFFER_HEIGHT);
+    AabbList bounds;
+    init_aabb_list(&bounds, count);
+    for (int i = 0; i < count; i++) {
+        float min[3], max[3];
+        chunk_bounds(chunks[i]->coord, min, max);
+        push_aabb(&bounds, min, max);
+    }
+    uint32_t *visible = (uint32_t *) malloc(count * sizeof(uint32_t));
+    printf("occlusion culling, %d chunks (%d solid), %dx%d buffer, %d tiles\n", count, solid,
+           buffer->width, buffer->height, buffer->tiles_x * buffer->tiles_y);
+
+    // Eye height above the ground at the world origin
+    static const float heights[] = {2.0f, 20.0f};
+    for (size_t h = 0; h < sizeof(heights) / sizeof(heights[0]); h++) {
+        float eye[3] = {0.5f, ground + heights[h], 0.5f};
+        uint64_t in_frustum = 0;
+        uint64_t occluded = 0;
+        uint64_t quads = 0;
+        double setup = 0.0, raster = 0.0, test = 0.0;
+
+        for (int v = 0; v < VIEWS; v++) {
+            float m[4][4];
+            Frustum frustum;
+            bench_view_projection(m, eye, v * 2.0f * 3.14159265f / VIEWS, -0.1f, VIEW_DISTANCE);
+            extract_frustum(&frustum, m);
+            uint32_t n = cull_aabbs(&frustum, &bounds, visible);
+
+            for (int r = 0; r < ROUNDS; r++) {
+                double t0 = bench_now();
+                begin_occlusion_frame(buffer, m);
+                for (uint32_t i = 0; i < n; i++) {
+                    float min[3], max[3];
+                    chunk_bounds(chunks[visible[i]]->coord, min, max);
+                    add_octant_occluders(buffer, min, CHUNK_SIZE, chunks[visible[i]]->occluders);
+                }
+                double t1 = bench_now();
+                rasterize_occlusion_buffer(buffer);
+                double t2 = bench_now();
+                uint32_t hidden = 0;
+                for (uint32_t i = 0; i < n; i++) {
+                    float min[3], max[3];
+                    chunk_bounds(chunks[visible[i]]->coord, min, max);
+                    hidden += is_aabb_occluded(buffer, min, max);
+                }
+                double t3 = bench_now();
+                setup += t1 - t0;
+                raster += t2 - t1;
+                test += t3 - t2;
+                if (r == 0) {
+                    in_frustum += n;
+                    occluded += hidden;
+                    quads += buffer->stats.quads;
+                }
+            }
+        }
+        double frames = (double)VIEWS * ROUNDS;
+        printf("  eye %4.0f above ground: %6.1f chunks in the frustum, %6.1f occluded (%4.1f%%), %6.0f quads\n",
+               heights[h], (double)in_frustum / VIEWS, (double)occluded / VIEWS,
+               100.0 * occluded / (double)in_frustum, (double)quads / VIEWS);
+        printf("    occluders %6.1f us, raster + Hi-Z %6.1f us, tests %6.1f us, total %6.1f us/frame\n",
+               setup / frames * 1e6, raster / frames * 1e6, test / frames * 1e6,
+               (setup + raster + test) / frames * 1e6);
+    }
+
+    // Tiles are independent, spread them over threads
+    float eye[3] = {0.5f, ground + 2.0f, 0.5f};
+    float m[4][4];
+    Frustum frustum;
+    bench_view_projection(m, eye, 0.0f, -0.1f, VIEW_DISTANCE);
+    extract_frustum(&frustum, m);
+    uint32_t n = cull_aabbs(&frustum, &bounds, visible);
+    begin_occlusion_frame(buffer, m);
+    for (uint32_t i = 0; i < n; i++) {
+        float min[3], max[3];
+        chunk_bounds(chunks[visible[i]]->coord, min, max);
+        add_octant_occluders(buffer, min, CHUNK_SIZE, chunks[visible[i]]->occluders);
+    }
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        double start = bench_now();
+        for (int r = 0; r < ROUNDS * VIEWS; r++) {
+            rasterize_threaded(buffer, threads);
+        }
+        printf("  %d thread%s raster + Hi-Z %6.1f us/frame\n", threads, threads > 1 ? "s" : " ",
+               (bench_now() - start) / (ROUNDS * VIEWS) * 1e6);
+    }
+
+    free(visible);
+    free_aabb_list(&bounds);
+    destroy_occlusion_buffer(buffer);
+    for (int i = 0; i < count; i++) {
+        destroy_chunk(chunks[i]);
+    }
+    free(chunks);
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "../src/loki.h"
+#include "../src/gfx/gfx.h"
+#include "../src/gfx/program_cache.h"
+#include "../src/gfx/shaders.h"
+#include "bench.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Startup cost of building programs from source against loading their
+// cached binaries. Needs a GL context with program binary formats, e.g.
+//   LIBGL_ALWAYS_SOFTWARE=1 ./bin/program_cache_bench
+#define VARIANTS        16
+
+static const char *vertex_src = "#version 330 core\n"
+    "#define VARIANT %d\n"
+    "layout (location = 0) in uvec2 aPacked;\n"
+    "layout (location = 3) in vec3 aOrigin;\n"
+    "layout (std140) uniform Frame { mat4 view_projection; };\n"
+    "uniform mat4 model;\n"
+    "out vec3 TexCoord;\n"
+    "void main()\n"
+    "{\n"
+    "   uint a = aPacked.x;\n"
+    "   uint b = aPacked.y;\n"
+    "   vec3 pos = vec3(a & 63u, (a >> 6) & 63u, (a >> 12) & 63u);\n"
+    "   gl_Position = view_projection * model * vec4(pos + aOrigin, 1.0);\n"
+    "   TexCoord = vec3(b & 63u, (b >> 6) & 63u, float(VARIANT));\n"
+    "}\n";
+
+static const char *fragment_src = "#version 330 core\n"
+    "in vec3 TexCoord;\n"
+    "out vec4 FragColor;\n"
+    "uniform sampler2DArray Texture;\n"
+    "void main()\n"
+    "{\n"
+    "   vec4 color = texture(Texture, TexCoord);\n"
+    "   if (color.a < 0.5) discard;\n"
+    "   FragColor = color;\n"
+    "}\n";
+
+// Build every variant, false when one fails
+static bool build_variants(unsigned int *programs)
+{
+    char src[2048];
+    for (int v = 0; v < VARIANTS; v++) {
+        snprintf(src, sizeof(src), vertex_src, v);
+        if ((programs[v] = create_cached_shader_program(src, fragment_src)) == 0) {
+            fprintf(stderr, "variant %d: %s\n", v, get_shader_error());
+            return false;
+        }
+    }
+    return true;
+}
+
+static void delete_variants(unsigned int *programs)
+{
+    for (int v = 0; v < VARIANTS; v++) {
+        glDeleteProgram(programs[v]);
+    }
+}
+
+static void remove_directory(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    char file[512];
+    for (struct dirent *e = readdir(dir); e != NULL; e = readdir(dir)) {
+        if (e->d_name[0] != '.') {
+            snprintf(file, sizeof(file), "%s/%s", path, e->d_name);
+            remove(file);
+        }
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+// Overwrite the binary bytes of every cached file
+static void corrupt_directory(const char *path)
+{
+    DIR *dir = opendir(path);
+    char file[512];
+    for (struct dirent *e = readdir(dir); e != NULL; e = readdir(dir)) {
+        if (e->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(file, sizeof(file), "%s/%s", path, e->d_name);
+        FILE *f = fopen(file, "r+b");
+        fseek(f, 64, SEEK_SET);
+        for (int i = 0; i < 256; i++) {
+            fputc(0xA5, f);
+        }
+        fclose(f);
+    }
+    closedir(dir);
+}
+
+int main(void)
+{
+    GLFWwindow *window = bench_gl_context(4, 1, "program cache bench");
+    if (window == NULL) {
+        fprintf(stderr, "no GL 4.1 context\n");
+        glfwTerminate();
+        return 1;
+    }
+
+    char directory[] = "/tmp/program_cache_XXXXXX";
+    if (mkdtemp(directory) == NULL || !init_program_cache(directory)) {
+        fprintf(stderr, "no program cache, the driver may lack binary formats\n");
+        return 1;
+    }
+    printf("program cache, %d variants, %s\n", VARIANTS, (const char *)glGetString(GL_RENDERER));
+
+    static const char *runs[] = {"cold", "warm", "corrupted"};
+    unsigned int programs[VARIANTS];
+    bool ok = true;
+    for (int run = 0; run < 3 && ok; run++) {
+        if (run == 2) {
+            corrupt_directory(directory);
+        }
+        init_program_cache(directory);
+        double start = bench_now();
+        ok = build_variants(programs);
+        double elapsed = bench_now() - start;
+        ProgramCacheStats stats;
+        get_program_cache_stats(&stats);
+        printf("  %-9s %7.2f ms: %2u hits (%.2f ms), %2u compiled (%.2f ms), %2u rejected, %2u stored, "
+               "%.2f ms saved\n", runs[run], elapsed * 1e3, stats.hits, stats.load_time * 1e3, stats.misses,
+               stats.compile_time * 1e3, stats.rejected, stats.stored, stats.saved_time * 1e3);
+        // Cold and corrupted runs compile everything, the warm run nothing
+        uint32_t expected_hits = run == 1 ? VARIANTS : 0;
+        if (ok && (stats.hits != expected_hits || stats.hits + stats.misses != VARIANTS)) {
+            fprintf(stderr, "%s run: expected %u hits\n", runs[run], expected_hits);
+            ok = false;
+        }
+        // Loaded programs must be usable like linked ones
+        for (int v = 0; v < VARIANTS && ok; v++) {
+            ok = glGetUniformBlockIndex(programs[v], "Frame") != GL_INVALID_INDEX &&
+                 glGetUniformLocation(programs[v], "model") >= 0;
+        }
+        if (ok) {
+            delete_variants(programs);
+        }
+    }
+    remove_directory(directory);
+    glfwTerminate();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+#include "../src/loki.h"
+#include "../src/gfx/gfx.h"
+#include "../src/gfx/renderer.h"
+#include "../src/gfx/shaders.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Render queue ordering and the binds the state cache saves. Needs a GL
+// context, e.g. Mesa llvmpipe:
+//   LIBGL_ALWAYS_SOFTWARE=1 ./bin/render_queue_bench
+// The items draw nothing, the numbers are sorting and bind overhead.
+#define ITEMS           4096
+#define PROGRAMS        8
+#define TEXTURES        8
+#define VAOS            16
+#define FRAMES          100
+
+static const char *vertex_src = "#version 330 core\n"
+    "void main()\n"
+    "{\n"
+    "   gl_Position = vec4(0.0);\n"
+    "}\0";
+
+static const char *fragment_src = "#version 330 core\n"
+    "out vec4 FragColor;\n"
+    "void main()\n"
+    "{\n"
+    "   FragColor = vec4(1.0);\n"
+    "}\0";
+
+typedef struct {
+    uint64_t *keys;
+    uint32_t count;
+} DrawLog;
+
+typedef struct {
+    DrawLog *log;
+    uint64_t key;
+} BenchItem;
+
+static uint32_t log_draw(void *data)
+{
+    BenchItem *item = (BenchItem *) data;
+    if (item->log != NULL) {
+        item->log->keys[item->log->count++] = item->key;
+    }
+    return 1;
+}
+
+static void fill_queue(RenderQueue *queue, RenderItem *items, int count)
+{
+    for (int i = 0; i < count; i++) {
+        push_render_item(queue, &items[i]);
+    }
+}
+
+int main(void)
+{
+    GLFWwindow *window = bench_gl_context(3, 3, "render queue bench");
+    if (window == NULL) {
+        fprintf(stderr, "no GL 3.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+
+    unsigned int programs[PROGRAMS];
+    unsigned int textures[TEXTURES];
+    unsigned int vaos[VAOS];
+    for (int i = 0; i < PROGRAMS; i++) {
+        if ((programs[i] = create_shader_program(vertex_src, fragment_src)) == 0) {
+            fprintf(stderr, "shader: %s\n", get_shader_error());
+            return 1;
+        }
+    }
+    glGenTextures(TEXTURES, textures);
+    for (int i = 0; i < TEXTURES; i++) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i]);
+    }
+    glGenVertexArrays(VAOS, vaos);
+    reset_gl_state_cache();
+
+    // Random state and depth, a quarter of the items translucent
+    static RenderItem items[ITEMS];
+    static BenchItem bench_items[ITEMS];
+    DrawLog log = {(uint64_t *) malloc(ITEMS * sizeof(uint64_t)), 0};
+    uint64_t seed = 0x5047;
+    for (int i = 0; i < ITEMS; i++) {
+        uint64_t r = bench_rand(&seed);
+        RenderPass pass = (r & 3) == 0 ? RENDER_PASS_TRANSLUCENT : RENDER_PASS_OPAQUE;
+        unsigned int program = programs[(r >> 8) % PROGRAMS];
+        unsigned int texture = textures[(r >> 16) % TEXTURES];
+        unsigned int vao = vaos[(r >> 24) % VAOS];
+        float depth = (float)((r >> 32) % 100000) * 0.01f;
+        bench_items[i] = (BenchItem){&log, make_render_key(pass, program, texture, vao, depth)};
+        items[i] = (RenderItem){bench_items[i].key, program, GL_TEXTURE_2D_ARRAY, texture, vao,
+                                log_draw, &bench_items[i]};
+    }
+
+    // Submission order follows the keys: passes in order, state grouped,
+    // opaque depth ascending within a state and translucent descending
+    RenderQueue queue;
+    init_render_queue(&queue);
+    fill_queue(&queue, items, ITEMS);
+    submit_render_queue(&queue);
+    bool ok = log.count == ITEMS;
+    for (uint32_t i = 1; i < log.count && ok; i++) {
+        ok = log.keys[i - 1] <= log.keys[i];
+    }
+    uint64_t near = make_render_key(RENDER_PASS_TRANSLUCENT, 1, 1, 1, 1.0f);
+    uint64_t far = make_render_key(RENDER_PASS_TRANSLUCENT, 1, 1, 1, 50.0f);
+    ok &= far < near;
+    ok &= make_render_key(RENDER_PASS_OPAQUE, 1, 1, 1, 1.0f) < make_render_key(RENDER_PASS_OPAQUE, 1, 1, 1, 50.0f);
+    ok &= make_render_key(RENDER_PASS_OPAQUE, 2, 1, 1, 0.0f) > make_render_key(RENDER_PASS_OPAQUE, 1, 9, 9, 1e9f);
+    if (!ok) {
+        fprintf(stderr, "render queue order is wrong\n");
+        return 1;
+    }
+    for (int i = 0; i < ITEMS; i++) {
+        bench_items[i].log = NULL;
+    }
+    printf("render queue, %d items over %d programs, %d textures, %d VAOs, %s\n", ITEMS, PROGRAMS,
+           TEXTURES, VAOS, (const char *)glGetString(GL_RENDERER));
+
+    // Unsorted: the same items bound in push order through the cache
+    RenderStats stats;
+    double start = bench_now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        begin_render_frame();
+        for (int i = 0; i < ITEMS; i++) {
+            use_program(items[i].program);
+            bind_texture(0, items[i].texture_target, items[i].texture);
+            bind_vertex_array(items[i].vao);
+            items[i].draw(items[i].data);
+        }
+    }
+    double unsorted = (bench_now() - start) / FRAMES;
+    begin_render_frame();
+    get_render_stats(&stats);
+    printf("  push order      %6u state changes, %6u binds skipped, %7.3f ms/frame\n",
+           stats.state_changes, stats.binds_skipped, unsorted * 1e3);
+
+    start = bench_now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        begin_render_frame();
+        fill_queue(&queue, items, ITEMS);
+        submit_render_queue(&queue);
+    }
+    double sorted = (bench_now() - start) / FRAMES;
+    begin_render_frame();
+    get_render_stats(&stats);
+    printf("  sorted queue    %6u state changes, %6u binds skipped, %7.3f ms/frame (sort included)\n",
+           stats.state_changes, stats.binds_skipped, sorted * 1e3);
+
+    free_render_queue(&queue);
+    free(log.keys);
+    glDeleteVertexArrays(VAOS, vaos);
+    glDeleteTextures(TEXTURES, textures);
+    for (int i = 0; i < PROGRAMS; i++) {
+        glDeleteProgram(programs[i]);
+    }
+    glfwTerminate();
+    return 0;
+}
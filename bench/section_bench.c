@@ -0,0 +1,195 @@
+#include "../src/world/section.h"
+#include "../src/world/worldgen.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SEA_LEVEL           64
+#define RENDER_DISTANCE     8
+#define COLUMN_CHUNKS       8       // 256 blocks of world height
+#define EDIT_ROUNDS         200000
+#define KERNEL_ROUNDS       2000
+
+
+// Random edits against a dense copy, the palette has to grow and shrink
+static int check_edits(void)
+{
+    static BlockId reference[CHUNK_VOLUME];
+    static BlockId unpacked[CHUNK_VOLUME];
+    ChunkSection section;
+    uint64_t seed = 0x5ec7;
+
+    init_section(&section, AIR);
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        reference[i] = AIR;
+    }
+    for (int round = 0; round < EDIT_ROUNDS; round++) {
+        // Few types early, then many, then back to few
+        int types = round < EDIT_ROUNDS / 3 ? 2 : (round < 2 * EDIT_ROUNDS / 3 ? 200 : 3);
+        int index = (int)(bench_rand(&seed) % CHUNK_VOLUME);
+        BlockId block = (BlockId)(bench_rand(&seed) % types);
+        set_section_block(&section, index, block);
+        reference[index] = block;
+        if (get_section_block(&section, index) != block) {
+            fprintf(stderr, "edit %d: read back mismatch\n", round);
+            return 1;
+        }
+    }
+    unpack_section(&section, unpacked);
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        if (unpacked[i] != reference[i]) {
+            fprintf(stderr, "edits: block %d mismatch\n", i);
+            return 1;
+        }
+    }
+    printf("  edits verified, final width %d bits, %d palette entries\n", section.bits, section.live);
+
+    // Placing and breaking a type unique to the section must not repack it
+    // each time: air and stone at 1 bit, dirt comes and goes at 0
+    ChunkSection edited;
+    init_section(&edited, AIR);
+    set_section_block(&edited, 1, STONE);
+    set_section_block(&edited, 0, DIRT);
+    int bits = edited.bits;
+    for (int round = 0; round < 1000; round++) {
+        set_section_block(&edited, 0, AIR);
+        set_section_block(&edited, 0, DIRT);
+        if (edited.bits != bits) {
+            fprintf(stderr, "edits: a place and break changed the width from %d to %d bits\n", bits, edited.bits);
+            return 1;
+        }
+    }
+    // Compacting narrows to what the live types need
+    set_section_block(&edited, 0, AIR);
+    if (!compact_section(&edited) || edited.bits != 1 || get_section_block(&edited, 1) != STONE) {
+        fprintf(stderr, "edits: compacting left %d bits\n", edited.bits);
+        return 1;
+    }
+    printf("  place and break kept %d bits, compacted to %d\n", bits, edited.bits);
+    free_section(&edited);
+
+    // Clearing everything has to collapse back to a uniform section
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        set_section_block(&section, i, STONE);
+    }
+    if (section.bits != 0 || section.data != NULL) {
+        fprintf(stderr, "edits: section did not collapse to uniform\n");
+        return 1;
+    }
+    free_section(&section);
+    return 0;
+}
+
+static void bench_kernels(int types)
+{
+    static BlockId blocks[CHUNK_VOLUME];
+    static BlockId unpacked[CHUNK_VOLUME];
+    ChunkSection section;
+    uint64_t seed = types;
+
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        blocks[i] = (BlockId)(bench_rand(&seed) % types);
+    }
+    init_section(&section, AIR);
+
+    double start = bench_now();
+    for (int r = 0; r < KERNEL_ROUNDS; r++) {
+        pack_section(&section, blocks);
+    }
+    double pack_time = bench_now() - start;
+
+    start = bench_now();
+    for (int r = 0; r < KERNEL_ROUNDS; r++) {
+        unpack_section(&section, unpacked);
+        bench_consume(unpacked[r & (CHUNK_VOLUME - 1)]);
+    }
+    double unpack_time = bench_now() - start;
+
+    double blocks_done = (double)KERNEL_ROUNDS * CHUNK_VOLUME;
+    printf("  %3d types, %d bits: pack %7.1f us/chunk (%6.0f M blocks/s), unpack %6.1f us/chunk (%6.0f M blocks/s)\n",
+           types, section.bits,
+           pack_time / KERNEL_ROUNDS * 1e6, blocks_done / pack_time * 1e-6,
+           unpack_time / KERNEL_ROUNDS * 1e6, blocks_done / unpack_time * 1e-6);
+    free_section(&section);
+}
+
+int main(void)
+{
+    static BlockId unpacked[CHUNK_VOLUME];
+
+    printf("palette sections\n");
+    if (check_edits() != 0) {
+        return 1;
+    }
+
+    WorldGen gen;
+    WorldGenDesc desc = {
+        .seed = 0x10C1,
+        .sea_level = SEA_LEVEL,
+        .land_height = SEA_LEVEL + 4.0f,
+        .land_range = 24.0f,
+        .mountain_height = 40.0f,
+        .soil_depth = 3,
+        .cave_threshold = 0.45f,
+        .cave_roof = 6,
+        .cave_step = 4,
+    };
+    Chunk *chunk = create_chunk((ChunkCoord){0, 0, 0});
+    if (!init_world_gen(&gen, &desc) || chunk == NULL) {
+        fprintf(stderr, "bad world generator\n");
+        return 1;
+    }
+
+    // Generated chunks inside the render distance, blocks[] against a
+    // section alone and the whole chunk as if it held a section instead
+    size_t dense_blocks = 0;
+    size_t packed_blocks = 0;
+    int chunks = 0;
+    int by_bits[17] = {0};
+    for (int cz = -RENDER_DISTANCE; cz <= RENDER_DISTANCE; cz++) {
+        for (int cx = -RENDER_DISTANCE; cx <= RENDER_DISTANCE; cx++) {
+            for (int cy = 0; cy < COLUMN_CHUNKS; cy++) {
+                ChunkSection section;
+                chunk->coord = (ChunkCoord){cx, cy, cz};
+                generate_chunk_terrain(&gen, chunk);
+                init_section(&section, AIR);
+                if (!pack_section(&section, chunk->blocks)) {
+                    fprintf(stderr, "out of memory\n");
+                    return 1;
+                }
+                // Spot check the round trip
+                if ((cx & 3) == 0 && (cz & 3) == 0) {
+                    unpack_section(&section, unpacked);
+                    for (int i = 0; i < CHUNK_VOLUME; i++) {
+                        if (unpacked[i] != chunk->blocks[i]) {
+                            fprintf(stderr, "round trip mismatch in chunk %d %d %d\n", cx, cy, cz);
+                            return 1;
+                        }
+                    }
+                }
+                dense_blocks += sizeof(chunk->blocks);
+                packed_blocks += section_memory_usage(&section);
+                by_bits[section.bits]++;
+                chunks++;
+                free_section(&section);
+            }
+        }
+    }
+    destroy_chunk(chunk);
+    size_t rest = (size_t)chunks * (sizeof(Chunk) - sizeof(((Chunk *)0)->blocks));
+    printf("  render distance %d: %d generated chunks\n", RENDER_DISTANCE, chunks);
+    printf("    blocks      dense %7.1f MiB, palette %7.1f MiB (%.1fx smaller)\n", dense_blocks / 1048576.0,
+           packed_blocks / 1048576.0, (double)dense_blocks / packed_blocks);
+    printf("    whole chunk dense %7.1f MiB, palette %7.1f MiB (%.1fx smaller), light and heights stay dense\n",
+           (dense_blocks + rest) / 1048576.0, (packed_blocks + rest) / 1048576.0,
+           (double)(dense_blocks + rest) / (packed_blocks + rest));
+    printf("  sections by width: 0b %d, 1b %d, 2b %d, 4b %d, 8b %d\n",
+           by_bits[0], by_bits[1], by_bits[2], by_bits[4], by_bits[8]);
+
+    bench_kernels(2);
+    bench_kernels(4);
+    bench_kernels(16);
+    bench_kernels(200);
+    return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef _BENCH_TERRAIN_H_
+#define _BENCH_TERRAIN_H_
+
+#include "../src/world/chunk.h"
+#include <math.h>
+
+#define BENCH_SEA_LEVEL 64
+
+// Rolling hills used by the benchmarks: stone, a few blocks of dirt, grass
+// or sand on top and water up to sea level
+static inline void generate_bench_terrain(BlockId *blocks, ChunkCoord coord)
+{
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            float wx = (float)(coord.x * CHUNK_SIZE + x);
+            float wz = (float)(coord.z * CHUNK_SIZE + z);
+            int height = BENCH_SEA_LEVEL + (int)(12.0f * sinf(wx * 0.05f) + 9.0f * cosf(wz * 0.07f)
+                                                 + 4.0f * sinf((wx + wz) * 0.13f));
+            for (int y = 0; y < CHUNK_SIZE; y++) {
+                int wy = coord.y * CHUNK_SIZE + y;
+                VoxelType type = AIR;
+                if (wy < height - 4) {
+                    type = STONE;
+                } else if (wy < height) {
+                    type = DIRT;
+                } else if (wy == height) {
+                    type = height <= BENCH_SEA_LEVEL + 1 ? SAND : GRASS;
+                } else if (wy <= BENCH_SEA_LEVEL) {
+                    type = WATER;
+                }
+                blocks[CHUNK_INDEX(x, y, z)] = (BlockId)type;
+            }
+        }
+    }
+}
+
+// Two crossing sine sheets, tunnels run where both are close to zero
+static inline bool is_bench_cave(int wx, int wy, int wz)
+{
+    float a = sinf(wx * 0.061f + 1.7f * cosf(wz * 0.029f)) + sinf(wy * 0.083f + wz * 0.041f);
+    float b = cosf(wz * 0.057f + 1.3f * sinf(wx * 0.037f)) + sinf(wy * 0.071f - wx * 0.023f);
+    return fabsf(a) < 0.16f && fabsf(b) < 0.35f;
+}
+
+// Tunnels through the stone well below the surface
+static inline void carve_bench_caves(BlockId *blocks, ChunkCoord coord)
+{
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        int wy = coord.y * CHUNK_SIZE + y;
+        if (wy <= 2 || wy >= BENCH_SEA_LEVEL - 12) {
+            continue;
+        }
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                if (is_bench_cave(coord.x * CHUNK_SIZE + x, wy, coord.z * CHUNK_SIZE + z)) {
+                    blocks[CHUNK_INDEX(x, y, z)] = (BlockId)AIR;
+                }
+            }
+        }
+    }
+}
+
+#endif // _BENCH_TERRAIN_H_
@@ -0,0 +1,56 @@
+#ifndef _BENCH_VIEW_H_
+#define _BENCH_VIEW_H_
+
+#include <math.h>
+
+// Column major view projection, the layout cglm produces, of a camera at
+// `eye` looking along (cos yaw, pitch, sin yaw), 70 degree fov, 16:9
+static inline void bench_view_projection(float m[4][4], const float eye[3], float yaw, float pitch, float far)
+{
+    float fov = 70.0f * 3.14159265f / 180.0f;
+    float aspect = 16.0f / 9.0f;
+    float near = 0.1f;
+    float f = 1.0f / tanf(fov / 2.0f);
+
+    float proj[4][4] = {{0}};
+    proj[0][0] = f / aspect;
+    proj[1][1] = f;
+    proj[2][2] = (far + near) / (near - far);
+    proj[2][3] = -1.0f;
+    proj[3][2] = 2.0f * far * near / (near - far);
+
+    float fwd[3] = {cosf(yaw), pitch, sinf(yaw)};
+    float len = sqrtf(fwd[0] * fwd[0] + fwd[1] * fwd[1] + fwd[2] * fwd[2]);
+    for (int i = 0; i < 3; i++) fwd[i] /= len;
+    float right[3] = {-fwd[2], 0.0f, fwd[0]};
+    len = sqrtf(right[0] * right[0] + right[2] * right[2]);
+    right[0] /= len;
+    right[2] /= len;
+    float up[3] = {
+        right[1] * fwd[2] - right[2] * fwd[1],
+        right[2] * fwd[0] - right[0] * fwd[2],
+        right[0] * fwd[1] - right[1] * fwd[0],
+    };
+
+    float view[4][4] = {{0}};
+    for (int i = 0; i < 3; i++) {
+        view[i][0] = right[i];
+        view[i][1] = up[i];
+        view[i][2] = -fwd[i];
+    }
+    view[3][0] = -(right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2]);
+    view[3][1] = -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2]);
+    view[3][2] = fwd[0] * eye[0] + fwd[1] * eye[1] + fwd[2] * eye[2];
+    view[3][3] = 1.0f;
+
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            m[c][r] = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                m[c][r] += proj[k][r] * view[c][k];
+            }
+        }
+    }
+}
+
+#endif // _BENCH_VIEW_H_
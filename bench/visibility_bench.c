@@ -0,0 +1,188 @@
+#include "../src/world/visibility.h"
+#include "bench.h"
+#include "terrain.h"
+#include "view.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Cave culling on rolling hills with tunnels carved through the stone: the
+// cost of the per chunk flood fill and of the per frame walk, and how many
+// chunks the walk removes on top of frustum culling
+#define WORLD_RADIUS    8           // chunks in x and z around the origin
+#define WORLD_HEIGHT    8           // chunks in y
+#define WORLD_CHUNKS    ((2 * WORLD_RADIUS) * (2 * WORLD_RADIUS) * WORLD_HEIGHT)
+#define VIEWS           16
+#define WALK_ROUNDS     50
+#define VIEW_DISTANCE   256.0f
+
+
+static Chunk *generate_chunk(ChunkCoord coord)
+{
+    Chunk *chunk = create_chunk(coord);
+    generate_bench_terrain(chunk->blocks, coord);
+    carve_bench_caves(chunk->blocks, coord);
+    update_chunk_heights(chunk);
+    return chunk;
+}
+
+static bool check(const char *what, uint16_t got, uint16_t expected)
+{
+    if (got != expected) {
+        fprintf(stderr, "%s: visibility %04x, expected %04x\n", what, got, expected);
+        return false;
+    }
+    return true;
+}
+
+// Hand made chunks with a known answer
+static bool check_visibility(void)
+{
+    Chunk *chunk = create_chunk((ChunkCoord){0, 0, 0});
+    bool ok = check("air", compute_chunk_visibility(chunk), CHUNK_VISIBILITY_ALL);
+
+    fill_chunk(chunk, STONE);
+    ok &= check("stone", compute_chunk_visibility(chunk), 0);
+
+    // Straight tunnel along x
+    fill_chunk_region(chunk, 0, 10, 10, CHUNK_SIZE, 12, 12, AIR);
+    ok &= check("tunnel", compute_chunk_visibility(chunk), visibility_pair_bit(NEIGHBOR_NEG_X, NEIGHBOR_POS_X));
+
+    // Turn it up into a shaft to the top face
+    fill_chunk_region(chunk, 20, 10, 10, 22, CHUNK_SIZE, 12, AIR);
+    ok &= check("shaft", compute_chunk_visibility(chunk),
+                visibility_pair_bit(NEIGHBOR_NEG_X, NEIGHBOR_POS_X) | visibility_pair_bit(NEIGHBOR_NEG_X, NEIGHBOR_POS_Y)
+                | visibility_pair_bit(NEIGHBOR_POS_X, NEIGHBOR_POS_Y));
+
+    // A sealed pocket joins nothing, water does not block
+    fill_chunk(chunk, STONE);
+    fill_chunk_region(chunk, 8, 8, 8, 16, 16, 16, AIR);
+    ok &= check("pocket", compute_chunk_visibility(chunk), 0);
+    fill_chunk_region(chunk, 0, 4, 4, CHUNK_SIZE, 6, 6, WATER);
+    ok &= check("water", compute_chunk_visibility(chunk), visibility_pair_bit(NEIGHBOR_NEG_X, NEIGHBOR_POS_X));
+
+    destroy_chunk(chunk);
+    return ok;
+}
+
+// Frustum culling alone against frustum plus cave culling, over VIEWS yaws
+static bool run_scene(const char *name, ChunkMap *map, Chunk **chunks, const float eye[3], float pitch)
+{
+    AabbList bounds;
+    init_aabb_list(&bounds, WORLD_CHUNKS);
+    for (int i = 0; i < WORLD_CHUNKS; i++) {
+        ChunkCoord c = chunks[i]->coord;
+        float min[3] = {(float)(c.x * CHUNK_SIZE), (float)(c.y * CHUNK_SIZE), (float)(c.z * CHUNK_SIZE)};
+        float max[3] = {min[0] + CHUNK_SIZE, min[1] + CHUNK_SIZE, min[2] + CHUNK_SIZE};
+        push_aabb(&bounds, min, max);
+    }
+    uint32_t *visible = (uint32_t *) malloc(WORLD_CHUNKS * sizeof(uint32_t));
+    ChunkTraversal traversal;
+    init_chunk_traversal(&traversal);
+
+    uint64_t frustum_total = 0;
+    uint64_t cave_total = 0;
+    double walk_time = 0.0;
+    for (int v = 0; v < VIEWS; v++) {
+        float m[4][4];
+        Frustum frustum;
+        bench_view_projection(m, eye, v * 2.0f * 3.14159265f / VIEWS, pitch, VIEW_DISTANCE);
+        extract_frustum(&frustum, m);
+
+        uint32_t in_frustum = cull_aabbs(&frustum, &bounds, visible);
+        int32_t reached = 0;
+        double start = bench_now();
+        for (int r = 0; r < WALK_ROUNDS; r++) {
+            reached = traverse_visible_chunks(&traversal, map, eye, &frustum);
+        }
+        walk_time += bench_now() - start;
+
+        if (reached < 1) {
+            fprintf(stderr, "%s: camera chunk not found\n", name);
+            return false;
+        }
+        // Apart from the camera chunk, everything reached passed the frustum
+        for (int32_t s = 1; s < reached; s++) {
+            ChunkCoord c = traversal.steps[s].chunk->coord;
+            float min[3] = {(float)(c.x * CHUNK_SIZE), (float)(c.y * CHUNK_SIZE), (float)(c.z * CHUNK_SIZE)};
+            float max[3] = {min[0] + CHUNK_SIZE, min[1] + CHUNK_SIZE, min[2] + CHUNK_SIZE};
+            if (!is_aabb_in_frustum(&frustum, min, max)) {
+                fprintf(stderr, "%s: walk reached a chunk outside the frustum\n", name);
+                return false;
+            }
+        }
+        frustum_total += in_frustum;
+        cave_total += (uint64_t)reached;
+    }
+
+    printf("  %-12s frustum %6.1f chunks, cave culled %6.1f (-%4.1f%%), walk %7.1f us\n", name,
+           (double)frustum_total / VIEWS, (double)cave_total / VIEWS,
+           100.0 * (1.0 - (double)cave_total / (double)frustum_total),
+           walk_time / (VIEWS * WALK_ROUNDS) * 1e6);
+
+    free_chunk_traversal(&traversal);
+    free(visible);
+    free_aabb_list(&bounds);
+    return true;
+}
+
+int main(void)
+{
+    if (!check_visibility()) {
+        return 1;
+    }
+
+    ChunkMap *map = create_chunk_map(WORLD_CHUNKS);
+    Chunk **chunks = (Chunk **) malloc(WORLD_CHUNKS * sizeof(Chunk *));
+    int count = 0;
+    for (int y = 0; y < WORLD_HEIGHT; y++) {
+        for (int z = -WORLD_RADIUS; z < WORLD_RADIUS; z++) {
+            for (int x = -WORLD_RADIUS; x < WORLD_RADIUS; x++) {
+                chunks[count] = generate_chunk((ChunkCoord){x, y, z});
+                insert_chunk(map, chunks[count++]);
+            }
+        }
+    }
+
+    // What the mesh workers add per chunk
+    double start = bench_now();
+    for (int i = 0; i < count; i++) {
+        chunks[i]->visibility = compute_chunk_visibility(chunks[i]);
+    }
+    double elapsed = bench_now() - start;
+    int sealed = 0;
+    for (int i = 0; i < count; i++) {
+        sealed += chunks[i]->visibility == 0;
+    }
+    printf("cave culling, %d chunks, %d with no connected faces\n", count, sealed);
+    printf("  flood fill %7.1f us/chunk\n", elapsed / count * 1e6);
+
+    // Underground: the first cave block below the middle of the world
+    float cave_eye[3] = {0};
+    bool found = false;
+    for (int r = 0; r < WORLD_RADIUS * CHUNK_SIZE && !found; r++) {
+        for (int wy = 24; wy < 40 && !found; wy++) {
+            if (is_bench_cave(r, wy, r)) {
+                cave_eye[0] = r + 0.5f;
+                cave_eye[1] = wy + 0.5f;
+                cave_eye[2] = r + 0.5f;
+                found = true;
+            }
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "no cave to put the camera in\n");
+        return 1;
+    }
+    float surface_eye[3] = {0.5f, BENCH_SEA_LEVEL + 30.0f, 0.5f};
+
+    bool ok = run_scene("in a cave", map, chunks, cave_eye, 0.0f)
+           && run_scene("on hills", map, chunks, surface_eye, -0.3f);
+
+    for (int i = 0; i < count; i++) {
+        destroy_chunk(chunks[i]);
+    }
+    free(chunks);
+    destroy_chunk_map(map);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#version 330 core
+// Chunk faces sampling the block texture array, darkened by the baked
+// voxel light. FOG fades to the fog colour of the Frame block, ALPHA_TEST
+// (a threshold) discards cut out texels.
+
+in vec3 TexCoord;
+in vec3 Normal;
+in vec2 Light;
+out vec4 FragColor;
+
+uniform sampler2DArray Texture;
+
+void main()
+{
+    vec4 color = texture(Texture, TexCoord);
+#ifdef ALPHA_TEST
+    if (color.a < ALPHA_TEST) {
+        discard;
+    }
+#endif
+    // Every light level a fifth darker than the one above, never pitch black
+    float level = max(Light.x * daylight, Light.y);
+    color.rgb *= mix(0.05, 1.0, pow(0.8, 15.0 * (1.0 - level)));
+#ifdef FOG
+    // Linear over the view depth, 1 / w of the fragment
+    float fog = clamp((1.0 / gl_FragCoord.w - fog_start) / (fog_end - fog_start), 0.0, 1.0);
+    color.rgb = mix(color.rgb, fog_color.rgb, fog);
+#endif
+    FragColor = color;
+}
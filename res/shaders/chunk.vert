@@ -0,0 +1,44 @@
+#version 330 core
+// Chunk meshes: PackedVertex with PACKED_VERTICES, Vertex without. The
+// Frame uniform block comes in after the defines (FRAME_UNIFORMS_GLSL).
+
+#ifdef PACKED_VERTICES
+layout (location = 0) in uvec2 aPacked;
+#else
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aTexCoord;
+layout (location = 2) in vec3 aNormal;
+layout (location = 4) in vec2 aLight;
+#endif
+layout (location = 3) in vec3 aOrigin;
+
+out vec3 TexCoord;
+out vec3 Normal;
+out vec2 Light;                 // sky and block light in [0, 1]
+
+uniform mat4 model;
+
+#ifdef PACKED_VERTICES
+const vec3 normals[6] = vec3[6](
+    vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+    vec3(0.0, -1.0, 0.0), vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0));
+#endif
+
+void main()
+{
+#ifdef PACKED_VERTICES
+    uint a = aPacked.x;
+    uint b = aPacked.y;
+    vec3 pos = vec3(a & 63u, (a >> 6) & 63u, (a >> 12) & 63u);
+    TexCoord = vec3(b & 63u, (b >> 6) & 63u, (b >> 12) & 255u);
+    Normal = normals[(a >> 18) & 7u];
+    Light = vec2((b >> 24) & 15u, (b >> 20) & 15u) / 15.0;
+#else
+    vec3 pos = aPos;
+    TexCoord = aTexCoord;
+    Normal = aNormal;
+    Light = aLight / 15.0;
+#endif
+    gl_Position = view_projection * model * vec4(pos + aOrigin, 1.0);
+}
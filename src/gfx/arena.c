@@ -0,0 +1,340 @@
+#include "arena.h"
+#include "gfx.h"
+#include "renderer.h"
+#include "../util/log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static uint32_t vertex_size(VertexFormat format)
+{
+    return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+static ArenaPage *add_page(VertexArena *arena, uint32_t quads)
+{
+    ArenaPage *pages = (ArenaPage *) realloc(arena->pages, (arena->page_count + 1) * sizeof(ArenaPage));
+    if (pages == NULL) {
+        return NULL;
+    }
+    arena->pages = pages;
+
+    ArenaPage *page = &pages[arena->page_count];
+    memset(page, 0, sizeof(ArenaPage));
+    if (!init_range_allocator(&page->ranges, quads)) {
+        return NULL;
+    }
+
+    glGenBuffers(1, &page->vbo);
+    glGenVertexArrays(1, &page->vao);
+    bind_vertex_array(page->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, page->vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)quads * arena->quad_bytes, NULL, GL_DYNAMIC_DRAW);
+    set_chunk_vertex_layout(arena->format);
+    // One origin per draw, picked by the command's base_instance
+    glBindBuffer(GL_ARRAY_BUFFER, arena->origin_buffer);
+    glVertexAttribPointer(CHUNK_ORIGIN_ATTRIB, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glVertexAttribDivisor(CHUNK_ORIGIN_ATTRIB, 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->index_buffer);
+    bind_vertex_array(0);
+
+    arena->page_count++;
+    DEBUG("Vertex arena (format %d): page %u, %.1f MiB\n",
+          arena->format, arena->page_count - 1, (double)quads * arena->quad_bytes / 1048576.0);
+    return page;
+}
+
+static bool track_alloc(ArenaPage *page, ArenaAlloc *alloc)
+{
+    if (page->live_count == page->live_capacity) {
+        uint32_t capacity = page->live_capacity ? page->live_capacity * 2 : 64;
+        ArenaAlloc **live = (ArenaAlloc **) realloc(page->live, capacity * sizeof(ArenaAlloc *));
+        if (live == NULL) {
+            return false;
+        }
+        page->live = live;
+        page->live_capacity = capacity;
+    }
+    alloc->slot = page->live_count;
+    page->live[page->live_count++] = alloc;
+    return true;
+}
+
+static void untrack_alloc(ArenaPage *page, ArenaAlloc *alloc)
+{
+    ArenaAlloc *last = page->live[--page->live_count];
+    page->live[alloc->slot] = last;
+    last->slot = alloc->slot;
+}
+
+
+VertexArena *create_vertex_arena(VertexFormat format, unsigned int index_buffer)
+{
+    VertexArena *arena = (VertexArena *) calloc(1, sizeof(VertexArena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->format = format;
+    arena->quad_bytes = 4 * vertex_size(format);
+    arena->page_quads = ARENA_PAGE_SIZE / arena->quad_bytes;
+    arena->index_buffer = index_buffer;
+    glGenBuffers(1, &arena->origin_buffer);
+    glGenBuffers(1, &arena->indirect_buffer);
+    return arena;
+}
+
+void destroy_vertex_arena(VertexArena *arena)
+{
+    for (uint32_t p = 0; p < arena->page_count; p++) {
+        ArenaPage *page = &arena->pages[p];
+        // Owners keep their records, mark them empty
+        for (uint32_t i = 0; i < page->live_count; i++) {
+            init_arena_alloc(page->live[i]);
+        }
+        glDeleteVertexArrays(1, &page->vao);
+        glDeleteBuffers(1, &page->vbo);
+        free_range_allocator(&page->ranges);
+        free(page->live);
+        free(page->commands);
+    }
+    glDeleteBuffers(1, &arena->origin_buffer);
+    glDeleteBuffers(1, &arena->indirect_buffer);
+    // A deleted VAO that was bound leaves 0 bound
+    reset_gl_state_cache();
+    free(arena->origins);
+    free(arena->pages);
+    free(arena);
+}
+
+void release_arena_mesh(VertexArena *arena, ArenaAlloc *alloc)
+{
+    if (alloc->page < 0) {
+        return;
+    }
+    ArenaPage *page = &arena->pages[alloc->page];
+    untrack_alloc(page, alloc);
+    if (!release_range(&page->ranges, alloc->offset, alloc->quads)) {
+        ERROR("Vertex arena lost %u quads of page %d, free list full\n", alloc->quads, alloc->page);
+    }
+    init_arena_alloc(alloc);
+    arena->revision++;
+}
+
+bool upload_arena_mesh(VertexArena *arena, ArenaAlloc *alloc, const void *vertices, uint32_t quads)
+{
+    release_arena_mesh(arena, alloc);
+    if (quads == 0) {
+        return true;
+    }
+
+    // First page with room, or a new one big enough
+    uint32_t offset = 0;
+    uint32_t p = 0;
+    while (p < arena->page_count && !alloc_range(&arena->pages[p].ranges, quads, &offset)) {
+        p++;
+    }
+    if (p == arena->page_count) {
+        uint32_t size = quads > arena->page_quads ? quads : arena->page_quads;
+        if (add_page(arena, size) == NULL || !alloc_range(&arena->pages[p].ranges, quads, &offset)) {
+            ERROR("Vertex arena out of memory for %u quads\n", quads);
+            return false;
+        }
+    }
+
+    ArenaPage *page = &arena->pages[p];
+    if (!track_alloc(page, alloc)) {
+        ERROR("Vertex arena out of memory tracking %u quads\n", quads);
+        if (!release_range(&page->ranges, offset, quads)) {
+            ERROR("Vertex arena lost %u quads of page %u, free list full\n", quads, p);
+        }
+        return false;
+    }
+    alloc->page = (int32_t)p;
+    alloc->offset = offset;
+    alloc->quads = quads;
+    arena->revision++;
+
+    GLsizeiptr bytes = (GLsizeiptr)quads * arena->quad_bytes;
+    glBindBuffer(GL_ARRAY_BUFFER, page->vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)offset * arena->quad_bytes, bytes, vertices);
+    arena->uploaded += bytes;
+    return true;
+}
+
+bool add_arena_draw(VertexArena *arena, const ArenaAlloc *alloc, const float origin[3])
+{
+    if (alloc->page < 0) {
+        return true;
+    }
+    ArenaPage *page = &arena->pages[alloc->page];
+    if (page->command_count == page->command_capacity) {
+        uint32_t capacity = page->command_capacity ? page->command_capacity * 2 : 64;
+        DrawElementsIndirectCommand *commands = (DrawElementsIndirectCommand *)
+            realloc(page->commands, capacity * sizeof(DrawElementsIndirectCommand));
+        if (commands == NULL) {
+            return false;
+        }
+        page->commands = commands;
+        page->command_capacity = capacity;
+    }
+    if (arena->origin_count == arena->origin_capacity) {
+        uint32_t capacity = arena->origin_capacity ? arena->origin_capacity * 2 : 256;
+        float (*origins)[3] = realloc(arena->origins, capacity * sizeof(*origins));
+        if (origins == NULL) {
+            return false;
+        }
+        arena->origins = origins;
+        arena->origin_capacity = capacity;
+    }
+
+    uint32_t instance = arena->origin_count++;
+    memcpy(arena->origins[instance], origin, sizeof(arena->origins[instance]));
+    // The shared indices count quads from 0, the base vertex moves them to the mesh
+    page->commands[page->command_count++] = (DrawElementsIndirectCommand){
+        alloc->quads * 6, 1, 0, (int32_t)(alloc->offset * 4), instance,
+    };
+    return true;
+}
+
+static void draw_page_single(ArenaPage *page, const float (*origins)[3])
+{
+    // The origin becomes a constant attribute, changed between draws
+    glDisableVertexAttribArray(CHUNK_ORIGIN_ATTRIB);
+    for (uint32_t i = 0; i < page->command_count; i++) {
+        const DrawElementsIndirectCommand *c = &page->commands[i];
+        glVertexAttrib3fv(CHUNK_ORIGIN_ATTRIB, origins[c->base_instance]);
+        glDrawElementsBaseVertex(GL_TRIANGLES, c->count, GL_UNSIGNED_INT, (void*)0, c->base_vertex);
+    }
+}
+
+void draw_arena_batch(VertexArena *arena, DrawPath path)
+{
+    if (arena->origin_count == 0) {
+        return;
+    }
+
+    if (path == DRAW_PATH_MULTI_INDIRECT) {
+        // Orphan and refill both buffers, every page reads its own slice of commands
+        glBindBuffer(GL_ARRAY_BUFFER, arena->origin_buffer);
+        glBufferData(GL_ARRAY_BUFFER, arena->origin_count * sizeof(*arena->origins), arena->origins, GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, arena->indirect_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, arena->origin_count * sizeof(DrawElementsIndirectCommand),
+                     NULL, GL_STREAM_DRAW);
+        GLintptr offset = 0;
+        for (uint32_t p = 0; p < arena->page_count; p++) {
+            ArenaPage *page = &arena->pages[p];
+            if (page->command_count == 0) {
+                continue;
+            }
+            GLsizeiptr bytes = page->command_count * sizeof(DrawElementsIndirectCommand);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offset, bytes, page->commands);
+            bind_vertex_array(page->vao);
+            glEnableVertexAttribArray(CHUNK_ORIGIN_ATTRIB);
+            multi_draw_elements_indirect((const void *)offset, (int)page->command_count);
+            arena->draw_calls++;
+            offset += bytes;
+            page->command_count = 0;
+        }
+    } else {
+        for (uint32_t p = 0; p < arena->page_count; p++) {
+            ArenaPage *page = &arena->pages[p];
+            if (page->command_count == 0) {
+                continue;
+            }
+            bind_vertex_array(page->vao);
+            draw_page_single(page, (const float (*)[3])arena->origins);
+            arena->draw_calls += page->command_count;
+            page->command_count = 0;
+        }
+    }
+    arena->origin_count = 0;
+}
+
+// Move the highest mesh of the page into the lowest hole it fits in.
+// Returns the bytes copied, 0 when the page tail cannot move down.
+static uint64_t compact_page(VertexArena *arena, ArenaPage *page)
+{
+    if (page->live_count == 0 || page->ranges.count == 0) {
+        return 0;
+    }
+    ArenaAlloc *top = page->live[0];
+    for (uint32_t i = 1; i < page->live_count; i++) {
+        if (page->live[i]->offset > top->offset) {
+            top = page->live[i];
+        }
+    }
+
+    uint32_t offset;
+    if (!alloc_range(&page->ranges, top->quads, &offset)) {
+        return 0;
+    }
+    // Handing back a range just taken from a hole never grows the free list
+    if (offset > top->offset) {
+        release_range(&page->ranges, offset, top->quads);
+        return 0;
+    }
+
+    // Free hole and live mesh never overlap, a copy inside one buffer is fine
+    GLsizeiptr bytes = (GLsizeiptr)top->quads * arena->quad_bytes;
+    glBindBuffer(GL_COPY_READ_BUFFER, page->vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, page->vbo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        (GLintptr)top->offset * arena->quad_bytes, (GLintptr)offset * arena->quad_bytes, bytes);
+    // The mesh only moves once its old range is free again. If the free
+    // list cannot grow it stays where it was and the copy is ignored.
+    if (!release_range(&page->ranges, top->offset, top->quads)) {
+        ERROR("Vertex arena compaction stopped, free list full\n");
+        release_range(&page->ranges, offset, top->quads);
+        return 0;
+    }
+    top->offset = offset;
+    arena->revision++;
+    return bytes;
+}
+
+void compact_vertex_arena(VertexArena *arena, uint64_t budget)
+{
+    for (uint32_t p = 0; p < arena->page_count; p++) {
+        ArenaPage *page = &arena->pages[p];
+        // A single hole means the page is already packed
+        while (arena->moved < budget && page->ranges.count > 1) {
+            uint64_t bytes = compact_page(arena, page);
+            if (bytes == 0) {
+                break;
+            }
+            arena->moved += bytes;
+        }
+    }
+}
+
+void begin_arena_frame(VertexArena *arena)
+{
+    arena->last_uploaded = arena->uploaded;
+    arena->last_moved = arena->moved;
+    arena->last_draw_calls = arena->draw_calls;
+    arena->uploaded = 0;
+    arena->moved = 0;
+    arena->draw_calls = 0;
+}
+
+void get_vertex_arena_stats(const VertexArena *arena, ArenaStats *stats)
+{
+    memset(stats, 0, sizeof(ArenaStats));
+    stats->pages = arena->page_count;
+    for (uint32_t p = 0; p < arena->page_count; p++) {
+        const ArenaPage *page = &arena->pages[p];
+        float fragmentation = range_fragmentation(&page->ranges);
+        stats->allocations += page->live_count;
+        stats->free_ranges += page->ranges.count;
+        stats->capacity += (uint64_t)page->ranges.size * arena->quad_bytes;
+        stats->used += (uint64_t)(page->ranges.size - page->ranges.free) * arena->quad_bytes;
+        if (fragmentation > stats->fragmentation) {
+            stats->fragmentation = fragmentation;
+        }
+    }
+    stats->occupancy = stats->capacity ? (float)stats->used / stats->capacity : 0.0f;
+    stats->uploaded = arena->last_uploaded;
+    stats->moved = arena->last_moved;
+    stats->draw_calls = arena->last_draw_calls;
+}
@@ -0,0 +1,117 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "../loki.h"
+#include "../util/range_alloc.h"
+#include "renderer.h"
+
+// GPU vertex memory shared by all chunk meshes of one vertex format.
+//
+// A few large GL_ARRAY_BUFFER pages, each with its VAO already set up for
+// the format and the shared quad index buffer. Meshes are placed at quad
+// aligned offsets with glBufferSubData, so streaming chunks in and out never
+// creates or binds per chunk buffers.
+//
+// Drawing goes through a per frame batch: add_arena_draw records one
+// indirect command per mesh (its page, base vertex and origin) and
+// draw_arena_batch submits them, one glMultiDrawElementsIndirect per page or
+// one glDrawElementsBaseVertex per mesh depending on the DrawPath.
+//
+// Allocations live in the owner (e.g. the chunk draw record) and the arena
+// keeps a pointer to them: compact_vertex_arena moves meshes down into holes
+// with glCopyBufferSubData and patches the owner's ArenaAlloc in place, so
+// owners must not move while allocated.
+
+#define ARENA_PAGE_SIZE     (16 << 20)  // bytes per page unless a mesh needs more
+
+typedef struct {
+    int32_t page;           // -1 when nothing is allocated
+    uint32_t offset;        // in quads
+    uint32_t quads;
+    uint32_t slot;          // position in the page's live list
+} ArenaAlloc;
+
+typedef struct {
+    unsigned int vbo;
+    unsigned int vao;
+    RangeAllocator ranges;  // in quads
+    ArenaAlloc **live;
+    uint32_t live_count;
+    uint32_t live_capacity;
+    DrawElementsIndirectCommand *commands;  // batch of the frame
+    uint32_t command_count;
+    uint32_t command_capacity;
+} ArenaPage;
+
+typedef struct {
+    VertexFormat format;
+    uint32_t quad_bytes;        // 4 vertices
+    uint32_t page_quads;
+    unsigned int index_buffer;
+    ArenaPage *pages;
+    uint32_t page_count;
+
+    // Batch of the frame, base_instance of a command indexes `origins`
+    unsigned int origin_buffer;
+    unsigned int indirect_buffer;
+    float (*origins)[3];
+    uint32_t origin_count;
+    uint32_t origin_capacity;
+    uint32_t draw_calls;
+    uint32_t last_draw_calls;
+    // Bumped whenever a mesh is placed, moved or released, for users keeping
+    // their own copy of the allocations (see gpu_cull.h)
+    uint64_t revision;
+
+    // Traffic of the current frame, moved to last_* by begin_arena_frame
+    uint64_t uploaded;
+    uint64_t moved;
+    uint64_t last_uploaded;
+    uint64_t last_moved;
+} VertexArena;
+
+typedef struct {
+    uint32_t pages;
+    uint32_t allocations;
+    uint32_t free_ranges;
+    uint64_t capacity;          // bytes
+    uint64_t used;              // bytes
+    float occupancy;            // used / capacity
+    float fragmentation;        // 1 - largest hole / free space, worst page
+    uint64_t uploaded;          // bytes, last frame
+    uint64_t moved;             // bytes copied by compaction, last frame
+    uint32_t draw_calls;        // last frame
+} ArenaStats;
+
+static inline void init_arena_alloc(ArenaAlloc *alloc)
+{
+    alloc->page = -1;
+    alloc->offset = 0;
+    alloc->quads = 0;
+    alloc->slot = 0;
+}
+
+// `index_buffer` is bound in every page VAO, see create_quad_index_buffer
+VertexArena *create_vertex_arena(VertexFormat format, unsigned int index_buffer);
+void destroy_vertex_arena(VertexArena *arena);
+
+// Place `quads` quads of `vertices` (in the arena format) and upload them.
+// Releases whatever `alloc` held before. False when GPU memory ran out.
+bool upload_arena_mesh(VertexArena *arena, ArenaAlloc *alloc, const void *vertices, uint32_t quads);
+void release_arena_mesh(VertexArena *arena, ArenaAlloc *alloc);
+
+// Queue a placed mesh for this frame's batch, `origin` is the chunk origin
+// in blocks. Empty allocations are skipped.
+bool add_arena_draw(VertexArena *arena, const ArenaAlloc *alloc, const float origin[3]);
+// Submit and clear the batch. DRAW_PATH_MULTI_INDIRECT needs
+// has_multi_draw_indirect().
+void draw_arena_batch(VertexArena *arena, DrawPath path);
+
+// Move meshes from the end of fragmented pages into lower holes, copying at
+// most `budget` bytes on the GPU. Call once per frame.
+void compact_vertex_arena(VertexArena *arena, uint64_t budget);
+
+void begin_arena_frame(VertexArena *arena);
+void get_vertex_arena_stats(const VertexArena *arena, ArenaStats *stats);
+
+#endif // _ARENA_H_
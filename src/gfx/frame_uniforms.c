@@ -0,0 +1,94 @@
+#include "frame_uniforms.h"
+#include "../util/log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+FrameUniformBuffer *create_frame_uniform_buffer(void)
+{
+    FrameUniformBuffer *buffer = (FrameUniformBuffer *) calloc(1, sizeof(FrameUniformBuffer));
+    if (buffer == NULL) {
+        ERROR("Out of memory for the frame uniform buffer\n");
+        return NULL;
+    }
+
+    // Slots are bound with glBindBufferRange, their offsets must be aligned
+    int alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment < 1) {
+        alignment = 256;
+    }
+    buffer->stride = (uint32_t)((sizeof(FrameUniforms) + alignment - 1) / alignment * alignment);
+    buffer->slot = FRAME_UNIFORM_RING - 1;
+
+    glGenBuffers(1, &buffer->buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer->buffer);
+    glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr) buffer->stride * FRAME_UNIFORM_RING, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    DEBUG("Frame uniforms: %u slots of %u bytes\n", FRAME_UNIFORM_RING, buffer->stride);
+    return buffer;
+}
+
+void destroy_frame_uniform_buffer(FrameUniformBuffer *buffer)
+{
+    if (buffer == NULL) {
+        return;
+    }
+    for (int i = 0; i < FRAME_UNIFORM_RING; i++) {
+        if (buffer->fences[i] != NULL) {
+            glDeleteSync(buffer->fences[i]);
+        }
+    }
+    glDeleteBuffers(1, &buffer->buffer);
+    free(buffer);
+}
+
+void update_frame_uniforms(FrameUniformBuffer *buffer, const FrameUniforms *uniforms)
+{
+    // Everything drawn since the last update read the previous slot
+    if (buffer->fences[buffer->slot] != NULL) {
+        glDeleteSync(buffer->fences[buffer->slot]);
+    }
+    buffer->fences[buffer->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    // The next slot was last read FRAME_UNIFORM_RING - 1 frames ago, only
+    // wait when the GPU has fallen that far behind
+    buffer->slot = (buffer->slot + 1) % FRAME_UNIFORM_RING;
+    GLsync fence = buffer->fences[buffer->slot];
+    if (fence != NULL) {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            buffer->waits++;
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+        }
+        glDeleteSync(fence);
+        buffer->fences[buffer->slot] = NULL;
+    }
+
+    // Unsynchronized: the fence already guarantees the slot is idle, the
+    // driver must not wait for the other slots still in flight
+    GLintptr offset = (GLintptr) buffer->slot * buffer->stride;
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer->buffer);
+    void *dst = glMapBufferRange(GL_UNIFORM_BUFFER, offset, sizeof(FrameUniforms),
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (dst != NULL) {
+        memcpy(dst, uniforms, sizeof(FrameUniforms));
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    else {
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(FrameUniforms), uniforms);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, buffer->buffer, offset, sizeof(FrameUniforms));
+}
+
+bool bind_frame_uniform_block(unsigned int program)
+{
+    unsigned int index = glGetUniformBlockIndex(program, "Frame");
+    if (index == GL_INVALID_INDEX) {
+        return false;
+    }
+    glUniformBlockBinding(program, index, FRAME_UNIFORM_BINDING);
+    return true;
+}
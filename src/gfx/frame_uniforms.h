@@ -0,0 +1,68 @@
+#ifndef _FRAME_UNIFORMS_H_
+#define _FRAME_UNIFORMS_H_
+
+#include "gfx.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per frame data every program reads from one std140 uniform block.
+//
+// The CPU writes the block once per frame into the next slot of a ring of
+// FRAME_UNIFORM_RING slots in a single buffer and binds that slot's range at
+// FRAME_UNIFORM_BINDING, where every program's Frame block reads it. A fence
+// per slot makes sure the GPU is done with a slot before it is written
+// again, which with three slots only waits when the GPU is frames behind.
+// Programs declare the block with FRAME_UNIFORMS_GLSL and are pointed at the
+// binding once with bind_frame_uniform_block.
+
+#define FRAME_UNIFORM_BINDING   0
+#define FRAME_UNIFORM_RING      3
+
+// std140 layout, keep in sync with FRAME_UNIFORMS_GLSL
+typedef struct {
+    float view[4][4];
+    float projection[4][4];
+    float view_projection[4][4];
+    float camera_position[4];   // xyz, w unused
+    float fog_color[4];         // rgb, a unused
+    float fog_start;            // view distance where the fog starts
+    float fog_end;              // and where it hides everything
+    float time;                 // seconds
+    float daylight;             // scale of sky light, 1 at noon
+} FrameUniforms;
+
+#define FRAME_UNIFORMS_GLSL \
+    "layout (std140) uniform Frame {\n" \
+    "   mat4 view;\n" \
+    "   mat4 projection;\n" \
+    "   mat4 view_projection;\n" \
+    "   vec4 camera_position;\n" \
+    "   vec4 fog_color;\n" \
+    "   float fog_start;\n" \
+    "   float fog_end;\n" \
+    "   float time;\n" \
+    "   float daylight;\n" \
+    "};\n"
+
+typedef struct {
+    unsigned int buffer;
+    uint32_t stride;            // slot size rounded up to the offset alignment
+    uint32_t slot;              // last written
+    GLsync fences[FRAME_UNIFORM_RING];  // NULL when the GPU is done with the slot
+    uint32_t waits;             // writes that had to wait for the GPU
+} FrameUniformBuffer;
+
+// NULL on failure
+FrameUniformBuffer *create_frame_uniform_buffer(void);
+void destroy_frame_uniform_buffer(FrameUniformBuffer *buffer);
+
+// Write `uniforms` into the next slot and bind it at FRAME_UNIFORM_BINDING.
+// Call once per frame before the first draw: the commands issued since the
+// previous call are fenced as the users of the previous slot.
+void update_frame_uniforms(FrameUniformBuffer *buffer, const FrameUniforms *uniforms);
+
+// Point the Frame block of `program` at FRAME_UNIFORM_BINDING. False when
+// the program has no such block (or the compiler dropped it as unused).
+bool bind_frame_uniform_block(unsigned int program);
+
+#endif // _FRAME_UNIFORMS_H_
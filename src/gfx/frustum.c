@@ -0,0 +1,281 @@
+#include "frustum.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CULL_X86
+#include <immintrin.h>
+#endif
+
+#define AABB_ALIGN  32
+#define AABB_LANES  8   // capacity granularity, the widest kernel
+
+
+void extract_frustum(Frustum *frustum, float m[4][4])
+{
+    // Rows of the matrix, cglm stores columns
+    float r[4][4];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            r[i][j] = m[j][i];
+        }
+    }
+    // Left, right, bottom, top, near, far: w +/- x, y, z >= 0
+    for (int p = 0; p < 6; p++) {
+        float sign = (p & 1) ? -1.0f : 1.0f;
+        float *plane = frustum->planes[p];
+        for (int j = 0; j < 4; j++) {
+            plane[j] = r[3][j] + sign * r[p >> 1][j];
+        }
+        float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0.0f) {
+            for (int j = 0; j < 4; j++) {
+                plane[j] /= length;
+            }
+        }
+    }
+}
+
+
+// All six arrays share one allocation starting at min_x
+static bool grow_aabb_list(AabbList *list, uint32_t capacity)
+{
+    capacity = (capacity + AABB_LANES - 1) & ~(uint32_t)(AABB_LANES - 1);
+    float *block = (float *) aligned_alloc(AABB_ALIGN, 6 * (size_t)capacity * sizeof(float));
+    if (block == NULL) {
+        return false;
+    }
+    // Zeroed padding keeps the lanes past `count` defined, they are masked out
+    memset(block, 0, 6 * (size_t)capacity * sizeof(float));
+
+    float *old = list->min_x;
+    float **arrays[6] = {&list->min_x, &list->min_y, &list->min_z, &list->max_x, &list->max_y, &list->max_z};
+    for (int a = 0; a < 6; a++) {
+        float *array = block + a * (size_t)capacity;
+        if (old != NULL) {
+            memcpy(array, *arrays[a], list->count * sizeof(float));
+        }
+        *arrays[a] = array;
+    }
+    free(old);
+    list->capacity = capacity;
+    return true;
+}
+
+bool init_aabb_list(AabbList *list, uint32_t capacity)
+{
+    memset(list, 0, sizeof(AabbList));
+    return grow_aabb_list(list, capacity > 0 ? capacity : AABB_LANES);
+}
+
+void free_aabb_list(AabbList *list)
+{
+    free(list->min_x);
+    memset(list, 0, sizeof(AabbList));
+}
+
+void clear_aabb_list(AabbList *list)
+{
+    list->count = 0;
+}
+
+void set_aabb(AabbList *list, uint32_t index, const float min[3], const float max[3])
+{
+    list->min_x[index] = min[0];
+    list->min_y[index] = min[1];
+    list->min_z[index] = min[2];
+    list->max_x[index] = max[0];
+    list->max_y[index] = max[1];
+    list->max_z[index] = max[2];
+}
+
+int32_t push_aabb(AabbList *list, const float min[3], const float max[3])
+{
+    if (list->count == list->capacity && !grow_aabb_list(list, list->capacity * 2)) {
+        return -1;
+    }
+    set_aabb(list, list->count, min, max);
+    return (int32_t)list->count++;
+}
+
+
+bool is_aabb_in_frustum(const Frustum *frustum, const float min[3], const float max[3])
+{
+    for (int p = 0; p < 6; p++) {
+        const float *plane = frustum->planes[p];
+        float d = plane[0] * (plane[0] >= 0.0f ? max[0] : min[0]) + plane[1] * (plane[1] >= 0.0f ? max[1] : min[1])
+                + plane[2] * (plane[2] >= 0.0f ? max[2] : min[2]) + plane[3];
+        if (d < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Corner of the box furthest along the plane normal, per axis
+static inline const float *far_x(const AabbList *list, const float *plane)
+{
+    return plane[0] >= 0.0f ? list->max_x : list->min_x;
+}
+
+static inline const float *far_y(const AabbList *list, const float *plane)
+{
+    return plane[1] >= 0.0f ? list->max_y : list->min_y;
+}
+
+static inline const float *far_z(const AabbList *list, const float *plane)
+{
+    return plane[2] >= 0.0f ? list->max_z : list->min_z;
+}
+
+static uint32_t cull_scalar(const Frustum *frustum, const AabbList *list, uint32_t *visible)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < list->count; i++) {
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++) {
+            const float *plane = frustum->planes[p];
+            float d = plane[0] * far_x(list, plane)[i] + plane[1] * far_y(list, plane)[i]
+                    + plane[2] * far_z(list, plane)[i] + plane[3];
+            outside = d < 0.0f;
+        }
+        if (!outside) {
+            visible[count++] = i;
+        }
+    }
+    return count;
+}
+
+// Append the lanes of `inside` (bit per box from `base`) that are real boxes
+static inline uint32_t emit_visible(uint32_t inside, uint32_t base, uint32_t total, uint32_t *visible, uint32_t count)
+{
+    while (inside) {
+        uint32_t i = base + (uint32_t)__builtin_ctz(inside);
+        if (i >= total) {
+            break;
+        }
+        visible[count++] = i;
+        inside &= inside - 1;
+    }
+    return count;
+}
+
+#ifdef CULL_X86
+static uint32_t cull_sse(const Frustum *frustum, const AabbList *list, uint32_t *visible)
+{
+    const float *xs[6];
+    const float *ys[6];
+    const float *zs[6];
+    __m128 a[6], b[6], c[6], d[6];
+    for (int p = 0; p < 6; p++) {
+        const float *plane = frustum->planes[p];
+        xs[p] = far_x(list, plane);
+        ys[p] = far_y(list, plane);
+        zs[p] = far_z(list, plane);
+        a[p] = _mm_set1_ps(plane[0]);
+        b[p] = _mm_set1_ps(plane[1]);
+        c[p] = _mm_set1_ps(plane[2]);
+        d[p] = _mm_set1_ps(plane[3]);
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < list->count; i += 4) {
+        __m128 outside = zero;
+        for (int p = 0; p < 6; p++) {
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], _mm_load_ps(xs[p] + i)),
+                                                           _mm_mul_ps(b[p], _mm_load_ps(ys[p] + i))),
+                                                _mm_mul_ps(c[p], _mm_load_ps(zs[p] + i))),
+                                     d[p]);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, zero));
+        }
+        uint32_t inside = ~(uint32_t)_mm_movemask_ps(outside) & 0xF;
+        count = emit_visible(inside, i, list->count, visible, count);
+    }
+    return count;
+}
+
+__attribute__((target("avx")))
+static uint32_t cull_avx(const Frustum *frustum, const AabbList *list, uint32_t *visible)
+{
+    const float *xs[6];
+    const float *ys[6];
+    const float *zs[6];
+    __m256 a[6], b[6], c[6], d[6];
+    for (int p = 0; p < 6; p++) {
+        const float *plane = frustum->planes[p];
+        xs[p] = far_x(list, plane);
+        ys[p] = far_y(list, plane);
+        zs[p] = far_z(list, plane);
+        a[p] = _mm256_set1_ps(plane[0]);
+        b[p] = _mm256_set1_ps(plane[1]);
+        c[p] = _mm256_set1_ps(plane[2]);
+        d[p] = _mm256_set1_ps(plane[3]);
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < list->count; i += 8) {
+        __m256 outside = zero;
+        for (int p = 0; p < 6; p++) {
+            // Same operation order as the scalar kernel, no FMA, so results match
+            __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[p], _mm256_load_ps(xs[p] + i)),
+                                                                    _mm256_mul_ps(b[p], _mm256_load_ps(ys[p] + i))),
+                                                      _mm256_mul_ps(c[p], _mm256_load_ps(zs[p] + i))),
+                                        d[p]);
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, zero, _CMP_LT_OQ));
+        }
+        uint32_t inside = ~(uint32_t)_mm256_movemask_ps(outside) & 0xFF;
+        count = emit_visible(inside, i, list->count, visible, count);
+    }
+    return count;
+}
+#endif
+
+bool has_cull_kernel(CullKernel kernel)
+{
+    switch (kernel) {
+    case CULL_SCALAR:
+        return true;
+#ifdef CULL_X86
+    case CULL_SSE:
+        return __builtin_cpu_supports("sse");
+    case CULL_AVX:
+        return __builtin_cpu_supports("avx");
+#endif
+    default:
+        return false;
+    }
+}
+
+CullKernel best_cull_kernel(void)
+{
+    static CullKernel best = MAX_CULL_KERNEL;
+    if (best == MAX_CULL_KERNEL) {
+        best = has_cull_kernel(CULL_AVX) ? CULL_AVX : (has_cull_kernel(CULL_SSE) ? CULL_SSE : CULL_SCALAR);
+    }
+    return best;
+}
+
+uint32_t cull_aabbs_with(CullKernel kernel, const Frustum *frustum, const AabbList *list, uint32_t *visible)
+{
+    switch (kernel) {
+#ifdef CULL_X86
+    case CULL_SSE:
+        return cull_sse(frustum, list, visible);
+    case CULL_AVX:
+        return cull_avx(frustum, list, visible);
+#endif
+    case CULL_SCALAR:
+    default:
+        return cull_scalar(frustum, list, visible);
+    }
+}
+
+uint32_t cull_aabbs(const Frustum *frustum, const AabbList *list, uint32_t *visible)
+{
+    return cull_aabbs_with(best_cull_kernel(), frustum, list, visible);
+}
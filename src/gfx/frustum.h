@@ -0,0 +1,59 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// View frustum culling of axis aligned boxes.
+//
+// Boxes are stored as structure of arrays so one SIMD iteration tests 4
+// (SSE) or 8 (AVX) of them against a plane. Each plane only needs the box
+// corner furthest along its normal: since the plane is the same for every
+// lane, that choice is a pointer swap (min or max array) per plane and not
+// a per lane blend.
+
+// Inside when a x + b y + c z + d >= 0, normals point into the frustum
+typedef struct {
+    float planes[6][4];
+} Frustum;
+
+typedef struct {
+    float *min_x;
+    float *min_y;
+    float *min_z;
+    float *max_x;
+    float *max_y;
+    float *max_z;
+    uint32_t count;
+    uint32_t capacity;          // multiple of 8, arrays are 32 byte aligned
+} AabbList;
+
+typedef enum {
+    CULL_SCALAR = 0,
+    CULL_SSE,                   // 4 boxes per iteration
+    CULL_AVX,                   // 8 boxes per iteration
+    MAX_CULL_KERNEL,
+} CullKernel;
+
+// Planes of a column major (cglm) view projection matrix, GL clip space
+void extract_frustum(Frustum *frustum, float m[4][4]);
+
+bool init_aabb_list(AabbList *list, uint32_t capacity);
+void free_aabb_list(AabbList *list);
+void clear_aabb_list(AabbList *list);
+// Returns the index of the box or -1 when the list could not grow
+int32_t push_aabb(AabbList *list, const float min[3], const float max[3]);
+void set_aabb(AabbList *list, uint32_t index, const float min[3], const float max[3]);
+
+// Single box test, for callers walking boxes one at a time
+bool is_aabb_in_frustum(const Frustum *frustum, const float min[3], const float max[3]);
+
+// Write the indices of the boxes touching the frustum to `visible` (room for
+// list->count entries) in increasing order and return how many there are.
+// cull_aabbs picks the widest kernel the CPU runs.
+uint32_t cull_aabbs(const Frustum *frustum, const AabbList *list, uint32_t *visible);
+uint32_t cull_aabbs_with(CullKernel kernel, const Frustum *frustum, const AabbList *list, uint32_t *visible);
+bool has_cull_kernel(CullKernel kernel);
+CullKernel best_cull_kernel(void);
+
+#endif // _FRUSTUM_H_
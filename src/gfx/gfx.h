@@ -6,4 +6,23 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+// glad only covers GL 4.1, the later enums used by the compute paths
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER                   0x91B9
+#define GL_SHADER_STORAGE_BUFFER            0x90D2
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT  0x00000001
+#define GL_TEXTURE_FETCH_BARRIER_BIT        0x00000008
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT  0x00000020
+#define GL_COMMAND_BARRIER_BIT              0x00000040
+#define GL_BUFFER_UPDATE_BARRIER_BIT        0x00000200
+#define GL_SHADER_STORAGE_BARRIER_BIT       0x00002000
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR  0x91B0
+#define GL_COMPLETION_STATUS_KHR            0x91B1
+#endif
+#ifndef GL_PARAMETER_BUFFER
+#define GL_PARAMETER_BUFFER                 0x80EE
+#endif
+
 #endif // _GFX_H_
\ No newline at end of file
@@ -0,0 +1,474 @@
+#include "gpu_cull.h"
+#include "frustum.h"
+#include "gfx.h"
+#include "program_cache.h"
+#include "renderer.h"
+#include "shaders.h"
+#include "../util/log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (APIENTRYP DispatchComputeProc)(GLuint x, GLuint y, GLuint z);
+typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+typedef void (APIENTRYP BindImageTextureProc)(GLuint unit, GLuint texture, GLint level, GLboolean layered,
+                                              GLint layer, GLenum access, GLenum format);
+typedef void (APIENTRYP ClearBufferDataProc)(GLenum target, GLenum internal_format, GLenum format,
+                                             GLenum type, const void *data);
+typedef void (APIENTRYP MultiDrawElementsIndirectCountProc)(GLenum mode, GLenum type, const void *indirect,
+                                                             GLintptr draw_count, GLsizei max_draw_count,
+                                                             GLsizei stride);
+
+static DispatchComputeProc dispatch_compute_proc;
+static MemoryBarrierProc memory_barrier_proc;
+static BindImageTextureProc bind_image_texture_proc;
+static ClearBufferDataProc clear_buffer_data_proc;
+static MultiDrawElementsIndirectCountProc indirect_count_proc;
+
+// Records are tested against the frustum planes (inside when dot >= 0, the
+// corner furthest along the normal decides) and then against the pyramid
+// texels under their screen rect, on the level where it spans 2x2 texels
+static const char *cull_src = "#version 430 core\n"
+    "layout (local_size_x = 64) in;\n"
+    "struct Record { vec3 lo; uint count; vec3 hi; int base_vertex; vec3 origin; uint page; };\n"
+    "layout (std430, binding = 0) readonly buffer Records { Record records[]; };\n"
+    "layout (std430, binding = 1) readonly buffer Pages { uint page_first[]; };\n"
+    "layout (std430, binding = 2) buffer Counters { uint counters[]; };\n"
+    "layout (std430, binding = 3) writeonly buffer Commands { uint commands[]; };\n"
+    "layout (std430, binding = 4) writeonly buffer Origins { float origins[]; };\n"
+    "uniform uint record_count;\n"
+    "uniform vec4 planes[6];\n"
+    "uniform mat4 view_projection;\n"
+    "uniform bool use_pyramid;\n"
+    "uniform int pyramid_levels;\n"
+    "uniform sampler2D pyramid;\n"
+    "bool in_frustum(vec3 lo, vec3 hi)\n"
+    "{\n"
+    "   for (int p = 0; p < 6; p++) {\n"
+    "       vec3 corner = mix(lo, hi, greaterThanEqual(planes[p].xyz, vec3(0.0)));\n"
+    "       if (dot(planes[p].xyz, corner) + planes[p].w < 0.0) return false;\n"
+    "   }\n"
+    "   return true;\n"
+    "}\n"
+    "bool is_occluded(vec3 lo, vec3 hi)\n"
+    "{\n"
+    "   vec2 rect_lo = vec2(1.0);\n"
+    "   vec2 rect_hi = vec2(0.0);\n"
+    "   float nearest = 1.0;\n"
+    "   for (int i = 0; i < 8; i++) {\n"
+    "       vec3 corner = mix(lo, hi, bvec3((i & 1) != 0, (i & 2) != 0, (i & 4) != 0));\n"
+    "       vec4 clip = view_projection * vec4(corner, 1.0);\n"
+    "       if (clip.w <= 0.0) return false;\n"
+    "       vec3 ndc = clip.xyz / clip.w;\n"
+    "       rect_lo = min(rect_lo, ndc.xy * 0.5 + 0.5);\n"
+    "       rect_hi = max(rect_hi, ndc.xy * 0.5 + 0.5);\n"
+    "       nearest = min(nearest, ndc.z * 0.5 + 0.5);\n"
+    "   }\n"
+    "   rect_lo = clamp(rect_lo, 0.0, 1.0);\n"
+    "   rect_hi = clamp(rect_hi, 0.0, 1.0);\n"
+    "   ivec2 base = textureSize(pyramid, 0);\n"
+    "   vec2 extent = (rect_hi - rect_lo) * vec2(base);\n"
+    "   int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, pyramid_levels - 1);\n"
+    "   ivec2 size = max(base >> level, ivec2(1));\n"
+    "   ivec2 t0 = clamp(ivec2(rect_lo * vec2(size)), ivec2(0), size - 1);\n"
+    "   ivec2 t1 = clamp(ivec2(rect_hi * vec2(size)), ivec2(0), size - 1);\n"
+    "   float farthest = 0.0;\n"
+    "   for (int y = t0.y; y <= t1.y; y++) {\n"
+    "       for (int x = t0.x; x <= t1.x; x++) {\n"
+    "           farthest = max(farthest, texelFetch(pyramid, ivec2(x, y), level).r);\n"
+    "       }\n"
+    "   }\n"
+    "   return nearest > farthest;\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "   uint i = gl_GlobalInvocationID.x;\n"
+    "   if (i >= record_count) return;\n"
+    "   Record r = records[i];\n"
+    "   if (!in_frustum(r.lo, r.hi) || (use_pyramid && is_occluded(r.lo, r.hi))) return;\n"
+    "   uint slot = page_first[r.page] + atomicAdd(counters[r.page], 1u);\n"
+    "   commands[slot * 5u + 0u] = r.count;\n"
+    "   commands[slot * 5u + 1u] = 1u;\n"
+    "   commands[slot * 5u + 2u] = 0u;\n"
+    "   commands[slot * 5u + 3u] = uint(r.base_vertex);\n"
+    "   commands[slot * 5u + 4u] = slot;\n"
+    "   origins[slot * 3u + 0u] = r.origin.x;\n"
+    "   origins[slot * 3u + 1u] = r.origin.y;\n"
+    "   origins[slot * 3u + 2u] = r.origin.z;\n"
+    "}\0";
+
+// Each target texel takes the farthest depth of every source texel it
+// overlaps, odd sizes included
+static const char *reduce_src = "#version 430 core\n"
+    "layout (local_size_x = 8, local_size_y = 8) in;\n"
+    "layout (r32f, binding = 0) writeonly uniform image2D target;\n"
+    "uniform sampler2D source;\n"
+    "uniform int source_level;\n"
+    "void main()\n"
+    "{\n"
+    "   ivec2 size = imageSize(target);\n"
+    "   ivec2 t = ivec2(gl_GlobalInvocationID.xy);\n"
+    "   if (any(greaterThanEqual(t, size))) return;\n"
+    "   ivec2 source_size = textureSize(source, source_level);\n"
+    "   ivec2 lo = t * source_size / size;\n"
+    "   ivec2 hi = min(((t + 1) * source_size + size - 1) / size, source_size);\n"
+    "   float depth = 0.0;\n"
+    "   for (int y = lo.y; y < hi.y; y++) {\n"
+    "       for (int x = lo.x; x < hi.x; x++) {\n"
+    "           depth = max(depth, texelFetch(source, ivec2(x, y), source_level).r);\n"
+    "       }\n"
+    "   }\n"
+    "   imageStore(target, t, vec4(depth));\n"
+    "}\0";
+
+
+bool load_gpu_culling(void)
+{
+    int major = 0;
+    int minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    dispatch_compute_proc = NULL;
+    indirect_count_proc = NULL;
+    if (major > 4 || (major == 4 && minor >= 3)) {
+        dispatch_compute_proc = (DispatchComputeProc) glfwGetProcAddress("glDispatchCompute");
+        memory_barrier_proc = (MemoryBarrierProc) glfwGetProcAddress("glMemoryBarrier");
+        bind_image_texture_proc = (BindImageTextureProc) glfwGetProcAddress("glBindImageTexture");
+        clear_buffer_data_proc = (ClearBufferDataProc) glfwGetProcAddress("glClearBufferData");
+        if (memory_barrier_proc == NULL || bind_image_texture_proc == NULL || clear_buffer_data_proc == NULL
+            || !has_multi_draw_indirect()) {
+            dispatch_compute_proc = NULL;
+        }
+    }
+    if (dispatch_compute_proc != NULL) {
+        if (major > 4 || (major == 4 && minor >= 6)) {
+            indirect_count_proc = (MultiDrawElementsIndirectCountProc)
+                glfwGetProcAddress("glMultiDrawElementsIndirectCount");
+        } else if (glfwExtensionSupported("GL_ARB_indirect_parameters")) {
+            indirect_count_proc = (MultiDrawElementsIndirectCountProc)
+                glfwGetProcAddress("glMultiDrawElementsIndirectCountARB");
+        }
+    }
+    DEBUG("GPU culling %s, indirect count %s\n", dispatch_compute_proc ? "available" : "missing",
+          indirect_count_proc ? "available" : "missing");
+    return dispatch_compute_proc != NULL;
+}
+
+bool has_gpu_culling(void)
+{
+    return dispatch_compute_proc != NULL;
+}
+
+bool has_indirect_count(void)
+{
+    return indirect_count_proc != NULL;
+}
+
+// Zero the whole buffer bound to `target`
+static void clear_buffer(GLenum target)
+{
+    clear_buffer_data_proc(target, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+}
+
+
+GpuCuller *create_gpu_culler(void)
+{
+    if (!has_gpu_culling()) {
+        return NULL;
+    }
+    GpuCuller *culler = (GpuCuller *) calloc(1, sizeof(GpuCuller));
+    if (culler == NULL) {
+        return NULL;
+    }
+    culler->program = create_cached_compute_program(cull_src);
+    if (culler->program == 0) {
+        ERROR("Failed to build the culling program:\n\t%s\n", get_shader_error());
+        free(culler);
+        return NULL;
+    }
+    culler->planes_loc = glGetUniformLocation(culler->program, "planes");
+    culler->view_projection_loc = glGetUniformLocation(culler->program, "view_projection");
+    culler->record_count_loc = glGetUniformLocation(culler->program, "record_count");
+    culler->use_pyramid_loc = glGetUniformLocation(culler->program, "use_pyramid");
+    culler->pyramid_levels_loc = glGetUniformLocation(culler->program, "pyramid_levels");
+    glGenBuffers(1, &culler->record_buffer);
+    glGenBuffers(1, &culler->page_buffer);
+    glGenBuffers(1, &culler->counter_buffer);
+    return culler;
+}
+
+void destroy_gpu_culler(GpuCuller *culler)
+{
+    if (culler == NULL) {
+        return;
+    }
+    glDeleteProgram(culler->program);
+    glDeleteBuffers(1, &culler->record_buffer);
+    glDeleteBuffers(1, &culler->page_buffer);
+    glDeleteBuffers(1, &culler->counter_buffer);
+    free(culler->records);
+    free(culler->page_first);
+    free(culler);
+}
+
+bool is_gpu_culler_stale(const GpuCuller *culler, const VertexArena *arena)
+{
+    return !culler->uploaded || culler->revision != arena->revision;
+}
+
+void begin_gpu_cull_records(GpuCuller *culler)
+{
+    culler->record_count = 0;
+    culler->uploaded = false;
+}
+
+bool add_gpu_cull_record(GpuCuller *culler, const ArenaAlloc *alloc, const float origin[3],
+                         const float min[3], const float max[3])
+{
+    if (alloc->page < 0) {
+        return true;
+    }
+    if (culler->record_count == culler->record_capacity) {
+        uint32_t capacity = culler->record_capacity ? culler->record_capacity * 2 : 256;
+        GpuCullRecord *records = (GpuCullRecord *) realloc(culler->records, capacity * sizeof(GpuCullRecord));
+        if (records == NULL) {
+            return false;
+        }
+        culler->records = records;
+        culler->record_capacity = capacity;
+    }
+    GpuCullRecord *r = &culler->records[culler->record_count++];
+    memcpy(r->min, min, sizeof(r->min));
+    memcpy(r->max, max, sizeof(r->max));
+    memcpy(r->origin, origin, sizeof(r->origin));
+    // The shared indices count quads from 0, the base vertex moves them to the mesh
+    r->count = alloc->quads * 6;
+    r->base_vertex = (int32_t)(alloc->offset * 4);
+    r->page = (uint32_t)alloc->page;
+    return true;
+}
+
+static int compare_record_pages(const void *a, const void *b)
+{
+    uint32_t pa = ((const GpuCullRecord *) a)->page;
+    uint32_t pb = ((const GpuCullRecord *) b)->page;
+    return (pa > pb) - (pa < pb);
+}
+
+bool end_gpu_cull_records(GpuCuller *culler, const VertexArena *arena)
+{
+    // Each page draws a contiguous slice of the commands
+    uint32_t *page_first = (uint32_t *) realloc(culler->page_first, (arena->page_count + 1) * sizeof(uint32_t));
+    if (page_first == NULL) {
+        return false;
+    }
+    culler->page_first = page_first;
+    culler->page_count = arena->page_count;
+    qsort(culler->records, culler->record_count, sizeof(GpuCullRecord), compare_record_pages);
+    uint32_t r = 0;
+    for (uint32_t p = 0; p <= culler->page_count; p++) {
+        while (r < culler->record_count && culler->records[r].page < p) {
+            r++;
+        }
+        page_first[p] = r;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, culler->record_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, culler->record_count * sizeof(GpuCullRecord), culler->records,
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, culler->page_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (culler->page_count + 1) * sizeof(uint32_t), page_first, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, culler->counter_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (culler->page_count + 1) * sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    culler->revision = arena->revision;
+    culler->uploaded = true;
+    return true;
+}
+
+void dispatch_gpu_cull(GpuCuller *culler, VertexArena *arena, float view_projection[4][4],
+                       const DepthPyramid *pyramid)
+{
+    if (culler->record_count == 0) {
+        return;
+    }
+    Frustum frustum;
+    extract_frustum(&frustum, view_projection);
+
+    // Commands and origins land in the arena buffers its page VAOs read.
+    // Without the indirect count the slots nobody writes must draw nothing.
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, arena->indirect_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, culler->record_count * sizeof(DrawElementsIndirectCommand),
+                 NULL, GL_STREAM_DRAW);
+    if (indirect_count_proc == NULL) {
+        clear_buffer(GL_SHADER_STORAGE_BUFFER);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, arena->origin_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, culler->record_count * 3 * sizeof(float), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, culler->counter_buffer);
+    clear_buffer(GL_SHADER_STORAGE_BUFFER);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, culler->record_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, culler->page_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, culler->counter_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, arena->indirect_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, arena->origin_buffer);
+
+    use_program(culler->program);
+    glUniform4fv(culler->planes_loc, 6, frustum.planes[0]);
+    glUniformMatrix4fv(culler->view_projection_loc, 1, GL_FALSE, view_projection[0]);
+    glUniform1ui(culler->record_count_loc, culler->record_count);
+    bool use_pyramid = pyramid != NULL && pyramid->valid;
+    glUniform1i(culler->use_pyramid_loc, use_pyramid);
+    if (use_pyramid) {
+        glUniform1i(culler->pyramid_levels_loc, pyramid->levels);
+        bind_texture(0, GL_TEXTURE_2D, pyramid->pyramid);
+    }
+    dispatch_compute_proc((culler->record_count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+    memory_barrier_proc(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void draw_gpu_culled(GpuCuller *culler, VertexArena *arena)
+{
+    if (culler->record_count == 0) {
+        return;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, arena->indirect_buffer);
+    if (indirect_count_proc != NULL) {
+        glBindBuffer(GL_PARAMETER_BUFFER, culler->counter_buffer);
+    }
+    for (uint32_t p = 0; p < culler->page_count; p++) {
+        uint32_t first = culler->page_first[p];
+        uint32_t count = culler->page_first[p + 1] - first;
+        if (count == 0) {
+            continue;
+        }
+        bind_vertex_array(arena->pages[p].vao);
+        glEnableVertexAttribArray(CHUNK_ORIGIN_ATTRIB);
+        const void *offset = (const void *)(first * sizeof(DrawElementsIndirectCommand));
+        if (indirect_count_proc != NULL) {
+            indirect_count_proc(GL_TRIANGLES, GL_UNSIGNED_INT, offset, p * sizeof(uint32_t), (GLsizei)count, 0);
+        } else {
+            multi_draw_elements_indirect(offset, (int)count);
+        }
+        arena->draw_calls++;
+    }
+}
+
+uint32_t read_gpu_cull_count(const GpuCuller *culler)
+{
+    if (culler->record_count == 0) {
+        return 0;
+    }
+    uint32_t total = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, culler->counter_buffer);
+    for (uint32_t p = 0; p < culler->page_count; p++) {
+        uint32_t count = 0;
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, p * sizeof(uint32_t), sizeof(uint32_t), &count);
+        total += count;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return total;
+}
+
+
+DepthPyramid *create_depth_pyramid(void)
+{
+    if (!has_gpu_culling()) {
+        return NULL;
+    }
+    DepthPyramid *pyramid = (DepthPyramid *) calloc(1, sizeof(DepthPyramid));
+    if (pyramid == NULL) {
+        return NULL;
+    }
+    pyramid->program = create_cached_compute_program(reduce_src);
+    if (pyramid->program == 0) {
+        ERROR("Failed to build the depth reduction program:\n\t%s\n", get_shader_error());
+        free(pyramid);
+        return NULL;
+    }
+    pyramid->source_level_loc = glGetUniformLocation(pyramid->program, "source_level");
+    glGenTextures(1, &pyramid->depth);
+    glGenTextures(1, &pyramid->pyramid);
+    return pyramid;
+}
+
+void destroy_depth_pyramid(DepthPyramid *pyramid)
+{
+    if (pyramid == NULL) {
+        return;
+    }
+    glDeleteProgram(pyramid->program);
+    glDeleteTextures(1, &pyramid->depth);
+    glDeleteTextures(1, &pyramid->pyramid);
+    reset_gl_state_cache();
+    free(pyramid);
+}
+
+// Texel fetches only, nothing is filtered
+static void set_fetch_parameters(int max_level)
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, max_level);
+}
+
+static void resize_depth_pyramid(DepthPyramid *pyramid, int width, int height)
+{
+    pyramid->width = width;
+    pyramid->height = height;
+    bind_texture(0, GL_TEXTURE_2D, pyramid->depth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+    set_fetch_parameters(0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+    // A complete mip chain down to 1x1, odd edges are folded in by the
+    // reduction reading every source texel a target texel overlaps
+    bind_texture(0, GL_TEXTURE_2D, pyramid->pyramid);
+    int w = width > 1 ? width / 2 : 1;
+    int h = height > 1 ? height / 2 : 1;
+    pyramid->levels = 0;
+    for (;;) {
+        glTexImage2D(GL_TEXTURE_2D, pyramid->levels++, GL_R32F, w, h, 0, GL_RED, GL_FLOAT, NULL);
+        if (w == 1 && h == 1) {
+            break;
+        }
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    set_fetch_parameters(pyramid->levels - 1);
+    bind_texture(0, GL_TEXTURE_2D, 0);
+}
+
+bool update_depth_pyramid(DepthPyramid *pyramid, int width, int height)
+{
+    if (width <= 0 || height <= 0) {
+        pyramid->valid = false;
+        return false;
+    }
+    if (width != pyramid->width || height != pyramid->height) {
+        resize_depth_pyramid(pyramid, width, height);
+    }
+    bind_texture(0, GL_TEXTURE_2D, pyramid->depth);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+    use_program(pyramid->program);
+    int w = width;
+    int h = height;
+    for (int l = 0; l < pyramid->levels; l++) {
+        // Level 0 reads the depth copy, the others the level below them
+        bind_texture(0, GL_TEXTURE_2D, l == 0 ? pyramid->depth : pyramid->pyramid);
+        glUniform1i(pyramid->source_level_loc, l == 0 ? 0 : l - 1);
+        bind_image_texture_proc(0, pyramid->pyramid, l, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+        dispatch_compute_proc((w + 7) / 8, (h + 7) / 8, 1);
+        memory_barrier_proc(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    bind_texture(0, GL_TEXTURE_2D, 0);
+    pyramid->valid = true;
+    return true;
+}
@@ -0,0 +1,103 @@
+#ifndef _GPU_CULL_H_
+#define _GPU_CULL_H_
+
+#include "../loki.h"
+#include "arena.h"
+
+// Chunk culling on the GPU, the alternative to frustum.h and occlusion.h.
+//
+// Every placed mesh of an arena has a record (bounds, origin and index
+// range) in a shader storage buffer, rebuilt only when the arena revision
+// changes. Each frame a compute shader tests all records against the
+// frustum and, given a DepthPyramid, against the depth of the previous
+// frame, and appends the survivors to their page's slice of the arena's
+// indirect buffer, an atomic counter per page handing out the slots. The
+// pages are then drawn with glMultiDrawElementsIndirectCount reading those
+// counters (GL 4.6 or ARB_indirect_parameters) or, without it, with multi
+// draw indirect over the whole slice after clearing it to empty commands.
+// The CPU side is a dispatch and a draw per page whatever the chunk count.
+//
+// The depth pyramid is a max reduction of a frame's depth buffer. Testing a
+// frame against the previous one's depth means a chunk the camera turns
+// towards can show up a frame late, never that a visible one is dropped
+// while the camera stands still.
+
+#define GPU_CULL_GROUP_SIZE     64      // records per compute work group
+
+// One record, std430 layout
+typedef struct {
+    float min[3];
+    uint32_t count;             // indices
+    float max[3];
+    int32_t base_vertex;
+    float origin[3];            // chunk origin in blocks, fed to CHUNK_ORIGIN_ATTRIB
+    uint32_t page;
+} GpuCullRecord;
+
+typedef struct {
+    unsigned int program;
+    int planes_loc;
+    int view_projection_loc;
+    int record_count_loc;
+    int use_pyramid_loc;
+    int pyramid_levels_loc;
+
+    unsigned int record_buffer;
+    unsigned int page_buffer;   // first record of each page
+    unsigned int counter_buffer;// commands written per page
+    GpuCullRecord *records;     // sorted by page once uploaded
+    uint32_t record_count;
+    uint32_t record_capacity;
+    uint32_t *page_first;       // page_count + 1 entries
+    uint32_t page_count;
+    uint64_t revision;          // of the arena the records came from
+    bool uploaded;
+} GpuCuller;
+
+typedef struct {
+    unsigned int program;
+    int source_level_loc;
+    unsigned int depth;         // copy of the framebuffer depth
+    unsigned int pyramid;       // GL_R32F mip chain, level 0 is half the depth size
+    int width;
+    int height;
+    int levels;
+    bool valid;                 // holds a frame
+} DepthPyramid;
+
+// Compute shaders, storage buffers and the buffer clears of GL 4.3, and the
+// indirect count draws when present. Call after gladLoadGL.
+bool load_gpu_culling(void);
+bool has_gpu_culling(void);
+bool has_indirect_count(void);
+
+// NULL when GPU culling is unsupported or the program fails to build
+GpuCuller *create_gpu_culler(void);
+void destroy_gpu_culler(GpuCuller *culler);
+
+// Records of `arena`: rebuild them (begin, one add per placed mesh, end)
+// when is_gpu_culler_stale says meshes were placed, moved or released.
+bool is_gpu_culler_stale(const GpuCuller *culler, const VertexArena *arena);
+void begin_gpu_cull_records(GpuCuller *culler);
+// Bounds in the space of the view projection, empty allocations are skipped
+bool add_gpu_cull_record(GpuCuller *culler, const ArenaAlloc *alloc, const float origin[3],
+                         const float min[3], const float max[3]);
+bool end_gpu_cull_records(GpuCuller *culler, const VertexArena *arena);
+
+// Cull every record into the arena's indirect and origin buffers. Binds the
+// culling program, so run it before the draw program is bound. `pyramid`
+// may be NULL for frustum culling only.
+void dispatch_gpu_cull(GpuCuller *culler, VertexArena *arena, float view_projection[4][4],
+                       const DepthPyramid *pyramid);
+// Draw what the last dispatch kept, with the draw program bound
+void draw_gpu_culled(GpuCuller *culler, VertexArena *arena);
+// Commands the last dispatch wrote. Waits for the GPU, for stats only.
+uint32_t read_gpu_cull_count(const GpuCuller *culler);
+
+DepthPyramid *create_depth_pyramid(void);
+void destroy_depth_pyramid(DepthPyramid *pyramid);
+// Copy the depth of the bound read framebuffer, `width` x `height`, and
+// reduce it. The framebuffer depth must convert to GL_DEPTH_COMPONENT24.
+bool update_depth_pyramid(DepthPyramid *pyramid, int width, int height);
+
+#endif // _GPU_CULL_H_
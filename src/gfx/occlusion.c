@@ -0,0 +1,447 @@
+#include "occlusion.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define TILE        OCCLUSION_TILE_SIZE
+#define MIN_QUADS   256
+#define SPAN_EPSILON 1e-3f
+
+// Corners of a box: bit 0 picks max x, bit 1 max y, bit 2 max z. Faces are
+// counter clockwise seen from outside.
+static const uint8_t box_faces[6][4] = {
+    {0, 4, 6, 2}, {1, 3, 7, 5},
+    {0, 1, 5, 4}, {2, 6, 7, 3},
+    {0, 2, 3, 1}, {4, 5, 7, 6},
+};
+
+
+OcclusionBuffer *create_occlusion_buffer(int width, int height)
+{
+    OcclusionBuffer *buffer = (OcclusionBuffer *) calloc(1, sizeof(OcclusionBuffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer->tiles_x = width > TILE ? (width + TILE - 1) / TILE : 1;
+    buffer->tiles_y = height > TILE ? (height + TILE - 1) / TILE : 1;
+    buffer->width = buffer->tiles_x * TILE;
+    buffer->height = buffer->tiles_y * TILE;
+
+    for (int l = 0; l < OCCLUSION_TILE_LEVELS; l++) {
+        buffer->levels[l] = (float *) malloc((size_t)(buffer->width >> l) * (buffer->height >> l) * sizeof(float));
+        if (buffer->levels[l] == NULL) {
+            destroy_occlusion_buffer(buffer);
+            return NULL;
+        }
+    }
+    buffer->bin_start = (uint32_t *) malloc((buffer->tiles_x * buffer->tiles_y + 1) * sizeof(uint32_t));
+    if (buffer->bin_start == NULL) {
+        destroy_occlusion_buffer(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+void destroy_occlusion_buffer(OcclusionBuffer *buffer)
+{
+    if (buffer == NULL) {
+        return;
+    }
+    for (int l = 0; l < OCCLUSION_TILE_LEVELS; l++) {
+        free(buffer->levels[l]);
+    }
+    free(buffer->quads);
+    free(buffer->bins);
+    free(buffer->bin_start);
+    free(buffer);
+}
+
+void begin_occlusion_frame(OcclusionBuffer *buffer, float view_projection[4][4])
+{
+    memcpy(buffer->view_projection, view_projection, sizeof(buffer->view_projection));
+    buffer->quad_count = 0;
+    memset(&buffer->stats, 0, sizeof(OcclusionStats));
+}
+
+
+// Screen position and view depth of the 8 corners. Returns false when one
+// is closer than OCCLUSION_NEAR, the projection is meaningless from there.
+static bool project_box(const OcclusionBuffer *buffer, const float min[3], const float max[3],
+                        float sx[8], float sy[8], float w[8])
+{
+    const float (*m)[4] = buffer->view_projection;
+    for (int i = 0; i < 8; i++) {
+        float x = (i & 1) ? max[0] : min[0];
+        float y = (i & 2) ? max[1] : min[1];
+        float z = (i & 4) ? max[2] : min[2];
+        float cw = m[0][3] * x + m[1][3] * y + m[2][3] * z + m[3][3];
+        if (cw < OCCLUSION_NEAR) {
+            return false;
+        }
+        float cx = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+        float cy = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+        sx[i] = (cx / cw * 0.5f + 0.5f) * buffer->width;
+        sy[i] = (cy / cw * 0.5f + 0.5f) * buffer->height;
+        w[i] = cw;
+    }
+    return true;
+}
+
+// Plain compares, fminf and fmaxf are library calls without -ffast-math
+static inline float min_float(float a, float b)
+{
+    return a < b ? a : b;
+}
+
+static inline float max_float(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+// Clamped before the conversion, corners close to the near plane land far off screen
+static inline int clamp_pixel(float v, int lo, int hi)
+{
+    return v < (float)lo ? lo : (v > (float)hi ? hi : (int)v);
+}
+
+bool add_occluder_box(OcclusionBuffer *buffer, const float min[3], const float max[3])
+{
+    float sx[8], sy[8], w[8];
+    buffer->stats.occluders++;
+    if (!project_box(buffer, min, max, sx, sy, w)) {
+        buffer->stats.rejected++;
+        return true;
+    }
+    float depth = w[0];
+    for (int i = 1; i < 8; i++) {
+        depth = max_float(depth, w[i]);
+    }
+
+    for (int f = 0; f < 6; f++) {
+        const uint8_t *v = box_faces[f];
+        float area = 0.0f;
+        float lo_x = FLT_MAX, lo_y = FLT_MAX, hi_x = -FLT_MAX, hi_y = -FLT_MAX;
+        for (int k = 0; k < 4; k++) {
+            int a = v[k];
+            int b = v[(k + 1) & 3];
+            area += sx[a] * sy[b] - sx[b] * sy[a];
+            lo_x = min_float(lo_x, sx[a]);
+            lo_y = min_float(lo_y, sy[a]);
+            hi_x = max_float(hi_x, sx[a]);
+            hi_y = max_float(hi_y, sy[a]);
+        }
+        // Back faces are covered by the front ones
+        if (area <= 0.0f) {
+            continue;
+        }
+        // Pixels whose center may lie inside
+        int x0 = clamp_pixel(ceilf(lo_x - 0.5f), 0, buffer->width);
+        int y0 = clamp_pixel(ceilf(lo_y - 0.5f), 0, buffer->height);
+        int x1 = clamp_pixel(floorf(hi_x - 0.5f), -1, buffer->width - 1);
+        int y1 = clamp_pixel(floorf(hi_y - 0.5f), -1, buffer->height - 1);
+        if (x0 > x1 || y0 > y1) {
+            continue;
+        }
+
+        if (buffer->quad_count == buffer->quad_capacity) {
+            uint32_t capacity = buffer->quad_capacity ? buffer->quad_capacity * 2 : MIN_QUADS;
+            OccluderQuad *quads = (OccluderQuad *) realloc(buffer->quads, capacity * sizeof(OccluderQuad));
+            if (quads == NULL) {
+                return false;
+            }
+            buffer->quads = quads;
+            buffer->quad_capacity = capacity;
+        }
+        OccluderQuad *q = &buffer->quads[buffer->quad_count++];
+        // Inside is on the left of every edge of a counter clockwise quad
+        for (int k = 0; k < 4; k++) {
+            int a = v[k];
+            int b = v[(k + 1) & 3];
+            float ex = sx[b] - sx[a];
+            float ey = sy[b] - sy[a];
+            q->edges[k][0] = -ey;
+            q->edges[k][1] = ex;
+            q->edges[k][2] = ey * sx[a] - ex * sy[a];
+        }
+        q->depth = depth;
+        q->x0 = (int16_t)x0;
+        q->y0 = (int16_t)y0;
+        q->x1 = (int16_t)x1;
+        q->y1 = (int16_t)y1;
+        buffer->stats.quads++;
+    }
+    return true;
+}
+
+bool add_octant_occluders(OcclusionBuffer *buffer, const float origin[3], float size, uint8_t octants)
+{
+    float half = size / 2.0f;
+    if (octants == 0xFF) {
+        float max[3] = {origin[0] + size, origin[1] + size, origin[2] + size};
+        return add_occluder_box(buffer, origin, max);
+    }
+    bool ok = true;
+    for (int oy = 0; oy < 2; oy++) {
+        uint8_t layer = (octants >> (4 * oy)) & 0xF;
+        float y = origin[1] + oy * half;
+        if (layer == 0xF) {
+            float min[3] = {origin[0], y, origin[2]};
+            float max[3] = {origin[0] + size, y + half, origin[2] + size};
+            ok &= add_occluder_box(buffer, min, max);
+            continue;
+        }
+        for (int i = 0; i < 4; i++) {
+            if (layer & (1 << i)) {
+                float min[3] = {origin[0] + (i & 1) * half, y, origin[2] + (i >> 1) * half};
+                float max[3] = {min[0] + half, y + half, min[2] + half};
+                ok &= add_occluder_box(buffer, min, max);
+            }
+        }
+    }
+    return ok;
+}
+
+
+static int compare_quad_depth(const void *a, const void *b)
+{
+    float da = ((const OccluderQuad *)a)->depth;
+    float db = ((const OccluderQuad *)b)->depth;
+    return (da > db) - (da < db);
+}
+
+int bin_occlusion_quads(OcclusionBuffer *buffer)
+{
+    int tiles = buffer->tiles_x * buffer->tiles_y;
+    uint32_t *start = buffer->bin_start;
+    memset(start, 0, (tiles + 1) * sizeof(uint32_t));
+
+    // Nearest first, the bins keep this order
+    qsort(buffer->quads, buffer->quad_count, sizeof(OccluderQuad), compare_quad_depth);
+
+    // Count, prefix sum to the end of each bin, then fill backwards so every
+    // start[t] walks down to the beginning of its bin
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < buffer->quad_count; i++) {
+        const OccluderQuad *q = &buffer->quads[i];
+        for (int ty = q->y0 / TILE; ty <= q->y1 / TILE; ty++) {
+            for (int tx = q->x0 / TILE; tx <= q->x1 / TILE; tx++) {
+                start[ty * buffer->tiles_x + tx]++;
+                total++;
+            }
+        }
+    }
+    if (total > buffer->bin_capacity) {
+        uint32_t *bins = (uint32_t *) realloc(buffer->bins, total * sizeof(uint32_t));
+        if (bins == NULL) {
+            // Drop the occluders: nothing is occluded this frame
+            buffer->quad_count = 0;
+            memset(start, 0, (tiles + 1) * sizeof(uint32_t));
+            return tiles;
+        }
+        buffer->bins = bins;
+        buffer->bin_capacity = total;
+    }
+    for (int t = 1; t < tiles; t++) {
+        start[t] += start[t - 1];
+    }
+    start[tiles] = total;
+    for (uint32_t i = buffer->quad_count; i-- > 0; ) {
+        const OccluderQuad *q = &buffer->quads[i];
+        for (int ty = q->y0 / TILE; ty <= q->y1 / TILE; ty++) {
+            for (int tx = q->x0 / TILE; tx <= q->x1 / TILE; tx++) {
+                buffer->bins[--start[ty * buffer->tiles_x + tx]] = i;
+            }
+        }
+    }
+    return tiles;
+}
+
+// Pixels [*sx, *ex] of the row at `py` whose centers lie inside the quad,
+// within [x0, x1] of the tile at `left`. Each edge bounds the span from one
+// side, shrunk a little so rounding never covers a pixel the quad misses.
+static bool quad_row_span(const OccluderQuad *q, float py, int left, int x0, int x1, int *sx, int *ex)
+{
+    float lo = (float)(left + x0) + 0.5f;
+    float hi = (float)(left + x1) + 0.5f;
+    for (int k = 0; k < 4; k++) {
+        float a = q->edges[k][0];
+        float rest = q->edges[k][1] * py + q->edges[k][2];
+        if (a > 0.0f) {
+            lo = max_float(lo, -rest / a + SPAN_EPSILON);
+        } else if (a < 0.0f) {
+            hi = min_float(hi, -rest / a - SPAN_EPSILON);
+        } else if (rest < 0.0f) {
+            return false;
+        }
+    }
+    if (lo > hi) {
+        return false;
+    }
+    // Both are >= x0 >= 0 here, so truncating rounds down
+    float first = lo - (float)left - 0.5f;
+    *sx = (int)first + ((float)(int)first < first);
+    *ex = (int)(hi - (float)left - 0.5f);
+    return *sx <= *ex;
+}
+
+// Nearest depth of the quad's pixels in rows [y0, y1] of the tile at (left, top)
+#ifdef __SSE2__
+static void raster_quad(float *depth, const OccluderQuad *q, int left, int top, int x0, int x1, int y0, int y1)
+{
+    __m128 z = _mm_set1_ps(q->depth);
+    __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+    for (int y = y0; y <= y1; y++) {
+        int sx, ex;
+        if (!quad_row_span(q, (float)(top + y) + 0.5f, left, x0, x1, &sx, &ex)) {
+            continue;
+        }
+        // Groups of 4 pixels, the tile is a whole number of groups
+        float *row = depth + y * TILE;
+        __m128i first = _mm_set1_epi32(sx - 1);
+        __m128i last = _mm_set1_epi32(ex + 1);
+        for (int x = sx & ~3; x <= ex; x += 4) {
+            __m128i index = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+            __m128 inside = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(index, first),
+                                                           _mm_cmplt_epi32(index, last)));
+            __m128 d = _mm_load_ps(row + x);
+            d = _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(d, z)), _mm_andnot_ps(inside, d));
+            _mm_store_ps(row + x, d);
+        }
+    }
+}
+#else
+static void raster_quad(float *depth, const OccluderQuad *q, int left, int top, int x0, int x1, int y0, int y1)
+{
+    for (int y = y0; y <= y1; y++) {
+        int sx, ex;
+        if (!quad_row_span(q, (float)(top + y) + 0.5f, left, x0, x1, &sx, &ex)) {
+            continue;
+        }
+        float *row = depth + y * TILE;
+        for (int x = sx; x <= ex; x++) {
+            row[x] = min_float(row[x], q->depth);
+        }
+    }
+}
+#endif
+
+// The quad is convex, holding the four corner pixels it holds the tile
+static bool covers_tile(const OccluderQuad *q, int left, int top)
+{
+    for (int c = 0; c < 4; c++) {
+        float px = (float)(left + (c & 1) * (TILE - 1)) + 0.5f;
+        float py = (float)(top + (c >> 1) * (TILE - 1)) + 0.5f;
+        for (int k = 0; k < 4; k++) {
+            if (q->edges[k][0] * px + q->edges[k][1] * py + q->edges[k][2] < 0.0f) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void rasterize_occlusion_tile(OcclusionBuffer *buffer, int tile)
+{
+    int left = (tile % buffer->tiles_x) * TILE;
+    int top = (tile / buffer->tiles_x) * TILE;
+    float *depth = buffer->levels[0] + (size_t)tile * TILE * TILE;
+    for (int i = 0; i < TILE * TILE; i++) {
+        depth[i] = FLT_MAX;
+    }
+
+    // Once a quad covers the whole tile everything farther is hidden behind it
+    float covered = FLT_MAX;
+    for (uint32_t b = buffer->bin_start[tile]; b < buffer->bin_start[tile + 1]; b++) {
+        const OccluderQuad *q = &buffer->quads[buffer->bins[b]];
+        if (q->depth >= covered) {
+            break;
+        }
+        if (covers_tile(q, left, top)) {
+            covered = q->depth;
+        }
+        int x0 = (q->x0 > left ? q->x0 : left) - left;
+        int y0 = (q->y0 > top ? q->y0 : top) - top;
+        int x1 = (q->x1 < left + TILE - 1 ? q->x1 : left + TILE - 1) - left;
+        int y1 = (q->y1 < top + TILE - 1 ? q->y1 : top + TILE - 1) - top;
+        raster_quad(depth, q, left, top, x0, x1, y0, y1);
+    }
+
+    // Farthest depth of each 2x2 block, inside the tile
+    for (int l = 1; l < OCCLUSION_TILE_LEVELS; l++) {
+        int size = TILE >> l;
+        const float *src = buffer->levels[l - 1] + (size_t)tile * (2 * size) * (2 * size);
+        float *dst = buffer->levels[l] + (size_t)tile * size * size;
+        for (int y = 0; y < size; y++) {
+            const float *r0 = src + (2 * y) * (2 * size);
+            const float *r1 = r0 + 2 * size;
+            for (int x = 0; x < size; x++) {
+                dst[y * size + x] = max_float(max_float(r0[2 * x], r0[2 * x + 1]),
+                                              max_float(r1[2 * x], r1[2 * x + 1]));
+            }
+        }
+    }
+}
+
+void rasterize_occlusion_buffer(OcclusionBuffer *buffer)
+{
+    int tiles = bin_occlusion_quads(buffer);
+    for (int t = 0; t < tiles; t++) {
+        rasterize_occlusion_tile(buffer, t);
+    }
+}
+
+
+// Texel (x, y) of level `l`, tiles are stored one after the other
+static inline float get_level_texel(const OcclusionBuffer *buffer, int l, int x, int y)
+{
+    int size = TILE >> l;
+    int tile = (y / size) * buffer->tiles_x + x / size;
+    return buffer->levels[l][(size_t)tile * size * size + (y % size) * size + x % size];
+}
+
+bool is_aabb_occluded(OcclusionBuffer *buffer, const float min[3], const float max[3])
+{
+    float sx[8], sy[8], w[8];
+    buffer->stats.tested++;
+    if (!project_box(buffer, min, max, sx, sy, w)) {
+        return false;
+    }
+    float nearest = w[0];
+    float lo_x = sx[0], lo_y = sy[0], hi_x = sx[0], hi_y = sy[0];
+    for (int i = 1; i < 8; i++) {
+        nearest = min_float(nearest, w[i]);
+        lo_x = min_float(lo_x, sx[i]);
+        lo_y = min_float(lo_y, sy[i]);
+        hi_x = max_float(hi_x, sx[i]);
+        hi_y = max_float(hi_y, sy[i]);
+    }
+    // Every pixel the box touches, the part off screen cannot be seen
+    if (hi_x < 0.0f || hi_y < 0.0f || lo_x >= buffer->width || lo_y >= buffer->height) {
+        return false;
+    }
+    int x0 = clamp_pixel(floorf(lo_x), 0, buffer->width - 1);
+    int y0 = clamp_pixel(floorf(lo_y), 0, buffer->height - 1);
+    int x1 = clamp_pixel(floorf(hi_x), 0, buffer->width - 1);
+    int y1 = clamp_pixel(floorf(hi_y), 0, buffer->height - 1);
+
+    // Coarsest useful level: the rect spans at most 2x2 texels there, or
+    // whole tiles on the top level
+    int l = 0;
+    while (l < OCCLUSION_TILE_LEVELS - 1 && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1)) {
+        l++;
+    }
+    for (int y = y0 >> l; y <= y1 >> l; y++) {
+        for (int x = x0 >> l; x <= x1 >> l; x++) {
+            if (!(nearest > get_level_texel(buffer, l, x, y))) {
+                return false;
+            }
+        }
+    }
+    buffer->stats.occluded++;
+    return true;
+}
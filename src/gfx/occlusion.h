@@ -0,0 +1,87 @@
+#ifndef _OCCLUSION_H_
+#define _OCCLUSION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// CPU occlusion culling against a small software depth buffer.
+//
+// Occluders are boxes known to be completely solid (opaque chunk octants).
+// Their front faces are rasterized into a low resolution buffer holding the
+// view depth (clip w) of the nearest occluder per pixel, each box written
+// at the depth of its farthest corner so it never claims more than it
+// hides. Each tile then builds a max depth (Hi-Z) pyramid, and a box is
+// occluded when its nearest corner lies behind every texel its screen rect
+// covers on the level where that rect spans at most 2x2 texels.
+//
+// A frame runs in steps:
+//   begin_occlusion_frame      set the view projection, drop last frame's occluders
+//   add_occluder_box           project and keep the front faces
+//   bin_occlusion_quads        sort the faces into screen tiles
+//   rasterize_occlusion_tile   per tile, from any thread, tiles are independent
+//   is_aabb_occluded           test boxes against the finished pyramid
+// Nothing is read back from the GPU, results are the same on every driver.
+
+#define OCCLUSION_TILE_SIZE     32      // pixels per side, the top pyramid level is one texel per tile
+#define OCCLUSION_TILE_LEVELS   6       // 32x32 down to 1x1
+#define OCCLUSION_NEAR          0.1f    // boxes reaching closer than this are never occluders or occluded
+
+// One convex face in screen space: inside where all four edge functions
+// a x + b y + c are >= 0
+typedef struct {
+    float edges[4][3];
+    float depth;                // farthest view depth of the box
+    int16_t x0, y0, x1, y1;     // pixel bounds, inclusive
+} OccluderQuad;
+
+typedef struct {
+    uint32_t occluders;         // boxes added
+    uint32_t rejected;          // boxes crossing the near plane
+    uint32_t quads;             // front faces rasterized
+    uint32_t tested;            // is_aabb_occluded calls
+    uint32_t occluded;
+} OcclusionStats;
+
+typedef struct {
+    int width;                  // multiples of OCCLUSION_TILE_SIZE
+    int height;
+    int tiles_x;
+    int tiles_y;
+    // Level l is (width >> l) x (height >> l), tile t of it a contiguous
+    // block of (OCCLUSION_TILE_SIZE >> l)^2 texels at t * that size
+    float *levels[OCCLUSION_TILE_LEVELS];
+    float view_projection[4][4];
+
+    OccluderQuad *quads;
+    uint32_t quad_count;
+    uint32_t quad_capacity;
+    // Quads overlapping tile t: bins[bin_start[t], bin_start[t + 1])
+    uint32_t *bins;
+    uint32_t bin_capacity;
+    uint32_t *bin_start;
+
+    OcclusionStats stats;
+} OcclusionBuffer;
+
+// The size is rounded up to whole tiles
+OcclusionBuffer *create_occlusion_buffer(int width, int height);
+void destroy_occlusion_buffer(OcclusionBuffer *buffer);
+
+// Column major (cglm) view projection of the space boxes are given in
+void begin_occlusion_frame(OcclusionBuffer *buffer, float view_projection[4][4]);
+// Returns false when the quads could not grow
+bool add_occluder_box(OcclusionBuffer *buffer, const float min[3], const float max[3]);
+// Solid octants of a cube at `origin` with side `size`, bit (y << 2 | z << 1 | x)
+// of `octants`. Full halves go in as one box.
+bool add_octant_occluders(OcclusionBuffer *buffer, const float origin[3], float size, uint8_t octants);
+
+// Returns the number of tiles to rasterize. When the bins cannot grow the
+// occluders are dropped and nothing is occluded this frame.
+int bin_occlusion_quads(OcclusionBuffer *buffer);
+void rasterize_occlusion_tile(OcclusionBuffer *buffer, int tile);
+// All tiles on the calling thread
+void rasterize_occlusion_buffer(OcclusionBuffer *buffer);
+
+bool is_aabb_occluded(OcclusionBuffer *buffer, const float min[3], const float max[3]);
+
+#endif // _OCCLUSION_H_
@@ -0,0 +1,237 @@
+#include "program_cache.h"
+#include "gfx.h"
+#include "shaders.h"
+#include "../util/log.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// File layout: the header, then `length` bytes of binary
+typedef struct {
+    uint32_t magic;
+    uint32_t format;            // as returned by glGetProgramBinary
+    uint32_t length;
+    uint32_t compile_us;        // what building it from source took
+    uint64_t check;             // second hash of the key, against name collisions
+} ProgramBinaryHeader;
+
+static struct {
+    bool enabled;
+    char directory[256];
+    uint64_t driver;            // hash of the driver strings
+} cache;
+
+static ProgramCacheStats stats;
+
+
+// FNV-1a, the two hashes differ in their basis
+#define HASH_BASIS  0xcbf29ce484222325ULL
+#define CHECK_BASIS 0x84222325cbf29ce4ULL
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint64_t hash_string(uint64_t h, const char *s)
+{
+    // The terminator separates consecutive strings
+    return hash_bytes(h, s, strlen(s) + 1);
+}
+
+static uint64_t hash_program(uint64_t basis, const unsigned int *types, const char *const *sources, int count)
+{
+    uint64_t h = hash_bytes(basis, &cache.driver, sizeof(cache.driver));
+    for (int i = 0; i < count; i++) {
+        h = hash_bytes(h, &types[i], sizeof(types[i]));
+        h = hash_string(h, sources[i]);
+    }
+    return h;
+}
+
+bool init_program_cache(const char *directory)
+{
+    cache.enabled = false;
+    memset(&stats, 0, sizeof(stats));
+
+    // A 3.3 context may leave the entry points unloaded
+    bool binaries = GLAD_GL_VERSION_4_1 || glfwExtensionSupported("GL_ARB_get_program_binary");
+    if (!binaries || glProgramBinary == NULL || glGetProgramBinary == NULL || glProgramParameteri == NULL) {
+        INFO("Program cache off, the driver has no program binaries\n");
+        return false;
+    }
+    int formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) {
+        INFO("Program cache off, the driver has no binary formats\n");
+        return false;
+    }
+    if (strlen(directory) >= sizeof(cache.directory)) {
+        ERROR("Program cache directory name too long: %s\n", directory);
+        return false;
+    }
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        ERROR("Program cache off, cannot create %s: %s\n", directory, strerror(errno));
+        return false;
+    }
+    strcpy(cache.directory, directory);
+
+    const GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION};
+    cache.driver = HASH_BASIS;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        const char *s = (const char *) glGetString(names[i]);
+        cache.driver = hash_string(cache.driver, s ? s : "");
+    }
+    cache.enabled = true;
+    DEBUG("Program cache in %s, %d binary formats\n", directory, formats);
+    return true;
+}
+
+// A program from the binary at `path`, 0 when there is none or it is refused
+static unsigned int load_program_binary(const char *path, uint64_t check, uint32_t *compile_us)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    ProgramBinaryHeader header;
+    void *binary = NULL;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == PROGRAM_CACHE_MAGIC &&
+              header.check == check && header.length > 0;
+    if (ok) {
+        binary = malloc(header.length);
+        ok = binary != NULL && fread(binary, 1, header.length, file) == header.length;
+    }
+    fclose(file);
+
+    unsigned int program = 0;
+    if (ok) {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary, (GLsizei) header.length);
+        int linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    free(binary);
+    if (program == 0) {
+        // Stale, truncated or from another build of the driver
+        stats.rejected++;
+        remove(path);
+        return 0;
+    }
+    *compile_us = header.compile_us;
+    return program;
+}
+
+static void store_program_binary(const char *path, uint64_t check, unsigned int program, uint32_t compile_us)
+{
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    void *binary = malloc(length);
+    if (binary == NULL) {
+        return;
+    }
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary);
+
+    // Written aside and renamed, a crash never leaves half a binary behind
+    char temp[PROGRAM_CACHE_PATH_SIZE + 8];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE *file = fopen(temp, "wb");
+    if (file != NULL) {
+        ProgramBinaryHeader header = {PROGRAM_CACHE_MAGIC, format, (uint32_t) written, compile_us, check};
+        bool ok = written > 0 && fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(binary, 1, written, file) == (size_t) written;
+        ok &= fclose(file) == 0;
+        if (ok && rename(temp, path) == 0) {
+            stats.stored++;
+        } else {
+            remove(temp);
+        }
+    }
+    free(binary);
+}
+
+unsigned int find_cached_program(const unsigned int *types, const char *const *sources, int count,
+                                 ProgramCacheKey *key)
+{
+    key->path[0] = '\0';
+    key->check = 0;
+    if (!cache.enabled) {
+        return 0;
+    }
+    snprintf(key->path, sizeof(key->path), "%s/%016llx.bin", cache.directory,
+             (unsigned long long) hash_program(HASH_BASIS, types, sources, count));
+    key->check = hash_program(CHECK_BASIS, types, sources, count);
+
+    double start = glfwGetTime();
+    uint32_t compile_us = 0;
+    unsigned int program = load_program_binary(key->path, key->check, &compile_us);
+    double elapsed = glfwGetTime() - start;
+    if (program != 0) {
+        stats.hits++;
+        stats.load_time += elapsed;
+        stats.saved_time += compile_us * 1e-6 - elapsed;
+        return program;
+    }
+    stats.misses++;
+    return 0;
+}
+
+void store_cached_program(const ProgramCacheKey *key, unsigned int program, double compile_time)
+{
+    stats.compile_time += compile_time;
+    if (key->path[0] != '\0' && program != 0) {
+        store_program_binary(key->path, key->check, program, (uint32_t)(compile_time * 1e6));
+    }
+}
+
+bool is_program_cache_enabled(void)
+{
+    return cache.enabled;
+}
+
+static unsigned int create_cached_program(const unsigned int *types, const char *const *sources, int count)
+{
+    ProgramCacheKey key;
+    unsigned int program = find_cached_program(types, sources, count, &key);
+    if (program != 0) {
+        return program;
+    }
+    double start = glfwGetTime();
+    program = build_shader_program(types, sources, count, cache.enabled);
+    store_cached_program(&key, program, glfwGetTime() - start);
+    return program;
+}
+
+unsigned int create_cached_shader_program(const char *vs, const char *fs)
+{
+    const unsigned int types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+    const char *sources[2] = {vs, fs};
+    return create_cached_program(types, sources, 2);
+}
+
+unsigned int create_cached_compute_program(const char *cs)
+{
+    const unsigned int types[1] = {GL_COMPUTE_SHADER};
+    return create_cached_program(types, &cs, 1);
+}
+
+void get_program_cache_stats(ProgramCacheStats *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,58 @@
+#ifndef _PROGRAM_CACHE_H_
+#define _PROGRAM_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Linked program binaries kept on disk between runs.
+//
+// A program is looked up by a hash of its stage sources (defines included,
+// they are part of the text) and of the driver vendor, renderer and version
+// strings, so a driver update simply misses. Hits are handed to
+// glProgramBinary. When the file is missing, or the driver rejects the
+// binary, the program is compiled from source and its binary written back.
+// Without GL 4.1 or GL_ARB_get_program_binary, or without binary formats,
+// the cache turns itself off and every program compiles.
+
+#define PROGRAM_CACHE_MAGIC     0x42504b4c  // "LKPB"
+#define PROGRAM_CACHE_PATH_SIZE 288
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;            // compiled, including the rejects
+    uint32_t rejected;          // binaries the driver refused
+    uint32_t stored;
+    double load_time;           // seconds in glProgramBinary for the hits
+    double compile_time;        // seconds compiling the misses
+    double saved_time;          // compile time recorded with the hits, minus loading them
+} ProgramCacheStats;
+
+// Keep binaries under `directory`, created if needed. Call after gladLoadGL.
+// False when the driver has no program binaries or the directory is unusable,
+// programs then always compile.
+bool init_program_cache(const char *directory);
+
+// Where a program's binary lives
+typedef struct {
+    char path[PROGRAM_CACHE_PATH_SIZE];     // empty when the cache is off
+    uint64_t check;
+} ProgramCacheKey;
+
+// create_shader_program and create_compute_program through the cache
+unsigned int create_cached_shader_program(const char *vs, const char *fs);
+unsigned int create_cached_compute_program(const char *cs);
+
+// The two halves of the above for callers building programs themselves:
+// look the stages up and get the loaded program, or 0 and the `key` to
+// store the binary under once the program, linked with the retrievable
+// hint, is built. `compile_time` is in seconds.
+unsigned int find_cached_program(const unsigned int *types, const char *const *sources, int count,
+                                 ProgramCacheKey *key);
+void store_cached_program(const ProgramCacheKey *key, unsigned int program, double compile_time);
+// True only with the program binary entry points loaded, glProgramParameteri
+// included
+bool is_program_cache_enabled(void);
+
+void get_program_cache_stats(ProgramCacheStats *stats);
+
+#endif // _PROGRAM_CACHE_H_
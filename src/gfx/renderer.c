@@ -1,4 +1,287 @@
 #include "renderer.h"
+#include "gfx.h"
 #include "../util/log.h"
+#include "../world/mesher.h"
 
+#include <stdlib.h>
+#include <string.h>
 
+typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void *indirect,
+                                                        GLsizei draw_count, GLsizei stride);
+
+static MultiDrawElementsIndirectProc multi_draw_indirect_proc;
+
+// What the cache believes is bound, the zero state of a fresh context
+static struct {
+    unsigned int program;
+    unsigned int vao;
+    unsigned int active_unit;
+    unsigned int textures[RENDER_TEXTURE_UNITS][2];  // GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY
+} gl_state;
+
+static RenderStats frame_stats;
+static RenderStats last_stats;
+
+
+unsigned int create_quad_index_buffer(uint32_t quads)
+{
+    size_t size = (size_t)quads * 6 * sizeof(unsigned int);
+    unsigned int *indices = (unsigned int *) malloc(size);
+    if (indices == NULL) {
+        ERROR("Out of memory for %u quad indices\n", quads);
+        return 0;
+    }
+    fill_quad_indices(indices, quads);
+
+    // Upload through the copy target, an element array binding would land in
+    // whatever VAO happens to be bound
+    unsigned int buffer = 0;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    free(indices);
+    DEBUG("Quad index buffer: %u quads, %.1f MiB\n", quads, size / 1048576.0);
+    return buffer;
+}
+
+void destroy_quad_index_buffer(unsigned int buffer)
+{
+    glDeleteBuffers(1, &buffer);
+}
+
+void set_chunk_vertex_layout(VertexFormat format)
+{
+    if (format == VERTEX_FORMAT_PACKED) {
+        // Both words as one integer attribute
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(PackedVertex), (void*)0);
+        glEnableVertexAttribArray(0);
+        glDisableVertexAttribArray(1);
+        glDisableVertexAttribArray(2);
+        glDisableVertexAttribArray(4);
+        return;
+    }
+
+    // Position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glEnableVertexAttribArray(0);
+    // Texture coordinate and layer attribute
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    // Normal attribute
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    // Light attribute, location 3 is the chunk origin
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(9 * sizeof(float)));
+    glEnableVertexAttribArray(4);
+}
+
+bool load_multi_draw_indirect(void)
+{
+    int major = 0;
+    int minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    multi_draw_indirect_proc = NULL;
+    // base_instance in the commands needs 4.2 or ARB_base_instance as well
+    bool core = major > 4 || (major == 4 && minor >= 3);
+    if (core || (glfwExtensionSupported("GL_ARB_multi_draw_indirect") && glfwExtensionSupported("GL_ARB_base_instance"))) {
+        multi_draw_indirect_proc = (MultiDrawElementsIndirectProc) glfwGetProcAddress("glMultiDrawElementsIndirect");
+    }
+    DEBUG("GL %d.%d, multi draw indirect %s\n", major, minor, multi_draw_indirect_proc ? "available" : "missing");
+    return multi_draw_indirect_proc != NULL;
+}
+
+bool has_multi_draw_indirect(void)
+{
+    return multi_draw_indirect_proc != NULL;
+}
+
+// Commands are read from the bound GL_DRAW_INDIRECT_BUFFER at `offset`
+void multi_draw_elements_indirect(const void *offset, int draw_count)
+{
+    multi_draw_indirect_proc(GL_TRIANGLES, GL_UNSIGNED_INT, offset, draw_count, 0);
+}
+
+void use_program(unsigned int program)
+{
+    if (gl_state.program == program) {
+        frame_stats.binds_skipped++;
+        return;
+    }
+    glUseProgram(program);
+    gl_state.program = program;
+    frame_stats.state_changes++;
+}
+
+void bind_texture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+    if (gl_state.active_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        gl_state.active_unit = unit;
+        frame_stats.state_changes++;
+    }
+    int slot = target == GL_TEXTURE_2D ? 0 : target == GL_TEXTURE_2D_ARRAY ? 1 : -1;
+    if (slot < 0 || unit >= RENDER_TEXTURE_UNITS) {
+        glBindTexture(target, texture);
+        frame_stats.state_changes++;
+        return;
+    }
+    if (gl_state.textures[unit][slot] == texture) {
+        frame_stats.binds_skipped++;
+        return;
+    }
+    glBindTexture(target, texture);
+    gl_state.textures[unit][slot] = texture;
+    frame_stats.state_changes++;
+}
+
+void bind_vertex_array(unsigned int vao)
+{
+    if (gl_state.vao == vao) {
+        frame_stats.binds_skipped++;
+        return;
+    }
+    glBindVertexArray(vao);
+    gl_state.vao = vao;
+    frame_stats.state_changes++;
+}
+
+void reset_gl_state_cache(void)
+{
+    // No GL name is ~0, the next bind of anything reaches GL
+    memset(&gl_state, 0xFF, sizeof(gl_state));
+}
+
+void begin_render_frame(void)
+{
+    last_stats = frame_stats;
+    memset(&frame_stats, 0, sizeof(frame_stats));
+}
+
+void get_render_stats(RenderStats *stats)
+{
+    *stats = last_stats;
+}
+
+uint64_t make_render_key(RenderPass pass, unsigned int program, unsigned int texture,
+                         unsigned int vao, float depth)
+{
+    // The bits of a non negative float sort like its value, keep the top 24
+    uint32_t bits = 0;
+    if (depth > 0.0f) {
+        memcpy(&bits, &depth, sizeof(bits));
+    }
+    uint64_t order = bits >> 7;
+    if (pass == RENDER_PASS_TRANSLUCENT) {
+        order = 0xFFFFFF - order;
+    } else if (pass == RENDER_PASS_OVERLAY) {
+        order = 0;
+    }
+    return (uint64_t)(pass & 0xF) << 60 | (uint64_t)(program & 0xFFF) << 48 |
+           (uint64_t)(texture & 0xFFF) << 36 | (uint64_t)(vao & 0xFFF) << 24 | order;
+}
+
+void init_render_queue(RenderQueue *queue)
+{
+    memset(queue, 0, sizeof(RenderQueue));
+}
+
+void free_render_queue(RenderQueue *queue)
+{
+    free(queue->items);
+    free(queue->keys);
+    free(queue->order);
+    init_render_queue(queue);
+}
+
+bool push_render_item(RenderQueue *queue, const RenderItem *item)
+{
+    if (queue->count == queue->capacity) {
+        uint32_t capacity = queue->capacity ? queue->capacity * 2 : 64;
+        RenderItem *items = (RenderItem *) realloc(queue->items, capacity * sizeof(RenderItem));
+        if (items == NULL) {
+            return false;
+        }
+        queue->items = items;
+        uint64_t *keys = (uint64_t *) realloc(queue->keys, 2 * capacity * sizeof(uint64_t));
+        if (keys == NULL) {
+            return false;
+        }
+        queue->keys = keys;
+        uint32_t *order = (uint32_t *) realloc(queue->order, 2 * capacity * sizeof(uint32_t));
+        if (order == NULL) {
+            return false;
+        }
+        queue->order = order;
+        queue->capacity = capacity;
+    }
+    queue->items[queue->count++] = *item;
+    return true;
+}
+
+// Least significant digit first, a byte per pass. Passes where every key
+// has the same byte leave the order as it is and are skipped, which for
+// a frame's keys is most of them. Returns the sorted item indices.
+static const uint32_t *sort_render_queue(RenderQueue *queue)
+{
+    uint32_t n = queue->count;
+    uint64_t *keys = queue->keys;
+    uint64_t *keys_out = queue->keys + queue->capacity;
+    uint32_t *order = queue->order;
+    uint32_t *order_out = queue->order + queue->capacity;
+    for (uint32_t i = 0; i < n; i++) {
+        keys[i] = queue->items[i].key;
+        order[i] = i;
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        uint32_t counts[256] = {0};
+        for (uint32_t i = 0; i < n; i++) {
+            counts[(keys[i] >> shift) & 0xFF]++;
+        }
+        if (counts[(keys[0] >> shift) & 0xFF] == n) {
+            continue;
+        }
+        uint32_t sum = 0;
+        for (int b = 0; b < 256; b++) {
+            uint32_t c = counts[b];
+            counts[b] = sum;
+            sum += c;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t to = counts[(keys[i] >> shift) & 0xFF]++;
+            keys_out[to] = keys[i];
+            order_out[to] = order[i];
+        }
+        uint64_t *k = keys;
+        keys = keys_out;
+        keys_out = k;
+        uint32_t *o = order;
+        order = order_out;
+        order_out = o;
+    }
+    return order;
+}
+
+void submit_render_queue(RenderQueue *queue)
+{
+    if (queue->count == 0) {
+        return;
+    }
+    const uint32_t *order = sort_render_queue(queue);
+    for (uint32_t i = 0; i < queue->count; i++) {
+        const RenderItem *item = &queue->items[order[i]];
+        use_program(item->program);
+        if (item->texture != 0) {
+            bind_texture(0, item->texture_target, item->texture);
+        }
+        if (item->vao != 0) {
+            bind_vertex_array(item->vao);
+        }
+        frame_stats.draw_calls += item->draw(item->data);
+    }
+    frame_stats.items += queue->count;
+    queue->count = 0;
+}
@@ -1,8 +1,115 @@
 #ifndef _RENDERER_H_
 #define _RENDERER_H_
 
+#include "../loki.h"
+#include <stdbool.h>
+#include <stdint.h>
 
+// Element buffer holding the quad index pattern for `quads` quads. It is
+// written once and bound in every chunk VAO, chunk meshes only upload their
+// vertices. Returns 0 on failure.
+unsigned int create_quad_index_buffer(uint32_t quads);
+void destroy_quad_index_buffer(unsigned int buffer);
 
+// Describe the chunk vertex attributes of `format` to the bound VAO, reading
+// from the bound GL_ARRAY_BUFFER
+void set_chunk_vertex_layout(VertexFormat format);
 
+// Per chunk origin (vec3, in blocks) added to the chunk local positions.
+// An instanced array when drawing indirect, a constant attribute otherwise.
+#define CHUNK_ORIGIN_ATTRIB 3
 
-#endif // _RENDERER_H_
\ No newline at end of file
+// How chunk batches reach the GPU
+typedef enum {
+    DRAW_PATH_SINGLE = 0,           // one glDrawElementsBaseVertex per chunk, GL 3.3
+    DRAW_PATH_MULTI_INDIRECT,       // one glMultiDrawElementsIndirect per page, GL 4.3
+    MAX_DRAW_PATH,
+} DrawPath;
+
+// Layout fixed by GL for GL_DRAW_INDIRECT_BUFFER
+typedef struct {
+    uint32_t count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+} DrawElementsIndirectCommand;
+
+// glad only covers GL 4.1, load glMultiDrawElementsIndirect by hand when the
+// context is 4.3 or has ARB_multi_draw_indirect. Call after gladLoadGL.
+bool load_multi_draw_indirect(void);
+bool has_multi_draw_indirect(void);
+void multi_draw_elements_indirect(const void *offset, int draw_count);
+
+// GL state cache. Programs, textures and VAOs are bound through these and
+// the call is skipped when the object is already bound. The cache starts
+// out matching a fresh context. Code binding any of them directly, or
+// deleting a bound object, calls reset_gl_state_cache afterwards.
+#define RENDER_TEXTURE_UNITS    8
+
+void use_program(unsigned int program);
+// GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY on the first RENDER_TEXTURE_UNITS
+// units are cached, other targets are always bound. Leaves `unit` active.
+void bind_texture(unsigned int unit, unsigned int target, unsigned int texture);
+void bind_vertex_array(unsigned int vao);
+void reset_gl_state_cache(void);
+
+typedef struct {
+    uint32_t items;             // render queue items submitted
+    uint32_t draw_calls;        // as reported by the items
+    uint32_t state_changes;     // binds that reached GL
+    uint32_t binds_skipped;     // redundant binds dropped by the cache
+} RenderStats;
+
+// Start a frame's counters, the finished frame's become the last ones
+void begin_render_frame(void);
+void get_render_stats(RenderStats *stats);
+
+// Render queue. Items collected over a frame are radix sorted on their key
+// and submitted in that order, so items sharing a program, texture or VAO
+// run back to back and the state cache drops the repeated binds.
+//
+// Key bits, most significant first: pass (4), program (12), texture (12),
+// VAO (12), depth (24). Opaque passes draw front to back, the translucent
+// one back to front.
+typedef enum {
+    RENDER_PASS_OPAQUE = 0,
+    RENDER_PASS_CUTOUT,             // alpha tested
+    RENDER_PASS_TRANSLUCENT,
+    RENDER_PASS_OVERLAY,            // UI and debug, no depth order
+    MAX_RENDER_PASS,
+} RenderPass;
+
+// Issues the item's draws with its state bound, returns the draw calls made
+typedef uint32_t (*RenderDrawFn)(void *data);
+
+typedef struct {
+    uint64_t key;
+    unsigned int program;
+    unsigned int texture_target;    // on unit 0, ignored when `texture` is 0
+    unsigned int texture;
+    unsigned int vao;               // 0 when the draw binds its own
+    RenderDrawFn draw;
+    void *data;
+} RenderItem;
+
+typedef struct {
+    RenderItem *items;
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t *keys;                 // sort scratch, two halves
+    uint32_t *order;                // sort scratch, two halves
+} RenderQueue;
+
+// `depth` is the view distance, negative values count as 0
+uint64_t make_render_key(RenderPass pass, unsigned int program, unsigned int texture,
+                         unsigned int vao, float depth);
+
+void init_render_queue(RenderQueue *queue);
+void free_render_queue(RenderQueue *queue);
+// False when out of memory
+bool push_render_item(RenderQueue *queue, const RenderItem *item);
+// Sort, bind and draw every item, then empty the queue
+void submit_render_queue(RenderQueue *queue);
+
+#endif // _RENDERER_H_
@@ -0,0 +1,203 @@
+#include "shader_loader.h"
+#include "gfx.h"
+#include "../util/log.h"
+#include "../util/res.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+static bool parallel_compile;
+
+
+bool load_parallel_shader_compile(void)
+{
+    MaxShaderCompilerThreadsProc proc = NULL;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+        proc = (MaxShaderCompilerThreadsProc) glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    } else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+        proc = (MaxShaderCompilerThreadsProc) glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    }
+    parallel_compile = proc != NULL;
+    if (parallel_compile) {
+        // As many threads as the driver likes
+        proc(0xFFFFFFFF);
+    }
+    DEBUG("Parallel shader compile %s\n", parallel_compile ? "available" : "missing");
+    return parallel_compile;
+}
+
+bool has_parallel_shader_compile(void)
+{
+    return parallel_compile;
+}
+
+// `text` with the defines and the preamble after its #version line
+static char *assemble_source(const char *text, const ShaderDesc *desc)
+{
+    const char *version = strstr(text, "#version");
+    if (version == NULL) {
+        return NULL;
+    }
+    const char *body = strchr(version, '\n');
+    body = body ? body + 1 : version + strlen(version);
+    int body_line = 1;
+    for (const char *c = text; c < body; c++) {
+        body_line += *c == '\n';
+    }
+
+    size_t size = strlen(text) + 32;
+    for (const char *const *d = desc->defines; d && *d; d++) {
+        size += strlen(*d) + 10;
+    }
+    size += desc->preamble ? strlen(desc->preamble) + 1 : 0;
+    char *source = (char *) malloc(size);
+    if (source == NULL) {
+        return NULL;
+    }
+    size_t used = (size_t)(body - text);
+    memcpy(source, text, used);
+    if (used == 0 || source[used - 1] != '\n') {
+        source[used++] = '\n';
+    }
+    for (const char *const *d = desc->defines; d && *d; d++) {
+        used += sprintf(source + used, "#define %s\n", *d);
+    }
+    if (desc->preamble) {
+        used += sprintf(source + used, "%s\n", desc->preamble);
+    }
+    used += sprintf(source + used, "#line %d\n", body_line);
+    strcpy(source + used, body);
+    return source;
+}
+
+static bool fail(ShaderProgram *program, const char *what, const char *file)
+{
+    snprintf(program->error, sizeof(program->error), "%s %s", what, file);
+    program->status = SHADER_FAILED;
+    return false;
+}
+
+bool begin_shader_program(ShaderProgram *program, const ShaderDesc *desc)
+{
+    memset(program, 0, sizeof(ShaderProgram));
+    const unsigned int types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+    const char *files[2] = {desc->vertex_file, desc->fragment_file};
+    char *sources[2] = {NULL, NULL};
+    for (int i = 0; i < 2; i++) {
+        char *text = read_text_file(files[i]);
+        if (text == NULL) {
+            free(sources[0]);
+            return fail(program, "cannot read", files[i]);
+        }
+        sources[i] = assemble_source(text, desc);
+        destroy_resource(text);
+        if (sources[i] == NULL) {
+            free(sources[0]);
+            return fail(program, "no #version line in", files[i]);
+        }
+    }
+
+    program->program = find_cached_program(types, (const char *const *) sources, 2, &program->cache_key);
+    if (program->program != 0) {
+        program->status = SHADER_READY;
+    } else {
+        // Compile and link without asking how it went, that is the poll's job
+        program->start = glfwGetTime();
+        program->polled = program->start;
+        program->program = glCreateProgram();
+        for (int i = 0; i < 2; i++) {
+            program->shaders[i] = glCreateShader(types[i]);
+            glShaderSource(program->shaders[i], 1, (const char *const *) &sources[i], NULL);
+            glCompileShader(program->shaders[i]);
+            glAttachShader(program->program, program->shaders[i]);
+        }
+        if (is_program_cache_enabled()) {
+            glProgramParameteri(program->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(program->program);
+        program->status = SHADER_PENDING;
+    }
+    free(sources[0]);
+    free(sources[1]);
+    return true;
+}
+
+// Collect the outcome of a finished compile and link
+static ShaderStatus finish_shader_program(ShaderProgram *program)
+{
+    static const char *stages[2] = {"vertex", "fragment"};
+    int ok = GL_TRUE;
+    for (int i = 0; i < 2 && ok; i++) {
+        glGetShaderiv(program->shaders[i], GL_COMPILE_STATUS, &ok);
+        if (ok != GL_TRUE) {
+            int used = snprintf(program->error, sizeof(program->error), "%s: ", stages[i]);
+            glGetShaderInfoLog(program->shaders[i], sizeof(program->error) - used, NULL, program->error + used);
+        }
+    }
+    if (ok == GL_TRUE) {
+        glGetProgramiv(program->program, GL_LINK_STATUS, &ok);
+        if (ok != GL_TRUE) {
+            int used = snprintf(program->error, sizeof(program->error), "link: ");
+            glGetProgramInfoLog(program->program, sizeof(program->error) - used, NULL, program->error + used);
+        }
+    }
+    // Without a completion status the queries above waited for the driver
+    if (program->compile_time == 0.0) {
+        program->compile_time = glfwGetTime() - program->start;
+    }
+    for (int i = 0; i < 2; i++) {
+        glDeleteShader(program->shaders[i]);
+        program->shaders[i] = 0;
+    }
+
+    if (ok != GL_TRUE) {
+        glDeleteProgram(program->program);
+        program->program = 0;
+        program->status = SHADER_FAILED;
+        return SHADER_FAILED;
+    }
+    // The driver finished somewhere between the last two polls, the middle
+    // is kept so the frames spent waiting to be polled are mostly left out
+    store_cached_program(&program->cache_key, program->program, program->compile_time - program->poll_wait / 2.0);
+    program->status = SHADER_READY;
+    return SHADER_READY;
+}
+
+ShaderStatus poll_shader_program(ShaderProgram *program)
+{
+    if (program->status != SHADER_PENDING) {
+        return program->status;
+    }
+    if (parallel_compile) {
+        int done = GL_FALSE;
+        glGetProgramiv(program->program, GL_COMPLETION_STATUS_KHR, &done);
+        double now = glfwGetTime();
+        if (done != GL_TRUE) {
+            program->polled = now;
+            return SHADER_PENDING;
+        }
+        program->compile_time = now - program->start;
+        program->poll_wait = now - program->polled;
+    }
+    return finish_shader_program(program);
+}
+
+ShaderStatus wait_shader_program(ShaderProgram *program)
+{
+    if (program->status != SHADER_PENDING) {
+        return program->status;
+    }
+    return finish_shader_program(program);
+}
+
+void free_shader_program(ShaderProgram *program)
+{
+    for (int i = 0; i < 2; i++) {
+        glDeleteShader(program->shaders[i]);
+    }
+    glDeleteProgram(program->program);
+    memset(program, 0, sizeof(ShaderProgram));
+}
@@ -0,0 +1,61 @@
+#ifndef _SHADER_LOADER_H_
+#define _SHADER_LOADER_H_
+
+#include "program_cache.h"
+#include "shaders.h"
+#include <stdbool.h>
+
+// Programs built from GLSL files, one permutation per set of defines, and
+// compiled without blocking the caller.
+//
+// The defines and a preamble (e.g. FRAME_UNIFORMS_GLSL) are inserted right
+// after each file's #version line, followed by a #line directive so errors
+// still point at the file's own lines. begin_shader_program hands the
+// stages to the driver and returns; poll_shader_program then reports the
+// program ready once the driver is done, asking GL_COMPLETION_STATUS_KHR
+// when GL_KHR_parallel_shader_compile (or the ARB version) is there so a
+// compile still running never stalls the frame. Without the extension the
+// first poll waits for the driver. Permutations found in the program cache
+// are ready straight away.
+
+#define SHADER_ERROR_SIZE   1024
+
+typedef enum {
+    SHADER_PENDING = 0,
+    SHADER_READY,
+    SHADER_FAILED,
+} ShaderStatus;
+
+typedef struct {
+    const char *vertex_file;
+    const char *fragment_file;
+    const char *const *defines;     // NULL terminated "NAME" or "NAME value", may be NULL
+    const char *preamble;           // GLSL after the defines, may be NULL
+} ShaderDesc;
+
+typedef struct {
+    unsigned int program;           // usable once SHADER_READY
+    ShaderStatus status;
+    unsigned int shaders[2];        // while compiling
+    double start;                   // when compiling started
+    double polled;                  // last poll that found it still compiling
+    double compile_time;            // seconds from start until seen done
+    double poll_wait;               // of compile_time, since the last poll still compiling
+    ProgramCacheKey cache_key;
+    char error[SHADER_ERROR_SIZE];  // when SHADER_FAILED
+} ShaderProgram;
+
+// Let the driver compile on its own threads when it can. Call after gladLoadGL.
+bool load_parallel_shader_compile(void);
+bool has_parallel_shader_compile(void);
+
+// Start building `desc`. False when it failed already (e.g. a missing
+// file), `program->error` says why.
+bool begin_shader_program(ShaderProgram *program, const ShaderDesc *desc);
+// Never blocks with parallel compile, see above
+ShaderStatus poll_shader_program(ShaderProgram *program);
+// Block until the program is ready or failed
+ShaderStatus wait_shader_program(ShaderProgram *program);
+void free_shader_program(ShaderProgram *program);
+
+#endif // _SHADER_LOADER_H_
@@ -7,7 +7,9 @@
 
 #define ERROR_MSG_SIZE 1024
 
-static char error_string[ERROR_MSG_SIZE];
+// Error of the last synchronous build on this thread, programs built with
+// shader_loader.h keep their own
+static _Thread_local char error_string[ERROR_MSG_SIZE];
 
 static bool check_compile_error(unsigned int shader)
 {
@@ -43,43 +45,72 @@ char* get_shader_error(void)
     return error_string;
 }
 
-unsigned int create_shader_program(const char *vs, const char* fs)
+static unsigned int compile_shader(unsigned int type, const char *src)
 {
-    // Create and compile vertex shader
-    unsigned int vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex_shader, 1, &vs, NULL);
-    glCompileShader(vertex_shader);
-    if (check_compile_error(vertex_shader)) {
-        glDeleteShader(vertex_shader);
+    unsigned int shader = glCreateShader(type);
+    if (shader == 0) {
+        strcpy(error_string, type == GL_COMPUTE_SHADER ? "compute shaders are not supported"
+                                                       : "shader stage is not supported");
+        return 0;
+    }
+    glShaderSource(shader, 1, &src, NULL);
+    glCompileShader(shader);
+    if (check_compile_error(shader)) {
+        glDeleteShader(shader);
         return 0;
     }
+    return shader;
+}
 
-    // Create and compile fragment shader
-    unsigned int fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader, 1, &fs, NULL);
-    glCompileShader(fragment_shader);
-    if (check_compile_error(fragment_shader)) {
-        glDeleteShader(fragment_shader);
+unsigned int build_shader_program(const unsigned int *types, const char *const *sources, int count,
+                                  bool retrievable)
+{
+    unsigned int shaders[MAX_SHADER_STAGES];
+    if (count > MAX_SHADER_STAGES) {
+        strcpy(error_string, "too many shader stages");
         return 0;
     }
+    for (int i = 0; i < count; i++) {
+        if ((shaders[i] = compile_shader(types[i], sources[i])) == 0) {
+            while (i-- > 0) {
+                glDeleteShader(shaders[i]);
+            }
+            return 0;
+        }
+    }
 
-    // Create shader program
     unsigned int shader_program = glCreateProgram();
-    glAttachShader(shader_program, vertex_shader);
-    glAttachShader(shader_program, fragment_shader);
+    for (int i = 0; i < count; i++) {
+        glAttachShader(shader_program, shaders[i]);
+    }
+    // Must be set before linking for glGetProgramBinary to have a binary
+    if (retrievable && glProgramParameteri != NULL) {
+        glProgramParameteri(shader_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(shader_program);
+
+    // Delete shaders as they're linked into our program now and no longer necessary
+    for (int i = 0; i < count; i++) {
+        glDeleteShader(shaders[i]);
+    }
     if (check_link_error(shader_program)) {
-        glDeleteShader(vertex_shader);
-        glDeleteShader(fragment_shader);
         glDeleteProgram(shader_program);
         return 0;
     }
+    return shader_program;
+}
 
-    // Delete shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);   
+unsigned int create_shader_program(const char *vs, const char* fs)
+{
+    const unsigned int types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+    const char *sources[2] = {vs, fs};
+    return build_shader_program(types, sources, 2, false);
+}
 
-    return shader_program;
+unsigned int create_compute_program(const char *cs)
+{
+    const unsigned int types[1] = {GL_COMPUTE_SHADER};
+    return build_shader_program(types, &cs, 1, false);
 }
 
 void destroy_shader_program(unsigned int sp)
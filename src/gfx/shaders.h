@@ -1,10 +1,19 @@
 #ifndef _SHADERS_H_
 #define _SHADERS_H_
 
+#include <stdbool.h>
 
+#define MAX_SHADER_STAGES   4
 
 char* get_shader_error(void);    
+// Compile `count` stages, `types` being GL_VERTEX_SHADER and the like, and
+// link them. `retrievable` keeps the binary for glGetProgramBinary (see
+// program_cache.h). Returns 0 on failure.
+unsigned int build_shader_program(const unsigned int *types, const char *const *sources, int count,
+                                  bool retrievable);
 unsigned int create_shader_program(const char *vs, const char* fs);
+// Compute only program, needs GL 4.3 or ARB_compute_shader
+unsigned int create_compute_program(const char *cs);
 void destroy_shader_program(unsigned int sp);
 
 #endif //_SHADERS_H_
\ No newline at end of file
@@ -1,8 +1,23 @@
 #include "loki.h"
+#include "gfx/arena.h"
+#include "gfx/frame_uniforms.h"
+#include "gfx/frustum.h"
 #include "gfx/gfx.h"
-#include "gfx/shaders.h"
+#include "gfx/gpu_cull.h"
+#include "gfx/occlusion.h"
+#include "gfx/program_cache.h"
+#include "gfx/renderer.h"
+#include "gfx/shader_loader.h"
 #include "util/log.h"
 #include "util/res.h"
+#include "world/chunk.h"
+#include "world/chunk_map.h"
+#include "world/gen_pool.h"
+#include "world/heightmap.h"
+#include "world/light.h"
+#include "world/mesh_pool.h"
+#include "world/visibility.h"
+#include "world/worldgen.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,35 +25,75 @@
 EngineState engine;
 Mouse mouse;
 Camera *camera;
+MesherMode mesher_mode = MESHER_GREEDY;
+VertexFormat vertex_format = VERTEX_FORMAT_PACKED;
+bool remesh = true;
+bool print_stats = false;
+DrawPath draw_path = DRAW_PATH_SINGLE;
+bool cave_culling = true;
+bool occlusion_culling = true;
+bool gpu_culling = false;
+
+// Demo world: a square of chunks around the origin, meshed by the worker pool
+#define DEMO_RADIUS 2
+#define DEMO_CHUNKS ((2 * DEMO_RADIUS + 1) * (2 * DEMO_RADIUS + 1))
+#define DEMO_INDEX(coord) (((coord).z + DEMO_RADIUS) * (2 * DEMO_RADIUS + 1) + (coord).x + DEMO_RADIUS)
+#define DEMO_SEED   0x10C1
+
+// Blocks between the ground and the camera at startup
+#define SPAWN_EYE_HEIGHT    8.0f
+// Bytes of chunk meshes the arenas may move per frame to close holes
+#define ARENA_COMPACT_BUDGET (1 << 20)
+
+// Linked shader binaries from earlier runs, see program_cache.h
+#define PROGRAM_CACHE_DIR "./shader_cache"
+
+// GPU side of one chunk of the demo world
+typedef struct {
+    Chunk *chunk;
+    ArenaAlloc alloc;       // in arenas[format]
+    VertexFormat format;
+} ChunkDraw;
+
+// Render queue item drawing one vertex format's chunks
+typedef struct {
+    VertexArena *arena;
+    GpuCuller *culler;      // NULL unless GPU culling fed the arena
+    DrawPath path;
+} ChunkBatch;
+
+static uint32_t draw_chunk_batch(void *data)
+{
+    ChunkBatch *batch = (ChunkBatch *) data;
+    uint32_t before = batch->arena->draw_calls;
+    draw_arena_batch(batch->arena, batch->path);
+    if (batch->culler != NULL) {
+        draw_gpu_culled(batch->culler, batch->arena);
+    }
+    return batch->arena->draw_calls - before;
+}
+
+// State of a chunk program set once, when its build finished
+static void setup_chunk_program(unsigned int program, float model[4][4])
+{
+    use_program(program);
+    if (!bind_frame_uniform_block(program)) {
+        WARNING("Program %u has no Frame uniform block\n", program);
+    }
+    int model_loc = glGetUniformLocation(program, "model");
+    DEBUG("Model location  = %d\n", model_loc);
+    glUniformMatrix4fv(model_loc, 1, GL_FALSE, model[0]);
+}
 
 
-// Vertex shader
-const char* vertex_shader_src = "#version 330 core\n"
-    "layout (location = 0) in vec3 aPos;\n"
-    "layout (location = 1) in vec2 aTexCoord;\n"
-    "layout (location = 2) in vec3 aNormal;\n"
-    "out vec2 TexCoord;\n"
-    "out vec3 Normal;\n" 
-    "uniform mat4 model;\n"    
-    "uniform mat4 view;\n"    
-    "uniform mat4 projection;\n"    
-    "void main()\n"
-    "{\n"
-    "   gl_Position = projection* view * model * vec4(aPos.x, aPos.y, aPos.z, 1.0);\n"
-    "   TexCoord = aTexCoord;\n"
-    // "   Normal = aNormal;\n"
-    "}\0";
-
-// Fragment shader
-const char* fragment_shader_src = "#version 330 core\n"
-    "in vec2 TexCoord;\n"
-    "in vec3 Normal;\n"
-    "out vec4 FragColor;\n"
-    "uniform sampler2D Texture;\n"
-    "void main()\n"
-    "{\n"
-    "   FragColor = texture(Texture, TexCoord);\n"
-    "}\n\0";
+// Chunk programs, one permutation per vertex format
+#define CHUNK_VERTEX_SHADER     "./res/shaders/chunk.vert"
+#define CHUNK_FRAGMENT_SHADER   "./res/shaders/chunk.frag"
+
+static const char *const chunk_defines[MAX_VERTEX_FORMAT][3] = {
+    [VERTEX_FORMAT_FLOAT] = {"FOG", NULL},
+    [VERTEX_FORMAT_PACKED] = {"PACKED_VERTICES", "FOG", NULL},
+};
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -86,6 +141,40 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         glfwSetWindowShouldClose(window, true);  
         engine.is_mouse_captured = false;
     }
+    // Cycle through the meshers
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        mesher_mode = (mesher_mode + 1) % MAX_MESHER;
+        remesh = true;
+    }
+    // Switch between packed and float (debug) vertices
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        vertex_format = (vertex_format + 1) % MAX_VERTEX_FORMAT;
+        remesh = true;
+    }
+    // Switch between one draw per chunk and multi draw indirect
+    if (key == GLFW_KEY_M && action == GLFW_PRESS && has_multi_draw_indirect()) {
+        draw_path = (draw_path + 1) % MAX_DRAW_PATH;
+        DEBUG("Draw path %d\n", draw_path);
+    }
+    // Cave culling on top of frustum culling
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        cave_culling = !cave_culling;
+        DEBUG("Cave culling %d\n", cave_culling);
+    }
+    // Software occlusion culling after the frustum and cave culling
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        occlusion_culling = !occlusion_culling;
+        DEBUG("Occlusion culling %d\n", occlusion_culling);
+    }
+    // Cull in a compute shader instead of on the CPU
+    if (key == GLFW_KEY_U && action == GLFW_PRESS && has_gpu_culling()) {
+        gpu_culling = !gpu_culling;
+        DEBUG("GPU culling %d\n", gpu_culling);
+    }
+    // Dump the vertex arena statistics
+    if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+        print_stats = true;
+    }
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -97,6 +186,21 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 }
 
 
+// A few lava blocks on the grass of a generated chunk, giving off block light
+static void sprinkle_demo_lava(Chunk *chunk)
+{
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            int wx = chunk->coord.x * CHUNK_SIZE + x;
+            int wz = chunk->coord.z * CHUNK_SIZE + z;
+            int height = get_chunk_height(chunk, x, z);
+            if (height > 0 && get_chunk_block(chunk, x, height - 1, z) == GRASS && (wx * 7 + wz * 13) % 89 == 0) {
+                set_chunk_block(chunk, x, height - 1, z, LAVA);
+            }
+        }
+    }
+}
+
 void update(EngineState* state)
 {
     // Regular game updates using delta time
@@ -153,8 +257,8 @@ int main()
         return -1;
     }
 
-    // Set OpenGL version
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // Set OpenGL version, 4.3 for multi draw indirect
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     #ifdef __APPLE__
@@ -163,6 +267,12 @@ int main()
 
     // Create a windowed mode window and its OpenGL context
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Voxel Engine", NULL, NULL);
+    if (!window) {
+        // Fall back to 3.3 and one draw call per chunk
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Voxel Engine", NULL, NULL);
+    }
     if (!window) {
         FATAL("Failed to create GLFW window\n");
         glfwTerminate();
@@ -187,123 +297,202 @@ int main()
         FATAL("Failed to initialize GLAD\n");
         return -1;
     }
+    if (load_multi_draw_indirect()) {
+        draw_path = DRAW_PATH_MULTI_INDIRECT;
+    }
+    load_gpu_culling();
+    init_program_cache(PROGRAM_CACHE_DIR);
+    load_parallel_shader_compile();
+
+    // Start the chunk programs, one per vertex format. They compile while the
+    // world is built and the render loop takes each one up once it is ready.
+    ShaderProgram chunk_programs[MAX_VERTEX_FORMAT];
+    unsigned int shader_programs[MAX_VERTEX_FORMAT] = {0};
+    int programs_ready = 0;
+    double programs_start = glfwGetTime();
+    for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+        ShaderDesc desc = {CHUNK_VERTEX_SHADER, CHUNK_FRAGMENT_SHADER, chunk_defines[f], FRAME_UNIFORMS_GLSL};
+        if (!begin_shader_program(&chunk_programs[f], &desc)) {
+            FATAL("Failed to generate shader program %d :\n\t%s\n", f, chunk_programs[f].error);
+            return -1;
+        }
+    }
+
 
-    // Create shader program
-    unsigned int shader_program = create_shader_program(vertex_shader_src,  fragment_shader_src);
-    DEBUG("Program creation returned : %d\n", shader_program);
-    if (shader_program == 0) {
-        FATAL("Failed to generate shader program :\n\t%s\n", get_shader_error());
+    // Build the demo world, the worker pool meshes it in the render loop
+    ChunkMap *chunk_map = create_chunk_map(DEMO_CHUNKS);
+    MeshPool *mesh_pool = create_mesh_pool(chunk_map, 0);
+    if (chunk_map == NULL || mesh_pool == NULL) {
+        FATAL("Failed to create the chunk map and mesh workers\n");
         return -1;
     }
+    DEBUG("Mesh pool started %d workers\n", mesh_pool->thread_count);
 
+    // One index buffer for every chunk, meshes only carry vertices
+    unsigned int quad_ebo = create_quad_index_buffer(MAX_CHUNK_QUADS);
+    if (quad_ebo == 0) {
+        FATAL("Failed to create the quad index buffer\n");
+        return -1;
+    }
 
-    // Set up vertex data (a cube)
-    Vertex vertices[] = {
-        // Front face             Texture Coord. U,V    Normal Vector
-        {{-0.5f, -0.5f,  0.5f},     {0.0f, 0.0f},       { 0.0f, 0.0f, 1.0f},},
-        {{ 0.5f, -0.5f,  0.5f},     {1.0f, 0.0f},       { 0.0f, 0.0f, 1.0f},},
-        {{ 0.5f,  0.5f,  0.5f},     {1.0f, 1.0f},       { 0.0f, 0.0f, 1.0f},},
-        {{-0.5f,  0.5f,  0.5f},     {0.0f, 1.0f},       { 0.0f, 0.0f, 1.0f},},
-        // Back face            
-        {{-0.5f, -0.5f, -0.5f},     {0.0f, 0.0f},       { 0.0f, 0.0f,-1.0f},}, 
-        {{ 0.5f, -0.5f, -0.5f},     {1.0f, 0.0f},       { 0.0f, 0.0f,-1.0f},},
-        {{ 0.5f,  0.5f, -0.5f},     {1.0f, 1.0f},       { 0.0f, 0.0f,-1.0f},},
-        {{-0.5f,  0.5f, -0.5f},     {0.0f, 1.0f},       { 0.0f, 0.0f,-1.0f},},
-        // Left face            
-        {{-0.5f, -0.5f, -0.5f},     {0.0f, 0.0f},       {-1.0f, 0.0f, 0.0f},},
-        {{-0.5f, -0.5f,  0.5f},     {1.0f, 0.0f},       {-1.0f, 0.0f, 0.0f},},
-        {{-0.5f,  0.5f,  0.5f},     {1.0f, 1.0f},       {-1.0f, 0.0f, 0.0f},},
-        {{-0.5f,  0.5f, -0.5f},     {0.0f, 1.0f},       {-1.0f, 0.0f, 0.0f},},
-        // Right face           
-        {{ 0.5f, -0.5f, -0.5f},     {0.0f, 0.0f},       { 1.0f, 0.0f, 0.0f},},
-        {{ 0.5f, -0.5f,  0.5f},     {1.0f, 0.0f},       { 1.0f, 0.0f, 0.0f},},
-        {{ 0.5f,  0.5f,  0.5f},     {1.0f, 1.0f},       { 1.0f, 0.0f, 0.0f},},
-        {{ 0.5f,  0.5f, -0.5f},     {0.0f, 1.0f},       { 1.0f, 0.0f, 0.0f},},
-        // Top face         
-        {{-0.5f,  0.5f, -0.5f},     {0.0f, 0.0f},       { 0.0f, 1.0f, 0.0f},},
-        {{ 0.5f,  0.5f, -0.5f},     {1.0f, 0.0f},       { 0.0f, 1.0f, 0.0f},},
-        {{ 0.5f,  0.5f,  0.5f},     {1.0f, 1.0f},       { 0.0f, 1.0f, 0.0f},},
-        {{-0.5f,  0.5f,  0.5f},     {0.0f, 1.0f},       { 0.0f, 1.0f, 0.0f},},
-        // Bottom face          
-        {{-0.5f, -0.5f, -0.5f},     {0.0f, 0.0f},       { 0.0f,-1.0f, 0.0f},},
-        {{ 0.5f, -0.5f, -0.5f},     {1.0f, 0.0f},       { 0.0f,-1.0f, 0.0f},},
-        {{ 0.5f, -0.5f,  0.5f},     {1.0f, 1.0f},       { 0.0f,-1.0f, 0.0f},},
-        {{-0.5f, -0.5f,  0.5f},     {0.0f, 1.0f},       { 0.0f,-1.0f, 0.0f},},
-    };  
-    
+    // Chunk vertices of each format share the pages of one arena
+    VertexArena *arenas[MAX_VERTEX_FORMAT];
+    for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+        if ((arenas[f] = create_vertex_arena((VertexFormat)f, quad_ebo)) == NULL) {
+            FATAL("Failed to create the vertex arenas\n");
+            return -1;
+        }
+    }
+    // GPU culling, when the context has compute shaders: records per arena,
+    // tested against the depth pyramid of the previous frame
+    GpuCuller *gpu_cullers[MAX_VERTEX_FORMAT] = {NULL};
+    DepthPyramid *depth_pyramid = NULL;
+    if (has_gpu_culling()) {
+        depth_pyramid = create_depth_pyramid();
+        for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+            gpu_cullers[f] = create_gpu_culler();
+            if (gpu_cullers[f] == NULL || depth_pyramid == NULL) {
+                FATAL("Failed to create the GPU culling\n");
+                return -1;
+            }
+        }
+    }
 
-    unsigned int indices[] = {
-        0, 1, 2, 0, 2, 3,       // Front face      7--------6 
-        4, 5, 6, 4, 6, 7,       // Back face      /|       /|
-        8, 9, 10, 8, 10, 11,    // Left face    3---------2 | 
-        12, 13, 14, 12, 14, 15, // Right face   |  |      | |   
-        16, 17, 18, 16, 18, 19, // Top face     |  4------|-5
-        20, 21, 22, 20, 22, 23  // Bottom face  | /       |/
-    };                          //              0---------1
-
-    unsigned int VBO, VAO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    glEnableVertexAttribArray(0);
-    // Texture coordinate attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // Normal attribute
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(5 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // Chunk batches go through the render queue, sorted by program and texture
+    RenderQueue render_queue;
+    init_render_queue(&render_queue);
+    ChunkBatch batches[MAX_VERTEX_FORMAT];
+
+    ChunkDraw draws[DEMO_CHUNKS];
+    int draw_count = 0;
+    // Chunk bounds in model space, indexed like draws
+    AabbList bounds;
+    if (!init_aabb_list(&bounds, DEMO_CHUNKS)) {
+        FATAL("Failed to create the chunk bounds\n");
+        return -1;
+    }
+    WorldGen world_gen;
+    WorldGenDesc world_gen_desc = {
+        .seed = DEMO_SEED,
+        .sea_level = 10,
+        .land_height = 12.0f,
+        .land_range = 16.0f,
+        .mountain_height = 10.0f,
+        .soil_depth = 2,
+        .cave_threshold = 0.5f,
+        .cave_roof = 4,
+        .cave_step = 4,
+    };
+    if (!init_world_gen(&world_gen, &world_gen_desc)) {
+        FATAL("Failed to set up the world generator\n");
+        return -1;
+    }
+    // Noise terrain low enough to fit the single layer of demo chunks, from
+    // the generation workers. They hand the chunks back in any order.
+    GenPool *gen_pool = create_gen_pool(&world_gen, 0, 0, 0);
+    if (gen_pool == NULL) {
+        FATAL("Failed to start the generation workers\n");
+        return -1;
+    }
+    double gen_start = glfwGetTime();
+    if (!request_gen_area(gen_pool, (ChunkCoord){0, 0, 0}, DEMO_RADIUS)) {
+        FATAL("Failed to request the demo chunks\n");
+        return -1;
+    }
+    wait_gen_pool(gen_pool);
+    Chunk *generated[DEMO_CHUNKS];
+    draw_count = collect_gen_chunks(gen_pool, generated, DEMO_CHUNKS);
+    if (draw_count != DEMO_CHUNKS) {
+        FATAL("Failed to generate the demo chunks, %d out of %d\n", draw_count, DEMO_CHUNKS);
+        return -1;
+    }
+    double gen_time = glfwGetTime() - gen_start;
+    DEBUG("Generated %d chunks on %d workers in %.1f ms, %.0f chunks/s\n", draw_count, gen_pool->thread_count,
+          gen_time * 1e3, draw_count / gen_time);
+    destroy_gen_pool(gen_pool);
+    for (int i = 0; i < draw_count; i++) {
+        sprinkle_demo_lava(generated[i]);
+        draws[DEMO_INDEX(generated[i]->coord)].chunk = generated[i];
+    }
+    for (int i = 0; i < draw_count; i++) {
+        ChunkDraw *draw = &draws[i];
+        insert_chunk(chunk_map, draw->chunk);
+        init_arena_alloc(&draw->alloc);
+        draw->format = vertex_format;
+        float min[3] = {draw->chunk->coord.x * CHUNK_SIZE, 0.0f, draw->chunk->coord.z * CHUNK_SIZE};
+        float max[3] = {min[0] + CHUNK_SIZE, CHUNK_SIZE, min[2] + CHUNK_SIZE};
+        push_aabb(&bounds, min, max);
+    }
+    // Light the loaded world, the first meshes bake it in
+    LightEngine light_engine;
+    init_light_engine(&light_engine, chunk_map);
+    double light_start = glfwGetTime();
+    for (int i = 0; i < draw_count; i++) {
+        if (!light_chunk(&light_engine, draws[i].chunk)) {
+            FATAL("Failed to light the demo chunk\n");
+            return -1;
+        }
+    }
+    DEBUG("Lit %d chunks in %.1f ms, %llu voxels visited\n", draw_count, (glfwGetTime() - light_start) * 1e3,
+          (unsigned long long)light_engine.visited);
+    free_light_engine(&light_engine);
+
+    uint32_t visible[DEMO_CHUNKS];
+    uint32_t visible_count = 0;
+    uint32_t frustum_count = 0;
+    ChunkTraversal traversal;
+    init_chunk_traversal(&traversal);
+    double cave_time = 0.0;
+    OcclusionBuffer *occlusion = create_occlusion_buffer(256, 128);
+    if (occlusion == NULL) {
+        FATAL("Failed to create the occlusion buffer\n");
+        return -1;
+    }
+    double occlusion_time = 0.0;
 
     // Enable depth testing
     glEnable(GL_DEPTH_TEST);
 
-    // Rotate the cube 90deg on Z and reduce the size
+    // Chunk meshes are in chunk local coordinates, move the world in front of
+    // the camera with the ground under it SPAWN_EYE_HEIGHT blocks below
+    vec3 world_offset = {-CHUNK_SIZE / 2.0f, 0.0f, -CHUNK_SIZE - 8.0f};
+    int32_t ground = find_surface_height(chunk_map, (int32_t)floorf(camera->position[0] - world_offset[0]),
+                                         (int32_t)floorf(camera->position[2] - world_offset[2]), CHUNK_SIZE - 1);
+    world_offset[1] = camera->position[1] - (float)(ground != HEIGHT_NONE ? ground + 1 : 0) - SPAWN_EYE_HEIGHT;
     mat4 model;
     glm_mat4_identity(model);
-
-    glm_rotate(model, glm_rad(-55.0), (vec3){1.0f, 0.0f, 0.0f});
+    glm_translate(model, world_offset);
     glm_perspective(glm_rad(camera->fov), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f, camera->projection);
 
-    // Use our shader program
-    glUseProgram(shader_program);
-
-    // send model matrix
-    unsigned int model_loc = glGetUniformLocation(shader_program, "model");
-    DEBUG("Model location  = %d\n", model_loc);
-    glUniformMatrix4fv(model_loc, 1, GL_FALSE, model[0]);
-
-    // send view matrix
-    unsigned int view_loc = glGetUniformLocation(shader_program, "view");
-    DEBUG("View location  = %d\n", view_loc);
-    glUniformMatrix4fv(view_loc, 1, GL_FALSE, camera->view[0]);
-
-    // send projection matrix
-    unsigned int projection_loc = glGetUniformLocation(shader_program, "projection");
-    DEBUG("Projection location  = %d\n", projection_loc);
-    glUniformMatrix4fv(projection_loc, 1, GL_FALSE, camera->projection[0]);
+    // The camera reaches every program through the Frame uniform block, only
+    // the constant model matrix is a uniform of its own
+    FrameUniformBuffer *frame_uniforms = create_frame_uniform_buffer();
+    if (frame_uniforms == NULL) {
+        FATAL("Failed to create the frame uniform buffer\n");
+        goto CLEAN_UP;
+    }
+    FrameUniforms frame = {
+        .fog_color = {0.6f, 0.75f, 0.9f, 1.0f},
+        .fog_start = 60.0f,
+        .fog_end = 100.0f,          // the far plane
+        .daylight = 1.0f,
+    };
+    glClearColor(frame.fog_color[0], frame.fog_color[1], frame.fog_color[2], 1.0f);
 
-    // Set back-face culling
-    // glEnable(GL_CULL_FACE);
-    // glCullFace(GL_BACK);
-    // glFrontFace(GL_CCW);
+    // Set back-face culling, the mesher emits counter clockwise faces
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glFrontFace(GL_CCW);
     glEnable(GL_DEPTH_TEST);
 
     // Generate texture
-    unsigned int texture = generate_texture("./res//container.jpg");
+    unsigned int texture = generate_texture_array("./res/blocks.png", 16);
     if (texture == 0){
         FATAL("Failed to generate texture\n");
         goto CLEAN_UP;
     }
+    // Resources were set up with plain binds
+    reset_gl_state_cache();
 
 
     // Render loop
@@ -330,21 +519,220 @@ int main()
         // Render
         render(&engine);
 
-        // Use our shader program
-        glUseProgram(shader_program);
+        // Queue every chunk again when the mesher or the vertex format changed,
+        // the workers start with the chunks closest to the camera
+        vec3 focus;
+        glm_vec3_sub(camera->position, world_offset, focus);
+        set_mesh_pool_focus(mesh_pool, focus);
+        if (remesh) {
+            for (int i = 0; i < draw_count; i++) {
+                submit_mesh_job(mesh_pool, draws[i].chunk, mesher_mode, vertex_format, &draws[i]);
+            }
+            remesh = false;
+        }
+
+        // Only the upload happens on the main thread
+        begin_render_frame();
+        for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+            begin_arena_frame(arenas[f]);
+        }
+        MeshJob *job = collect_mesh_jobs(mesh_pool);
+        while (job) {
+            MeshJob *next = job->next;
+            ChunkDraw *draw = (ChunkDraw *) job->user;
+            if (job->built) {
+                const ChunkMesh *m = &job->mesh;
+                const void *vertices = m->format == VERTEX_FORMAT_PACKED ? (const void *)m->packed_vertices
+                                                                         : (const void *)m->vertices;
+                release_arena_mesh(arenas[draw->format], &draw->alloc);
+                draw->format = m->format;
+                if (!upload_arena_mesh(arenas[draw->format], &draw->alloc, vertices, m->vertex_count / 4)) {
+                    // The old mesh is gone already, skip the chunk rather than draw a stale range
+                    ERROR("Failed to upload the mesh of chunk (%d, %d, %d)\n", draw->chunk->coord.x,
+                          draw->chunk->coord.y, draw->chunk->coord.z);
+                    init_arena_alloc(&draw->alloc);
+                }
+            }
+            release_mesh_job(mesh_pool, job);
+            job = next;
+        }
+        for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+            compact_vertex_arena(arenas[f], ARENA_COMPACT_BUDGET);
+        }
+        if (print_stats) {
+            for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+                ArenaStats stats;
+                get_vertex_arena_stats(arenas[f], &stats);
+                INFO("Arena %d: %u pages, %u meshes, %.1f/%.1f MiB (%.0f%%), fragmentation %.2f, "
+                     "uploaded %llu B, moved %llu B, %u draw calls last frame\n",
+                     f, stats.pages, stats.allocations, stats.used / 1048576.0, stats.capacity / 1048576.0,
+                     stats.occupancy * 100.0f, stats.fragmentation,
+                     (unsigned long long)stats.uploaded, (unsigned long long)stats.moved, stats.draw_calls);
+            }
+            INFO("Culling: %d chunks, %u in the frustum, %u drawn, cave culling %s "
+                 "(%u graph and %u frustum rejects, %.3f ms)\n",
+                 draw_count, frustum_count, visible_count, cave_culling ? "on" : "off",
+                 traversal.stats.graph_rejects, traversal.stats.frustum_rejects, cave_time * 1e3);
+            INFO("Occlusion culling %s: %u occluders, %u quads, %u of %u occluded (%.3f ms)\n",
+                 occlusion_culling ? "on" : "off", occlusion->stats.occluders, occlusion->stats.quads,
+                 occlusion->stats.occluded, occlusion->stats.tested, occlusion_time * 1e3);
+            if (gpu_culling) {
+                uint32_t kept = 0;
+                for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+                    kept += read_gpu_cull_count(gpu_cullers[f]);
+                }
+                INFO("GPU culling: %u chunks drawn\n", kept);
+            }
+            RenderStats render_stats;
+            get_render_stats(&render_stats);
+            INFO("Render queue: %u items, %u draw calls, %u state changes, %u binds skipped\n",
+                 render_stats.items, render_stats.draw_calls, render_stats.state_changes,
+                 render_stats.binds_skipped);
+            print_stats = false;
+        }
+
         update_camera(camera , window);
-        if (engine.update_prospective) {
-            glUniformMatrix4fv(projection_loc, 1, GL_FALSE, camera->projection[0]);
-            engine.update_prospective = false;
+
+        // Camera of the frame, written once for all programs
+        glm_mat4_copy(camera->view, frame.view);
+        glm_mat4_copy(camera->projection, frame.projection);
+        glm_mat4_mul(camera->projection, camera->view, frame.view_projection);
+        glm_vec3_copy(camera->position, frame.camera_position);
+        frame.time = (float) glfwGetTime();
+        update_frame_uniforms(frame_uniforms, &frame);
+
+        // Cull in model space: the planes of projection * view * model
+        // bound the chunks in their own coordinates
+        mat4 view_projection;
+        Frustum frustum;
+        glm_mat4_mul(frame.view_projection, model, view_projection);
+        extract_frustum(&frustum, view_projection);
+        visible_count = 0;
+        frustum_count = 0;
+        if (!gpu_culling) {
+            visible_count = cull_aabbs(&frustum, &bounds, visible);
+            frustum_count = visible_count;
+        }
+
+        // Cave culling walks out from the camera chunk, the chunks it reaches
+        // come front to back. Outside the loaded chunks the frustum result stays.
+        if (cave_culling && !gpu_culling) {
+            double cave_start = glfwGetTime();
+            int32_t reached = traverse_visible_chunks(&traversal, chunk_map, focus, &frustum);
+            cave_time = glfwGetTime() - cave_start;
+            if (reached >= 0) {
+                visible_count = 0;
+                for (int32_t s = 0; s < reached; s++) {
+                    visible[visible_count++] = DEMO_INDEX(traversal.steps[s].chunk->coord);
+                }
+            }
         }
-        glUniformMatrix4fv(view_loc, 1, GL_FALSE, camera->view[0]);
 
-        // Bind texture
-        glBindTexture(GL_TEXTURE_2D, texture);
+        // The solid octants of the remaining chunks hide whatever is behind
+        // them, a chunk never hides itself as it goes in at its far depth
+        if (occlusion_culling && !gpu_culling) {
+            double occlusion_start = glfwGetTime();
+            begin_occlusion_frame(occlusion, view_projection);
+            for (uint32_t v = 0; v < visible_count; v++) {
+                const Chunk *chunk = draws[visible[v]].chunk;
+                float origin[3] = {chunk->coord.x * CHUNK_SIZE, chunk->coord.y * CHUNK_SIZE, chunk->coord.z * CHUNK_SIZE};
+                add_octant_occluders(occlusion, origin, CHUNK_SIZE, chunk->occluders);
+            }
+            rasterize_occlusion_buffer(occlusion);
+            uint32_t kept = 0;
+            for (uint32_t v = 0; v < visible_count; v++) {
+                const Chunk *chunk = draws[visible[v]].chunk;
+                float min[3] = {chunk->coord.x * CHUNK_SIZE, chunk->coord.y * CHUNK_SIZE, chunk->coord.z * CHUNK_SIZE};
+                float max[3] = {min[0] + CHUNK_SIZE, min[1] + CHUNK_SIZE, min[2] + CHUNK_SIZE};
+                if (!is_aabb_occluded(occlusion, min, max)) {
+                    visible[kept++] = visible[v];
+                }
+            }
+            visible_count = kept;
+            occlusion_time = glfwGetTime() - occlusion_start;
+        }
+
+        // Programs still compiling are polled, the chunks they draw wait
+        for (int f = 0; f < MAX_VERTEX_FORMAT && programs_ready < MAX_VERTEX_FORMAT; f++) {
+            if (shader_programs[f] != 0) {
+                continue;
+            }
+            ShaderStatus status = poll_shader_program(&chunk_programs[f]);
+            if (status == SHADER_FAILED) {
+                FATAL("Failed to generate shader program %d :\n\t%s\n", f, chunk_programs[f].error);
+                goto CLEAN_UP;
+            }
+            if (status == SHADER_READY) {
+                shader_programs[f] = chunk_programs[f].program;
+                setup_chunk_program(shader_programs[f], model);
+                if (++programs_ready == MAX_VERTEX_FORMAT) {
+                    ProgramCacheStats program_stats;
+                    get_program_cache_stats(&program_stats);
+                    INFO("Programs ready after %.1f ms: %u from the cache (%.1f ms, %.1f ms of compiling saved), "
+                         "%u compiled (%.1f ms), %u rejected binaries\n", (glfwGetTime() - programs_start) * 1e3,
+                         program_stats.hits, program_stats.load_time * 1e3, program_stats.saved_time * 1e3,
+                         program_stats.misses, program_stats.compile_time * 1e3, program_stats.rejected);
+                }
+            }
+        }
+
+        // Queue the visible chunks, a batch per vertex format with its program
+        for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+            if (shader_programs[f] == 0) {
+                continue;
+            }
+            // The compute pass binds its own program, run it first. Records
+            // only change when meshes were placed, moved or released.
+            if (gpu_culling) {
+                if (is_gpu_culler_stale(gpu_cullers[f], arenas[f])) {
+                    begin_gpu_cull_records(gpu_cullers[f]);
+                    for (int i = 0; i < draw_count; i++) {
+                        if (draws[i].format != (VertexFormat)f) {
+                            continue;
+                        }
+                        ChunkCoord c = draws[i].chunk->coord;
+                        float origin[3] = {c.x * CHUNK_SIZE, c.y * CHUNK_SIZE, c.z * CHUNK_SIZE};
+                        float max[3] = {origin[0] + CHUNK_SIZE, origin[1] + CHUNK_SIZE, origin[2] + CHUNK_SIZE};
+                        add_gpu_cull_record(gpu_cullers[f], &draws[i].alloc, origin, origin, max);
+                    }
+                    end_gpu_cull_records(gpu_cullers[f], arenas[f]);
+                }
+                dispatch_gpu_cull(gpu_cullers[f], arenas[f], view_projection, depth_pyramid);
+            }
+            // One command per chunk, the chunk origin travels with it
+            for (uint32_t v = 0; v < visible_count; v++) {
+                ChunkDraw *draw = &draws[visible[v]];
+                if (draw->format != (VertexFormat)f) {
+                    continue;
+                }
+                ChunkCoord c = draw->chunk->coord;
+                float origin[3] = {c.x * CHUNK_SIZE, c.y * CHUNK_SIZE, c.z * CHUNK_SIZE};
+                if (!add_arena_draw(arenas[f], &draw->alloc, origin)) {
+                    ERROR("Failed to batch the chunk draws of vertex format %d\n", f);
+                    break;
+                }
+            }
+            batches[f] = (ChunkBatch){arenas[f], gpu_culling ? gpu_cullers[f] : NULL, draw_path};
+            RenderItem item = {
+                .key = make_render_key(RENDER_PASS_OPAQUE, shader_programs[f], texture, 0, 0.0f),
+                .program = shader_programs[f],
+                .texture_target = GL_TEXTURE_2D_ARRAY,
+                .texture = texture,
+                .draw = draw_chunk_batch,
+                .data = &batches[f],
+            };
+            if (!push_render_item(&render_queue, &item)) {
+                ERROR("Failed to queue the chunk batch of vertex format %d\n", f);
+            }
+        }
+        submit_render_queue(&render_queue);
 
-        // Draw the cube
-        glBindVertexArray(VAO);
-        glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, 1);
+        // Next frame's occlusion test reads this frame's depth
+        if (gpu_culling) {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            update_depth_pyramid(depth_pyramid, width, height);
+        }
 
         // Swap front and back buffers
         glfwSwapBuffers(window);
@@ -356,10 +744,28 @@ int main()
 
     // Clean up
 CLEAN_UP:
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
-    glDeleteProgram(shader_program);
+    // Workers may still hold chunks, stop them first
+    destroy_mesh_pool(mesh_pool);
+    for (int i = 0; i < draw_count; i++) {
+        destroy_chunk(draws[i].chunk);
+    }
+    destroy_chunk_map(chunk_map);
+    free_aabb_list(&bounds);
+    free_chunk_traversal(&traversal);
+    destroy_occlusion_buffer(occlusion);
+    for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+        destroy_gpu_culler(gpu_cullers[f]);
+    }
+    destroy_depth_pyramid(depth_pyramid);
+    destroy_frame_uniform_buffer(frame_uniforms);
+    free_render_queue(&render_queue);
+    for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+        destroy_vertex_arena(arenas[f]);
+    }
+    destroy_quad_index_buffer(quad_ebo);
+    for (int f = 0; f < MAX_VERTEX_FORMAT; f++) {
+        free_shader_program(&chunk_programs[f]);
+    }
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
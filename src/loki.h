@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
 #include <errno.h>
 #define CGLM_ALL_UNALIGNED
@@ -27,14 +28,13 @@ typedef enum {
     SAND,
     GRASS,
     WATER,
+    LAVA,
+    WOOD,
+    LEAVES,
+    SNOW,
     MAX_VOXEL,
 } VoxelType;
 
-typedef struct {
-    vec3 position;
-    VoxelType type;
-} Voxel;
-
 typedef struct {
     float x;
     float y;
@@ -45,13 +45,33 @@ typedef struct {
 
 typedef struct {
     float position[3];
-    float texCoords[2];
+    float texCoords[3];         // u, v in blocks, texture array layer
     float normal[3];
+    float light[2];             // sky and block light level in front of the face, 0 to 15
     // unsigned int color;
     // unsigned int material_id;
     // float occlusion;
 } Vertex;
 
+// Compact vertex for axis aligned chunk faces, 8 bytes instead of 44.
+// Decoded with bit operations by the packed vertex shader.
+typedef struct {
+    uint32_t position_face;     // x, y, z: 6 bits each (chunk local), face: 3 bits
+    uint32_t uv_layer;          // u, v: 6 bits each (blocks), texture layer: 8 bits,
+                                // light: 8 bits (sky << 4 | block)
+} PackedVertex;
+
+#define PACK_POSITION_FACE(x, y, z, face) \
+    ((uint32_t)(x) | ((uint32_t)(y) << 6) | ((uint32_t)(z) << 12) | ((uint32_t)(face) << 18))
+#define PACK_UV_LAYER(u, v, layer, light) \
+    ((uint32_t)(u) | ((uint32_t)(v) << 6) | ((uint32_t)(layer) << 12) | ((uint32_t)(light) << 20))
+
+typedef enum {
+    VERTEX_FORMAT_FLOAT = 0,    // Vertex, kept for debug meshes
+    VERTEX_FORMAT_PACKED,       // PackedVertex
+    MAX_VERTEX_FORMAT,
+} VertexFormat;
+
 
 
 typedef struct {
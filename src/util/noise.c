@@ -0,0 +1,364 @@
+#include "noise.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define NOISE_AVX2
+#endif
+
+// Backends are instances of noise_kernel.h, see there for the operations
+// each one maps. A backend that is not compiled in has no kernels.
+typedef struct {
+    void (*sample2)(const Noise *noise, const float *x, const float *y, float *out);
+    void (*sample3)(const Noise *noise, const float *x, const float *y, const float *z, float *out);
+} NoiseKernels;
+
+// Scalar: one lane, the reference the vector backends must match bit for bit
+
+static inline float max_scalar(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+static inline uint32_t floor_scalar(float a)
+{
+    int32_t i = (int32_t)a;
+    return (uint32_t)(i - (a < (float)i));
+}
+
+#define NK_WIDTH            1
+#define NK_NAME(name)       name##_scalar
+#define nkf                 float
+#define nki                 uint32_t
+#define nkm                 bool
+#define NK_F(c)             ((float)(c))
+#define NK_I(c)             ((uint32_t)(c))
+#define NK_LOAD(p)          (*(p))
+#define NK_STORE(p, v)      (*(p) = (v))
+#define NK_ADD(a, b)        ((a) + (b))
+#define NK_SUB(a, b)        ((a) - (b))
+#define NK_MUL(a, b)        ((a) * (b))
+#define NK_MAX(a, b)        max_scalar(a, b)
+#define NK_ABS(a)           fabsf(a)
+#define NK_FLIP(m, a)       ((m) ? -(a) : (a))
+#define NK_SELECT(m, a, b)  ((m) ? (a) : (b))
+#define NK_GT(a, b)         ((a) > (b))
+#define NK_GE(a, b)         ((a) >= (b))
+#define NK_MAND(a, b)       ((a) && (b))
+#define NK_MOR(a, b)        ((a) || (b))
+#define NK_MNOT(a)          (!(a))
+#define NK_ONE_IF(m)        ((m) ? 1.0f : 0.0f)
+#define NK_IMASK(m, i)      ((m) ? (i) : 0u)
+#define NK_FLOOR(a)         floor_scalar(a)
+#define NK_TOF(i)           ((float)(int32_t)(i))
+#define NK_IADD(a, b)       ((a) + (b))
+#define NK_IMUL(a, b)       ((a) * (b))
+#define NK_IXOR(a, b)       ((a) ^ (b))
+#define NK_IAND(a, b)       ((a) & (b))
+#define NK_ISHR(a, n)       ((a) >> (n))
+#define NK_IBIT(i, bit)     (((i) & (bit)) != 0)
+#define NK_ILT(a, b)        ((a) < (b))
+#define NK_IEQ(a, b)        ((a) == (b))
+#include "noise_kernel.h"
+
+// SSE2: four lanes, two vectors a call. SSE2 has no 32-bit low multiply,
+// it is put together from the two 32x32->64 products of the even lanes.
+
+#ifdef __SSE2__
+static inline __m128i mullo_sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Truncate, then step down where that rounded up, as floor_scalar does
+static inline __m128i floor_sse2(__m128 a)
+{
+    __m128i i = _mm_cvttps_epi32(a);
+    return _mm_add_epi32(i, _mm_castps_si128(_mm_cmplt_ps(a, _mm_cvtepi32_ps(i))));
+}
+
+static inline __m128 select_sse2(__m128 m, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+static inline __m128 bit_sse2(__m128i i, int bit)
+{
+    __m128i b = _mm_set1_epi32(bit);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(i, b), b));
+}
+
+#define NK_WIDTH            4
+#define NK_NAME(name)       name##_sse2
+#define nkf                 __m128
+#define nki                 __m128i
+#define nkm                 __m128
+#define NK_F(c)             _mm_set1_ps(c)
+#define NK_I(c)             _mm_set1_epi32((int32_t)(c))
+#define NK_LOAD(p)          _mm_loadu_ps(p)
+#define NK_STORE(p, v)      _mm_storeu_ps(p, v)
+#define NK_ADD(a, b)        _mm_add_ps(a, b)
+#define NK_SUB(a, b)        _mm_sub_ps(a, b)
+#define NK_MUL(a, b)        _mm_mul_ps(a, b)
+#define NK_MAX(a, b)        _mm_max_ps(a, b)
+#define NK_ABS(a)           _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define NK_FLIP(m, a)       _mm_xor_ps(a, _mm_and_ps(m, _mm_set1_ps(-0.0f)))
+#define NK_SELECT(m, a, b)  select_sse2(m, a, b)
+#define NK_GT(a, b)         _mm_cmpgt_ps(a, b)
+#define NK_GE(a, b)         _mm_cmpge_ps(a, b)
+#define NK_MAND(a, b)       _mm_and_ps(a, b)
+#define NK_MOR(a, b)        _mm_or_ps(a, b)
+#define NK_MNOT(a)          _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1)))
+#define NK_ONE_IF(m)        _mm_and_ps(m, _mm_set1_ps(1.0f))
+#define NK_IMASK(m, i)      _mm_and_si128(_mm_castps_si128(m), i)
+#define NK_FLOOR(a)         floor_sse2(a)
+#define NK_TOF(i)           _mm_cvtepi32_ps(i)
+#define NK_IADD(a, b)       _mm_add_epi32(a, b)
+#define NK_IMUL(a, b)       mullo_sse2(a, b)
+#define NK_IXOR(a, b)       _mm_xor_si128(a, b)
+#define NK_IAND(a, b)       _mm_and_si128(a, b)
+#define NK_ISHR(a, n)       _mm_srli_epi32(a, n)
+#define NK_IBIT(i, bit)     bit_sse2(i, bit)
+#define NK_ILT(a, b)        _mm_castsi128_ps(_mm_cmplt_epi32(a, b))
+#define NK_IEQ(a, b)        _mm_castsi128_ps(_mm_cmpeq_epi32(a, b))
+#include "noise_kernel.h"
+#endif // __SSE2__
+
+// AVX2: eight lanes, one vector a call. Only these functions are built for
+// AVX2, the build itself stays at the SSE2 baseline. FMA is left out on
+// purpose, a fused multiply add rounds differently from the other backends.
+
+#ifdef NOISE_AVX2
+#ifdef __clang__
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+static inline __m256i floor_avx2(__m256 a)
+{
+    __m256i i = _mm256_cvttps_epi32(a);
+    return _mm256_add_epi32(i, _mm256_castps_si256(_mm256_cmp_ps(a, _mm256_cvtepi32_ps(i), _CMP_LT_OQ)));
+}
+
+static inline __m256 select_avx2(__m256 m, __m256 a, __m256 b)
+{
+    return _mm256_or_ps(_mm256_and_ps(m, a), _mm256_andnot_ps(m, b));
+}
+
+static inline __m256 bit_avx2(__m256i i, int bit)
+{
+    __m256i b = _mm256_set1_epi32(bit);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(i, b), b));
+}
+
+#define NK_WIDTH            8
+#define NK_NAME(name)       name##_avx2
+#define nkf                 __m256
+#define nki                 __m256i
+#define nkm                 __m256
+#define NK_F(c)             _mm256_set1_ps(c)
+#define NK_I(c)             _mm256_set1_epi32((int32_t)(c))
+#define NK_LOAD(p)          _mm256_loadu_ps(p)
+#define NK_STORE(p, v)      _mm256_storeu_ps(p, v)
+#define NK_ADD(a, b)        _mm256_add_ps(a, b)
+#define NK_SUB(a, b)        _mm256_sub_ps(a, b)
+#define NK_MUL(a, b)        _mm256_mul_ps(a, b)
+#define NK_MAX(a, b)        _mm256_max_ps(a, b)
+#define NK_ABS(a)           _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define NK_FLIP(m, a)       _mm256_xor_ps(a, _mm256_and_ps(m, _mm256_set1_ps(-0.0f)))
+#define NK_SELECT(m, a, b)  select_avx2(m, a, b)
+#define NK_GT(a, b)         _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define NK_GE(a, b)         _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define NK_MAND(a, b)       _mm256_and_ps(a, b)
+#define NK_MOR(a, b)        _mm256_or_ps(a, b)
+#define NK_MNOT(a)          _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))
+#define NK_ONE_IF(m)        _mm256_and_ps(m, _mm256_set1_ps(1.0f))
+#define NK_IMASK(m, i)      _mm256_and_si256(_mm256_castps_si256(m), i)
+#define NK_FLOOR(a)         floor_avx2(a)
+#define NK_TOF(i)           _mm256_cvtepi32_ps(i)
+#define NK_IADD(a, b)       _mm256_add_epi32(a, b)
+#define NK_IMUL(a, b)       _mm256_mullo_epi32(a, b)
+#define NK_IXOR(a, b)       _mm256_xor_si256(a, b)
+#define NK_IAND(a, b)       _mm256_and_si256(a, b)
+#define NK_ISHR(a, n)       _mm256_srli_epi32(a, n)
+#define NK_IBIT(i, bit)     bit_avx2(i, bit)
+#define NK_ILT(a, b)        _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a))
+#define NK_IEQ(a, b)        _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))
+#include "noise_kernel.h"
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif // NOISE_AVX2
+
+static const NoiseKernels kernels[MAX_NOISE_BACKEND] = {
+    [NOISE_BACKEND_SCALAR] = {sample2_scalar, sample3_scalar},
+#ifdef __SSE2__
+    [NOISE_BACKEND_SSE2] = {sample2_sse2, sample3_sse2},
+#endif
+#ifdef NOISE_AVX2
+    [NOISE_BACKEND_AVX2] = {sample2_avx2, sample3_avx2},
+#endif
+};
+
+static const char *backend_names[MAX_NOISE_BACKEND] = {"scalar", "sse2", "avx2"};
+
+// -1 until the first sample picks the best backend. Racing threads pick the same one.
+static _Atomic int active_backend = -1;
+
+static inline const NoiseKernels *get_kernels(void)
+{
+    int backend = atomic_load_explicit(&active_backend, memory_order_relaxed);
+    if (backend < 0) {
+        backend = NOISE_BACKEND_SCALAR;
+        for (int b = MAX_NOISE_BACKEND - 1; b > NOISE_BACKEND_SCALAR; b--) {
+            if (has_noise_backend(b)) {
+                backend = b;
+                break;
+            }
+        }
+        atomic_store_explicit(&active_backend, backend, memory_order_relaxed);
+    }
+    return &kernels[backend];
+}
+
+bool has_noise_backend(NoiseBackend backend)
+{
+    if (backend < 0 || backend >= MAX_NOISE_BACKEND || kernels[backend].sample2 == NULL) {
+        return false;
+    }
+#ifdef NOISE_AVX2
+    if (backend == NOISE_BACKEND_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return true;
+}
+
+NoiseBackend get_noise_backend(void)
+{
+    return (NoiseBackend)(get_kernels() - kernels);
+}
+
+bool set_noise_backend(NoiseBackend backend)
+{
+    if (!has_noise_backend(backend)) {
+        return false;
+    }
+    atomic_store_explicit(&active_backend, backend, memory_order_relaxed);
+    return true;
+}
+
+const char *get_noise_backend_name(NoiseBackend backend)
+{
+    return backend >= 0 && backend < MAX_NOISE_BACKEND ? backend_names[backend] : "unknown";
+}
+
+// splitmix64, a full 64-bit seed reaches every octave seed
+static inline uint64_t mix_seed(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+bool init_noise(Noise *noise, const NoiseDesc *desc, uint64_t seed)
+{
+    if (desc->octaves < 1 || desc->octaves > MAX_NOISE_OCTAVES || desc->type >= MAX_NOISE_TYPE ||
+        desc->fractal >= MAX_NOISE_FRACTAL) {
+        return false;
+    }
+    noise->desc = *desc;
+
+    float amplitude = 1.0f;
+    float total = 0.0f;
+    for (int o = 0; o < MAX_NOISE_OCTAVES; o++) {
+        noise->seeds[o] = (uint32_t)(mix_seed(&seed) >> 32);
+        if (o < desc->octaves) {
+            total += amplitude;
+            amplitude *= desc->gain;
+        }
+    }
+    noise->scale = 1.0f / total;
+    return true;
+}
+
+void sample_noise2(const Noise *noise, const float *x, const float *y, float *out)
+{
+    get_kernels()->sample2(noise, x, y, out);
+}
+
+void sample_noise3(const Noise *noise, const float *x, const float *y, const float *z, float *out)
+{
+    get_kernels()->sample3(noise, x, y, z, out);
+}
+
+// Grid points are gathered NOISE_LANES at a time; the last batch repeats its
+// final point and stores only what is in the grid.
+void fill_noise2_grid(const Noise *noise, const float origin[2], float step, const int size[2], float *out)
+{
+    const NoiseKernels *k = get_kernels();
+    float x[NOISE_LANES];
+    float y[NOISE_LANES];
+    float batch[NOISE_LANES];
+    int count = size[0] * size[1];
+
+    for (int i = 0; i < count; i += NOISE_LANES) {
+        int lanes = count - i < NOISE_LANES ? count - i : NOISE_LANES;
+        for (int l = 0; l < NOISE_LANES; l++) {
+            int p = i + (l < lanes ? l : lanes - 1);
+            x[l] = origin[0] + (float)(p % size[0]) * step;
+            y[l] = origin[1] + (float)(p / size[0]) * step;
+        }
+        if (lanes == NOISE_LANES) {
+            k->sample2(noise, x, y, &out[i]);
+            continue;
+        }
+        k->sample2(noise, x, y, batch);
+        for (int l = 0; l < lanes; l++) {
+            out[i + l] = batch[l];
+        }
+    }
+}
+
+void fill_noise3_grid(const Noise *noise, const float origin[3], float step, const int size[3], float *out)
+{
+    const NoiseKernels *k = get_kernels();
+    float x[NOISE_LANES];
+    float y[NOISE_LANES];
+    float z[NOISE_LANES];
+    float batch[NOISE_LANES];
+    int layer = size[0] * size[2];
+    int count = layer * size[1];
+
+    for (int i = 0; i < count; i += NOISE_LANES) {
+        int lanes = count - i < NOISE_LANES ? count - i : NOISE_LANES;
+        for (int l = 0; l < NOISE_LANES; l++) {
+            int p = i + (l < lanes ? l : lanes - 1);
+            x[l] = origin[0] + (float)(p % size[0]) * step;
+            z[l] = origin[2] + (float)(p % layer / size[0]) * step;
+            y[l] = origin[1] + (float)(p / layer) * step;
+        }
+        if (lanes == NOISE_LANES) {
+            k->sample3(noise, x, y, z, &out[i]);
+            continue;
+        }
+        k->sample3(noise, x, y, z, batch);
+        for (int l = 0; l < lanes; l++) {
+            out[i + l] = batch[l];
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef _NOISE_H_
+#define _NOISE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Simplex (gradient) and value noise in 2D and 3D, eight samples per call.
+//
+// One kernel source, noise_kernel.h, is compiled three times: for plain
+// floats, for SSE2 and for AVX2. The widest version the CPU runs is picked
+// on first use. Every version does the same float operations in the same
+// order, so all give bit identical results and a seed always makes the
+// same world. Keep it that way: no -ffast-math and no FMA contraction for
+// noise.c.
+//
+// Fractal noise sums octaves at rising frequency and falling amplitude,
+// normalized by the total amplitude. fBm sums the noise itself, in about
+// [-1, 1]. Ridged sums (1 - |noise|)^2, in [0, 1], with sharp crests where
+// the noise crosses zero.
+
+#define NOISE_LANES         8
+#define MAX_NOISE_OCTAVES   12
+
+typedef enum {
+    NOISE_SIMPLEX = 0,
+    NOISE_VALUE,
+    MAX_NOISE_TYPE,
+} NoiseType;
+
+typedef enum {
+    NOISE_FBM = 0,
+    NOISE_RIDGED,
+    MAX_NOISE_FRACTAL,
+} NoiseFractal;
+
+typedef enum {
+    NOISE_BACKEND_SCALAR = 0,
+    NOISE_BACKEND_SSE2,
+    NOISE_BACKEND_AVX2,
+    MAX_NOISE_BACKEND,
+} NoiseBackend;
+
+typedef struct {
+    NoiseType type;
+    NoiseFractal fractal;
+    int octaves;                // 1 to MAX_NOISE_OCTAVES
+    float frequency;            // of the first octave, per block
+    float lacunarity;           // frequency factor per octave, usually 2
+    float gain;                 // amplitude factor per octave, usually 0.5
+} NoiseDesc;
+
+typedef struct {
+    NoiseDesc desc;
+    float scale;                // 1 / sum of the octave amplitudes
+    uint32_t seeds[MAX_NOISE_OCTAVES];
+} Noise;
+
+// Derive the per octave seeds from `seed`, false when the octave count is out of range
+bool init_noise(Noise *noise, const NoiseDesc *desc, uint64_t seed);
+
+// NOISE_LANES samples at (x[i], y[i]) or (x[i], y[i], z[i])
+void sample_noise2(const Noise *noise, const float *x, const float *y, float *out);
+void sample_noise3(const Noise *noise, const float *x, const float *y, const float *z, float *out);
+
+// Samples on a grid of `size` points `step` blocks apart from `origin`,
+// x varies fastest. The 3D grid continues with z then y, like CHUNK_INDEX.
+void fill_noise2_grid(const Noise *noise, const float origin[2], float step, const int size[2], float *out);
+void fill_noise3_grid(const Noise *noise, const float origin[3], float step, const int size[3], float *out);
+
+// The backend in use, the best one the CPU supports unless set otherwise.
+// Setting fails when the CPU or the build lacks the backend.
+NoiseBackend get_noise_backend(void);
+bool set_noise_backend(NoiseBackend backend);
+bool has_noise_backend(NoiseBackend backend);
+const char *get_noise_backend_name(NoiseBackend backend);
+
+#endif // _NOISE_H_
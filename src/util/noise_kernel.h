@@ -0,0 +1,328 @@
+// Noise kernels, included by noise.c once per backend. No include guard.
+//
+// The includer defines the lane type and the operations on it:
+//   NK_WIDTH                  lanes per vector, dividing NOISE_LANES
+//   NK_NAME(name)             backend specific function name
+//   nkf, nki, nkm             float, 32 bit integer and mask vectors
+//   NK_F(c), NK_I(c)          broadcast a constant
+//   NK_LOAD(p), NK_STORE(p, v)
+//   NK_ADD, NK_SUB, NK_MUL    float arithmetic
+//   NK_MAX(a, b)              a > b ? a : b, as maxps does it
+//   NK_ABS(a), NK_FLIP(m, a)  clear the sign, flip it where m is set
+//   NK_SELECT(m, a, b)        m ? a : b
+//   NK_GT, NK_GE              float compares
+//   NK_MAND, NK_MOR, NK_MNOT  mask logic
+//   NK_ONE_IF(m)              m ? 1.0f : 0.0f
+//   NK_IMASK(m, i)            m ? i : 0
+//   NK_FLOOR(a), NK_TOF(i)    float to integer rounding down, integer to float
+//   NK_IADD, NK_IMUL, NK_IXOR, NK_IAND, NK_ISHR(a, n)
+//   NK_IBIT(i, bit)           (i & bit) != 0
+//   NK_ILT, NK_IEQ            integer compares
+//
+// All of them are undefined again at the end.
+//
+// Every backend runs the same IEEE operations in the same order and nothing
+// here depends on the width, which keeps the backends bit identical.
+
+// Lattice point hash, the primes spread neighboring points over the bits
+#define NK_PRIME_X      0x5205402B
+#define NK_PRIME_Y      0x1F1FC2FD
+#define NK_PRIME_Z      0x3CA1E4F7
+#define NK_HASH_MUL     0x27D4EB2D
+
+#define NK_F2           0.36602540378f      // (sqrt(3) - 1) / 2, skews the 2D grid to triangles
+#define NK_G2           0.21132486540f      // (3 - sqrt(3)) / 6, unskews it
+#define NK_F3           (1.0f / 3.0f)
+#define NK_G3           (1.0f / 6.0f)
+#define NK_SIMPLEX2     90.46f              // brings the 2D sum to [-1, 1]
+#define NK_SIMPLEX3     32.69f
+#define NK_INV_2_31     (1.0f / 2147483648.0f)
+
+static inline nki NK_NAME(hash2)(nki seed, nki xp, nki yp)
+{
+    nki h = NK_IMUL(NK_IXOR(NK_IXOR(seed, xp), yp), NK_I(NK_HASH_MUL));
+    return NK_IXOR(h, NK_ISHR(h, 15));
+}
+
+static inline nki NK_NAME(hash3)(nki seed, nki xp, nki yp, nki zp)
+{
+    nki h = NK_IMUL(NK_IXOR(NK_IXOR(NK_IXOR(seed, xp), yp), zp), NK_I(NK_HASH_MUL));
+    return NK_IXOR(h, NK_ISHR(h, 15));
+}
+
+// Lattice value in [-1, 1)
+static inline nkf NK_NAME(hash_value)(nki h)
+{
+    return NK_MUL(NK_TOF(h), NK_F(NK_INV_2_31));
+}
+
+// Dot with one of the eight gradients (+-1, +-0.5) and (+-0.5, +-1)
+static inline nkf NK_NAME(grad2)(nki h, nkf x, nkf y)
+{
+    nkm swap = NK_IBIT(h, 1);
+    nkf a = NK_SELECT(swap, y, x);
+    nkf b = NK_SELECT(swap, x, y);
+    return NK_ADD(NK_FLIP(NK_IBIT(h, 2), a), NK_MUL(NK_FLIP(NK_IBIT(h, 4), b), NK_F(0.5f)));
+}
+
+// Dot with one of the twelve cube edge gradients, four of them twice
+static inline nkf NK_NAME(grad3)(nki h, nkf x, nkf y, nkf z)
+{
+    nki h4 = NK_IAND(h, NK_I(15));
+    nkf u = NK_SELECT(NK_ILT(h4, NK_I(8)), x, y);
+    nkm xz = NK_MOR(NK_IEQ(h4, NK_I(12)), NK_IEQ(h4, NK_I(14)));
+    nkf v = NK_SELECT(NK_ILT(h4, NK_I(4)), y, NK_SELECT(xz, x, z));
+    return NK_ADD(NK_FLIP(NK_IBIT(h, 1), u), NK_FLIP(NK_IBIT(h, 2), v));
+}
+
+// Quintic fade, zero first and second derivative at the lattice
+static inline nkf NK_NAME(fade)(nkf t)
+{
+    nkf t3 = NK_MUL(NK_MUL(t, t), t);
+    return NK_MUL(t3, NK_ADD(NK_MUL(t, NK_SUB(NK_MUL(t, NK_F(6.0f)), NK_F(15.0f))), NK_F(10.0f)));
+}
+
+static inline nkf NK_NAME(lerp)(nkf a, nkf b, nkf t)
+{
+    return NK_ADD(a, NK_MUL(NK_SUB(b, a), t));
+}
+
+static inline nkf NK_NAME(corner2)(nki h, nkf x, nkf y)
+{
+    nkf t = NK_SUB(NK_SUB(NK_F(0.5f), NK_MUL(x, x)), NK_MUL(y, y));
+    t = NK_MAX(t, NK_F(0.0f));
+    t = NK_MUL(t, t);
+    return NK_MUL(NK_MUL(t, t), NK_NAME(grad2)(h, x, y));
+}
+
+static inline nkf NK_NAME(corner3)(nki h, nkf x, nkf y, nkf z)
+{
+    nkf t = NK_SUB(NK_SUB(NK_SUB(NK_F(0.6f), NK_MUL(x, x)), NK_MUL(y, y)), NK_MUL(z, z));
+    t = NK_MAX(t, NK_F(0.0f));
+    t = NK_MUL(t, t);
+    return NK_MUL(NK_MUL(t, t), NK_NAME(grad3)(h, x, y, z));
+}
+
+static inline nkf NK_NAME(simplex2)(nki seed, nkf x, nkf y)
+{
+    nkf s = NK_MUL(NK_ADD(x, y), NK_F(NK_F2));
+    nki i = NK_FLOOR(NK_ADD(x, s));
+    nki j = NK_FLOOR(NK_ADD(y, s));
+    nkf fi = NK_TOF(i);
+    nkf fj = NK_TOF(j);
+    nkf t = NK_MUL(NK_ADD(fi, fj), NK_F(NK_G2));
+    nkf x0 = NK_SUB(x, NK_SUB(fi, t));
+    nkf y0 = NK_SUB(y, NK_SUB(fj, t));
+
+    // The middle corner: one step along x or along y
+    nkm xfirst = NK_GT(x0, y0);
+    nkf x1 = NK_ADD(NK_SUB(x0, NK_ONE_IF(xfirst)), NK_F(NK_G2));
+    nkf y1 = NK_ADD(NK_SUB(y0, NK_ONE_IF(NK_MNOT(xfirst))), NK_F(NK_G2));
+    nkf x2 = NK_ADD(x0, NK_F(2.0f * NK_G2 - 1.0f));
+    nkf y2 = NK_ADD(y0, NK_F(2.0f * NK_G2 - 1.0f));
+
+    nki xp = NK_IMUL(i, NK_I(NK_PRIME_X));
+    nki yp = NK_IMUL(j, NK_I(NK_PRIME_Y));
+    nki xp1 = NK_IADD(xp, NK_IMASK(xfirst, NK_I(NK_PRIME_X)));
+    nki yp1 = NK_IADD(yp, NK_IMASK(NK_MNOT(xfirst), NK_I(NK_PRIME_Y)));
+    nki xp2 = NK_IADD(xp, NK_I(NK_PRIME_X));
+    nki yp2 = NK_IADD(yp, NK_I(NK_PRIME_Y));
+
+    nkf n = NK_NAME(corner2)(NK_NAME(hash2)(seed, xp, yp), x0, y0);
+    n = NK_ADD(n, NK_NAME(corner2)(NK_NAME(hash2)(seed, xp1, yp1), x1, y1));
+    n = NK_ADD(n, NK_NAME(corner2)(NK_NAME(hash2)(seed, xp2, yp2), x2, y2));
+    return NK_MUL(n, NK_F(NK_SIMPLEX2));
+}
+
+static inline nkf NK_NAME(simplex3)(nki seed, nkf x, nkf y, nkf z)
+{
+    nkf s = NK_MUL(NK_ADD(NK_ADD(x, y), z), NK_F(NK_F3));
+    nki i = NK_FLOOR(NK_ADD(x, s));
+    nki j = NK_FLOOR(NK_ADD(y, s));
+    nki k = NK_FLOOR(NK_ADD(z, s));
+    nkf fi = NK_TOF(i);
+    nkf fj = NK_TOF(j);
+    nkf fk = NK_TOF(k);
+    nkf t = NK_MUL(NK_ADD(NK_ADD(fi, fj), fk), NK_F(NK_G3));
+    nkf x0 = NK_SUB(x, NK_SUB(fi, t));
+    nkf y0 = NK_SUB(y, NK_SUB(fj, t));
+    nkf z0 = NK_SUB(z, NK_SUB(fk, t));
+
+    // The two middle corners of the tetrahedron, from the order of x0, y0, z0
+    nkm xy = NK_GE(x0, y0);
+    nkm xz = NK_GE(x0, z0);
+    nkm yz = NK_GE(y0, z0);
+    nkm i1 = NK_MAND(xy, xz);
+    nkm j1 = NK_MAND(NK_MNOT(xy), yz);
+    nkm k1 = NK_MAND(NK_MNOT(xz), NK_MNOT(yz));
+    nkm i2 = NK_MOR(xy, xz);
+    nkm j2 = NK_MOR(NK_MNOT(xy), yz);
+    nkm k2 = NK_MNOT(NK_MAND(xz, yz));
+
+    nkf x1 = NK_ADD(NK_SUB(x0, NK_ONE_IF(i1)), NK_F(NK_G3));
+    nkf y1 = NK_ADD(NK_SUB(y0, NK_ONE_IF(j1)), NK_F(NK_G3));
+    nkf z1 = NK_ADD(NK_SUB(z0, NK_ONE_IF(k1)), NK_F(NK_G3));
+    nkf x2 = NK_ADD(NK_SUB(x0, NK_ONE_IF(i2)), NK_F(2.0f * NK_G3));
+    nkf y2 = NK_ADD(NK_SUB(y0, NK_ONE_IF(j2)), NK_F(2.0f * NK_G3));
+    nkf z2 = NK_ADD(NK_SUB(z0, NK_ONE_IF(k2)), NK_F(2.0f * NK_G3));
+    nkf x3 = NK_ADD(x0, NK_F(3.0f * NK_G3 - 1.0f));
+    nkf y3 = NK_ADD(y0, NK_F(3.0f * NK_G3 - 1.0f));
+    nkf z3 = NK_ADD(z0, NK_F(3.0f * NK_G3 - 1.0f));
+
+    nki xp = NK_IMUL(i, NK_I(NK_PRIME_X));
+    nki yp = NK_IMUL(j, NK_I(NK_PRIME_Y));
+    nki zp = NK_IMUL(k, NK_I(NK_PRIME_Z));
+    nki h1 = NK_NAME(hash3)(seed, NK_IADD(xp, NK_IMASK(i1, NK_I(NK_PRIME_X))),
+                            NK_IADD(yp, NK_IMASK(j1, NK_I(NK_PRIME_Y))), NK_IADD(zp, NK_IMASK(k1, NK_I(NK_PRIME_Z))));
+    nki h2 = NK_NAME(hash3)(seed, NK_IADD(xp, NK_IMASK(i2, NK_I(NK_PRIME_X))),
+                            NK_IADD(yp, NK_IMASK(j2, NK_I(NK_PRIME_Y))), NK_IADD(zp, NK_IMASK(k2, NK_I(NK_PRIME_Z))));
+    nki h3 = NK_NAME(hash3)(seed, NK_IADD(xp, NK_I(NK_PRIME_X)), NK_IADD(yp, NK_I(NK_PRIME_Y)),
+                            NK_IADD(zp, NK_I(NK_PRIME_Z)));
+
+    nkf n = NK_NAME(corner3)(NK_NAME(hash3)(seed, xp, yp, zp), x0, y0, z0);
+    n = NK_ADD(n, NK_NAME(corner3)(h1, x1, y1, z1));
+    n = NK_ADD(n, NK_NAME(corner3)(h2, x2, y2, z2));
+    n = NK_ADD(n, NK_NAME(corner3)(h3, x3, y3, z3));
+    return NK_MUL(n, NK_F(NK_SIMPLEX3));
+}
+
+static inline nkf NK_NAME(value2)(nki seed, nkf x, nkf y)
+{
+    nki i = NK_FLOOR(x);
+    nki j = NK_FLOOR(y);
+    nkf u = NK_NAME(fade)(NK_SUB(x, NK_TOF(i)));
+    nkf v = NK_NAME(fade)(NK_SUB(y, NK_TOF(j)));
+    nki xp0 = NK_IMUL(i, NK_I(NK_PRIME_X));
+    nki yp0 = NK_IMUL(j, NK_I(NK_PRIME_Y));
+    nki xp1 = NK_IADD(xp0, NK_I(NK_PRIME_X));
+    nki yp1 = NK_IADD(yp0, NK_I(NK_PRIME_Y));
+
+    nkf a = NK_NAME(lerp)(NK_NAME(hash_value)(NK_NAME(hash2)(seed, xp0, yp0)),
+                          NK_NAME(hash_value)(NK_NAME(hash2)(seed, xp1, yp0)), u);
+    nkf b = NK_NAME(lerp)(NK_NAME(hash_value)(NK_NAME(hash2)(seed, xp0, yp1)),
+                          NK_NAME(hash_value)(NK_NAME(hash2)(seed, xp1, yp1)), u);
+    return NK_NAME(lerp)(a, b, v);
+}
+
+static inline nkf NK_NAME(value3)(nki seed, nkf x, nkf y, nkf z)
+{
+    nki i = NK_FLOOR(x);
+    nki j = NK_FLOOR(y);
+    nki k = NK_FLOOR(z);
+    nkf u = NK_NAME(fade)(NK_SUB(x, NK_TOF(i)));
+    nkf v = NK_NAME(fade)(NK_SUB(y, NK_TOF(j)));
+    nkf w = NK_NAME(fade)(NK_SUB(z, NK_TOF(k)));
+    nki xp0 = NK_IMUL(i, NK_I(NK_PRIME_X));
+    nki yp0 = NK_IMUL(j, NK_I(NK_PRIME_Y));
+    nki zp0 = NK_IMUL(k, NK_I(NK_PRIME_Z));
+    nki xp1 = NK_IADD(xp0, NK_I(NK_PRIME_X));
+    nki yp1 = NK_IADD(yp0, NK_I(NK_PRIME_Y));
+    nki zp1 = NK_IADD(zp0, NK_I(NK_PRIME_Z));
+
+    nkf a = NK_NAME(lerp)(NK_NAME(hash_value)(NK_NAME(hash3)(seed, xp0, yp0, zp0)),
+                          NK_NAME(hash_value)(NK_NAME(hash3)(seed, xp1, yp0, zp0)), u);
+    nkf b = NK_NAME(lerp)(NK_NAME(hash_value)(NK_NAME(hash3)(seed, xp0, yp1, zp0)),
+                          NK_NAME(hash_value)(NK_NAME(hash3)(seed, xp1, yp1, zp0)), u);
+    nkf c = NK_NAME(lerp)(NK_NAME(hash_value)(NK_NAME(hash3)(seed, xp0, yp0, zp1)),
+                          NK_NAME(hash_value)(NK_NAME(hash3)(seed, xp1, yp0, zp1)), u);
+    nkf d = NK_NAME(lerp)(NK_NAME(hash_value)(NK_NAME(hash3)(seed, xp0, yp1, zp1)),
+                          NK_NAME(hash_value)(NK_NAME(hash3)(seed, xp1, yp1, zp1)), u);
+    return NK_NAME(lerp)(NK_NAME(lerp)(a, b, v), NK_NAME(lerp)(c, d, v), w);
+}
+
+// Octave sum. The octave loop runs per vector so a sample stays in registers.
+static void NK_NAME(sample2)(const Noise *noise, const float *xs, const float *ys, float *out)
+{
+    const NoiseDesc *desc = &noise->desc;
+    for (int lane = 0; lane < NOISE_LANES; lane += NK_WIDTH) {
+        nkf x = NK_MUL(NK_LOAD(xs + lane), NK_F(desc->frequency));
+        nkf y = NK_MUL(NK_LOAD(ys + lane), NK_F(desc->frequency));
+        nkf sum = NK_F(0.0f);
+        float amplitude = 1.0f;
+        for (int o = 0; o < desc->octaves; o++) {
+            nki seed = NK_I(noise->seeds[o]);
+            nkf n = desc->type == NOISE_SIMPLEX ? NK_NAME(simplex2)(seed, x, y) : NK_NAME(value2)(seed, x, y);
+            if (desc->fractal == NOISE_RIDGED) {
+                n = NK_SUB(NK_F(1.0f), NK_ABS(n));
+                n = NK_MUL(n, n);
+            }
+            sum = NK_ADD(sum, NK_MUL(n, NK_F(amplitude)));
+            x = NK_MUL(x, NK_F(desc->lacunarity));
+            y = NK_MUL(y, NK_F(desc->lacunarity));
+            amplitude *= desc->gain;
+        }
+        NK_STORE(out + lane, NK_MUL(sum, NK_F(noise->scale)));
+    }
+}
+
+static void NK_NAME(sample3)(const Noise *noise, const float *xs, const float *ys, const float *zs, float *out)
+{
+    const NoiseDesc *desc = &noise->desc;
+    for (int lane = 0; lane < NOISE_LANES; lane += NK_WIDTH) {
+        nkf x = NK_MUL(NK_LOAD(xs + lane), NK_F(desc->frequency));
+        nkf y = NK_MUL(NK_LOAD(ys + lane), NK_F(desc->frequency));
+        nkf z = NK_MUL(NK_LOAD(zs + lane), NK_F(desc->frequency));
+        nkf sum = NK_F(0.0f);
+        float amplitude = 1.0f;
+        for (int o = 0; o < desc->octaves; o++) {
+            nki seed = NK_I(noise->seeds[o]);
+            nkf n = desc->type == NOISE_SIMPLEX ? NK_NAME(simplex3)(seed, x, y, z) : NK_NAME(value3)(seed, x, y, z);
+            if (desc->fractal == NOISE_RIDGED) {
+                n = NK_SUB(NK_F(1.0f), NK_ABS(n));
+                n = NK_MUL(n, n);
+            }
+            sum = NK_ADD(sum, NK_MUL(n, NK_F(amplitude)));
+            x = NK_MUL(x, NK_F(desc->lacunarity));
+            y = NK_MUL(y, NK_F(desc->lacunarity));
+            z = NK_MUL(z, NK_F(desc->lacunarity));
+            amplitude *= desc->gain;
+        }
+        NK_STORE(out + lane, NK_MUL(sum, NK_F(noise->scale)));
+    }
+}
+
+// Ready for the next backend
+#undef NK_WIDTH
+#undef NK_NAME
+#undef nkf
+#undef nki
+#undef nkm
+#undef NK_F
+#undef NK_I
+#undef NK_LOAD
+#undef NK_STORE
+#undef NK_ADD
+#undef NK_SUB
+#undef NK_MUL
+#undef NK_MAX
+#undef NK_ABS
+#undef NK_FLIP
+#undef NK_SELECT
+#undef NK_GT
+#undef NK_GE
+#undef NK_MAND
+#undef NK_MOR
+#undef NK_MNOT
+#undef NK_ONE_IF
+#undef NK_IMASK
+#undef NK_FLOOR
+#undef NK_TOF
+#undef NK_IADD
+#undef NK_IMUL
+#undef NK_IXOR
+#undef NK_IAND
+#undef NK_ISHR
+#undef NK_IBIT
+#undef NK_ILT
+#undef NK_IEQ
+#undef NK_PRIME_X
+#undef NK_PRIME_Y
+#undef NK_PRIME_Z
+#undef NK_HASH_MUL
+#undef NK_F2
+#undef NK_G2
+#undef NK_F3
+#undef NK_G3
+#undef NK_SIMPLEX2
+#undef NK_SIMPLEX3
+#undef NK_INV_2_31
@@ -0,0 +1,102 @@
+#include "range_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_RANGES 16
+
+
+bool init_range_allocator(RangeAllocator *alloc, uint32_t size)
+{
+    alloc->ranges = (FreeRange *) malloc(MIN_RANGES * sizeof(FreeRange));
+    if (alloc->ranges == NULL) {
+        return false;
+    }
+    alloc->ranges[0] = (FreeRange){0, size};
+    alloc->count = size > 0;
+    alloc->capacity = MIN_RANGES;
+    alloc->size = size;
+    alloc->free = size;
+    return true;
+}
+
+void free_range_allocator(RangeAllocator *alloc)
+{
+    free(alloc->ranges);
+    memset(alloc, 0, sizeof(RangeAllocator));
+}
+
+bool alloc_range(RangeAllocator *alloc, uint32_t size, uint32_t *offset)
+{
+    for (uint32_t i = 0; i < alloc->count; i++) {
+        FreeRange *r = &alloc->ranges[i];
+        if (r->size < size) {
+            continue;
+        }
+        *offset = r->offset;
+        r->offset += size;
+        r->size -= size;
+        if (r->size == 0) {
+            memmove(r, r + 1, (alloc->count - i - 1) * sizeof(FreeRange));
+            alloc->count--;
+        }
+        alloc->free -= size;
+        return true;
+    }
+    return false;
+}
+
+bool release_range(RangeAllocator *alloc, uint32_t offset, uint32_t size)
+{
+    // First free range after the released one
+    uint32_t lo = 0;
+    uint32_t hi = alloc->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (alloc->ranges[mid].offset < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    bool merge_prev = lo > 0 && alloc->ranges[lo - 1].offset + alloc->ranges[lo - 1].size == offset;
+    bool merge_next = lo < alloc->count && offset + size == alloc->ranges[lo].offset;
+
+    if (merge_prev && merge_next) {
+        alloc->ranges[lo - 1].size += size + alloc->ranges[lo].size;
+        memmove(&alloc->ranges[lo], &alloc->ranges[lo + 1], (alloc->count - lo - 1) * sizeof(FreeRange));
+        alloc->count--;
+    } else if (merge_prev) {
+        alloc->ranges[lo - 1].size += size;
+    } else if (merge_next) {
+        alloc->ranges[lo].offset = offset;
+        alloc->ranges[lo].size += size;
+    } else {
+        if (alloc->count == alloc->capacity) {
+            uint32_t capacity = alloc->capacity * 2;
+            FreeRange *ranges = (FreeRange *) realloc(alloc->ranges, capacity * sizeof(FreeRange));
+            if (ranges == NULL) {
+                return false;
+            }
+            alloc->ranges = ranges;
+            alloc->capacity = capacity;
+        }
+        memmove(&alloc->ranges[lo + 1], &alloc->ranges[lo], (alloc->count - lo) * sizeof(FreeRange));
+        alloc->ranges[lo] = (FreeRange){offset, size};
+        alloc->count++;
+    }
+    alloc->free += size;
+    return true;
+}
+
+uint32_t largest_free_range(const RangeAllocator *alloc)
+{
+    uint32_t largest = 0;
+    for (uint32_t i = 0; i < alloc->count; i++) {
+        if (alloc->ranges[i].size > largest) {
+            largest = alloc->ranges[i].size;
+        }
+    }
+    return largest;
+}
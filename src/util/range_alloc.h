@@ -0,0 +1,41 @@
+#ifndef _RANGE_ALLOC_H_
+#define _RANGE_ALLOC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// First fit allocator for ranges of abstract units (bytes, vertices, quads)
+// inside a fixed size space. Only the bookkeeping lives here, the memory
+// itself is elsewhere, e.g. in a GPU buffer. Free ranges are kept sorted by
+// offset and merged with their neighbors when released.
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} FreeRange;
+
+typedef struct {
+    FreeRange *ranges;      // sorted by offset, never adjacent
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t size;          // units managed
+    uint32_t free;          // units in all free ranges
+} RangeAllocator;
+
+bool init_range_allocator(RangeAllocator *alloc, uint32_t size);
+void free_range_allocator(RangeAllocator *alloc);
+
+// Lowest offset where `size` units fit, false when no free range is big enough
+bool alloc_range(RangeAllocator *alloc, uint32_t size, uint32_t *offset);
+// Returns false only when the free list could not grow
+bool release_range(RangeAllocator *alloc, uint32_t offset, uint32_t size);
+
+uint32_t largest_free_range(const RangeAllocator *alloc);
+
+// 0 when all free space is one range, towards 1 as it splits into pieces
+static inline float range_fragmentation(const RangeAllocator *alloc)
+{
+    return alloc->free ? 1.0f - (float)largest_free_range(alloc) / (float)alloc->free : 0.0f;
+}
+
+#endif // _RANGE_ALLOC_H_
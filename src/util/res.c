@@ -102,6 +102,26 @@ unsigned char* read_image_file(const char *filename, size_t *length)
     return buffer;    
 }
 
+char *read_text_file(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = length >= 0 ? malloc(length + 1) : NULL;
+    if (!text || fread(text, 1, length, file) != (size_t) length) {
+        free(text);
+        fclose(file);
+        return NULL;
+    }
+    text[length] = '\0';
+    fclose(file);
+    return text;
+}
+
 unsigned int write_image_file(const char *filename, unsigned char *data, size_t length) 
 {
     FILE *file = fopen(filename, "wb");
@@ -155,12 +175,72 @@ unsigned int generate_texture(const char*file_name)
     int width, height, nrChannels;
     unsigned char *data = stbi_load(file_name, &width, &height, &nrChannels, 0);
     if (data){
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+        // Keep the alpha channel of images that have one
+        GLenum format = nrChannels == 4 ? GL_RGBA : nrChannels == 1 ? GL_RED : GL_RGB;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
         glGenerateMipmap(GL_TEXTURE_2D);
     }
     else {
+        glDeleteTextures(1, &texture);
+        return 0;
+    }
+    stbi_image_free(data);
+    return texture;
+}
+
+unsigned int generate_texture_array(const char *file_name, int tile_size)
+{
+    int width, height, channels;
+    unsigned char *data = stbi_load(file_name, &width, &height, &channels, 4);
+    if (!data) {
+        return 0;
+    }
+    int tiles_x = tile_size > 0 ? width / tile_size : 0;
+    int tiles_y = tile_size > 0 ? height / tile_size : 0;
+    int layers = tiles_x * tiles_y;
+    int max_layers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    if (layers == 0 || tiles_x * tile_size != width || tiles_y * tile_size != height ||
+        layers > max_layers) {
+        stbi_image_free(data);
         return 0;
     }
+
+    // Gather each tile's rows so the layers are contiguous
+    size_t row = (size_t) tile_size * 4;
+    unsigned char *slices = (unsigned char *) malloc(row * tile_size * layers);
+    if (!slices) {
+        stbi_image_free(data);
+        return 0;
+    }
+    unsigned char *out = slices;
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            for (int y = 0; y < tile_size; y++) {
+                size_t src = ((size_t)(ty * tile_size + y) * width + (size_t) tx * tile_size) * 4;
+                memcpy(out, data + src, row);
+                out += row;
+            }
+        }
+    }
     stbi_image_free(data);
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, tile_size, tile_size, layers, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, slices);
+    free(slices);
+    // Mipmaps of an array texture shrink within each layer
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    // Repeat so a merged quad tiles its block texture, sharp pixels up close
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     return texture;
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 
 // File encoding/decoding
 unsigned char* read_image_file(const char *filename, size_t *length); 
+// Whole file with a terminating NUL, free with destroy_resource. NULL on failure.
+char *read_text_file(const char *filename);
 unsigned int write_image_file(const char *filename, unsigned char *data, size_t length);
 void encode_base_64(const unsigned char *input, size_t length, char *output);
 size_t decodeBase64(const char *input, unsigned char *output) ;
@@ -15,6 +17,10 @@ void destroy_resource(void *res);
 
 // Texture generation
 unsigned int generate_texture(const char*file_name);
+// Slice an atlas of `tile_size` square tiles into a GL_TEXTURE_2D_ARRAY, one
+// layer per tile in row major order, each mipmapped on its own so tiles never
+// bleed into each other. Returns 0 on failure.
+unsigned int generate_texture_array(const char *file_name, int tile_size);
 
 
 #endif // _RES_H_
\ No newline at end of file
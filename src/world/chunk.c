@@ -0,0 +1,153 @@
+#include "chunk.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// update_chunk_heights works on rows of blocks along x as 32-bit masks
+_Static_assert(CHUNK_SIZE <= 32, "row masks are 32 bits");
+
+// Bit x set where row[x] is not air
+#if defined(__SSE2__) && !defined(LOKI_WIDE_BLOCK_IDS) && CHUNK_SIZE == 32
+static inline uint32_t solid_row_mask(const BlockId *row)
+{
+    __m128i air = _mm_setzero_si128();
+    __m128i lo = _mm_loadu_si128((const __m128i *)row);
+    __m128i hi = _mm_loadu_si128((const __m128i *)(row + 16));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, air))
+                  | (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, air)) << 16;
+    return ~mask;
+}
+#else
+static inline uint32_t solid_row_mask(const BlockId *row)
+{
+    uint32_t mask = 0;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        mask |= (uint32_t)(row[x] != AIR) << x;
+    }
+    return mask;
+}
+#endif
+
+
+Chunk *create_chunk(ChunkCoord coord)
+{
+    // calloc leaves every block set to AIR
+    Chunk *chunk = (Chunk *) calloc(1, sizeof(Chunk));
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->coord = coord;
+    chunk->visibility = CHUNK_VISIBILITY_ALL;
+    return chunk;
+}
+
+void destroy_chunk(Chunk *chunk)
+{
+    free(chunk);
+}
+
+void fill_chunk(Chunk *chunk, BlockId block)
+{
+#ifdef LOKI_WIDE_BLOCK_IDS
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        chunk->blocks[i] = block;
+    }
+#else
+    memset(chunk->blocks, block, sizeof(chunk->blocks));
+#endif
+    memset(chunk->heights, block != AIR ? CHUNK_SIZE : 0, sizeof(chunk->heights));
+}
+
+// Fill the box [x0, x1) x [y0, y1) x [z0, z1), bounds are clamped to the chunk
+void fill_chunk_region(Chunk *chunk, int x0, int y0, int z0, int x1, int y1, int z1, BlockId block)
+{
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (z0 < 0) z0 = 0;
+    if (x1 > CHUNK_SIZE) x1 = CHUNK_SIZE;
+    if (y1 > CHUNK_SIZE) y1 = CHUNK_SIZE;
+    if (z1 > CHUNK_SIZE) z1 = CHUNK_SIZE;
+
+    for (int y = y0; y < y1; y++) {
+        for (int z = z0; z < z1; z++) {
+            BlockId *row = &chunk->blocks[CHUNK_INDEX(0, y, z)];
+            for (int x = x0; x < x1; x++) {
+                row[x] = block;
+            }
+        }
+    }
+
+    // Blocks raise columns to the top of the box, air only lowers the
+    // columns whose top block it cleared
+    for (int z = z0; z < z1 && y0 < y1; z++) {
+        for (int x = x0; x < x1; x++) {
+            uint8_t *height = &chunk->heights[CHUNK_COLUMN(x, z)];
+            if (block != AIR) {
+                if (*height < y1) {
+                    *height = (uint8_t)y1;
+                }
+            } else if (*height > y0 && *height <= y1) {
+                *height = (uint8_t)(y0 > 0 ? scan_chunk_height(chunk, x, y0 - 1, z) : 0);
+            }
+        }
+    }
+}
+
+int scan_chunk_height(const Chunk *chunk, int x, int y, int z)
+{
+    for (; y >= 0; y--) {
+        if (chunk->blocks[CHUNK_INDEX(x, y, z)] != AIR) {
+            return y + 1;
+        }
+    }
+    return 0;
+}
+
+void update_chunk_heights(Chunk *chunk)
+{
+    // Layers top down as rows of bits, a column takes the first layer with
+    // a block in it and drops out of `open`
+    uint32_t open[CHUNK_SIZE];
+    uint32_t any_open = ~0u;
+    memset(open, 0xFF, sizeof(open));
+    memset(chunk->heights, 0, sizeof(chunk->heights));
+
+    for (int y = CHUNK_SIZE - 1; y >= 0 && any_open; y--) {
+        any_open = 0;
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            if (open[z] == 0) {
+                continue;
+            }
+            uint32_t found = solid_row_mask(&chunk->blocks[CHUNK_INDEX(0, y, z)]) & open[z];
+            open[z] &= ~found;
+            any_open |= open[z];
+            while (found) {
+                chunk->heights[CHUNK_COLUMN(__builtin_ctz(found), z)] = (uint8_t)(y + 1);
+                found &= found - 1;
+            }
+        }
+    }
+}
+
+int get_chunk_top(const Chunk *chunk)
+{
+    uint8_t top = 0;
+    for (int i = 0; i < CHUNK_AREA; i++) {
+        top = chunk->heights[i] > top ? chunk->heights[i] : top;
+    }
+    return top;
+}
+
+// Chunk containing the world block (x, y, z), rounding towards negative infinity
+ChunkCoord world_to_chunk_coord(int x, int y, int z)
+{
+    ChunkCoord coord = {
+        x >> CHUNK_SHIFT,
+        y >> CHUNK_SHIFT,
+        z >> CHUNK_SHIFT,
+    };
+    return coord;
+}
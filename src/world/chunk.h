@@ -0,0 +1,112 @@
+#ifndef _CHUNK_H_
+#define _CHUNK_H_
+
+#include "../loki.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Chunk dimensions, every chunk is a cube of CHUNK_SIZE blocks per side
+#define CHUNK_SHIFT     5
+#define CHUNK_SIZE      (1 << CHUNK_SHIFT)
+#define CHUNK_MASK      (CHUNK_SIZE - 1)
+#define CHUNK_AREA      (CHUNK_SIZE * CHUNK_SIZE)
+#define CHUNK_VOLUME    (CHUNK_AREA * CHUNK_SIZE)
+
+// Flat index of a block inside a chunk: x varies fastest, then z, then y,
+// so every horizontal layer of the chunk is contiguous in memory.
+#define CHUNK_INDEX(x, y, z) \
+    (((y) << (2 * CHUNK_SHIFT)) | ((z) << CHUNK_SHIFT) | (x))
+
+// Index of the vertical column (x, z) in Chunk.heights, the low bits of CHUNK_INDEX
+#define CHUNK_COLUMN(x, z)  (((z) << CHUNK_SHIFT) | (x))
+
+// Block id storage. One byte is enough for the VoxelType enum, build with
+// -DLOKI_WIDE_BLOCK_IDS when more than 256 block types are needed.
+#ifdef LOKI_WIDE_BLOCK_IDS
+typedef uint16_t BlockId;
+#define BLOCK_ID_LIMIT  65536
+#else
+typedef uint8_t BlockId;
+#define BLOCK_ID_LIMIT  256
+#endif
+
+// Position of a chunk in the world, measured in chunks
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t z;
+} ChunkCoord;
+
+// One bit per pair of chunk faces joined by non opaque blocks, see visibility.h
+#define CHUNK_VISIBILITY_ALL    0x7FFF
+
+typedef struct {
+    ChunkCoord coord;
+    _Atomic uint32_t revision;      // bumped on every remesh request, see mesh_pool.h
+    uint16_t visibility;            // face connectivity of the last mesh, main thread only
+    uint8_t occluders;              // opaque octants of the last mesh, main thread only
+    uint8_t light_changes;          // see light.h, main thread only
+    BlockId blocks[CHUNK_VOLUME];   // indexed with CHUNK_INDEX
+    uint8_t light[CHUNK_VOLUME];    // sky light << 4 | block light, see light.h
+    // Per column 1 + y of the highest non AIR block, 0 when the column is
+    // all air. Kept up to date by set_chunk_block and the fills, call
+    // update_chunk_heights after writing `blocks` directly.
+    uint8_t heights[CHUNK_AREA];    // indexed with CHUNK_COLUMN
+} Chunk;
+
+Chunk *create_chunk(ChunkCoord coord);
+void destroy_chunk(Chunk *chunk);
+void fill_chunk(Chunk *chunk, BlockId block);
+void fill_chunk_region(Chunk *chunk, int x0, int y0, int z0, int x1, int y1, int z1, BlockId block);
+ChunkCoord world_to_chunk_coord(int x, int y, int z);
+
+// Recompute every column height from the blocks
+void update_chunk_heights(Chunk *chunk);
+// 1 + y of the highest non AIR block of column (x, z) at or below y, 0 if none
+int scan_chunk_height(const Chunk *chunk, int x, int y, int z);
+// Highest column height of the chunk, 0 when it is all air
+int get_chunk_top(const Chunk *chunk);
+
+// Blocks that faces and caves show through, every other block is opaque.
+// SIMD paths compare against each of them, see open_row_mask.
+#define CLEAR_BLOCK_COUNT 2
+static const BlockId clear_blocks[CLEAR_BLOCK_COUNT] = {AIR, WATER};
+
+// Opaque blocks hide the faces of whatever is next to them
+static inline bool is_block_opaque(BlockId block)
+{
+    for (int i = 0; i < CLEAR_BLOCK_COUNT; i++) {
+        if (block == clear_blocks[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Local coordinates must be in [0, CHUNK_SIZE)
+static inline BlockId get_chunk_block(const Chunk *chunk, int x, int y, int z)
+{
+    return chunk->blocks[CHUNK_INDEX(x, y, z)];
+}
+
+// Column height of (x, z), see Chunk.heights
+static inline int get_chunk_height(const Chunk *chunk, int x, int z)
+{
+    return chunk->heights[CHUNK_COLUMN(x, z)];
+}
+
+// Keeps the column height in O(1) unless the top block of the column goes
+static inline void set_chunk_block(Chunk *chunk, int x, int y, int z, BlockId block)
+{
+    chunk->blocks[CHUNK_INDEX(x, y, z)] = block;
+    uint8_t *height = &chunk->heights[CHUNK_COLUMN(x, z)];
+    if (block != AIR) {
+        if (y >= *height) {
+            *height = (uint8_t)(y + 1);
+        }
+    } else if (y + 1 == *height) {
+        *height = (uint8_t)scan_chunk_height(chunk, x, y, z);
+    }
+}
+
+#endif // _CHUNK_H_
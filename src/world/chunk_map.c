@@ -0,0 +1,257 @@
+#include "chunk_map.h"
+
+#include <stdlib.h>
+
+#define COORD_BITS  21
+#define COORD_MASK  ((1ULL << COORD_BITS) - 1)
+
+// Grow (or clean tombstones) once this many slots out of 4 are used
+#define MAX_LOAD_NUM 3
+#define MIN_CAPACITY 16
+
+static const ChunkCoord neighbor_offsets[MAX_NEIGHBOR] = {
+    {-1, 0, 0}, {1, 0, 0},
+    {0, -1, 0}, {0, 1, 0},
+    {0, 0, -1}, {0, 0, 1},
+};
+
+
+uint64_t pack_chunk_coord(ChunkCoord coord)
+{
+    return ((uint64_t)coord.x & COORD_MASK)
+         | (((uint64_t)coord.y & COORD_MASK) << COORD_BITS)
+         | (((uint64_t)coord.z & COORD_MASK) << (2 * COORD_BITS));
+}
+
+static int32_t sign_extend(uint64_t value)
+{
+    // Move the 21-bit field to the top and shift back arithmetically
+    return (int32_t)((int64_t)(value << (64 - COORD_BITS)) >> (64 - COORD_BITS));
+}
+
+ChunkCoord unpack_chunk_coord(uint64_t key)
+{
+    ChunkCoord coord = {
+        sign_extend(key & COORD_MASK),
+        sign_extend((key >> COORD_BITS) & COORD_MASK),
+        sign_extend((key >> (2 * COORD_BITS)) & COORD_MASK),
+    };
+    return coord;
+}
+
+// splitmix64 finalizer, neighboring coordinates land far apart
+static inline uint32_t hash_key(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    key ^= key >> 31;
+    return (uint32_t)key;
+}
+
+static ChunkTable *create_table(uint32_t capacity)
+{
+    ChunkTable *table = (ChunkTable *) malloc(sizeof(ChunkTable));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->capacity = capacity;
+    table->keys = malloc(capacity * sizeof(*table->keys));
+    table->values = malloc(capacity * sizeof(*table->values));
+    table->next = NULL;
+    if (table->keys == NULL || table->values == NULL) {
+        free(table->keys);
+        free(table->values);
+        free(table);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < capacity; i++) {
+        atomic_init(&table->keys[i], CHUNK_KEY_EMPTY);
+        atomic_init(&table->values[i], NULL);
+    }
+    return table;
+}
+
+static void destroy_table(ChunkTable *table)
+{
+    free(table->keys);
+    free(table->values);
+    free(table);
+}
+
+static uint32_t round_capacity(uint32_t capacity)
+{
+    uint32_t c = MIN_CAPACITY;
+    while (c < capacity) {
+        c <<= 1;
+    }
+    return c;
+}
+
+
+ChunkMap *create_chunk_map(uint32_t capacity)
+{
+    ChunkMap *map = (ChunkMap *) malloc(sizeof(ChunkMap));
+    if (map == NULL) {
+        return NULL;
+    }
+    ChunkTable *table = create_table(round_capacity(capacity));
+    if (table == NULL) {
+        free(map);
+        return NULL;
+    }
+    atomic_init(&map->table, table);
+    map->count = 0;
+    map->used = 0;
+    map->retired = NULL;
+    return map;
+}
+
+// Chunks stored in the map are not destroyed
+void destroy_chunk_map(ChunkMap *map)
+{
+    reclaim_chunk_map(map);
+    destroy_table(atomic_load_explicit(&map->table, memory_order_relaxed));
+    free(map);
+}
+
+Chunk *find_chunk(ChunkMap *map, ChunkCoord coord)
+{
+    ChunkTable *table = atomic_load_explicit(&map->table, memory_order_acquire);
+    uint64_t key = pack_chunk_coord(coord);
+    uint32_t mask = table->capacity - 1;
+
+    for (uint32_t i = hash_key(key) & mask; ; i = (i + 1) & mask) {
+        uint64_t k = atomic_load_explicit(&table->keys[i], memory_order_acquire);
+        if (k == key) {
+            Chunk *chunk = atomic_load_explicit(&table->values[i], memory_order_acquire);
+            // The slot may have been emptied and reused while we read it
+            if (atomic_load_explicit(&table->keys[i], memory_order_acquire) != key) {
+                return NULL;
+            }
+            return chunk;
+        }
+        if (k == CHUNK_KEY_EMPTY) {
+            return NULL;
+        }
+    }
+}
+
+void find_chunk_neighbors(ChunkMap *map, ChunkCoord coord, Chunk *neighbors[MAX_NEIGHBOR])
+{
+    for (int n = 0; n < MAX_NEIGHBOR; n++) {
+        ChunkCoord c = {
+            coord.x + neighbor_offsets[n].x,
+            coord.y + neighbor_offsets[n].y,
+            coord.z + neighbor_offsets[n].z,
+        };
+        neighbors[n] = find_chunk(map, c);
+    }
+}
+
+// Build a fresh table holding only the live entries and publish it
+static bool rehash(ChunkMap *map, uint32_t capacity)
+{
+    ChunkTable *old = atomic_load_explicit(&map->table, memory_order_relaxed);
+    ChunkTable *table = create_table(capacity);
+    if (table == NULL) {
+        return false;
+    }
+
+    uint32_t mask = capacity - 1;
+    for (uint32_t i = 0; i < old->capacity; i++) {
+        uint64_t key = atomic_load_explicit(&old->keys[i], memory_order_relaxed);
+        if (key == CHUNK_KEY_EMPTY || key == CHUNK_KEY_TOMBSTONE) {
+            continue;
+        }
+        uint32_t j = hash_key(key) & mask;
+        while (atomic_load_explicit(&table->keys[j], memory_order_relaxed) != CHUNK_KEY_EMPTY) {
+            j = (j + 1) & mask;
+        }
+        atomic_store_explicit(&table->keys[j], key, memory_order_relaxed);
+        atomic_store_explicit(&table->values[j],
+            atomic_load_explicit(&old->values[i], memory_order_relaxed), memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&map->table, table, memory_order_release);
+    old->next = map->retired;
+    map->retired = old;
+    map->used = map->count;
+    return true;
+}
+
+// Insert or replace the chunk stored at chunk->coord
+bool insert_chunk(ChunkMap *map, Chunk *chunk)
+{
+    ChunkTable *table = atomic_load_explicit(&map->table, memory_order_relaxed);
+    if ((map->used + 1) * 4 > table->capacity * MAX_LOAD_NUM) {
+        // Mostly tombstones: clean up in place, otherwise double
+        uint32_t capacity = table->capacity;
+        if ((map->count + 1) * 2 > capacity) {
+            capacity *= 2;
+        }
+        if (!rehash(map, capacity)) {
+            return false;
+        }
+        table = atomic_load_explicit(&map->table, memory_order_relaxed);
+    }
+
+    uint64_t key = pack_chunk_coord(chunk->coord);
+    uint32_t mask = table->capacity - 1;
+    int64_t slot = -1;
+    for (uint32_t i = hash_key(key) & mask; ; i = (i + 1) & mask) {
+        uint64_t k = atomic_load_explicit(&table->keys[i], memory_order_relaxed);
+        if (k == key) {
+            atomic_store_explicit(&table->values[i], chunk, memory_order_release);
+            return true;
+        }
+        if (k == CHUNK_KEY_TOMBSTONE && slot < 0) {
+            slot = i;
+        }
+        if (k == CHUNK_KEY_EMPTY) {
+            if (slot < 0) {
+                slot = i;
+                map->used++;
+            }
+            break;
+        }
+    }
+
+    // Publish the value before the key so a reader matching the key sees it
+    atomic_store_explicit(&table->values[slot], chunk, memory_order_release);
+    atomic_store_explicit(&table->keys[slot], key, memory_order_release);
+    map->count++;
+    return true;
+}
+
+// Returns the removed chunk, which readers may still hold until reclaimed
+Chunk *remove_chunk(ChunkMap *map, ChunkCoord coord)
+{
+    ChunkTable *table = atomic_load_explicit(&map->table, memory_order_relaxed);
+    uint64_t key = pack_chunk_coord(coord);
+    uint32_t mask = table->capacity - 1;
+
+    for (uint32_t i = hash_key(key) & mask; ; i = (i + 1) & mask) {
+        uint64_t k = atomic_load_explicit(&table->keys[i], memory_order_relaxed);
+        if (k == key) {
+            Chunk *chunk = atomic_load_explicit(&table->values[i], memory_order_relaxed);
+            atomic_store_explicit(&table->keys[i], CHUNK_KEY_TOMBSTONE, memory_order_release);
+            atomic_store_explicit(&table->values[i], NULL, memory_order_release);
+            map->count--;
+            return chunk;
+        }
+        if (k == CHUNK_KEY_EMPTY) {
+            return NULL;
+        }
+    }
+}
+
+void reclaim_chunk_map(ChunkMap *map)
+{
+    while (map->retired) {
+        ChunkTable *next = map->retired->next;
+        destroy_table(map->retired);
+        map->retired = next;
+    }
+}
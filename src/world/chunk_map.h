@@ -0,0 +1,64 @@
+#ifndef _CHUNK_MAP_H_
+#define _CHUNK_MAP_H_
+
+#include "chunk.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// World level map from chunk coordinates to loaded chunks.
+//
+// Open addressing with linear probing. Keys live in their own array (eight
+// per cache line) and are chunk coordinates packed into 64 bits, values sit
+// in a parallel array and are only touched on a key hit.
+//
+// Any number of threads may call find_chunk while a single writer inserts
+// or removes: readers take no lock. When the writer grows the table the old
+// one is retired instead of freed, call reclaim_chunk_map once no reader can
+// still be inside find_chunk (e.g. after the workers synced for the frame).
+// The same holds for chunks returned by remove_chunk.
+
+#define CHUNK_KEY_EMPTY     UINT64_MAX
+#define CHUNK_KEY_TOMBSTONE (UINT64_MAX - 1)
+
+typedef struct ChunkTable {
+    uint32_t capacity;              // power of two
+    _Atomic uint64_t *keys;
+    _Atomic(Chunk *) *values;
+    struct ChunkTable *next;        // retired list
+} ChunkTable;
+
+typedef struct {
+    _Atomic(ChunkTable *) table;
+    uint32_t count;                 // live entries
+    uint32_t used;                  // live entries plus tombstones
+    ChunkTable *retired;
+} ChunkMap;
+
+// Order of the neighbor slots filled by find_chunk_neighbors
+typedef enum {
+    NEIGHBOR_NEG_X = 0,
+    NEIGHBOR_POS_X,
+    NEIGHBOR_NEG_Y,
+    NEIGHBOR_POS_Y,
+    NEIGHBOR_NEG_Z,
+    NEIGHBOR_POS_Z,
+    MAX_NEIGHBOR,
+} ChunkNeighbor;
+
+// 21 bits per axis, enough for +/- 1M chunks (32M blocks) in every direction
+uint64_t pack_chunk_coord(ChunkCoord coord);
+ChunkCoord unpack_chunk_coord(uint64_t key);
+
+ChunkMap *create_chunk_map(uint32_t capacity);
+void destroy_chunk_map(ChunkMap *map);
+
+// Reader side, lock free
+Chunk *find_chunk(ChunkMap *map, ChunkCoord coord);
+void find_chunk_neighbors(ChunkMap *map, ChunkCoord coord, Chunk *neighbors[MAX_NEIGHBOR]);
+
+// Writer side, one thread at a time
+bool insert_chunk(ChunkMap *map, Chunk *chunk);
+Chunk *remove_chunk(ChunkMap *map, ChunkCoord coord);
+void reclaim_chunk_map(ChunkMap *map);
+
+#endif // _CHUNK_MAP_H_
@@ -0,0 +1,613 @@
+#include "gen_pool.h"
+#include "chunk_map.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MIN_TASK_CAPACITY   256
+#define MIN_HEAP_CAPACITY   64
+
+// Priorities are only refreshed once the focus moved this far (squared),
+// or turned more than this (cosine)
+#define REFOCUS_DISTANCE2   ((CHUNK_SIZE / 2.0f) * (CHUNK_SIZE / 2.0f))
+#define REFOCUS_TURN        0.95f
+
+// Chunks around its own a stage reads, they must have done the stage before
+static const int stage_reaches[MAX_GEN_STAGE] = {
+    [GEN_DECORATED] = 1,
+};
+
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Squared distance from the focus, scaled from half for chunks straight
+// ahead to twice for chunks straight behind
+static float task_priority(ChunkCoord coord, const float focus[3], const float front[3])
+{
+    float dx = (coord.x + 0.5f) * CHUNK_SIZE - focus[0];
+    float dy = (coord.y + 0.5f) * CHUNK_SIZE - focus[1];
+    float dz = (coord.z + 0.5f) * CHUNK_SIZE - focus[2];
+    float distance2 = dx * dx + dy * dy + dz * dz;
+    if (distance2 < 1.0f) {
+        return 0.0f;
+    }
+    float ahead = (dx * front[0] + dy * front[1] + dz * front[2]) / sqrtf(distance2);
+    return distance2 * (1.25f - 0.75f * ahead);
+}
+
+
+// Task table, open addressing with linear probing, called with the lock held
+
+static inline uint32_t hash_key(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+static GenTask *find_task(GenPool *pool, ChunkCoord coord)
+{
+    uint64_t key = pack_chunk_coord(coord);
+    uint32_t mask = pool->task_capacity - 1;
+    for (uint32_t i = hash_key(key) & mask; pool->tasks[i] != NULL; i = (i + 1) & mask) {
+        if (pack_chunk_coord(pool->tasks[i]->coord) == key) {
+            return pool->tasks[i];
+        }
+    }
+    return NULL;
+}
+
+static void place_task(GenTask **tasks, uint32_t capacity, GenTask *task)
+{
+    uint32_t mask = capacity - 1;
+    uint32_t i = hash_key(pack_chunk_coord(task->coord)) & mask;
+    while (tasks[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    tasks[i] = task;
+}
+
+// Kept at most half full
+static bool insert_task(GenPool *pool, GenTask *task)
+{
+    if (2 * (pool->task_count + 1) > pool->task_capacity) {
+        uint32_t capacity = pool->task_capacity * 2;
+        GenTask **tasks = (GenTask **) calloc(capacity, sizeof(GenTask *));
+        if (tasks == NULL) {
+            return false;
+        }
+        for (uint32_t i = 0; i < pool->task_capacity; i++) {
+            if (pool->tasks[i] != NULL) {
+                place_task(tasks, capacity, pool->tasks[i]);
+            }
+        }
+        free(pool->tasks);
+        pool->tasks = tasks;
+        pool->task_capacity = capacity;
+    }
+    place_task(pool->tasks, pool->task_capacity, task);
+    pool->task_count++;
+    return true;
+}
+
+// Backward shift deletion, no tombstones
+static void erase_task(GenPool *pool, GenTask *task)
+{
+    uint32_t mask = pool->task_capacity - 1;
+    uint32_t i = hash_key(pack_chunk_coord(task->coord)) & mask;
+    while (pool->tasks[i] != task) {
+        i = (i + 1) & mask;
+    }
+    for (uint32_t j = (i + 1) & mask; pool->tasks[j] != NULL; j = (j + 1) & mask) {
+        uint32_t home = hash_key(pack_chunk_coord(pool->tasks[j]->coord)) & mask;
+        // Move j into the hole unless its home lies cyclically in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            pool->tasks[i] = pool->tasks[j];
+            i = j;
+        }
+    }
+    pool->tasks[i] = NULL;
+    pool->task_count--;
+}
+
+
+// Heap helpers, called with the lock held
+static void sift_up(GenTask **heap, uint32_t i)
+{
+    GenTask *task = heap[i];
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (heap[parent]->priority <= task->priority) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = task;
+}
+
+static void sift_down(GenTask **heap, uint32_t count, uint32_t i)
+{
+    GenTask *task = heap[i];
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && heap[child + 1]->priority < heap[child]->priority) {
+            child++;
+        }
+        if (task->priority <= heap[child]->priority) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = task;
+}
+
+static void heapify(GenTask **heap, uint32_t count)
+{
+    for (uint32_t i = count / 2; i-- > 0;) {
+        sift_down(heap, count, i);
+    }
+}
+
+
+static bool in_world(const GenPool *pool, ChunkCoord coord)
+{
+    return coord.y >= pool->min_y && coord.y <= pool->max_y;
+}
+
+// The next stage can run: every neighbor it reads is done with this one
+static bool is_task_ready(GenPool *pool, const GenTask *task)
+{
+    if (task->running || task->stage >= task->target) {
+        return false;
+    }
+    int reach = stage_reaches[task->stage + 1];
+    for (int dy = -reach; dy <= reach; dy++) {
+        for (int dz = -reach; dz <= reach; dz++) {
+            for (int dx = -reach; dx <= reach; dx++) {
+                ChunkCoord coord = {task->coord.x + dx, task->coord.y + dy, task->coord.z + dz};
+                if ((dx == 0 && dy == 0 && dz == 0) || !in_world(pool, coord)) {
+                    continue;
+                }
+                const GenTask *neighbor = find_task(pool, coord);
+                if (neighbor == NULL || neighbor->stage < task->stage) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool queue_task(GenPool *pool, GenTask *task)
+{
+    if (task->queued || !is_task_ready(pool, task)) {
+        return true;
+    }
+    if (pool->heap_count == pool->heap_capacity) {
+        uint32_t capacity = pool->heap_capacity * 2;
+        GenTask **heap = (GenTask **) realloc(pool->heap, capacity * sizeof(GenTask *));
+        if (heap == NULL) {
+            return false;
+        }
+        pool->heap = heap;
+        pool->heap_capacity = capacity;
+    }
+    task->queued = true;
+    task->priority = task_priority(task->coord, pool->focus, pool->front);
+    pool->heap[pool->heap_count] = task;
+    sift_up(pool->heap, pool->heap_count++);
+    pthread_cond_signal(&pool->wake);
+    return true;
+}
+
+// Raise the target of the task at `coord`, creating it, and the targets of
+// the neighbors its new stages read
+static bool request_task(GenPool *pool, ChunkCoord coord, GenStage target)
+{
+    if (!in_world(pool, coord)) {
+        return true;
+    }
+    GenTask *task = find_task(pool, coord);
+    if (task == NULL) {
+        task = (GenTask *) calloc(1, sizeof(GenTask));
+        if (task == NULL) {
+            return false;
+        }
+        task->coord = coord;
+        if (!insert_task(pool, task)) {
+            free(task);
+            return false;
+        }
+    }
+    if (task->target < target) {
+        pool->pending += target == GEN_DECORATED;
+        task->target = target;
+    }
+
+    // Neighbors are requested again for the stages still to run up to
+    // `target`, pruning may have dropped them
+    GenStage needed = GEN_EMPTY;
+    for (GenStage stage = task->stage + 1; stage <= target; stage++) {
+        if (stage_reaches[stage] > 0) {
+            needed = stage - 1;
+        }
+    }
+    if (needed > GEN_EMPTY) {
+        int reach = stage_reaches[needed + 1];
+        for (int dy = -reach; dy <= reach; dy++) {
+            for (int dz = -reach; dz <= reach; dz++) {
+                for (int dx = -reach; dx <= reach; dx++) {
+                    ChunkCoord around = {coord.x + dx, coord.y + dy, coord.z + dz};
+                    if ((dx != 0 || dy != 0 || dz != 0) && !request_task(pool, around, needed)) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return queue_task(pool, task);
+}
+
+// A chunk stacked on this one that already has the column, NULL if none.
+// One running a column stage is writing its column without the lock.
+static const GenTask *find_column_task(GenPool *pool, const GenTask *task, GenStage stage)
+{
+    for (int32_t y = pool->min_y; y <= pool->max_y; y++) {
+        const GenTask *other = find_task(pool, (ChunkCoord){task->coord.x, y, task->coord.z});
+        if (other == NULL || other == task || (other->running && other->stage < GEN_HEIGHTMAP)) {
+            continue;
+        }
+        if (other->stage >= stage) {
+            return other;
+        }
+    }
+    return NULL;
+}
+
+// Runs without the lock. `columns` are the neighbor columns for decorating.
+static bool run_stage(GenPool *pool, GenTask *task, GenStage stage, const TerrainColumn **columns)
+{
+    const WorldGen *gen = pool->gen;
+    switch (stage) {
+    case GEN_CLIMATE:
+        generate_column_climate(gen, task->coord.x, task->coord.z, &task->column);
+        break;
+    case GEN_HEIGHTMAP:
+        generate_column_heights(gen, &task->column);
+        break;
+    case GEN_SURFACE:
+        task->chunk = create_chunk(task->coord);
+        if (task->chunk == NULL) {
+            return false;
+        }
+        fill_terrain_layers(gen, task->chunk, &task->column);
+        break;
+    case GEN_CAVES:
+        carve_terrain_caves(gen, task->chunk, &task->column);
+        break;
+    case GEN_DECORATED:
+        decorate_terrain_chunk(gen, task->chunk, columns);
+        update_chunk_heights(task->chunk);
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+static void *gen_worker(void *arg)
+{
+    GenPool *pool = (GenPool *) arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->heap_count == 0) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        GenTask *task = pool->heap[0];
+        pool->heap[0] = pool->heap[--pool->heap_count];
+        if (pool->heap_count > 0) {
+            sift_down(pool->heap, pool->heap_count, 0);
+        }
+        task->queued = false;
+        // A neighbor may have been pruned since it was queued
+        if (!is_task_ready(pool, task)) {
+            continue;
+        }
+        GenStage stage = task->stage + 1;
+        task->running = true;
+        pool->running++;
+
+        // The column passes run once per column, the other chunks stacked
+        // in it copy the result
+        bool copied = false;
+        if (stage == GEN_CLIMATE || stage == GEN_HEIGHTMAP) {
+            const GenTask *other = find_column_task(pool, task, stage);
+            if (other != NULL) {
+                task->column = other->column;
+                copied = true;
+            }
+        }
+        GenTask *neighbors[COLUMN_NEIGHBORHOOD];
+        const TerrainColumn *columns[COLUMN_NEIGHBORHOOD];
+        if (stage == GEN_DECORATED) {
+            for (int dz = -1; dz <= 1; dz++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    GenTask *neighbor = find_task(pool, (ChunkCoord){task->coord.x + dx, task->coord.y,
+                                                                     task->coord.z + dz});
+                    neighbor->readers++;
+                    neighbors[COLUMN_NEIGHBOR(dx, dz)] = neighbor;
+                    columns[COLUMN_NEIGHBOR(dx, dz)] = &neighbor->column;
+                }
+            }
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        double start = now_seconds();
+        bool ok = copied || run_stage(pool, task, stage, columns);
+        double elapsed = now_seconds() - start;
+
+        pthread_mutex_lock(&pool->lock);
+        if (stage == GEN_DECORATED) {
+            for (int c = 0; c < COLUMN_NEIGHBORHOOD; c++) {
+                neighbors[c]->readers--;
+            }
+        }
+        task->running = false;
+        pool->running--;
+        pool->busy_seconds += elapsed;
+        if (!ok) {
+            // Out of memory, the task stays where it is
+            pool->pending -= task->target == GEN_DECORATED;
+            task->target = task->stage;
+            pool->failed++;
+        } else {
+            task->stage = stage;
+            pool->stage_jobs[stage]++;
+            pool->stage_seconds[stage] += elapsed;
+            if (stage == GEN_DECORATED) {
+                task->next = pool->completed;
+                pool->completed = task;
+                pool->generated++;
+                pool->pending--;
+            }
+
+            // This task and the neighbors waiting on it may be ready now
+            queue_task(pool, task);
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dz = -1; dz <= 1; dz++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        GenTask *neighbor = find_task(pool, (ChunkCoord){task->coord.x + dx, task->coord.y + dy,
+                                                                         task->coord.z + dz});
+                        if (neighbor != NULL && neighbor != task) {
+                            queue_task(pool, neighbor);
+                        }
+                    }
+                }
+            }
+        }
+        if (pool->running == 0 && pool->heap_count == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+
+GenPool *create_gen_pool(const WorldGen *gen, int32_t min_y, int32_t max_y, int threads)
+{
+    if (threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 1 ? (int)cores - 1 : 1;
+    }
+
+    GenPool *pool = (GenPool *) calloc(1, sizeof(GenPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->gen = gen;
+    pool->min_y = min_y;
+    pool->max_y = max_y;
+    pool->front[2] = -1.0f;
+    pool->tasks = (GenTask **) calloc(MIN_TASK_CAPACITY, sizeof(GenTask *));
+    pool->task_capacity = MIN_TASK_CAPACITY;
+    pool->heap = (GenTask **) malloc(MIN_HEAP_CAPACITY * sizeof(GenTask *));
+    pool->heap_capacity = MIN_HEAP_CAPACITY;
+    pool->threads = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    if (pool->tasks == NULL || pool->heap == NULL || pool->threads == NULL) {
+        free(pool->tasks);
+        free(pool->heap);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, gen_worker, pool) != 0) {
+            break;
+        }
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0) {
+        destroy_gen_pool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static void free_task(GenTask *task)
+{
+    if (!task->collected && task->chunk != NULL) {
+        destroy_chunk(task->chunk);
+    }
+    free(task);
+}
+
+void destroy_gen_pool(GenPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (uint32_t i = 0; i < pool->task_capacity; i++) {
+        if (pool->tasks[i] != NULL) {
+            free_task(pool->tasks[i]);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->tasks);
+    free(pool->heap);
+    free(pool->threads);
+    free(pool);
+}
+
+bool request_gen_chunk(GenPool *pool, ChunkCoord coord)
+{
+    pthread_mutex_lock(&pool->lock);
+    bool ok = request_task(pool, coord, GEN_DECORATED);
+    pthread_mutex_unlock(&pool->lock);
+    return ok;
+}
+
+bool request_gen_area(GenPool *pool, ChunkCoord center, int radius)
+{
+    bool ok = true;
+    pthread_mutex_lock(&pool->lock);
+    for (int32_t y = pool->min_y; y <= pool->max_y && ok; y++) {
+        for (int32_t z = center.z - radius; z <= center.z + radius && ok; z++) {
+            for (int32_t x = center.x - radius; x <= center.x + radius && ok; x++) {
+                ok = request_task(pool, (ChunkCoord){x, y, z}, GEN_DECORATED);
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return ok;
+}
+
+void set_gen_pool_focus(GenPool *pool, const float position[3], const float front[3])
+{
+    pthread_mutex_lock(&pool->lock);
+    float dx = position[0] - pool->focus[0];
+    float dy = position[1] - pool->focus[1];
+    float dz = position[2] - pool->focus[2];
+    float turn = front[0] * pool->front[0] + front[1] * pool->front[1] + front[2] * pool->front[2];
+    if (dx * dx + dy * dy + dz * dz < REFOCUS_DISTANCE2 && turn > REFOCUS_TURN) {
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    memcpy(pool->focus, position, sizeof(pool->focus));
+    memcpy(pool->front, front, sizeof(pool->front));
+
+    for (uint32_t i = 0; i < pool->heap_count; i++) {
+        pool->heap[i]->priority = task_priority(pool->heap[i]->coord, pool->focus, pool->front);
+    }
+    heapify(pool->heap, pool->heap_count);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int collect_gen_chunks(GenPool *pool, Chunk **chunks, int max)
+{
+    pthread_mutex_lock(&pool->lock);
+    // The list is newest first, hand out its tail
+    int total = 0;
+    for (const GenTask *task = pool->completed; task != NULL; task = task->next) {
+        total++;
+    }
+    int count = total < max ? total : max;
+    GenTask **link = &pool->completed;
+    for (int i = 0; i < total - count; i++) {
+        link = &(*link)->next;
+    }
+    GenTask *task = *link;
+    *link = NULL;
+    for (int i = count - 1; i >= 0; i--) {
+        task->collected = true;
+        chunks[i] = task->chunk;
+        task = task->next;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return count;
+}
+
+int prune_gen_pool(GenPool *pool, ChunkCoord center, int radius)
+{
+    pthread_mutex_lock(&pool->lock);
+    // Victims are gathered first, erasing moves the other tasks around
+    GenTask **victims = (GenTask **) malloc(pool->task_count * sizeof(GenTask *));
+    if (victims == NULL) {
+        pthread_mutex_unlock(&pool->lock);
+        return 0;
+    }
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < pool->task_capacity; i++) {
+        GenTask *task = pool->tasks[i];
+        if (task == NULL || task->running || task->readers > 0 ||
+            (abs(task->coord.x - center.x) <= radius && abs(task->coord.z - center.z) <= radius)) {
+            continue;
+        }
+        // Finished and not yet collected, leave it to the caller
+        if (task->stage == GEN_DECORATED && !task->collected) {
+            continue;
+        }
+        victims[count++] = task;
+    }
+    if (count > 0) {
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < pool->heap_count; i++) {
+            GenTask *task = pool->heap[i];
+            bool far = abs(task->coord.x - center.x) > radius || abs(task->coord.z - center.z) > radius;
+            if (!far || task->readers > 0) {
+                pool->heap[kept++] = task;
+            }
+        }
+        pool->heap_count = kept;
+        heapify(pool->heap, pool->heap_count);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        pool->pending -= victims[i]->target == GEN_DECORATED && victims[i]->stage < GEN_DECORATED;
+        erase_task(pool, victims[i]);
+        free_task(victims[i]);
+    }
+    if (pool->running == 0 && pool->heap_count == 0) {
+        pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    free(victims);
+    return (int)count;
+}
+
+void wait_gen_pool(GenPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0 || pool->heap_count > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
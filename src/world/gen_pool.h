@@ -0,0 +1,106 @@
+#ifndef _GEN_POOL_H_
+#define _GEN_POOL_H_
+
+#include "chunk.h"
+#include "worldgen.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Worker threads generating chunks in stages (see worldgen.h).
+//
+// Every requested chunk has a task that moves through the stages one job
+// at a time, and every job is one stage of one chunk. A stage may read the
+// neighbors of its chunk (stage_reaches in gen_pool.c): it then waits until
+// the 26 chunks around have finished the stage before it. Requesting a
+// chunk also requests its neighbors up to that stage, so the chunks around
+// the requested area stop partway. Today only decorating reads neighbors:
+// trees need the surface of the columns around.
+//
+// Ready jobs go on one heap. Workers take the chunk that is closest first,
+// and chunks in front of the focus count as closer than chunks behind it.
+// Small jobs from many chunks keep every worker busy while the focus
+// moves fast.
+//
+// Finished chunks go to the main thread through collect_gen_chunks, and
+// the caller owns them from then on. A task stays in the pool after its
+// chunk is handed out, so its neighbors can still read its column. Pruning
+// drops the tasks far from the focus. A pruned chunk that is requested
+// again is generated again.
+
+typedef enum {
+    GEN_EMPTY = 0,
+    GEN_CLIMATE,            // biome of every column
+    GEN_HEIGHTMAP,          // surface heights and soil depth
+    GEN_SURFACE,            // stone, soil, top blocks and water
+    GEN_CAVES,
+    GEN_DECORATED,          // trees, the chunk is done
+    MAX_GEN_STAGE,
+} GenStage;
+
+typedef struct GenTask {
+    ChunkCoord coord;
+    Chunk *chunk;               // created by the surface stage
+    TerrainColumn column;
+    GenStage stage;             // last stage done
+    GenStage target;            // stage it was requested up to
+    bool queued;
+    bool running;
+    bool collected;             // chunk handed to the caller
+    uint16_t readers;           // running neighbors reading `column`
+    float priority;
+    struct GenTask *next;       // completed list
+} GenTask;
+
+typedef struct {
+    const WorldGen *gen;
+    int32_t min_y;              // chunks outside [min_y, max_y] do not exist
+    int32_t max_y;
+    pthread_t *threads;
+    int thread_count;
+
+    // Guards everything below
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    GenTask **tasks;            // open addressing on the packed coordinate
+    uint32_t task_count;
+    uint32_t task_capacity;     // power of two
+    GenTask **heap;             // binary min heap of ready tasks on priority
+    uint32_t heap_count;
+    uint32_t heap_capacity;
+    GenTask *completed;         // oldest last
+    uint32_t running;
+    uint32_t pending;           // requested chunks not generated yet, the backlog
+    float focus[3];
+    float front[3];
+    bool stop;
+
+    // Counters, for reports
+    uint32_t generated;         // chunks that reached GEN_DECORATED
+    uint32_t failed;            // chunks that could not be allocated
+    uint32_t stage_jobs[MAX_GEN_STAGE];
+    double stage_seconds[MAX_GEN_STAGE];
+    double busy_seconds;        // summed over the workers
+} GenPool;
+
+// `threads` <= 0 uses one worker per core, leaving one core to the main thread
+GenPool *create_gen_pool(const WorldGen *gen, int32_t min_y, int32_t max_y, int threads);
+// Destroys the chunks that were not collected
+void destroy_gen_pool(GenPool *pool);
+
+// Main thread side. Requests return false when out of memory.
+bool request_gen_chunk(GenPool *pool, ChunkCoord coord);
+// Every chunk within `radius` chunks of `center` along x and z, all of [min_y, max_y]
+bool request_gen_area(GenPool *pool, ChunkCoord center, int radius);
+void set_gen_pool_focus(GenPool *pool, const float position[3], const float front[3]);
+// Up to `max` finished chunks, oldest first, the caller owns them
+int collect_gen_chunks(GenPool *pool, Chunk **chunks, int max);
+// Drops the idle tasks further than `radius` chunks from `center` along x
+// or z, and their chunks unless collected. Keep at least the requested
+// radius plus one, the partway neighbors. Returns the tasks dropped.
+int prune_gen_pool(GenPool *pool, ChunkCoord center, int radius);
+// Blocks until no job is ready or running
+void wait_gen_pool(GenPool *pool);
+
+#endif // _GEN_POOL_H_
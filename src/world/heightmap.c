@@ -0,0 +1,175 @@
+#include "heightmap.h"
+
+
+int32_t find_surface_height(ChunkMap *map, int32_t x, int32_t z, int32_t top)
+{
+    ChunkCoord coord = world_to_chunk_coord(x, top, z);
+    int lx = x & CHUNK_MASK;
+    int lz = z & CHUNK_MASK;
+    int y = top & CHUNK_MASK;
+
+    for (Chunk *chunk = find_chunk(map, coord); chunk != NULL; chunk = find_chunk(map, coord)) {
+        int height = get_chunk_height(chunk, lx, lz);
+        // Only the start chunk can have its top block above `top`
+        if (height > y + 1) {
+            height = scan_chunk_height(chunk, lx, y, lz);
+        }
+        if (height > 0) {
+            return coord.y * CHUNK_SIZE + height - 1;
+        }
+        coord.y--;
+        y = CHUNK_MASK;
+    }
+    return HEIGHT_NONE;
+}
+
+int build_column_heightmap(ChunkMap *map, int32_t x, int32_t z, int32_t bottom, int32_t top,
+                           ColumnHeightmap *heightmap)
+{
+    heightmap->x = x;
+    heightmap->z = z;
+    for (int i = 0; i < CHUNK_AREA; i++) {
+        heightmap->heights[i] = HEIGHT_NONE;
+        heightmap->surface[i] = AIR;
+    }
+
+    // Top down, a column is done with the first chunk that has a block in it
+    int missing = CHUNK_AREA;
+    int loaded = 0;
+    for (int32_t y = top; y >= bottom && missing > 0; y--) {
+        Chunk *chunk = find_chunk(map, (ChunkCoord){x, y, z});
+        if (chunk == NULL) {
+            continue;
+        }
+        loaded++;
+        for (int i = 0; i < CHUNK_AREA; i++) {
+            int height = chunk->heights[i];
+            if (height == 0 || heightmap->heights[i] != HEIGHT_NONE) {
+                continue;
+            }
+            heightmap->heights[i] = y * CHUNK_SIZE + height - 1;
+            heightmap->surface[i] = chunk->blocks[(height - 1) << (2 * CHUNK_SHIFT) | i];
+            missing--;
+        }
+    }
+    return loaded;
+}
+
+static inline uint8_t *put_varint(uint8_t *out, uint64_t value)
+{
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+// NULL when the varint runs past `end` or over `max_bytes`
+static inline const uint8_t *get_varint(const uint8_t *in, const uint8_t *end, int max_bytes, uint64_t *value)
+{
+    *value = 0;
+    for (int i = 0; i < max_bytes && in < end; i++) {
+        uint8_t byte = *in++;
+        *value |= (uint64_t)(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+static inline uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+size_t pack_column_heightmap(const ColumnHeightmap *heightmap, uint8_t *out)
+{
+    uint8_t *p = out;
+    p = put_varint(p, zigzag(heightmap->x));
+    p = put_varint(p, zigzag(heightmap->z));
+
+    // 0 for an empty column, else 1 + the zigzag delta to the last height.
+    // Neighboring heights of smooth terrain are a byte each.
+    int64_t last = 0;
+    for (int i = 0; i < CHUNK_AREA; i++) {
+        int32_t height = heightmap->heights[i];
+        if (height == HEIGHT_NONE) {
+            *p++ = 0;
+            continue;
+        }
+        p = put_varint(p, zigzag((int64_t)height - last) + 1);
+        last = height;
+    }
+
+    for (int i = 0; i < CHUNK_AREA; ) {
+        BlockId block = heightmap->surface[i];
+        int run = 1;
+        while (i + run < CHUNK_AREA && run < 255 && heightmap->surface[i + run] == block) {
+            run++;
+        }
+        *p++ = (uint8_t)run;
+        for (size_t b = 0; b < sizeof(BlockId); b++) {
+            *p++ = (uint8_t)(block >> (8 * b));
+        }
+        i += run;
+    }
+    return (size_t)(p - out);
+}
+
+size_t unpack_column_heightmap(ColumnHeightmap *heightmap, const uint8_t *data, size_t size)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    uint64_t value;
+
+    if ((p = get_varint(p, end, 5, &value)) == NULL) {
+        return 0;
+    }
+    heightmap->x = (int32_t)unzigzag(value);
+    if ((p = get_varint(p, end, 5, &value)) == NULL) {
+        return 0;
+    }
+    heightmap->z = (int32_t)unzigzag(value);
+
+    int64_t last = 0;
+    for (int i = 0; i < CHUNK_AREA; i++) {
+        if ((p = get_varint(p, end, 5, &value)) == NULL) {
+            return 0;
+        }
+        if (value == 0) {
+            heightmap->heights[i] = HEIGHT_NONE;
+            continue;
+        }
+        int64_t height = last + unzigzag(value - 1);
+        if (height <= HEIGHT_NONE || height > INT32_MAX) {
+            return 0;
+        }
+        heightmap->heights[i] = (int32_t)height;
+        last = height;
+    }
+
+    for (int i = 0; i < CHUNK_AREA; ) {
+        if (end - p < (ptrdiff_t)(1 + sizeof(BlockId))) {
+            return 0;
+        }
+        int run = *p++;
+        BlockId block = 0;
+        for (size_t b = 0; b < sizeof(BlockId); b++) {
+            block |= (BlockId)(*p++ << (8 * b));
+        }
+        if (run == 0 || i + run > CHUNK_AREA) {
+            return 0;
+        }
+        for (int r = 0; r < run; r++) {
+            heightmap->surface[i++] = block;
+        }
+    }
+    return (size_t)(p - data);
+}
@@ -0,0 +1,45 @@
+#ifndef _HEIGHTMAP_H_
+#define _HEIGHTMAP_H_
+
+#include "chunk.h"
+#include "chunk_map.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// World column heights built on the per chunk heights (Chunk.heights).
+//
+// A world column runs through the chunks stacked along y. Its surface is
+// found by walking the loaded chunks downward, one byte per chunk, with no
+// voxel reads unless the start is inside a chunk. A ColumnHeightmap holds
+// the heights and surface blocks of a whole chunk column. It packs into a
+// couple of bytes per column, enough to draw far terrain from.
+
+#define HEIGHT_NONE     INT32_MIN
+
+// World y of the highest non AIR block of the world column (x, z) at or
+// below world y `top`, searching downward through loaded chunks.
+// HEIGHT_NONE when a missing chunk is reached first.
+int32_t find_surface_height(ChunkMap *map, int32_t x, int32_t z, int32_t top);
+
+typedef struct {
+    int32_t x;                      // chunk column, in chunks
+    int32_t z;
+    int32_t heights[CHUNK_AREA];    // world y of the top block, HEIGHT_NONE; indexed with CHUNK_COLUMN
+    BlockId surface[CHUNK_AREA];    // the top block, AIR without one
+} ColumnHeightmap;
+
+// Summarize the chunk column (x, z) over the loaded chunks y in [bottom, top].
+// Returns the number of loaded chunks it read.
+int build_column_heightmap(ChunkMap *map, int32_t x, int32_t z, int32_t bottom, int32_t top,
+                           ColumnHeightmap *heightmap);
+
+// Packed form: the coordinates, then the heights as zigzag varint deltas
+// in CHUNK_COLUMN order, then the surface blocks run length coded.
+#define COLUMN_HEIGHTMAP_MAX_BYTES  (10 + CHUNK_AREA * (5 + 1 + sizeof(BlockId)))
+
+// Bytes written to `out`, which holds COLUMN_HEIGHTMAP_MAX_BYTES
+size_t pack_column_heightmap(const ColumnHeightmap *heightmap, uint8_t *out);
+// Bytes read, 0 when `data` is cut short or malformed
+size_t unpack_column_heightmap(ColumnHeightmap *heightmap, const uint8_t *data, size_t size);
+
+#endif // _HEIGHTMAP_H_
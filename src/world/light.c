@@ -0,0 +1,386 @@
+#include "light.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_QUEUE_CAPACITY  4096
+#define MIN_CHANGED         64
+
+static const int index_offsets[MAX_NEIGHBOR] = {
+    -1, 1,
+    -CHUNK_AREA, CHUNK_AREA,
+    -CHUNK_SIZE, CHUNK_SIZE,
+};
+
+// Shift of each axis in CHUNK_INDEX
+static const int axis_shifts[3] = {0, 2 * CHUNK_SHIFT, CHUNK_SHIFT};
+
+static const ChunkCoord neighbor_offsets[MAX_NEIGHBOR] = {
+    {-1, 0, 0}, {1, 0, 0},
+    {0, -1, 0}, {0, 1, 0},
+    {0, 0, -1}, {0, 0, 1},
+};
+
+static const uint8_t block_emission[MAX_VOXEL] = {
+    [LAVA] = LIGHT_MAX,
+};
+
+
+uint8_t get_block_emission(BlockId block)
+{
+    return block < MAX_VOXEL ? block_emission[block] : 0;
+}
+
+static void init_light_queue(LightQueue *queue)
+{
+    memset(queue, 0, sizeof(LightQueue));
+}
+
+static void free_light_queue(LightQueue *queue)
+{
+    free(queue->nodes);
+    init_light_queue(queue);
+}
+
+void init_light_engine(LightEngine *engine, ChunkMap *map)
+{
+    memset(engine, 0, sizeof(LightEngine));
+    engine->map = map;
+}
+
+void free_light_engine(LightEngine *engine)
+{
+    free_light_queue(&engine->add);
+    free_light_queue(&engine->remove);
+    free(engine->changed);
+    memset(engine, 0, sizeof(LightEngine));
+}
+
+static void push_light_node(LightEngine *engine, LightQueue *queue, Chunk *chunk, int index, int level)
+{
+    if (queue->count == queue->capacity) {
+        if (queue->head > 0) {
+            // Reuse the consumed front before growing
+            memmove(queue->nodes, &queue->nodes[queue->head], (queue->count - queue->head) * sizeof(LightNode));
+            queue->count -= queue->head;
+            queue->head = 0;
+        } else {
+            uint32_t capacity = queue->capacity ? queue->capacity * 2 : MIN_QUEUE_CAPACITY;
+            LightNode *nodes = (LightNode *) realloc(queue->nodes, capacity * sizeof(LightNode));
+            if (nodes == NULL) {
+                engine->failed = true;
+                return;
+            }
+            queue->nodes = nodes;
+            queue->capacity = capacity;
+        }
+    }
+    queue->nodes[queue->count++] = (LightNode){chunk, (uint16_t)index, (uint8_t)level};
+}
+
+static inline bool pop_light_node(LightQueue *queue, LightNode *node)
+{
+    if (queue->head == queue->count) {
+        queue->head = 0;
+        queue->count = 0;
+        return false;
+    }
+    *node = queue->nodes[queue->head++];
+    return true;
+}
+
+static inline int get_light_level(const Chunk *chunk, int index, LightChannel channel)
+{
+    uint8_t light = chunk->light[index];
+    return channel == LIGHT_SKY ? SKY_LIGHT(light) : BLOCK_LIGHT(light);
+}
+
+static void add_changed_chunk(LightEngine *engine, Chunk *chunk)
+{
+    if (engine->changed_count == engine->changed_capacity) {
+        uint32_t capacity = engine->changed_capacity ? engine->changed_capacity * 2 : MIN_CHANGED;
+        Chunk **changed = (Chunk **) realloc(engine->changed, capacity * sizeof(Chunk *));
+        if (changed == NULL) {
+            engine->failed = true;
+            return;
+        }
+        engine->changed = changed;
+        engine->changed_capacity = capacity;
+    }
+    engine->changed[engine->changed_count++] = chunk;
+}
+
+// Remember that the voxel `index` of `chunk` changed, and which borders it lies on
+static inline void mark_light_change(LightEngine *engine, Chunk *chunk, int index)
+{
+    if (!(chunk->light_changes & LIGHT_CHANGED)) {
+        chunk->light_changes |= LIGHT_CHANGED;
+        add_changed_chunk(engine, chunk);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        int c = (index >> axis_shifts[axis]) & CHUNK_MASK;
+        if (c == 0) {
+            chunk->light_changes |= 1 << (2 * axis);
+        } else if (c == CHUNK_MASK) {
+            chunk->light_changes |= 1 << (2 * axis + 1);
+        }
+    }
+}
+
+static inline void set_light_level(LightEngine *engine, Chunk *chunk, int index, LightChannel channel, int level)
+{
+    uint8_t light = chunk->light[index];
+    chunk->light[index] = channel == LIGHT_SKY ? PACK_LIGHT(level, BLOCK_LIGHT(light))
+                                               : PACK_LIGHT(SKY_LIGHT(light), level);
+    mark_light_change(engine, chunk, index);
+}
+
+static Chunk *find_neighbor_chunk(LightEngine *engine, const Chunk *chunk, int face)
+{
+    ChunkCoord coord = {
+        chunk->coord.x + neighbor_offsets[face].x,
+        chunk->coord.y + neighbor_offsets[face].y,
+        chunk->coord.z + neighbor_offsets[face].z,
+    };
+    return find_chunk(engine->map, coord);
+}
+
+// Voxel next to `index` of `chunk` across `face`. Returns NULL when that
+// voxel is in a chunk that is not loaded.
+static inline Chunk *step_voxel(LightEngine *engine, Chunk *chunk, int index, int face, int *next)
+{
+    int axis = face >> 1;
+    int c = (index >> axis_shifts[axis]) & CHUNK_MASK;
+    if (c != ((face & 1) ? CHUNK_MASK : 0)) {
+        *next = index + index_offsets[face];
+        return chunk;
+    }
+    // Wrap around to the opposite border of the neighbor
+    *next = index - index_offsets[face] * CHUNK_MASK;
+    return find_neighbor_chunk(engine, chunk, face);
+}
+
+// Level that light of `level` has after spreading into `block` across `face`
+static inline int spread_level(LightChannel channel, int level, int face, BlockId block)
+{
+    // Full sky light falls through air undimmed
+    if (channel == LIGHT_SKY && level == LIGHT_MAX && face == NEIGHBOR_NEG_Y && block == AIR) {
+        return LIGHT_MAX;
+    }
+    return level - 1;
+}
+
+// Spread light from every voxel of the add queue until nothing brightens
+static void propagate_light(LightEngine *engine, LightChannel channel)
+{
+    LightNode node;
+    while (pop_light_node(&engine->add, &node)) {
+        engine->visited++;
+        int level = get_light_level(node.chunk, node.index, channel);
+        if (level <= 1) {
+            continue;
+        }
+        for (int face = 0; face < MAX_NEIGHBOR; face++) {
+            int next;
+            Chunk *chunk = step_voxel(engine, node.chunk, node.index, face, &next);
+            if (chunk == NULL || is_block_opaque(chunk->blocks[next])) {
+                continue;
+            }
+            int spread = spread_level(channel, level, face, chunk->blocks[next]);
+            if (get_light_level(chunk, next, channel) < spread) {
+                set_light_level(engine, chunk, next, channel, spread);
+                push_light_node(engine, &engine->add, chunk, next, spread);
+            }
+        }
+    }
+}
+
+// Darken what the voxels of the remove queue lit, queueing the brighter
+// voxels at the edge of the darkened region for propagate_light
+static void remove_light(LightEngine *engine, LightChannel channel)
+{
+    LightNode node;
+    while (pop_light_node(&engine->remove, &node)) {
+        engine->visited++;
+        for (int face = 0; face < MAX_NEIGHBOR; face++) {
+            int next;
+            Chunk *chunk = step_voxel(engine, node.chunk, node.index, face, &next);
+            if (chunk == NULL) {
+                continue;
+            }
+            int level = get_light_level(chunk, next, channel);
+            if (level == 0) {
+                continue;
+            }
+            bool lit_by_node = level < node.level ||
+                (channel == LIGHT_SKY && face == NEIGHBOR_NEG_Y && node.level == LIGHT_MAX && level == LIGHT_MAX);
+            if (lit_by_node) {
+                // Emitters keep their own light and shine into the region again
+                int own = channel == LIGHT_BLOCK ? get_block_emission(chunk->blocks[next]) : 0;
+                set_light_level(engine, chunk, next, channel, own);
+                push_light_node(engine, &engine->remove, chunk, next, level);
+                if (own > 0) {
+                    push_light_node(engine, &engine->add, chunk, next, own);
+                }
+            } else if (level >= node.level) {
+                push_light_node(engine, &engine->add, chunk, next, level);
+            }
+        }
+    }
+}
+
+// Add the neighbors of changed borders to the changed chunks
+static void flush_border_changes(LightEngine *engine)
+{
+    uint32_t count = engine->changed_count;
+    for (uint32_t i = 0; i < count; i++) {
+        Chunk *chunk = engine->changed[i];
+        uint8_t borders = chunk->light_changes & ~LIGHT_CHANGED;
+        chunk->light_changes &= LIGHT_CHANGED;
+        for (int face = 0; face < MAX_NEIGHBOR; face++) {
+            Chunk *neighbor = (borders >> face) & 1 ? find_neighbor_chunk(engine, chunk, face) : NULL;
+            if (neighbor != NULL && !(neighbor->light_changes & LIGHT_CHANGED)) {
+                neighbor->light_changes |= LIGHT_CHANGED;
+                add_changed_chunk(engine, neighbor);
+            }
+        }
+    }
+}
+
+// Queue the lit voxels of the neighbor across `face` that touch `chunk`
+static void pull_neighbor_light(LightEngine *engine, Chunk *chunk, int face, LightChannel channel)
+{
+    Chunk *neighbor = find_neighbor_chunk(engine, chunk, face);
+    if (neighbor == NULL) {
+        return;
+    }
+    int axis = face >> 1;
+    int a1 = (axis + 1) % 3;
+    int a2 = (axis + 2) % 3;
+    int border = (face & 1) ? 0 : CHUNK_MASK;
+    for (int v = 0; v < CHUNK_SIZE; v++) {
+        for (int u = 0; u < CHUNK_SIZE; u++) {
+            int index = border << axis_shifts[axis] | u << axis_shifts[a1] | v << axis_shifts[a2];
+            int level = get_light_level(neighbor, index, channel);
+            if (level > 1) {
+                push_light_node(engine, &engine->add, neighbor, index, level);
+            }
+        }
+    }
+}
+
+bool light_chunk(LightEngine *engine, Chunk *chunk)
+{
+    engine->failed = false;
+
+    // Sky: open above when no chunk is. A chunk below lit as open sky is
+    // in the shade of this one now, its full light top layer goes.
+    Chunk *below = find_neighbor_chunk(engine, chunk, NEIGHBOR_NEG_Y);
+    if (below != NULL) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                int index = CHUNK_INDEX(x, CHUNK_MASK, z);
+                if (get_light_level(below, index, LIGHT_SKY) == LIGHT_MAX) {
+                    set_light_level(engine, below, index, LIGHT_SKY, 0);
+                    push_light_node(engine, &engine->remove, below, index, LIGHT_MAX);
+                }
+            }
+        }
+        remove_light(engine, LIGHT_SKY);
+    }
+    if (find_neighbor_chunk(engine, chunk, NEIGHBOR_POS_Y) == NULL) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                int index = CHUNK_INDEX(x, CHUNK_MASK, z);
+                if (!is_block_opaque(chunk->blocks[index])) {
+                    set_light_level(engine, chunk, index, LIGHT_SKY, LIGHT_MAX);
+                    push_light_node(engine, &engine->add, chunk, index, LIGHT_MAX);
+                }
+            }
+        }
+    }
+    for (int face = 0; face < MAX_NEIGHBOR; face++) {
+        pull_neighbor_light(engine, chunk, face, LIGHT_SKY);
+    }
+    propagate_light(engine, LIGHT_SKY);
+
+    // Block light from the emitters of the chunk, none above its top block,
+    // and the neighbors' light
+    int emitter_end = get_chunk_top(chunk) * CHUNK_AREA;
+    for (int i = 0; i < emitter_end; i++) {
+        int emission = get_block_emission(chunk->blocks[i]);
+        if (emission > 0) {
+            set_light_level(engine, chunk, i, LIGHT_BLOCK, emission);
+            push_light_node(engine, &engine->add, chunk, i, emission);
+        }
+    }
+    for (int face = 0; face < MAX_NEIGHBOR; face++) {
+        pull_neighbor_light(engine, chunk, face, LIGHT_BLOCK);
+    }
+    propagate_light(engine, LIGHT_BLOCK);
+
+    // A new chunk changes the apron of every loaded neighbor's mesh
+    chunk->light_changes |= 0x3F;
+    if (!(chunk->light_changes & LIGHT_CHANGED)) {
+        chunk->light_changes |= LIGHT_CHANGED;
+        add_changed_chunk(engine, chunk);
+    }
+    flush_border_changes(engine);
+    return !engine->failed;
+}
+
+bool set_light_block(LightEngine *engine, int x, int y, int z, BlockId block)
+{
+    Chunk *chunk = find_chunk(engine->map, world_to_chunk_coord(x, y, z));
+    if (chunk == NULL) {
+        return false;
+    }
+    int index = CHUNK_INDEX(x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK);
+    if (chunk->blocks[index] == block) {
+        return true;
+    }
+    engine->failed = false;
+    set_chunk_block(chunk, x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK, block);
+    mark_light_change(engine, chunk, index);
+
+    bool open = !is_block_opaque(block);
+    // Open sky above the top layer of a column's highest chunk
+    bool sky_source = open && (y & CHUNK_MASK) == CHUNK_MASK &&
+                      find_neighbor_chunk(engine, chunk, NEIGHBOR_POS_Y) == NULL;
+    for (int channel = 0; channel < MAX_LIGHT_CHANNEL; channel++) {
+        int old_level = get_light_level(chunk, index, channel);
+        int source = channel == LIGHT_SKY ? (sky_source ? LIGHT_MAX : 0) : get_block_emission(block);
+
+        if (old_level > 0) {
+            set_light_level(engine, chunk, index, channel, 0);
+            push_light_node(engine, &engine->remove, chunk, index, old_level);
+            remove_light(engine, channel);
+        }
+        if (source > 0) {
+            set_light_level(engine, chunk, index, channel, source);
+            push_light_node(engine, &engine->add, chunk, index, source);
+        }
+        if (open) {
+            // Let the neighbors shine into the voxel
+            for (int face = 0; face < MAX_NEIGHBOR; face++) {
+                int next;
+                Chunk *neighbor = step_voxel(engine, chunk, index, face, &next);
+                int level = neighbor != NULL ? get_light_level(neighbor, next, channel) : 0;
+                if (level > 1) {
+                    push_light_node(engine, &engine->add, neighbor, next, level);
+                }
+            }
+        }
+        propagate_light(engine, channel);
+    }
+    flush_border_changes(engine);
+    return !engine->failed;
+}
+
+void clear_light_changes(LightEngine *engine)
+{
+    for (uint32_t i = 0; i < engine->changed_count; i++) {
+        engine->changed[i]->light_changes = 0;
+    }
+    engine->changed_count = 0;
+}
@@ -0,0 +1,89 @@
+#ifndef _LIGHT_H_
+#define _LIGHT_H_
+
+#include "chunk.h"
+#include "chunk_map.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Voxel light flood filled over the loaded chunks.
+//
+// Every voxel keeps a sky and a block light level from 0 to LIGHT_MAX in
+// Chunk.light. Light spreads breadth first from its sources into non opaque
+// voxels and loses a level per step, so a level 15 source reaches 14
+// blocks. Sky light comes in at the top of the highest loaded chunk of a
+// column and goes straight down through air without getting darker. Block
+// light comes from emissive blocks, see get_block_emission.
+//
+// Edits use two queues. First the voxels the old light reached are
+// darkened breadth first. Brighter voxels found at the edge of the dark
+// region go to the relight queue. Propagating that queue, together with
+// any new source, lights the region again. Only voxels whose light can
+// depend on the edited block are visited.
+//
+// All calls must come from the thread that writes chunks. Mesh workers
+// read the light the same way they read blocks.
+
+#define LIGHT_MAX               15
+#define SKY_LIGHT(light)        ((light) >> 4)
+#define BLOCK_LIGHT(light)      ((light) & 0xF)
+#define PACK_LIGHT(sky, block)  ((uint8_t)((sky) << 4 | (block)))
+
+// Chunk.light_changes: the chunk's light changed, and bit `face` for each
+// face whose border voxels changed (the neighbor's mesh shows them)
+#define LIGHT_CHANGED           0x80
+
+typedef enum {
+    LIGHT_SKY = 0,
+    LIGHT_BLOCK,
+    MAX_LIGHT_CHANNEL,
+} LightChannel;
+
+typedef struct {
+    Chunk *chunk;
+    uint16_t index;             // CHUNK_INDEX in chunk
+    uint8_t level;              // removal queue: level before darkening
+} LightNode;
+
+// FIFO, the nodes before `head` are consumed
+typedef struct {
+    LightNode *nodes;
+    uint32_t head;
+    uint32_t count;
+    uint32_t capacity;
+} LightQueue;
+
+typedef struct {
+    ChunkMap *map;
+    LightQueue add;             // voxels to spread light from
+    LightQueue remove;          // voxels to darken the neighbors of
+    // Chunks to remesh because their light changed since the last
+    // clear_light_changes. Includes neighbors of changed borders.
+    Chunk **changed;
+    uint32_t changed_count;
+    uint32_t changed_capacity;
+    uint64_t visited;           // voxels taken off a queue, for stats
+    bool failed;                // a queue or the changed list could not grow
+} LightEngine;
+
+// The queues grow on first use
+void init_light_engine(LightEngine *engine, ChunkMap *map);
+void free_light_engine(LightEngine *engine);
+
+// Block light level a block gives off, 0 for most blocks
+uint8_t get_block_emission(BlockId block);
+
+// Light a newly loaded chunk whose light is still all zero. Light from the
+// loaded neighbors flows in and the chunk's own light flows out. If the
+// chunk below was lit as open sky, it is shaded now.
+// Returns false if a queue could not grow. The light is then incomplete.
+bool light_chunk(LightEngine *engine, Chunk *chunk);
+
+// Set the block at world position (x, y, z) and update the light around
+// it. Returns false if the chunk is not loaded or a queue could not grow.
+bool set_light_block(LightEngine *engine, int x, int y, int z, BlockId block);
+
+// Forget the changed chunks, once they are queued for remeshing
+void clear_light_changes(LightEngine *engine);
+
+#endif // _LIGHT_H_
@@ -0,0 +1,302 @@
+#include "mesh_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_HEAP_CAPACITY   64
+
+// Priorities are only refreshed once the focus moved this far (squared)
+#define REFOCUS_DISTANCE2   ((CHUNK_SIZE / 2.0f) * (CHUNK_SIZE / 2.0f))
+
+
+// Squared distance from the center of a chunk to a point in block units
+static float chunk_distance2(ChunkCoord coord, const float position[3])
+{
+    float dx = (coord.x + 0.5f) * CHUNK_SIZE - position[0];
+    float dy = (coord.y + 0.5f) * CHUNK_SIZE - position[1];
+    float dz = (coord.z + 0.5f) * CHUNK_SIZE - position[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+static bool is_job_stale(const MeshJob *job)
+{
+    return job->revision != atomic_load_explicit(&job->chunk->revision, memory_order_acquire);
+}
+
+
+// Heap helpers, called with the pool lock held
+static void sift_up(MeshJob **heap, uint32_t i)
+{
+    MeshJob *job = heap[i];
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (heap[parent]->priority <= job->priority) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = job;
+}
+
+static void sift_down(MeshJob **heap, uint32_t count, uint32_t i)
+{
+    MeshJob *job = heap[i];
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && heap[child + 1]->priority < heap[child]->priority) {
+            child++;
+        }
+        if (job->priority <= heap[child]->priority) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = job;
+}
+
+static MeshJob *pop_job(MeshPool *pool)
+{
+    MeshJob *job = pool->heap[0];
+    pool->heap[0] = pool->heap[--pool->heap_count];
+    if (pool->heap_count > 0) {
+        sift_down(pool->heap, pool->heap_count, 0);
+    }
+    return job;
+}
+
+// Return a job to the free list and forget it
+static void recycle_job(MeshPool *pool, MeshJob *job)
+{
+    pthread_mutex_lock(&pool->lock);
+    job->next = pool->free_jobs;
+    pool->free_jobs = job;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void drop_stale_job(MeshPool *pool, MeshJob *job)
+{
+    atomic_fetch_add(&pool->cancelled, 1);
+    atomic_fetch_sub(&pool->pending, 1);
+    recycle_job(pool, job);
+}
+
+static void push_completed(MeshPool *pool, MeshJob *job)
+{
+    MeshJob *head = atomic_load_explicit(&pool->completed, memory_order_relaxed);
+    do {
+        job->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->completed, &head, job,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+static void *mesh_worker(void *arg)
+{
+    MeshPool *pool = (MeshPool *) arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && pool->heap_count == 0) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        MeshJob *job = pop_job(pool);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (is_job_stale(job)) {
+            drop_stale_job(pool, job);
+            continue;
+        }
+
+        Chunk *neighbors[MAX_NEIGHBOR];
+        find_chunk_neighbors(pool->map, job->chunk->coord, neighbors);
+        job->built = build_chunk_mesh(&job->mesh, job->chunk, neighbors, job->mode);
+        job->visibility = compute_chunk_visibility(job->chunk);
+        job->occluders = compute_chunk_occluders(job->chunk);
+
+        // Edited again while we were meshing
+        if (is_job_stale(job)) {
+            drop_stale_job(pool, job);
+            continue;
+        }
+        push_completed(pool, job);
+    }
+}
+
+
+MeshPool *create_mesh_pool(ChunkMap *map, int threads)
+{
+    if (threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 1 ? (int)cores - 1 : 1;
+    }
+
+    MeshPool *pool = (MeshPool *) calloc(1, sizeof(MeshPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->map = map;
+    pool->heap = (MeshJob **) malloc(MIN_HEAP_CAPACITY * sizeof(MeshJob *));
+    pool->heap_capacity = MIN_HEAP_CAPACITY;
+    pool->threads = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    if (pool->heap == NULL || pool->threads == NULL) {
+        free(pool->heap);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    atomic_init(&pool->completed, NULL);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->cancelled, 0);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, mesh_worker, pool) != 0) {
+            break;
+        }
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0) {
+        destroy_mesh_pool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static void free_job_list(MeshJob *job)
+{
+    while (job) {
+        MeshJob *next = job->next;
+        free_chunk_mesh(&job->mesh);
+        free(job);
+        job = next;
+    }
+}
+
+void destroy_mesh_pool(MeshPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (uint32_t i = 0; i < pool->heap_count; i++) {
+        pool->heap[i]->next = NULL;
+        free_job_list(pool->heap[i]);
+    }
+    free_job_list(atomic_load(&pool->completed));
+    free_job_list(pool->free_jobs);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->heap);
+    free(pool->threads);
+    free(pool);
+}
+
+bool submit_mesh_job(MeshPool *pool, Chunk *chunk, MesherMode mode, VertexFormat format, void *user)
+{
+    // Every job already queued or running for this chunk becomes stale
+    uint32_t revision = atomic_fetch_add_explicit(&chunk->revision, 1, memory_order_acq_rel) + 1;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->heap_count == pool->heap_capacity) {
+        uint32_t capacity = pool->heap_capacity * 2;
+        MeshJob **heap = (MeshJob **) realloc(pool->heap, capacity * sizeof(MeshJob *));
+        if (heap == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            return false;
+        }
+        pool->heap = heap;
+        pool->heap_capacity = capacity;
+    }
+
+    MeshJob *job = pool->free_jobs;
+    if (job != NULL) {
+        pool->free_jobs = job->next;
+    } else {
+        job = (MeshJob *) malloc(sizeof(MeshJob));
+        if (job == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            return false;
+        }
+        init_chunk_mesh(&job->mesh);
+    }
+    job->chunk = chunk;
+    job->revision = revision;
+    job->mode = mode;
+    job->priority = chunk_distance2(chunk->coord, pool->focus);
+    job->built = false;
+    job->user = user;
+    job->mesh.format = format;
+    job->next = NULL;
+
+    pool->heap[pool->heap_count] = job;
+    sift_up(pool->heap, pool->heap_count++);
+    atomic_fetch_add(&pool->pending, 1);
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+void set_mesh_pool_focus(MeshPool *pool, const float position[3])
+{
+    pthread_mutex_lock(&pool->lock);
+    float dx = position[0] - pool->focus[0];
+    float dy = position[1] - pool->focus[1];
+    float dz = position[2] - pool->focus[2];
+    if (dx * dx + dy * dy + dz * dz < REFOCUS_DISTANCE2) {
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    memcpy(pool->focus, position, sizeof(pool->focus));
+
+    // Recompute every queued priority and rebuild the heap bottom up
+    for (uint32_t i = 0; i < pool->heap_count; i++) {
+        pool->heap[i]->priority = chunk_distance2(pool->heap[i]->chunk->coord, pool->focus);
+    }
+    for (uint32_t i = pool->heap_count / 2; i-- > 0;) {
+        sift_down(pool->heap, pool->heap_count, i);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Take every finished job, linked through `next`, in completion order.
+// Jobs that went stale since they were built are dropped here.
+MeshJob *collect_mesh_jobs(MeshPool *pool)
+{
+    MeshJob *job = atomic_exchange_explicit(&pool->completed, NULL, memory_order_acquire);
+    MeshJob *list = NULL;
+
+    // The stack is newest first, reversing it restores completion order
+    while (job) {
+        MeshJob *next = job->next;
+        if (is_job_stale(job)) {
+            drop_stale_job(pool, job);
+        } else {
+            atomic_fetch_sub(&pool->pending, 1);
+            job->chunk->visibility = job->visibility;
+            job->chunk->occluders = job->occluders;
+            job->next = list;
+            list = job;
+        }
+        job = next;
+    }
+    return list;
+}
+
+void release_mesh_job(MeshPool *pool, MeshJob *job)
+{
+    recycle_job(pool, job);
+}
@@ -0,0 +1,74 @@
+#ifndef _MESH_POOL_H_
+#define _MESH_POOL_H_
+
+#include "chunk_map.h"
+#include "mesher.h"
+#include "visibility.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Worker threads building chunk meshes off the main thread.
+//
+// The main thread submits dirty chunks, workers pick the job closest to the
+// focus point (the camera) first, look the neighbors up in the chunk map and
+// build the mesh. Finished jobs are pushed on a lock free stack that the main
+// thread drains with collect_mesh_jobs, uploads, and hands back with
+// release_mesh_job so the mesh buffers get reused. Workers also flood fill
+// the chunk for cave culling and find its solid octants for occlusion
+// culling, collecting a job stores both in the chunk.
+//
+// Submitting a chunk bumps its revision. A job built from an older revision
+// is stale: it is dropped before it runs, or when it is collected, so only
+// the mesh of the last edit ever reaches the GPU. Chunks must stay alive (and
+// in the map) while they have pending jobs.
+
+typedef struct MeshJob {
+    Chunk *chunk;
+    uint32_t revision;          // chunk revision the job was submitted for
+    MesherMode mode;
+    float priority;             // squared distance to the focus, lowest first
+    bool built;                 // false when the mesh could not grow
+    uint16_t visibility;        // face connectivity, see visibility.h
+    uint8_t occluders;          // opaque octants, both copied to the chunk when collected
+    void *user;                 // caller data, e.g. where to upload the mesh
+    ChunkMesh mesh;
+    struct MeshJob *next;       // free list and completion stack link
+} MeshJob;
+
+typedef struct {
+    ChunkMap *map;
+    pthread_t *threads;
+    int thread_count;
+
+    // Guards everything up to `stop`
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    MeshJob **heap;             // binary min heap on priority
+    uint32_t heap_count;
+    uint32_t heap_capacity;
+    MeshJob *free_jobs;
+    float focus[3];
+    bool stop;
+
+    _Atomic(MeshJob *) completed;
+    atomic_uint pending;        // submitted and not yet collected or dropped
+    atomic_uint cancelled;      // stale jobs dropped so far
+} MeshPool;
+
+// `threads` <= 0 uses one worker per core, leaving one core to the main thread
+MeshPool *create_mesh_pool(ChunkMap *map, int threads);
+void destroy_mesh_pool(MeshPool *pool);
+
+// Main thread side
+bool submit_mesh_job(MeshPool *pool, Chunk *chunk, MesherMode mode, VertexFormat format, void *user);
+void set_mesh_pool_focus(MeshPool *pool, const float position[3]);
+MeshJob *collect_mesh_jobs(MeshPool *pool);
+void release_mesh_job(MeshPool *pool, MeshJob *job);
+
+static inline unsigned int mesh_pool_pending(MeshPool *pool)
+{
+    return atomic_load(&pool->pending);
+}
+
+#endif // _MESH_POOL_H_
@@ -0,0 +1,675 @@
+#include "mesher.h"
+#include "light.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The mesher works on a copy of the chunk with a one block apron holding the
+// border layers of the six neighbors, so every face test is a fixed offset.
+#define PAD_SIZE    (CHUNK_SIZE + 2)
+#define PAD_VOLUME  (PAD_SIZE * PAD_SIZE * PAD_SIZE)
+#define PAD_INDEX(x, y, z) ((((y) * PAD_SIZE) + (z)) * PAD_SIZE + (x))
+
+// Quad corners of each face of a unit cube, counter clockwise seen from
+// outside, in ChunkNeighbor order. u_axis/v_axis tell which axis the texture
+// coordinates follow so they can be scaled for merged quads.
+typedef struct {
+    int8_t corners[4][3];
+    float normal[3];
+    uint8_t u_axis;
+    uint8_t v_axis;
+} FaceDesc;
+
+static const FaceDesc faces[MAX_NEIGHBOR] = {
+    {{{0, 0, 0}, {0, 0, 1}, {0, 1, 1}, {0, 1, 0}}, {-1.0f, 0.0f, 0.0f}, 2, 1},   // -X
+    {{{1, 0, 1}, {1, 0, 0}, {1, 1, 0}, {1, 1, 1}}, { 1.0f, 0.0f, 0.0f}, 2, 1},   // +X
+    {{{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1}}, { 0.0f,-1.0f, 0.0f}, 0, 2},   // -Y
+    {{{0, 1, 1}, {1, 1, 1}, {1, 1, 0}, {0, 1, 0}}, { 0.0f, 1.0f, 0.0f}, 0, 2},   // +Y
+    {{{1, 0, 0}, {0, 0, 0}, {0, 1, 0}, {1, 1, 0}}, { 0.0f, 0.0f,-1.0f}, 0, 1},   // -Z
+    {{{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}}, { 0.0f, 0.0f, 1.0f}, 0, 1},   // +Z
+};
+
+static const int8_t corner_uvs[4][2] = {
+    {0, 0}, {1, 0}, {1, 1}, {0, 1},
+};
+
+#define ATLAS_LAYER(x, y) ((y) * BLOCK_ATLAS_TILES + (x))
+
+// Per face layers, in ChunkNeighbor order
+static const uint8_t block_layers[MAX_VOXEL][MAX_NEIGHBOR] = {
+    [AIR]   = {BLOCK_LAYER_MISSING, BLOCK_LAYER_MISSING, BLOCK_LAYER_MISSING,
+               BLOCK_LAYER_MISSING, BLOCK_LAYER_MISSING, BLOCK_LAYER_MISSING},
+    [STONE] = {ATLAS_LAYER(3, 0), ATLAS_LAYER(3, 0), ATLAS_LAYER(3, 0),
+               ATLAS_LAYER(3, 0), ATLAS_LAYER(3, 0), ATLAS_LAYER(3, 0)},
+    [DIRT]  = {ATLAS_LAYER(2, 0), ATLAS_LAYER(2, 0), ATLAS_LAYER(2, 0),
+               ATLAS_LAYER(2, 0), ATLAS_LAYER(2, 0), ATLAS_LAYER(2, 0)},
+    [SAND]  = {ATLAS_LAYER(0, 1), ATLAS_LAYER(0, 1), ATLAS_LAYER(0, 1),
+               ATLAS_LAYER(0, 1), ATLAS_LAYER(0, 1), ATLAS_LAYER(0, 1)},
+    // Grass sides, dirt below, grass on top
+    [GRASS] = {ATLAS_LAYER(1, 0), ATLAS_LAYER(1, 0), ATLAS_LAYER(2, 0),
+               ATLAS_LAYER(0, 0), ATLAS_LAYER(1, 0), ATLAS_LAYER(1, 0)},
+    [WATER] = {ATLAS_LAYER(0, 15), ATLAS_LAYER(0, 15), ATLAS_LAYER(0, 15),
+               ATLAS_LAYER(0, 15), ATLAS_LAYER(0, 15), ATLAS_LAYER(0, 15)},
+    [LAVA]  = {ATLAS_LAYER(0, 14), ATLAS_LAYER(0, 14), ATLAS_LAYER(0, 14),
+               ATLAS_LAYER(0, 14), ATLAS_LAYER(0, 14), ATLAS_LAYER(0, 14)},
+    // Bark on the sides, rings on the cut ends
+    [WOOD]  = {ATLAS_LAYER(2, 1), ATLAS_LAYER(2, 1), ATLAS_LAYER(3, 1),
+               ATLAS_LAYER(3, 1), ATLAS_LAYER(2, 1), ATLAS_LAYER(2, 1)},
+    [LEAVES] = {ATLAS_LAYER(4, 1), ATLAS_LAYER(4, 1), ATLAS_LAYER(4, 1),
+                ATLAS_LAYER(4, 1), ATLAS_LAYER(4, 1), ATLAS_LAYER(4, 1)},
+    [SNOW]  = {ATLAS_LAYER(3, 2), ATLAS_LAYER(3, 2), ATLAS_LAYER(3, 2),
+               ATLAS_LAYER(3, 2), ATLAS_LAYER(3, 2), ATLAS_LAYER(3, 2)},
+};
+
+static const int pad_offsets[MAX_NEIGHBOR] = {
+    -1, 1,
+    -PAD_SIZE * PAD_SIZE, PAD_SIZE * PAD_SIZE,
+    -PAD_SIZE, PAD_SIZE,
+};
+
+
+uint8_t get_block_face_layer(BlockId block, int face)
+{
+    return block < MAX_VOXEL ? block_layers[block][face] : BLOCK_LAYER_MISSING;
+}
+
+void init_chunk_mesh(ChunkMesh *mesh)
+{
+    memset(mesh, 0, sizeof(ChunkMesh));
+}
+
+void free_chunk_mesh(ChunkMesh *mesh)
+{
+    free(mesh->vertices);
+    free(mesh->packed_vertices);
+    init_chunk_mesh(mesh);
+}
+
+void fill_quad_indices(unsigned int *indices, uint32_t quads)
+{
+    for (uint32_t q = 0; q < quads; q++) {
+        unsigned int base = q * 4;
+        indices[0] = base;
+        indices[1] = base + 1;
+        indices[2] = base + 2;
+        indices[3] = base;
+        indices[4] = base + 2;
+        indices[5] = base + 3;
+        indices += 6;
+    }
+}
+
+void clear_chunk_mesh(ChunkMesh *mesh)
+{
+    mesh->vertex_count = 0;
+}
+
+static bool reserve_quads(ChunkMesh *mesh, uint32_t quads)
+{
+    uint32_t vertices = mesh->vertex_count + quads * 4;
+
+    if (mesh->format == VERTEX_FORMAT_PACKED && vertices > mesh->packed_capacity) {
+        uint32_t capacity = mesh->packed_capacity ? mesh->packed_capacity : 1024;
+        while (capacity < vertices) capacity *= 2;
+        PackedVertex *v = (PackedVertex *) realloc(mesh->packed_vertices, capacity * sizeof(PackedVertex));
+        if (v == NULL) {
+            return false;
+        }
+        mesh->packed_vertices = v;
+        mesh->packed_capacity = capacity;
+    }
+    if (mesh->format == VERTEX_FORMAT_FLOAT && vertices > mesh->vertex_capacity) {
+        uint32_t capacity = mesh->vertex_capacity ? mesh->vertex_capacity : 1024;
+        while (capacity < vertices) capacity *= 2;
+        Vertex *v = (Vertex *) realloc(mesh->vertices, capacity * sizeof(Vertex));
+        if (v == NULL) {
+            return false;
+        }
+        mesh->vertices = v;
+        mesh->vertex_capacity = capacity;
+    }
+    return true;
+}
+
+// Append one quad of `face` of `block` starting at block `pos` and covering
+// `size` blocks along each axis (the size along the face normal is ignored),
+// lit by `light` (sky << 4 | block) all over
+static bool push_quad(ChunkMesh *mesh, int face, BlockId block, uint8_t light, const int pos[3],
+                      const int size[3])
+{
+    if (!reserve_quads(mesh, 1)) {
+        return false;
+    }
+
+    const FaceDesc *f = &faces[face];
+    int extent[3] = {size[0], size[1], size[2]};
+    extent[face >> 1] = 1;
+
+    uint32_t base = mesh->vertex_count;
+    uint8_t layer = get_block_face_layer(block, face);
+    if (mesh->format == VERTEX_FORMAT_PACKED) {
+        PackedVertex *v = &mesh->packed_vertices[base];
+        for (int c = 0; c < 4; c++) {
+            int x = pos[0] + f->corners[c][0] * extent[0];
+            int y = pos[1] + f->corners[c][1] * extent[1];
+            int z = pos[2] + f->corners[c][2] * extent[2];
+            int u = corner_uvs[c][0] * extent[f->u_axis];
+            int w = corner_uvs[c][1] * extent[f->v_axis];
+            v[c].position_face = PACK_POSITION_FACE(x, y, z, face);
+            v[c].uv_layer = PACK_UV_LAYER(u, w, layer, light);
+        }
+    } else {
+        Vertex *v = &mesh->vertices[base];
+        for (int c = 0; c < 4; c++) {
+            for (int a = 0; a < 3; a++) {
+                v[c].position[a] = (float)(pos[a] + f->corners[c][a] * extent[a]);
+                v[c].normal[a] = f->normal[a];
+            }
+            // Texture coordinates repeat once per block across merged quads
+            v[c].texCoords[0] = (float)(corner_uvs[c][0] * extent[f->u_axis]);
+            v[c].texCoords[1] = (float)(corner_uvs[c][1] * extent[f->v_axis]);
+            v[c].texCoords[2] = (float)layer;
+            v[c].light[0] = (float)SKY_LIGHT(light);
+            v[c].light[1] = (float)BLOCK_LIGHT(light);
+        }
+    }
+    mesh->vertex_count += 4;
+    return true;
+}
+
+static inline bool is_face_visible(BlockId block, BlockId neighbor)
+{
+    return block != AIR && neighbor != block && !is_block_opaque(neighbor);
+}
+
+// Copy a chunk and the touching layers of its neighbors into `pad`
+static void fill_padded(BlockId *pad, const Chunk *chunk, Chunk *const neighbors[MAX_NEIGHBOR])
+{
+    const int last = CHUNK_SIZE - 1;
+    memset(pad, AIR, PAD_VOLUME * sizeof(BlockId));
+
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            memcpy(&pad[PAD_INDEX(1, y + 1, z + 1)], &chunk->blocks[CHUNK_INDEX(0, y, z)],
+                   CHUNK_SIZE * sizeof(BlockId));
+        }
+    }
+
+    for (int a = 0; a < CHUNK_SIZE; a++) {
+        for (int b = 0; b < CHUNK_SIZE; b++) {
+            if (neighbors[NEIGHBOR_NEG_X]) {
+                pad[PAD_INDEX(0, a + 1, b + 1)] = get_chunk_block(neighbors[NEIGHBOR_NEG_X], last, a, b);
+            }
+            if (neighbors[NEIGHBOR_POS_X]) {
+                pad[PAD_INDEX(PAD_SIZE - 1, a + 1, b + 1)] = get_chunk_block(neighbors[NEIGHBOR_POS_X], 0, a, b);
+            }
+            if (neighbors[NEIGHBOR_NEG_Y]) {
+                pad[PAD_INDEX(a + 1, 0, b + 1)] = get_chunk_block(neighbors[NEIGHBOR_NEG_Y], a, last, b);
+            }
+            if (neighbors[NEIGHBOR_POS_Y]) {
+                pad[PAD_INDEX(a + 1, PAD_SIZE - 1, b + 1)] = get_chunk_block(neighbors[NEIGHBOR_POS_Y], a, 0, b);
+            }
+            if (neighbors[NEIGHBOR_NEG_Z]) {
+                pad[PAD_INDEX(a + 1, b + 1, 0)] = get_chunk_block(neighbors[NEIGHBOR_NEG_Z], a, b, last);
+            }
+            if (neighbors[NEIGHBOR_POS_Z]) {
+                pad[PAD_INDEX(a + 1, b + 1, PAD_SIZE - 1)] = get_chunk_block(neighbors[NEIGHBOR_POS_Z], a, b, 0);
+            }
+        }
+    }
+}
+
+// Same for the light, faces looking into a missing neighbor (air) get the
+// light of open sky
+static void fill_padded_light(uint8_t *pad, const Chunk *chunk, Chunk *const neighbors[MAX_NEIGHBOR])
+{
+    const int last = CHUNK_SIZE - 1;
+    memset(pad, PACK_LIGHT(LIGHT_MAX, 0), PAD_VOLUME);
+
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            memcpy(&pad[PAD_INDEX(1, y + 1, z + 1)], &chunk->light[CHUNK_INDEX(0, y, z)], CHUNK_SIZE);
+        }
+    }
+
+    for (int a = 0; a < CHUNK_SIZE; a++) {
+        for (int b = 0; b < CHUNK_SIZE; b++) {
+            if (neighbors[NEIGHBOR_NEG_X]) {
+                pad[PAD_INDEX(0, a + 1, b + 1)] = neighbors[NEIGHBOR_NEG_X]->light[CHUNK_INDEX(last, a, b)];
+            }
+            if (neighbors[NEIGHBOR_POS_X]) {
+                pad[PAD_INDEX(PAD_SIZE - 1, a + 1, b + 1)] = neighbors[NEIGHBOR_POS_X]->light[CHUNK_INDEX(0, a, b)];
+            }
+            if (neighbors[NEIGHBOR_NEG_Y]) {
+                pad[PAD_INDEX(a + 1, 0, b + 1)] = neighbors[NEIGHBOR_NEG_Y]->light[CHUNK_INDEX(a, last, b)];
+            }
+            if (neighbors[NEIGHBOR_POS_Y]) {
+                pad[PAD_INDEX(a + 1, PAD_SIZE - 1, b + 1)] = neighbors[NEIGHBOR_POS_Y]->light[CHUNK_INDEX(a, 0, b)];
+            }
+            if (neighbors[NEIGHBOR_NEG_Z]) {
+                pad[PAD_INDEX(a + 1, b + 1, 0)] = neighbors[NEIGHBOR_NEG_Z]->light[CHUNK_INDEX(a, b, last)];
+            }
+            if (neighbors[NEIGHBOR_POS_Z]) {
+                pad[PAD_INDEX(a + 1, b + 1, PAD_SIZE - 1)] = neighbors[NEIGHBOR_POS_Z]->light[CHUNK_INDEX(a, b, 0)];
+            }
+        }
+    }
+}
+
+// Light of the voxel in front of `face` of the block at chunk local `pos`,
+// every face is lit by the voxel it shows towards
+static inline uint8_t get_face_light(const uint8_t *light, int face, const int pos[3])
+{
+    return light[PAD_INDEX(pos[0] + 1, pos[1] + 1, pos[2] + 1) + pad_offsets[face]];
+}
+
+static bool mesh_culled(ChunkMesh *mesh, const BlockId *pad, const uint8_t *light)
+{
+    static const int unit[3] = {1, 1, 1};
+
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                int i = PAD_INDEX(x + 1, y + 1, z + 1);
+                BlockId block = pad[i];
+                if (block == AIR) {
+                    continue;
+                }
+                int pos[3] = {x, y, z};
+                for (int face = 0; face < MAX_NEIGHBOR; face++) {
+                    if (is_face_visible(block, pad[i + pad_offsets[face]])) {
+                        if (!push_quad(mesh, face, block, light[i + pad_offsets[face]], pos, unit)) {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Greedy meshing. For every face direction and every slice along its normal
+// the visible faces are collected in a 2D mask of block ids and face light,
+// then merged row by row: a quad first grows along u as long as block and
+// light match, then along v as long as the whole row below matches. u and v
+// are the two axes following the normal axis, (normal + 1) % 3 and
+// (normal + 2) % 3.
+#define MASK_ENTRY(block, light)    ((uint32_t)(block) | (uint32_t)(light) << 16)
+
+static bool mesh_greedy(ChunkMesh *mesh, const BlockId *pad, const uint8_t *light)
+{
+    // 0 where no face shows, AIR has no faces
+    uint32_t mask[CHUNK_AREA];
+
+    for (int face = 0; face < MAX_NEIGHBOR; face++) {
+        int n = face >> 1;
+        int a1 = (n + 1) % 3;
+        int a2 = (n + 2) % 3;
+        int offset = pad_offsets[face];
+
+        for (int d = 0; d < CHUNK_SIZE; d++) {
+            int pos[3];
+            pos[n] = d;
+            for (int v = 0; v < CHUNK_SIZE; v++) {
+                pos[a2] = v;
+                for (int u = 0; u < CHUNK_SIZE; u++) {
+                    pos[a1] = u;
+                    int i = PAD_INDEX(pos[0] + 1, pos[1] + 1, pos[2] + 1);
+                    BlockId block = pad[i];
+                    mask[v * CHUNK_SIZE + u] = is_face_visible(block, pad[i + offset]) ?
+                                               MASK_ENTRY(block, light[i + offset]) : 0;
+                }
+            }
+
+            for (int v = 0; v < CHUNK_SIZE; v++) {
+                for (int u = 0; u < CHUNK_SIZE; ) {
+                    uint32_t entry = mask[v * CHUNK_SIZE + u];
+                    if (entry == 0) {
+                        u++;
+                        continue;
+                    }
+
+                    int w = 1;
+                    while (u + w < CHUNK_SIZE && mask[v * CHUNK_SIZE + u + w] == entry) {
+                        w++;
+                    }
+                    int h = 1;
+                    for (; v + h < CHUNK_SIZE; h++) {
+                        uint32_t *row = &mask[(v + h) * CHUNK_SIZE + u];
+                        int k = 0;
+                        while (k < w && row[k] == entry) {
+                            k++;
+                        }
+                        if (k < w) {
+                            break;
+                        }
+                    }
+
+                    int size[3];
+                    pos[a1] = u;
+                    pos[a2] = v;
+                    size[n] = 1;
+                    size[a1] = w;
+                    size[a2] = h;
+                    if (!push_quad(mesh, face, (BlockId)(entry & 0xFFFF), (uint8_t)(entry >> 16), pos, size)) {
+                        return false;
+                    }
+                    for (int r = 0; r < h; r++) {
+                        memset(&mask[(v + r) * CHUNK_SIZE + u], 0, w * sizeof(uint32_t));
+                    }
+                    u += w;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Binary greedy meshing, same quads as mesh_greedy without per block work.
+//
+// Every column of the chunk along each axis is a 64-bit occupancy word (34
+// bits used, apron included), one set of words per block type present.
+// Visible faces of a type are then `occupied & ~(shifted blockers)` for a
+// whole column at once, scattered into one 32-bit row mask per slice and
+// merged with count trailing zeros. Types never merge with each other so
+// handling them one at a time yields exactly the greedy quads. Runs are cut
+// where the face light changes, the only per face work left.
+#define BINARY_MAX_TYPES    16
+#define INTERIOR_BITS       0x1FFFFFFFEULL
+
+// Bit x set where row[x] is not air / is `block`, CHUNK_SIZE blocks per row
+#if defined(__SSE2__) && !defined(LOKI_WIDE_BLOCK_IDS) && CHUNK_SIZE == 32
+static inline uint32_t type_row_mask(const BlockId *row, BlockId block)
+{
+    __m128i b = _mm_set1_epi8((char)block);
+    __m128i lo = _mm_loadu_si128((const __m128i *)row);
+    __m128i hi = _mm_loadu_si128((const __m128i *)(row + 16));
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, b))
+         | (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, b)) << 16;
+}
+
+static inline uint32_t solid_row_mask(const BlockId *row)
+{
+    return ~type_row_mask(row, AIR);
+}
+#else
+static inline uint32_t type_row_mask(const BlockId *row, BlockId block)
+{
+    uint32_t mask = 0;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        mask |= (uint32_t)(row[x] == block) << x;
+    }
+    return mask;
+}
+
+static inline uint32_t solid_row_mask(const BlockId *row)
+{
+    uint32_t mask = 0;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        mask |= (uint32_t)(row[x] != AIR) << x;
+    }
+    return mask;
+}
+#endif
+
+// In place transpose of a 32x32 bit matrix, bit x of m[y] ends up as bit y
+// of m[x]. Empty and full matrices are their own transpose.
+static void transpose_bits(uint32_t m[32])
+{
+    uint32_t any = 0;
+    uint32_t all = ~0u;
+    for (int i = 0; i < 32; i++) {
+        any |= m[i];
+        all &= m[i];
+    }
+    if (any == 0 || all == ~0u) {
+        return;
+    }
+
+    uint32_t mask = 0x0000FFFF;
+    for (int j = 16; j != 0; j >>= 1, mask ^= mask << j) {
+        for (int k = 0; k < 32; k = ((k | j) + 1) & ~j) {
+            uint32_t t = ((m[k] >> j) ^ m[k | j]) & mask;
+            m[k | j] ^= t;
+            m[k] ^= t << j;
+        }
+    }
+}
+
+static bool mesh_binary(ChunkMesh *mesh, const BlockId *pad, const uint8_t *light)
+{
+    // Columns per type and axis, indexed [v * CHUNK_SIZE + u] with u and v
+    // the axes following the column axis, bit i = padded coordinate i
+    static _Thread_local uint64_t columns[BINARY_MAX_TYPES][3][CHUNK_AREA];
+    static _Thread_local uint64_t opaque[3][CHUNK_AREA];
+    static _Thread_local uint32_t rows[BINARY_MAX_TYPES][CHUNK_SIZE][CHUNK_SIZE];
+    // Slice row masks, left all zero again by the merge loop
+    static _Thread_local uint32_t planes[CHUNK_SIZE][CHUNK_SIZE];
+    static _Thread_local uint8_t type_index[BLOCK_ID_LIMIT];
+    static _Thread_local bool type_index_ready;
+
+    BlockId types[BINARY_MAX_TYPES];
+    int type_count = 0;
+
+    if (!type_index_ready) {
+        memset(type_index, 0xFF, sizeof(type_index));
+        type_index_ready = true;
+    }
+
+    // One 32-bit row mask per type for every (y, z) row of the chunk
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            const BlockId *row = &pad[PAD_INDEX(1, y + 1, z + 1)];
+            uint32_t solid = solid_row_mask(row);
+            uint32_t seen = 0;
+            for (int t = 0; t < type_count; t++) {
+                uint32_t m = solid ? type_row_mask(row, types[t]) : 0;
+                rows[t][z][y] = m;
+                seen |= m;
+            }
+            // Blocks not seen in earlier rows
+            while (solid & ~seen) {
+                if (type_count == BINARY_MAX_TYPES) {
+                    // Too many types for per type masks to pay off
+                    for (int i = 0; i < type_count; i++) {
+                        type_index[types[i]] = 0xFF;
+                    }
+                    return mesh_greedy(mesh, pad, light);
+                }
+                int t = type_count++;
+                BlockId block = row[__builtin_ctz(solid & ~seen)];
+                type_index[block] = t;
+                types[t] = block;
+                memset(rows[t], 0, sizeof(rows[t]));
+                rows[t][z][y] = type_row_mask(row, block);
+                seen |= rows[t][z][y];
+            }
+        }
+    }
+
+    // Row masks are the X columns. Transposing the rows of a z layer gives
+    // the Y columns, transposing the rows of a y layer the Z columns.
+    // X columns run over (u = y, v = z), Y over (z, x) and Z over (x, y).
+    for (int t = 0; t < type_count; t++) {
+        uint32_t layer[CHUNK_SIZE];
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int y = 0; y < CHUNK_SIZE; y++) {
+                columns[t][0][z * CHUNK_SIZE + y] = (uint64_t)rows[t][z][y] << 1;
+                layer[y] = rows[t][z][y];
+            }
+            transpose_bits(layer);
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                columns[t][1][x * CHUNK_SIZE + z] = (uint64_t)layer[x] << 1;
+            }
+        }
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                layer[z] = rows[t][z][y];
+            }
+            transpose_bits(layer);
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                columns[t][2][y * CHUNK_SIZE + x] = (uint64_t)layer[x] << 1;
+            }
+        }
+    }
+
+    memset(opaque, 0, sizeof(opaque));
+    for (int t = 0; t < type_count; t++) {
+        if (!is_block_opaque(types[t])) {
+            continue;
+        }
+        for (int n = 0; n < 3; n++) {
+            for (int c = 0; c < CHUNK_AREA; c++) {
+                opaque[n][c] |= columns[t][n][c];
+            }
+        }
+    }
+
+    // Apron blocks only block faces, along the axis crossing the border.
+    // Types missing from the chunk can only matter when opaque.
+    static const uint64_t apron_bits[2] = {1ULL, 1ULL << (PAD_SIZE - 1)};
+    for (int a = 0; a < CHUNK_SIZE; a++) {
+        for (int b = 0; b < CHUNK_SIZE; b++) {
+            for (int side = 0; side < 2; side++) {
+                int edge = side * (PAD_SIZE - 1);
+                BlockId apron[3] = {
+                    pad[PAD_INDEX(edge, a + 1, b + 1)],     // X column (y = a, z = b)
+                    pad[PAD_INDEX(b + 1, edge, a + 1)],     // Y column (z = a, x = b)
+                    pad[PAD_INDEX(a + 1, b + 1, edge)],     // Z column (x = a, y = b)
+                };
+                int c = b * CHUNK_SIZE + a;
+                for (int n = 0; n < 3; n++) {
+                    BlockId block = apron[n];
+                    if (block == AIR) {
+                        continue;
+                    }
+                    if (type_index[block] != 0xFF) {
+                        columns[type_index[block]][n][c] |= apron_bits[side];
+                    }
+                    if (is_block_opaque(block)) {
+                        opaque[n][c] |= apron_bits[side];
+                    }
+                }
+            }
+        }
+    }
+
+    bool ok = true;
+    for (int t = 0; t < type_count && ok; t++) {
+        for (int face = 0; face < MAX_NEIGHBOR && ok; face++) {
+            int n = face >> 1;
+            int a1 = (n + 1) % 3;
+            int a2 = (n + 2) % 3;
+            const uint64_t *occupied = columns[t][n];
+            uint32_t used_slices = 0;
+
+            // Faces whose neighbor along the normal is neither opaque nor
+            // the same block, bit d + 1 becomes slice d
+            for (int c = 0; c < CHUNK_AREA; c++) {
+                uint64_t column = occupied[c];
+                if (column == 0) {
+                    continue;
+                }
+                uint64_t blockers = opaque[n][c] | column;
+                uint64_t neighbor = (face & 1) ? blockers >> 1 : blockers << 1;
+                uint64_t visible = column & ~neighbor & INTERIOR_BITS;
+                uint32_t faces_mask = (uint32_t)(visible >> 1);
+                if (faces_mask == 0) {
+                    continue;
+                }
+                used_slices |= faces_mask;
+                uint32_t u_bit = 1u << (c & CHUNK_MASK);
+                int v = c >> CHUNK_SHIFT;
+                while (faces_mask) {
+                    planes[__builtin_ctz(faces_mask)][v] |= u_bit;
+                    faces_mask &= faces_mask - 1;
+                }
+            }
+
+            while (used_slices) {
+                int d = __builtin_ctz(used_slices);
+                used_slices &= used_slices - 1;
+                uint32_t *plane = planes[d];
+                for (int v = 0; v < CHUNK_SIZE; v++) {
+                    while (plane[v]) {
+                        int pos[3];
+                        pos[n] = d;
+                        pos[a2] = v;
+                        int u = __builtin_ctz(plane[v]);
+                        int w = __builtin_ctzll(~((uint64_t)plane[v] >> u));
+                        pos[a1] = u;
+                        uint8_t face_light = get_face_light(light, face, pos);
+                        for (int k = 1; k < w; k++) {
+                            pos[a1] = u + k;
+                            if (get_face_light(light, face, pos) != face_light) {
+                                w = k;
+                                break;
+                            }
+                        }
+                        uint32_t run = (uint32_t)(((1ULL << w) - 1) << u);
+                        plane[v] &= ~run;
+                        int h = 1;
+                        while (v + h < CHUNK_SIZE && (plane[v + h] & run) == run) {
+                            pos[a2] = v + h;
+                            int k = 0;
+                            for (; k < w; k++) {
+                                pos[a1] = u + k;
+                                if (get_face_light(light, face, pos) != face_light) {
+                                    break;
+                                }
+                            }
+                            if (k < w) {
+                                break;
+                            }
+                            plane[v + h] &= ~run;
+                            h++;
+                        }
+                        if (ok) {
+                            int size[3];
+                            pos[a1] = u;
+                            pos[a2] = v;
+                            size[n] = 1;
+                            size[a1] = w;
+                            size[a2] = h;
+                            // Keep draining the planes on failure, they must end up zero
+                            ok = push_quad(mesh, face, types[t], face_light, pos, size);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int t = 0; t < type_count; t++) {
+        type_index[types[t]] = 0xFF;
+    }
+    return ok;
+}
+
+bool build_chunk_mesh(ChunkMesh *mesh, const Chunk *chunk, Chunk *const neighbors[MAX_NEIGHBOR], MesherMode mode)
+{
+    static _Thread_local BlockId pad[PAD_VOLUME];
+    static _Thread_local uint8_t light[PAD_VOLUME];
+
+    clear_chunk_mesh(mesh);
+    // Faces belong to the chunk's own blocks, an all air chunk has none
+    if (get_chunk_top(chunk) == 0) {
+        return true;
+    }
+    fill_padded(pad, chunk, neighbors);
+    fill_padded_light(light, chunk, neighbors);
+
+    switch (mode) {
+    case MESHER_GREEDY:
+        return mesh_greedy(mesh, pad, light);
+    case MESHER_BINARY:
+        return mesh_binary(mesh, pad, light);
+    case MESHER_CULLED:
+    default:
+        return mesh_culled(mesh, pad, light);
+    }
+}
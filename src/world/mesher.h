@@ -0,0 +1,64 @@
+#ifndef _MESHER_H_
+#define _MESHER_H_
+
+#include "chunk.h"
+#include "chunk_map.h"
+#include <stdbool.h>
+
+typedef enum {
+    MESHER_CULLED = 0,  // one quad per visible block face
+    MESHER_GREEDY,      // coplanar faces of the same block merged into rectangles
+    MESHER_BINARY,      // greedy quads computed on 64-bit column bitmasks
+    MAX_MESHER,
+} MesherMode;
+
+// Upper bound on the quads of one chunk mesh: every block showing all six
+// faces. Sizes the index buffer shared by all chunk meshes.
+#define MAX_CHUNK_QUADS (6 * CHUNK_VOLUME)
+
+// CPU side mesh of one chunk, positions are chunk local in [0, CHUNK_SIZE].
+// Every face is a quad of 4 consecutive vertices. Meshes carry no indices:
+// quad q is drawn with the indices 4q + (0, 1, 2, 0, 2, 3) that every chunk
+// shares, see fill_quad_indices.
+// Vertices go to `vertices` or `packed_vertices` depending on `format`,
+// which defaults to VERTEX_FORMAT_FLOAT and can be changed between builds.
+typedef struct {
+    VertexFormat format;
+    Vertex *vertices;
+    PackedVertex *packed_vertices;
+    uint32_t vertex_count;
+    uint32_t vertex_capacity;
+    uint32_t packed_capacity;
+} ChunkMesh;
+
+// Indices to draw the mesh with the shared quad index buffer
+static inline uint32_t chunk_mesh_index_count(const ChunkMesh *mesh)
+{
+    return mesh->vertex_count / 4 * 6;
+}
+
+// Write the shared index pattern of `quads` quads, 6 indices per quad
+void fill_quad_indices(unsigned int *indices, uint32_t quads);
+
+void init_chunk_mesh(ChunkMesh *mesh);
+void free_chunk_mesh(ChunkMesh *mesh);
+void clear_chunk_mesh(ChunkMesh *mesh);
+
+// Texture layers of res/blocks.png sliced into a texture array by
+// generate_texture_array: tile (x, y) of the 16x16 atlas is layer y * 16 + x
+#define BLOCK_ATLAS_TILES   16
+#define BLOCK_LAYER_MISSING 7       // magenta, for blocks without a texture
+
+// Layer showing on `face` (a ChunkNeighbor) of `block`
+uint8_t get_block_face_layer(BlockId block, int face);
+
+// Emit the faces of `chunk` that touch a non opaque neighbor. Faces on the
+// chunk border look into `neighbors` (indexed by ChunkNeighbor), a NULL
+// neighbor counts as air. Merged quads have texture coordinates running
+// from 0 to their size in blocks and the layer of their block face, so a
+// GL_REPEAT texture array tiles once per block. Faces carry the light of the
+// voxel they face (see light.h) and only merge under the same light.
+// Returns false when the mesh could not grow.
+bool build_chunk_mesh(ChunkMesh *mesh, const Chunk *chunk, Chunk *const neighbors[MAX_NEIGHBOR], MesherMode mode);
+
+#endif // _MESHER_H_
@@ -0,0 +1,331 @@
+#include "section.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LOKI_WIDE_BLOCK_IDS
+#define SECTION_MAX_BITS 16
+#else
+#define SECTION_MAX_BITS 8
+#endif
+
+#define SECTION_NO_INDEX 0xFFFF
+
+static size_t section_words(int bits)
+{
+    return (size_t)CHUNK_VOLUME * bits / 64;
+}
+
+// Narrowest supported width able to index `entries` palette entries
+static int bits_for_entries(int entries)
+{
+    if (entries <= 1) return 0;
+    if (entries <= 2) return 1;
+    if (entries <= 4) return 2;
+    if (entries <= 16) return 4;
+    if (entries <= 256) return 8;
+    return 16;
+}
+
+static inline int read_index(const ChunkSection *section, int index)
+{
+    int bits = section->bits;
+    int per_word_log2 = 6 - __builtin_ctz(bits);
+    uint64_t word = section->data[index >> per_word_log2];
+    int shift = (index & ((1 << per_word_log2) - 1)) * bits;
+    return (int)((word >> shift) & ((1ULL << bits) - 1));
+}
+
+static inline void write_index(uint64_t *data, int bits, int index, int value)
+{
+    int per_word_log2 = 6 - __builtin_ctz(bits);
+    uint64_t *word = &data[index >> per_word_log2];
+    int shift = (index & ((1 << per_word_log2) - 1)) * bits;
+    uint64_t mask = ((1ULL << bits) - 1) << shift;
+    *word = (*word & ~mask) | ((uint64_t)value << shift);
+}
+
+static void release_arrays(ChunkSection *section)
+{
+    free(section->palette);
+    free(section->counts);
+    free(section->data);
+    section->palette = NULL;
+    section->counts = NULL;
+    section->data = NULL;
+}
+
+static void make_uniform(ChunkSection *section, BlockId block)
+{
+    release_arrays(section);
+    section->bits = 0;
+    section->capacity = 1;
+    section->live = 1;
+    section->uniform = block;
+}
+
+// Re-encode the section at `bits` per index, dropping unused palette entries.
+// The live entries must fit the new width.
+static bool resize_section(ChunkSection *section, int bits)
+{
+    int capacity = 1 << bits;
+    BlockId *palette = (BlockId *) malloc(capacity * sizeof(BlockId));
+    uint16_t *counts = (uint16_t *) calloc(capacity, sizeof(uint16_t));
+    uint64_t *data = (uint64_t *) calloc(section_words(bits), sizeof(uint64_t));
+    if (palette == NULL || counts == NULL || data == NULL) {
+        free(palette);
+        free(counts);
+        free(data);
+        return false;
+    }
+
+    if (section->bits == 0) {
+        // Everything maps to entry 0, which calloc already wrote
+        palette[0] = section->uniform;
+        counts[0] = CHUNK_VOLUME;
+    } else {
+        uint16_t remap[1 << SECTION_MAX_BITS];
+        int next = 0;
+        for (uint32_t i = 0; i < section->capacity; i++) {
+            if (section->counts[i] > 0) {
+                remap[i] = next;
+                palette[next] = section->palette[i];
+                counts[next] = section->counts[i];
+                next++;
+            }
+        }
+        for (int i = 0; i < CHUNK_VOLUME; i++) {
+            write_index(data, bits, i, remap[read_index(section, i)]);
+        }
+    }
+
+    release_arrays(section);
+    section->bits = bits;
+    section->capacity = capacity;
+    section->palette = palette;
+    section->counts = counts;
+    section->data = data;
+    return true;
+}
+
+
+void init_section(ChunkSection *section, BlockId block)
+{
+    section->palette = NULL;
+    section->counts = NULL;
+    section->data = NULL;
+    make_uniform(section, block);
+}
+
+void free_section(ChunkSection *section)
+{
+    release_arrays(section);
+}
+
+BlockId get_section_block(const ChunkSection *section, int index)
+{
+    if (section->bits == 0) {
+        return section->uniform;
+    }
+    return section->palette[read_index(section, index)];
+}
+
+// Returns false only when growing the index array fails
+bool set_section_block(ChunkSection *section, int index, BlockId block)
+{
+    if (section->bits == 0) {
+        if (block == section->uniform) {
+            return true;
+        }
+        if (!resize_section(section, 1)) {
+            return false;
+        }
+    }
+
+    int old = read_index(section, index);
+    if (section->palette[old] == block) {
+        return true;
+    }
+
+    // Look the block up, remembering a free slot in case it is new
+    int entry = -1;
+    int free_slot = -1;
+    for (uint32_t i = 0; i < section->capacity; i++) {
+        if (section->counts[i] == 0) {
+            if (free_slot < 0) {
+                free_slot = i;
+            }
+        } else if (section->palette[i] == block) {
+            entry = i;
+            break;
+        }
+    }
+
+    if (entry < 0) {
+        if (free_slot < 0) {
+            // Palette is full, double the width (compacts the palette too)
+            if (!resize_section(section, section->bits * 2)) {
+                return false;
+            }
+            old = read_index(section, index);
+            free_slot = section->live;
+        }
+        entry = free_slot;
+        section->palette[entry] = block;
+        section->live++;
+    }
+
+    write_index(section->data, section->bits, index, entry);
+    section->counts[entry]++;
+    if (--section->counts[old] > 0) {
+        return true;
+    }
+
+    // A block type just disappeared. Collapsing to uniform costs no repack,
+    // narrower widths only pay off once the rest fits in under half the
+    // bits, so a type placed and broken again does not repack every time.
+    section->live--;
+    int bits = bits_for_entries(section->live);
+    if (bits == 0) {
+        make_uniform(section, block);
+    } else if (bits < section->bits / 2) {
+        // A failed shrink leaves a valid, just wider, section
+        resize_section(section, bits);
+    }
+    return true;
+}
+
+bool compact_section(ChunkSection *section)
+{
+    if (section->bits == 0) {
+        return true;
+    }
+    int bits = bits_for_entries(section->live);
+    if (bits == 0) {
+        for (uint32_t i = 0; i < section->capacity; i++) {
+            if (section->counts[i] > 0) {
+                make_uniform(section, section->palette[i]);
+                break;
+            }
+        }
+        return true;
+    }
+    return bits == section->bits || resize_section(section, bits);
+}
+
+
+// Unpack kernels. `bits` is a constant at every call site so each width gets
+// its own unrolled loop with no variable shifts.
+static inline void unpack_words(const uint64_t *data, const BlockId *palette, BlockId *blocks, const int bits)
+{
+    const int per_word = 64 / bits;
+    const uint64_t mask = (1ULL << bits) - 1;
+    const size_t words = section_words(bits);
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = data[w];
+        BlockId *out = &blocks[w * per_word];
+        for (int i = 0; i < per_word; i++) {
+            out[i] = palette[word & mask];
+            word >>= bits;
+        }
+    }
+}
+
+static inline void pack_words(uint64_t *data, const uint16_t *lookup, const BlockId *blocks, const int bits)
+{
+    const int per_word = 64 / bits;
+    const size_t words = section_words(bits);
+    for (size_t w = 0; w < words; w++) {
+        const BlockId *in = &blocks[w * per_word];
+        uint64_t word = 0;
+        for (int i = per_word - 1; i >= 0; i--) {
+            word = (word << bits) | lookup[in[i]];
+        }
+        data[w] = word;
+    }
+}
+
+void unpack_section(const ChunkSection *section, BlockId *blocks)
+{
+    switch (section->bits) {
+    case 0:
+        for (int i = 0; i < CHUNK_VOLUME; i++) {
+            blocks[i] = section->uniform;
+        }
+        break;
+    case 1:  unpack_words(section->data, section->palette, blocks, 1);  break;
+    case 2:  unpack_words(section->data, section->palette, blocks, 2);  break;
+    case 4:  unpack_words(section->data, section->palette, blocks, 4);  break;
+    case 8:  unpack_words(section->data, section->palette, blocks, 8);  break;
+    case 16: unpack_words(section->data, section->palette, blocks, 16); break;
+    }
+}
+
+// Rebuild the section from a dense block array, picking the narrowest width.
+// On allocation failure the section is left untouched and false is returned.
+bool pack_section(ChunkSection *section, const BlockId *blocks)
+{
+    // Block id -> palette index, 128KB of stack with LOKI_WIDE_BLOCK_IDS
+    uint16_t lookup[BLOCK_ID_LIMIT];
+    uint16_t counts[CHUNK_VOLUME < BLOCK_ID_LIMIT ? CHUNK_VOLUME : BLOCK_ID_LIMIT];
+    BlockId palette[CHUNK_VOLUME < BLOCK_ID_LIMIT ? CHUNK_VOLUME : BLOCK_ID_LIMIT];
+    int entries = 0;
+
+    memset(lookup, 0xFF, sizeof(lookup));
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        BlockId block = blocks[i];
+        if (lookup[block] == SECTION_NO_INDEX) {
+            lookup[block] = entries;
+            palette[entries] = block;
+            counts[entries] = 0;
+            entries++;
+        }
+        counts[lookup[block]]++;
+    }
+
+    int bits = bits_for_entries(entries);
+    if (bits == 0) {
+        make_uniform(section, blocks[0]);
+        return true;
+    }
+
+    int capacity = 1 << bits;
+    BlockId *new_palette = (BlockId *) malloc(capacity * sizeof(BlockId));
+    uint16_t *new_counts = (uint16_t *) calloc(capacity, sizeof(uint16_t));
+    uint64_t *data = (uint64_t *) malloc(section_words(bits) * sizeof(uint64_t));
+    if (new_palette == NULL || new_counts == NULL || data == NULL) {
+        free(new_palette);
+        free(new_counts);
+        free(data);
+        return false;
+    }
+    memcpy(new_palette, palette, entries * sizeof(BlockId));
+    memcpy(new_counts, counts, entries * sizeof(uint16_t));
+
+    switch (bits) {
+    case 1:  pack_words(data, lookup, blocks, 1);  break;
+    case 2:  pack_words(data, lookup, blocks, 2);  break;
+    case 4:  pack_words(data, lookup, blocks, 4);  break;
+    case 8:  pack_words(data, lookup, blocks, 8);  break;
+    case 16: pack_words(data, lookup, blocks, 16); break;
+    }
+
+    release_arrays(section);
+    section->bits = bits;
+    section->capacity = capacity;
+    section->live = entries;
+    section->palette = new_palette;
+    section->counts = new_counts;
+    section->data = data;
+    return true;
+}
+
+size_t section_memory_usage(const ChunkSection *section)
+{
+    size_t size = sizeof(ChunkSection);
+    if (section->bits > 0) {
+        size += section->capacity * (sizeof(BlockId) + sizeof(uint16_t));
+        size += section_words(section->bits) * sizeof(uint64_t);
+    }
+    return size;
+}
@@ -0,0 +1,53 @@
+#ifndef _SECTION_H_
+#define _SECTION_H_
+
+#include "chunk.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Palette compressed storage for one chunk worth of blocks.
+//
+// Every distinct block of the section gets an entry in a local palette and
+// the blocks are stored as palette indices packed at 1, 2, 4 or 8 bits
+// (16 with LOKI_WIDE_BLOCK_IDS). Widths are powers of two so an index never
+// straddles two 64-bit words. A section holding a single block type keeps
+// no index array at all (bits == 0).
+//
+// The width grows when a new block type does not fit the palette. It only
+// shrinks once the remaining types fit in less than half the bits, or on
+// compact_section, so edits going back and forth over one type do not
+// repack the section each time. A single remaining type always collapses
+// to uniform.
+//
+// Sections are a compact block format for chunks at rest (saving, sending,
+// keeping far chunks around), not the storage of loaded chunks: mesh
+// workers read Chunk::blocks without locks while the main thread edits, so
+// loaded chunks stay dense. Even with blocks in a section, light[] keeps a
+// byte per block and a whole chunk shrinks about 1.8x, not the ~10x that
+// section_bench reports for blocks alone.
+typedef struct {
+    uint8_t bits;           // bits per index, 0 for a uniform section
+    uint32_t capacity;      // palette slots, 1 << bits
+    uint16_t live;          // palette entries with a non zero count
+    BlockId uniform;        // the block when bits == 0
+    BlockId *palette;       // capacity entries, NULL when uniform
+    uint16_t *counts;       // blocks referencing each palette entry
+    uint64_t *data;         // packed indices, NULL when uniform
+} ChunkSection;
+
+void init_section(ChunkSection *section, BlockId block);
+void free_section(ChunkSection *section);
+
+BlockId get_section_block(const ChunkSection *section, int index);
+bool set_section_block(ChunkSection *section, int index, BlockId block);
+// Re-encodes at the narrowest width for the live types. False when out of
+// memory, the section stays valid.
+bool compact_section(ChunkSection *section);
+
+// Bulk kernels between a section and a dense CHUNK_VOLUME block array
+void unpack_section(const ChunkSection *section, BlockId *blocks);
+bool pack_section(ChunkSection *section, const BlockId *blocks);
+
+size_t section_memory_usage(const ChunkSection *section);
+
+#endif // _SECTION_H_
@@ -0,0 +1,338 @@
+#include "visibility.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The flood fill works on rows of blocks along x as 32-bit masks
+_Static_assert(CHUNK_SIZE == 32, "row masks are 32 bits");
+
+#define MIN_CAPACITY    16
+#define ROW_ENDS        (1u | 1u << CHUNK_MASK)
+
+static const ChunkCoord neighbor_offsets[MAX_NEIGHBOR] = {
+    {-1, 0, 0}, {1, 0, 0},
+    {0, -1, 0}, {0, 1, 0},
+    {0, 0, -1}, {0, 0, 1},
+};
+
+
+// Bit x set where row[x] is not opaque, one of clear_blocks
+#if defined(__SSE2__) && !defined(LOKI_WIDE_BLOCK_IDS)
+static inline uint32_t open_row_mask(const BlockId *row)
+{
+    __m128i lo = _mm_loadu_si128((const __m128i *)row);
+    __m128i hi = _mm_loadu_si128((const __m128i *)(row + 16));
+    __m128i lo_open = _mm_setzero_si128();
+    __m128i hi_open = _mm_setzero_si128();
+    for (int i = 0; i < CLEAR_BLOCK_COUNT; i++) {
+        __m128i clear = _mm_set1_epi8((char)clear_blocks[i]);
+        lo_open = _mm_or_si128(lo_open, _mm_cmpeq_epi8(lo, clear));
+        hi_open = _mm_or_si128(hi_open, _mm_cmpeq_epi8(hi, clear));
+    }
+    return (uint32_t)_mm_movemask_epi8(lo_open) | (uint32_t)_mm_movemask_epi8(hi_open) << 16;
+}
+#else
+static inline uint32_t open_row_mask(const BlockId *row)
+{
+    uint32_t mask = 0;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        mask |= (uint32_t)!is_block_opaque(row[x]) << x;
+    }
+    return mask;
+}
+#endif
+
+// Faces of the chunk touched by the blocks `mask` of row (y << CHUNK_SHIFT | z)
+static inline uint8_t row_faces(int row, uint32_t mask)
+{
+    int y = row >> CHUNK_SHIFT;
+    int z = row & CHUNK_MASK;
+    return (uint8_t)(((mask & 1) << NEIGHBOR_NEG_X) | ((mask >> CHUNK_MASK) << NEIGHBOR_POS_X)
+                   | ((y == 0) << NEIGHBOR_NEG_Y) | ((y == CHUNK_MASK) << NEIGHBOR_POS_Y)
+                   | ((z == 0) << NEIGHBOR_NEG_Z) | ((z == CHUNK_MASK) << NEIGHBOR_POS_Z));
+}
+
+static uint16_t connect_faces(uint8_t faces)
+{
+    uint16_t pairs = 0;
+    for (int a = 0; a < MAX_NEIGHBOR; a++) {
+        for (int b = a + 1; b < MAX_NEIGHBOR; b++) {
+            if ((faces >> a & 1) && (faces >> b & 1)) {
+                pairs |= visibility_pair_bit((ChunkNeighbor)a, (ChunkNeighbor)b);
+            }
+        }
+    }
+    return pairs;
+}
+
+// Extend `seed` over the runs of `open` it touches, doubling the reach in
+// both directions every step (Kogge-Stone). A run is one region, so the bits
+// it adds are either unvisited or already part of the current fill.
+static inline uint32_t fill_runs(uint32_t seed, uint32_t open)
+{
+    uint32_t up = seed;
+    uint32_t down = seed;
+    uint32_t up_open = open;
+    uint32_t down_open = open;
+    for (int shift = 1; shift < CHUNK_SIZE; shift <<= 1) {
+        up |= up_open & (up << shift);
+        down |= down_open & (down >> shift);
+        up_open &= up_open << shift;
+        down_open &= down_open >> shift;
+    }
+    return up | down;
+}
+
+// Fill the non opaque region grown from `seed` in `row`, return the faces
+// it touches. Blocks are marked visited when they are reached and the seeds
+// waiting for a row collect in `pending`, so a row is on the stack once.
+static uint8_t flood_region(int row, uint32_t seed, const uint32_t *open, uint32_t *visited,
+                            uint32_t *pending, uint16_t *stack)
+{
+    uint8_t faces = 0;
+    int top = 0;
+    visited[row] |= seed;
+    pending[row] = seed;
+    stack[top++] = (uint16_t)row;
+
+    while (top > 0) {
+        int r = stack[--top];
+        uint32_t fill = pending[r];
+        pending[r] = 0;
+        fill = fill_runs(fill, open[r]);
+        visited[r] |= fill;
+        faces |= row_faces(r, fill);
+
+        int y = r >> CHUNK_SHIFT;
+        int z = r & CHUNK_MASK;
+        int next[4];
+        int n = 0;
+        if (z > 0)          next[n++] = r - 1;
+        if (z < CHUNK_MASK) next[n++] = r + 1;
+        if (y > 0)          next[n++] = r - CHUNK_SIZE;
+        if (y < CHUNK_MASK) next[n++] = r + CHUNK_SIZE;
+        for (int k = 0; k < n; k++) {
+            uint32_t spread = fill & open[next[k]] & ~visited[next[k]];
+            if (spread != 0) {
+                visited[next[k]] |= spread;
+                if (pending[next[k]] == 0) {
+                    stack[top++] = (uint16_t)next[k];
+                }
+                pending[next[k]] |= spread;
+            }
+        }
+    }
+    return faces;
+}
+
+// Open masks of all rows, plus their union and intersection
+static void build_open_rows(const Chunk *chunk, uint32_t *open, uint32_t *any_open, uint32_t *all_open)
+{
+    for (int r = 0; r < CHUNK_AREA; r++) {
+        uint32_t mask = open_row_mask(&chunk->blocks[r << CHUNK_SHIFT]);
+        open[r] = mask;
+        *any_open |= mask;
+        *all_open &= mask;
+    }
+}
+
+uint16_t compute_chunk_visibility(const Chunk *chunk)
+{
+    // Non opaque blocks of row (y << CHUNK_SHIFT | z), bit x
+    static _Thread_local uint32_t open[CHUNK_AREA];
+    static _Thread_local uint32_t visited[CHUNK_AREA];
+    // Left all zero by every fill
+    static _Thread_local uint32_t pending[CHUNK_AREA];
+    static _Thread_local uint16_t stack[CHUNK_AREA];
+
+    uint32_t any_open = 0;
+    uint32_t all_open = UINT32_MAX;
+    build_open_rows(chunk, open, &any_open, &all_open);
+    // Solid rock and open sky need no fill
+    if (any_open == 0) {
+        return 0;
+    }
+    if (all_open == UINT32_MAX) {
+        return CHUNK_VISIBILITY_ALL;
+    }
+    memset(visited, 0, sizeof(visited));
+
+    // A region that touches no face cannot join two, so fills only start on
+    // the border: whole rows on the y and z faces, the two ends elsewhere
+    uint16_t visibility = 0;
+    for (int r = 0; r < CHUNK_AREA; r++) {
+        int y = r >> CHUNK_SHIFT;
+        int z = r & CHUNK_MASK;
+        bool side = y == 0 || y == CHUNK_MASK || z == 0 || z == CHUNK_MASK;
+        uint32_t seeds = open[r] & ~visited[r] & (side ? UINT32_MAX : ROW_ENDS);
+        while (seeds != 0) {
+            visibility |= connect_faces(flood_region(r, seeds & -seeds, open, visited, pending, stack));
+            if (visibility == CHUNK_VISIBILITY_ALL) {
+                return visibility;
+            }
+            seeds &= ~visited[r];
+        }
+    }
+    return visibility;
+}
+
+uint8_t compute_chunk_occluders(const Chunk *chunk)
+{
+    static _Thread_local uint32_t open[CHUNK_AREA];
+    uint32_t any_open = 0;
+    uint32_t all_open = UINT32_MAX;
+    build_open_rows(chunk, open, &any_open, &all_open);
+    if (any_open == 0) {
+        return 0xFF;
+    }
+
+    // Open blocks of each octant, halves of the rows split on x
+    const int half = CHUNK_SIZE / 2;
+    const uint32_t half_mask[2] = {(1u << half) - 1, ~((1u << half) - 1)};
+    uint32_t open_octants[8] = {0};
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            uint32_t row = open[y << CHUNK_SHIFT | z];
+            int octant = (y / half) << 2 | (z / half) << 1;
+            open_octants[octant] |= row & half_mask[0];
+            open_octants[octant | 1] |= row & half_mask[1];
+        }
+    }
+    uint8_t octants = 0;
+    for (int i = 0; i < 8; i++) {
+        octants |= (uint8_t)((open_octants[i] == 0) << i);
+    }
+    return octants;
+}
+
+
+void init_chunk_traversal(ChunkTraversal *traversal)
+{
+    memset(traversal, 0, sizeof(ChunkTraversal));
+}
+
+void free_chunk_traversal(ChunkTraversal *traversal)
+{
+    free(traversal->steps);
+    free(traversal->visited);
+    memset(traversal, 0, sizeof(ChunkTraversal));
+}
+
+// splitmix64 finalizer, as in the chunk map
+static inline uint32_t hash_key(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    key ^= key >> 31;
+    return (uint32_t)key;
+}
+
+// Every loaded chunk is queued and marked at most once, so `chunks` bounds both
+static bool reserve_traversal(ChunkTraversal *traversal, uint32_t chunks)
+{
+    if (chunks > traversal->capacity) {
+        VisibilityStep *steps = (VisibilityStep *) realloc(traversal->steps, chunks * sizeof(VisibilityStep));
+        if (steps == NULL) {
+            return false;
+        }
+        traversal->steps = steps;
+        traversal->capacity = chunks;
+    }
+
+    // At most half full keeps the probes short
+    uint32_t capacity = MIN_CAPACITY;
+    while (capacity < 2 * chunks) {
+        capacity <<= 1;
+    }
+    if (capacity > traversal->visited_capacity) {
+        uint64_t *visited = (uint64_t *) malloc(capacity * sizeof(uint64_t));
+        if (visited == NULL) {
+            return false;
+        }
+        free(traversal->visited);
+        traversal->visited = visited;
+        traversal->visited_capacity = capacity;
+    }
+    memset(traversal->visited, 0xFF, traversal->visited_capacity * sizeof(uint64_t));
+    return true;
+}
+
+// Returns false when `key` was already marked
+static bool mark_visited(ChunkTraversal *traversal, uint64_t key)
+{
+    uint32_t mask = traversal->visited_capacity - 1;
+    for (uint32_t i = hash_key(key) & mask; ; i = (i + 1) & mask) {
+        if (traversal->visited[i] == key) {
+            return false;
+        }
+        if (traversal->visited[i] == CHUNK_KEY_EMPTY) {
+            traversal->visited[i] = key;
+            return true;
+        }
+    }
+}
+
+int32_t traverse_visible_chunks(ChunkTraversal *traversal, ChunkMap *map, const float camera[3],
+                                const Frustum *frustum)
+{
+    memset(&traversal->stats, 0, sizeof(VisibilityStats));
+    traversal->count = 0;
+
+    ChunkCoord start_coord = world_to_chunk_coord((int)floorf(camera[0]), (int)floorf(camera[1]),
+                                                  (int)floorf(camera[2]));
+    Chunk *start = find_chunk(map, start_coord);
+    if (start == NULL || !reserve_traversal(traversal, map->count)) {
+        return -1;
+    }
+    mark_visited(traversal, pack_chunk_coord(start_coord));
+    traversal->steps[traversal->count++] = (VisibilityStep){start, MAX_NEIGHBOR, 0};
+
+    for (uint32_t head = 0; head < traversal->count; head++) {
+        VisibilityStep step = traversal->steps[head];
+        ChunkCoord coord = step.chunk->coord;
+
+        for (int face = 0; face < MAX_NEIGHBOR; face++) {
+            // Faces come in opposite pairs, face ^ 1 points back
+            if (step.directions & (1 << (face ^ 1))) {
+                continue;
+            }
+            // The camera chunk sees out of every face
+            if (step.entered != MAX_NEIGHBOR
+                && !are_chunk_faces_connected(step.chunk->visibility, (ChunkNeighbor)step.entered,
+                                              (ChunkNeighbor)face)) {
+                traversal->stats.graph_rejects++;
+                continue;
+            }
+
+            ChunkCoord n = {
+                coord.x + neighbor_offsets[face].x,
+                coord.y + neighbor_offsets[face].y,
+                coord.z + neighbor_offsets[face].z,
+            };
+            Chunk *next = find_chunk(map, n);
+            if (next == NULL || !mark_visited(traversal, pack_chunk_coord(n))) {
+                continue;
+            }
+            // Outside the frustum whichever way the walk arrives, marking it above is final
+            if (frustum != NULL) {
+                float min[3] = {(float)(n.x * CHUNK_SIZE), (float)(n.y * CHUNK_SIZE), (float)(n.z * CHUNK_SIZE)};
+                float max[3] = {min[0] + CHUNK_SIZE, min[1] + CHUNK_SIZE, min[2] + CHUNK_SIZE};
+                if (!is_aabb_in_frustum(frustum, min, max)) {
+                    traversal->stats.frustum_rejects++;
+                    continue;
+                }
+            }
+            traversal->steps[traversal->count++] = (VisibilityStep){
+                next, (uint8_t)(face ^ 1), (uint8_t)(step.directions | (1 << face)),
+            };
+        }
+    }
+    traversal->stats.visible = traversal->count;
+    return (int32_t)traversal->count;
+}
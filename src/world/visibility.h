@@ -0,0 +1,81 @@
+#ifndef _VISIBILITY_H_
+#define _VISIBILITY_H_
+
+#include "../loki.h"
+#include "../gfx/frustum.h"
+#include "chunk_map.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Cave culling: which chunks can be seen from the camera chunk at all.
+//
+// At mesh time a flood fill of the non opaque blocks of a chunk records
+// which of its six faces see each other through it, one bit for each of the
+// 15 face pairs (chunk->visibility). Each frame a breadth first walk starts
+// at the camera chunk and steps into a neighbor only when
+//   - the face it entered the current chunk through connects to the face it
+//     leaves through,
+//   - it never steps back against a direction it already moved in, so the
+//     walk only goes away from the camera, and
+//   - the neighbor touches the frustum.
+// Chunks the walk never reaches are hidden behind solid ground, e.g. the
+// cave systems below the player. Each chunk is entered once, through the
+// face the walk reaches first, which keeps the walk linear in the chunks it
+// reaches; a chunk seen only along a longer path can be missed.
+
+// Bit of the face pair (a, b), a != b, faces in ChunkNeighbor order
+static inline uint16_t visibility_pair_bit(ChunkNeighbor a, ChunkNeighbor b)
+{
+    int lo = a < b ? (int)a : (int)b;
+    int hi = a < b ? (int)b : (int)a;
+    return (uint16_t)(1u << (lo * (11 - lo) / 2 + hi - lo - 1));
+}
+
+static inline bool are_chunk_faces_connected(uint16_t visibility, ChunkNeighbor a, ChunkNeighbor b)
+{
+    return (visibility & visibility_pair_bit(a, b)) != 0;
+}
+
+// Face connectivity of the blocks of `chunk`, for chunk->visibility.
+// Safe to call from the mesh workers.
+uint16_t compute_chunk_visibility(const Chunk *chunk);
+
+// Octants of `chunk` (bit y << 2 | z << 1 | x, halves of CHUNK_SIZE) made of
+// opaque blocks only, the occluders of occlusion.h. Safe on the mesh workers.
+uint8_t compute_chunk_occluders(const Chunk *chunk);
+
+typedef struct {
+    Chunk *chunk;
+    uint8_t entered;            // face of `chunk` the walk came in through, MAX_NEIGHBOR at the start
+    uint8_t directions;         // bit per ChunkNeighbor stepped through so far
+} VisibilityStep;
+
+typedef struct {
+    uint32_t visible;           // chunks reached by the walk
+    uint32_t frustum_rejects;   // neighbors outside the frustum
+    uint32_t graph_rejects;     // steps through faces the chunk does not connect
+} VisibilityStats;
+
+// Reusable state of the walk. Chunks are queued once, so the queue is also
+// the result: `steps[0, count)` in breadth first, roughly front to back, order.
+typedef struct {
+    VisibilityStep *steps;
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t *visited;          // open addressing set of packed chunk coordinates
+    uint32_t visited_capacity;  // power of two
+    VisibilityStats stats;
+} ChunkTraversal;
+
+void init_chunk_traversal(ChunkTraversal *traversal);
+void free_chunk_traversal(ChunkTraversal *traversal);
+
+// Walk the chunks visible from `camera` (in block units, the space chunk
+// coordinates live in) through the chunks of `map`. `frustum` is in the same
+// space, NULL skips the frustum test. Returns the number of visible chunks,
+// or -1 when the camera chunk is not loaded or memory ran out: the caller
+// then falls back to frustum culling alone.
+int32_t traverse_visible_chunks(ChunkTraversal *traversal, ChunkMap *map, const float camera[3],
+                                const Frustum *frustum);
+
+#endif // _VISIBILITY_H_
@@ -0,0 +1,391 @@
+#include "worldgen.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Each noise gets its own stream of octave seeds
+#define TEMPERATURE_SEED 0xD6E8FEB86659FD93ull
+#define HUMIDITY_SEED   0xA0761D6478BD642Full
+#define CONTINENT_SEED  0x6C8E9CF570932BD5ull
+#define MOUNTAIN_SEED   0x1B873593CC9E2D51ull
+#define SOIL_SEED       0x85EBCA6BC2B2AE35ull
+#define CAVE_SEED       0x27D4EB2F165667C5ull
+#define TREE_SEED       0xE7037ED1A0B428DBull
+
+// At most one tree per TREE_CELL x TREE_CELL columns, leaves reach
+// TREE_REACH blocks from the trunk
+#define TREE_CELL       6
+#define TREE_REACH      2
+#define TREE_MIN_TRUNK  4
+_Static_assert(TREE_REACH < CHUNK_SIZE, "trees reach one column of chunks around");
+
+// Cave lattice points along a chunk edge at the finest coarse step, 2
+#define MAX_CAVE_LATTICE (CHUNK_SIZE / 2 + 1)
+
+static const NoiseDesc climate_noise = {NOISE_SIMPLEX, NOISE_FBM, 3, 1.0f / 1024.0f, 2.0f, 0.5f};
+static const NoiseDesc continent_noise = {NOISE_SIMPLEX, NOISE_FBM, 5, 1.0f / 512.0f, 2.0f, 0.5f};
+static const NoiseDesc mountain_noise = {NOISE_SIMPLEX, NOISE_RIDGED, 4, 1.0f / 256.0f, 2.0f, 0.5f};
+static const NoiseDesc soil_noise = {NOISE_VALUE, NOISE_FBM, 2, 1.0f / 16.0f, 2.0f, 0.5f};
+static const NoiseDesc cave_noise = {NOISE_SIMPLEX, NOISE_FBM, 2, 1.0f / 40.0f, 2.0f, 0.5f};
+
+static const BlockId top_blocks[MAX_BIOME] = {
+    [BIOME_PLAINS] = GRASS,
+    [BIOME_FOREST] = GRASS,
+    [BIOME_DESERT] = SAND,
+    [BIOME_TUNDRA] = SNOW,
+};
+
+static const BlockId soil_blocks[MAX_BIOME] = {
+    [BIOME_PLAINS] = DIRT,
+    [BIOME_FOREST] = DIRT,
+    [BIOME_DESERT] = SAND,
+    [BIOME_TUNDRA] = DIRT,
+};
+
+// Chance of a tree per cell, out of 256
+static const uint8_t tree_chances[MAX_BIOME] = {
+    [BIOME_PLAINS] = 24,
+    [BIOME_FOREST] = 200,
+    [BIOME_DESERT] = 0,
+    [BIOME_TUNDRA] = 48,
+};
+
+// Interpolated cave density spreads less around 0 than the noise itself,
+// the threshold shrinks by the same factor, by log2 of the cave step. The
+// spread ratios come from cave_bench, measure again when cave_noise changes.
+static const float cave_contrast[] = {1.0f, 0.988f, 0.945f, 0.819f, 0.604f, 0.585f};
+_Static_assert(sizeof(cave_contrast) / sizeof(cave_contrast[0]) == CHUNK_SHIFT + 1, "a contrast per cave step");
+
+
+bool init_world_gen(WorldGen *gen, const WorldGenDesc *desc)
+{
+    int step = desc->cave_step;
+    if (desc->cave_roof < 1 || step < 0 || step > CHUNK_SIZE || (step & (step - 1)) != 0) {
+        return false;
+    }
+    gen->desc = *desc;
+    if (step == 0) {
+        gen->desc.cave_step = 1;
+    }
+    int shift = 0;
+    while ((1 << shift) < gen->desc.cave_step) {
+        shift++;
+    }
+    gen->cave_threshold = desc->cave_threshold * cave_contrast[shift];
+    return init_noise(&gen->temperature, &climate_noise, desc->seed ^ TEMPERATURE_SEED) &&
+           init_noise(&gen->humidity, &climate_noise, desc->seed ^ HUMIDITY_SEED) &&
+           init_noise(&gen->continents, &continent_noise, desc->seed ^ CONTINENT_SEED) &&
+           init_noise(&gen->mountains, &mountain_noise, desc->seed ^ MOUNTAIN_SEED) &&
+           init_noise(&gen->soil, &soil_noise, desc->seed ^ SOIL_SEED) &&
+           init_noise(&gen->caves, &cave_noise, desc->seed ^ CAVE_SEED);
+}
+
+static Biome pick_biome(float temperature, float humidity)
+{
+    if (temperature > 0.3f && humidity < 0.0f) {
+        return BIOME_DESERT;
+    }
+    if (temperature < -0.3f) {
+        return BIOME_TUNDRA;
+    }
+    return humidity > 0.15f ? BIOME_FOREST : BIOME_PLAINS;
+}
+
+void generate_column_climate(const WorldGen *gen, int32_t x, int32_t z, TerrainColumn *column)
+{
+    static _Thread_local float temperature[CHUNK_AREA];
+    static _Thread_local float humidity[CHUNK_AREA];
+    float origin[2] = {(float)(x * CHUNK_SIZE), (float)(z * CHUNK_SIZE)};
+    int size[2] = {CHUNK_SIZE, CHUNK_SIZE};
+    fill_noise2_grid(&gen->temperature, origin, 1.0f, size, temperature);
+    fill_noise2_grid(&gen->humidity, origin, 1.0f, size, humidity);
+
+    column->x = x;
+    column->z = z;
+    for (int i = 0; i < CHUNK_AREA; i++) {
+        column->biomes[i] = (uint8_t)pick_biome(temperature[i], humidity[i]);
+    }
+}
+
+void generate_column_heights(const WorldGen *gen, TerrainColumn *column)
+{
+    static _Thread_local float continents[CHUNK_AREA];
+    static _Thread_local float mountains[CHUNK_AREA];
+    static _Thread_local float soil[CHUNK_AREA];
+    const WorldGenDesc *desc = &gen->desc;
+    float origin[2] = {(float)(column->x * CHUNK_SIZE), (float)(column->z * CHUNK_SIZE)};
+    int size[2] = {CHUNK_SIZE, CHUNK_SIZE};
+    fill_noise2_grid(&gen->continents, origin, 1.0f, size, continents);
+    fill_noise2_grid(&gen->mountains, origin, 1.0f, size, mountains);
+    fill_noise2_grid(&gen->soil, origin, 1.0f, size, soil);
+
+    column->min_height = INT32_MAX;
+    column->max_height = INT32_MIN;
+    for (int i = 0; i < CHUNK_AREA; i++) {
+        // Mountains rise out of the high ground only
+        float land = continents[i];
+        float rise = fminf(fmaxf((land + 0.1f) * 2.0f, 0.0f), 1.0f);
+        float ridge = mountains[i] * mountains[i];
+        float height = desc->land_height + land * desc->land_range + ridge * desc->mountain_height * rise;
+        column->heights[i] = (int32_t)floorf(height);
+        column->soil[i] = (uint8_t)(desc->soil_depth + (int)(2.0f * (soil[i] + 1.0f)));
+        if (column->heights[i] < column->min_height) {
+            column->min_height = column->heights[i];
+        }
+        if (column->heights[i] > column->max_height) {
+            column->max_height = column->heights[i];
+        }
+    }
+}
+
+void generate_terrain_column(const WorldGen *gen, int32_t x, int32_t z, TerrainColumn *column)
+{
+    generate_column_climate(gen, x, z, column);
+    generate_column_heights(gen, column);
+}
+
+void fill_terrain_layers(const WorldGen *gen, Chunk *chunk, const TerrainColumn *column)
+{
+    int32_t sea_level = gen->desc.sea_level;
+    int32_t y0 = chunk->coord.y * CHUNK_SIZE;
+    if (y0 > column->max_height && y0 > sea_level) {
+        memset(chunk->blocks, AIR, sizeof(chunk->blocks));
+        return;
+    }
+
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        int32_t wy = y0 + y;
+        BlockId *layer = &chunk->blocks[CHUNK_INDEX(0, y, 0)];
+        for (int c = 0; c < CHUNK_AREA; c++) {
+            int32_t height = column->heights[c];
+            bool shore = height <= sea_level + 1;
+            BlockId block = AIR;
+            if (wy < height - column->soil[c]) {
+                block = STONE;
+            } else if (wy < height) {
+                block = shore ? SAND : soil_blocks[column->biomes[c]];
+            } else if (wy == height) {
+                block = shore ? SAND : top_blocks[column->biomes[c]];
+            } else if (wy <= sea_level) {
+                block = WATER;
+            }
+            layer[c] = block;
+        }
+    }
+}
+
+// out = a + t * (b - a), `count` a multiple of 4
+#ifdef __SSE2__
+static inline void lerp_rows(float *out, const float *a, const float *b, float t, int count)
+{
+    __m128 w = _mm_set1_ps(t);
+    for (int i = 0; i < count; i += 4) {
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        _mm_storeu_ps(out + i, _mm_add_ps(va, _mm_mul_ps(w, _mm_sub_ps(vb, va))));
+    }
+}
+#else
+static inline void lerp_rows(float *out, const float *a, const float *b, float t, int count)
+{
+    for (int i = 0; i < count; i++) {
+        out[i] = a[i] + t * (b[i] - a[i]);
+    }
+}
+#endif
+
+// One layer of blocks at lattice layer `ly`, from the rows already
+// interpolated along x
+static void expand_cave_plane(float *plane, const float *rows, int ly, int step, int lattice)
+{
+    float scale = 1.0f / step;
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        const float *row = &rows[(ly * lattice + z / step) * CHUNK_SIZE];
+        lerp_rows(&plane[z * CHUNK_SIZE], row, row + CHUNK_SIZE, (z % step) * scale, CHUNK_SIZE);
+    }
+}
+
+int sample_cave_density(const WorldGen *gen, ChunkCoord coord, int layers, float *density)
+{
+    int step = gen->desc.cave_step;
+    float origin[3] = {(float)(coord.x * CHUNK_SIZE), (float)(coord.y * CHUNK_SIZE), (float)(coord.z * CHUNK_SIZE)};
+    if (step == 1) {
+        // The grid is in CHUNK_INDEX order
+        int size[3] = {CHUNK_SIZE, layers, CHUNK_SIZE};
+        fill_noise3_grid(&gen->caves, origin, 1.0f, size, density);
+        return layers * CHUNK_AREA;
+    }
+
+    static _Thread_local float samples[MAX_CAVE_LATTICE * MAX_CAVE_LATTICE * MAX_CAVE_LATTICE];
+    static _Thread_local float rows[MAX_CAVE_LATTICE * MAX_CAVE_LATTICE * CHUNK_SIZE];
+    static _Thread_local float planes[2][CHUNK_AREA];
+    // Lattice points are world multiples of the step, so chunks agree on
+    // their shared faces
+    int lattice = CHUNK_SIZE / step + 1;
+    int lattice_y = (layers - 1) / step + 2;
+    int size[3] = {lattice, lattice_y, lattice};
+    fill_noise3_grid(&gen->caves, origin, (float)step, size, samples);
+
+    // Along x for every lattice row, then along z and y a row of blocks at a time
+    float scale = 1.0f / step;
+    for (int r = 0; r < lattice_y * lattice; r++) {
+        const float *sample = &samples[r * lattice];
+        float *row = &rows[r * CHUNK_SIZE];
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            const float *s = &sample[x / step];
+            row[x] = s[0] + (x % step) * scale * (s[1] - s[0]);
+        }
+    }
+    float *below = planes[0];
+    float *above = planes[1];
+    expand_cave_plane(below, rows, 0, step, lattice);
+    for (int ly = 0; ly * step < layers; ly++) {
+        expand_cave_plane(above, rows, ly + 1, step, lattice);
+        int top = ly * step + step < layers ? ly * step + step : layers;
+        for (int y = ly * step; y < top; y++) {
+            lerp_rows(&density[CHUNK_INDEX(0, y, 0)], below, above, (y % step) * scale, CHUNK_AREA);
+        }
+        float *swap = below;
+        below = above;
+        above = swap;
+    }
+    return lattice * lattice_y * lattice;
+}
+
+int carve_terrain_caves(const WorldGen *gen, Chunk *chunk, const TerrainColumn *column)
+{
+    static _Thread_local float density[CHUNK_VOLUME];
+    const WorldGenDesc *desc = &gen->desc;
+    int32_t y0 = chunk->coord.y * CHUNK_SIZE;
+    // Only the layers up to the deepest roof can hold a cave
+    int layers = column->max_height - desc->cave_roof - y0;
+    if (desc->cave_threshold >= 1.0f || layers <= 0) {
+        return 0;
+    }
+    if (layers > CHUNK_SIZE) {
+        layers = CHUNK_SIZE;
+    }
+
+    int samples = sample_cave_density(gen, chunk->coord, layers, density);
+    for (int y = 0; y < layers; y++) {
+        for (int c = 0; c < CHUNK_AREA; c++) {
+            int i = CHUNK_INDEX(0, y, 0) | c;
+            if (density[i] > gen->cave_threshold && y0 + y < column->heights[c] - desc->cave_roof) {
+                chunk->blocks[i] = AIR;
+            }
+        }
+    }
+    return samples;
+}
+
+static inline int32_t floor_div(int32_t a, int32_t b)
+{
+    return (a >= 0 ? a : a - (b - 1)) / b;
+}
+
+// splitmix64 finalizer over the cell and the seed
+static inline uint64_t hash_cell(uint64_t seed, int32_t x, int32_t z)
+{
+    uint64_t h = seed ^ TREE_SEED ^ ((uint64_t)(uint32_t)x << 32 | (uint32_t)z);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+// Leaves only fill air and wood only air or leaves, so overlapping trees
+// come out the same in whatever order they grow
+static inline void put_tree_block(Chunk *chunk, int x, int y, int z, BlockId block)
+{
+    if ((unsigned)x >= CHUNK_SIZE || (unsigned)y >= CHUNK_SIZE || (unsigned)z >= CHUNK_SIZE) {
+        return;
+    }
+    BlockId *b = &chunk->blocks[CHUNK_INDEX(x, y, z)];
+    if (*b == AIR || (block == WOOD && *b == LEAVES)) {
+        *b = block;
+    }
+}
+
+// A trunk from (x, y, z) up in chunk local coordinates, possibly outside
+// the chunk, under two wide rounded layers of leaves and two narrow ones
+static void grow_tree(Chunk *chunk, int x, int y, int z, int trunk)
+{
+    int top = y + trunk - 1;
+    for (int ly = top - 1; ly <= top + 2; ly++) {
+        int r = ly <= top ? TREE_REACH : 1;
+        for (int dz = -r; dz <= r; dz++) {
+            for (int dx = -r; dx <= r; dx++) {
+                bool corner = abs(dx) == r && abs(dz) == r;
+                if (corner && (r == TREE_REACH || ly == top + 2)) {
+                    continue;
+                }
+                put_tree_block(chunk, x + dx, ly, z + dz, LEAVES);
+            }
+        }
+    }
+    for (int ly = y; ly <= top; ly++) {
+        put_tree_block(chunk, x, ly, z, WOOD);
+    }
+}
+
+int decorate_terrain_chunk(const WorldGen *gen, Chunk *chunk, const TerrainColumn *columns[COLUMN_NEIGHBORHOOD])
+{
+    int32_t x0 = chunk->coord.x * CHUNK_SIZE;
+    int32_t y0 = chunk->coord.y * CHUNK_SIZE;
+    int32_t z0 = chunk->coord.z * CHUNK_SIZE;
+    int trees = 0;
+
+    // Every cell with room for a trunk close enough to reach the chunk
+    int32_t cx0 = floor_div(x0 - TREE_REACH, TREE_CELL);
+    int32_t cx1 = floor_div(x0 + CHUNK_SIZE - 1 + TREE_REACH, TREE_CELL);
+    int32_t cz0 = floor_div(z0 - TREE_REACH, TREE_CELL);
+    int32_t cz1 = floor_div(z0 + CHUNK_SIZE - 1 + TREE_REACH, TREE_CELL);
+    for (int32_t cz = cz0; cz <= cz1; cz++) {
+        for (int32_t cx = cx0; cx <= cx1; cx++) {
+            uint64_t h = hash_cell(gen->desc.seed, cx, cz);
+            int32_t wx = cx * TREE_CELL + (int32_t)(h % TREE_CELL);
+            int32_t wz = cz * TREE_CELL + (int32_t)((h >> 8) % TREE_CELL);
+            if (wx < x0 - TREE_REACH || wx >= x0 + CHUNK_SIZE + TREE_REACH ||
+                wz < z0 - TREE_REACH || wz >= z0 + CHUNK_SIZE + TREE_REACH) {
+                continue;
+            }
+
+            const TerrainColumn *column = columns[COLUMN_NEIGHBOR(floor_div(wx, CHUNK_SIZE) - chunk->coord.x,
+                                                                  floor_div(wz, CHUNK_SIZE) - chunk->coord.z)];
+            int c = CHUNK_COLUMN(wx & CHUNK_MASK, wz & CHUNK_MASK);
+            int32_t ground = column->heights[c];
+            if (((h >> 16) & 0xFF) >= tree_chances[column->biomes[c]] || ground <= gen->desc.sea_level + 1) {
+                continue;
+            }
+            int trunk = TREE_MIN_TRUNK + (int)((h >> 24) % 3);
+            if (ground + trunk + 2 < y0 || ground + 1 >= y0 + CHUNK_SIZE) {
+                continue;
+            }
+            grow_tree(chunk, wx - x0, ground + 1 - y0, wz - z0, trunk);
+            trees++;
+        }
+    }
+    return trees;
+}
+
+void generate_chunk_terrain(const WorldGen *gen, Chunk *chunk)
+{
+    static _Thread_local TerrainColumn columns[COLUMN_NEIGHBORHOOD];
+    const TerrainColumn *neighborhood[COLUMN_NEIGHBORHOOD];
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            TerrainColumn *column = &columns[COLUMN_NEIGHBOR(dx, dz)];
+            generate_terrain_column(gen, chunk->coord.x + dx, chunk->coord.z + dz, column);
+            neighborhood[COLUMN_NEIGHBOR(dx, dz)] = column;
+        }
+    }
+    const TerrainColumn *column = neighborhood[COLUMN_NEIGHBOR(0, 0)];
+    fill_terrain_layers(gen, chunk, column);
+    carve_terrain_caves(gen, chunk, column);
+    decorate_terrain_chunk(gen, chunk, neighborhood);
+    update_chunk_heights(chunk);
+}
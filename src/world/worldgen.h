@@ -0,0 +1,96 @@
+#ifndef _WORLDGEN_H_
+#define _WORLDGEN_H_
+
+#include "../util/noise.h"
+#include "chunk.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Terrain from noise, the same for a given seed on every machine.
+//
+// Column passes: temperature and humidity noise pick the biome, fBm
+// continents set the land height, ridged noise raises mountains where the
+// land is high and value noise varies the soil depth. Chunk passes then lay
+// down the layers (stone, soil, the biome's top block, water up to sea
+// level), carve caves where 3D fBm density is above a threshold under a
+// roof of ground, and plant trees. The cave density is sampled on a coarse
+// lattice and interpolated in between, which flattens it, so the threshold
+// is scaled down with the step to keep the caves' volume. Trees reach across chunk borders: a
+// chunk grows the parts of every tree rooted in the columns around it, so
+// decorating needs the 3x3 columns centered on the chunk.
+
+typedef enum {
+    BIOME_PLAINS = 0,
+    BIOME_FOREST,
+    BIOME_DESERT,
+    BIOME_TUNDRA,
+    MAX_BIOME,
+} Biome;
+
+typedef struct {
+    uint64_t seed;
+    int32_t sea_level;          // world y of the water surface
+    float land_height;          // world y of the average land surface
+    float land_range;           // continents go this far above and below it
+    float mountain_height;      // most the ridges add on top
+    int soil_depth;             // dirt or sand blocks under the top, plus up to 3 more
+    float cave_threshold;       // density above it is carved, from 0 to 1, 1 for no caves
+    int cave_roof;              // blocks of ground kept over caves, at least 1 so trees stand
+    int cave_step;              // blocks between cave density samples, a power of two up to
+                                // CHUNK_SIZE, 0 or 1 samples every block
+} WorldGenDesc;
+
+typedef struct {
+    WorldGenDesc desc;
+    Noise temperature;
+    Noise humidity;
+    Noise continents;
+    Noise mountains;
+    Noise soil;
+    Noise caves;
+    float cave_threshold;       // desc.cave_threshold scaled for the cave step
+} WorldGen;
+
+// The surface of a chunk column, shared by every chunk stacked in it
+typedef struct {
+    int32_t x;                      // chunk column, in chunks
+    int32_t z;
+    int32_t min_height;
+    int32_t max_height;
+    int32_t heights[CHUNK_AREA];    // world y of the top block, indexed with CHUNK_COLUMN
+    uint8_t soil[CHUNK_AREA];       // soil blocks under the top one
+    uint8_t biomes[CHUNK_AREA];
+} TerrainColumn;
+
+// Neighborhood of a chunk column handed to decorate_terrain_chunk
+#define COLUMN_NEIGHBORHOOD         9
+#define COLUMN_NEIGHBOR(dx, dz)     (((dz) + 1) * 3 + (dx) + 1)
+
+// False for a cave roof under 1 block or a cave step that does not divide chunks
+bool init_world_gen(WorldGen *gen, const WorldGenDesc *desc);
+
+// Column passes, climate first. generate_terrain_column runs both.
+void generate_column_climate(const WorldGen *gen, int32_t x, int32_t z, TerrainColumn *column);
+void generate_column_heights(const WorldGen *gen, TerrainColumn *column);
+void generate_terrain_column(const WorldGen *gen, int32_t x, int32_t z, TerrainColumn *column);
+
+// Chunk passes, in this order, on the column of the chunk. None of them
+// keep Chunk.heights, update them once the chunk is done.
+// Overwrites every block of `chunk`.
+void fill_terrain_layers(const WorldGen *gen, Chunk *chunk, const TerrainColumn *column);
+// Density samples taken, 0 when the chunk has no ground deep enough
+int carve_terrain_caves(const WorldGen *gen, Chunk *chunk, const TerrainColumn *column);
+
+// Cave density of the lowest `layers` layers of the chunk at `coord`, in
+// CHUNK_INDEX order. Exact on the lattice, trilinear in between. Returns the
+// noise samples taken.
+int sample_cave_density(const WorldGen *gen, ChunkCoord coord, int layers, float *density);
+// Trees rooted in the columns around, indexed with COLUMN_NEIGHBOR. Writes
+// only into `chunk`. Returns the number of trees that reach into it.
+int decorate_terrain_chunk(const WorldGen *gen, Chunk *chunk, const TerrainColumn *columns[COLUMN_NEIGHBORHOOD]);
+
+// Every pass for a single chunk, heights included. Computes the columns
+// around it for the trees, a pipeline shares them instead (see gen_pool.h).
+void generate_chunk_terrain(const WorldGen *gen, Chunk *chunk);
+
+#endif // _WORLDGEN_H_